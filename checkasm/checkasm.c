@@ -0,0 +1,964 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "ass_utils.h"
+#include "ass_bitmap.h"
+#include "ass_rasterizer.h"
+
+/*
+ * Checks every function of the optimized bitmap engines against
+ * the C implementation on random inputs, and optionally benchmarks them.
+ * Linked statically against libass to reach the internal functions.
+ */
+
+// C rasterizer functions for every tile size, the engines differ in it
+#define DECLARE_TILE_FUNCS(size) \
+    void ass_fill_solid_tile##size##_c(uint8_t *buf, ptrdiff_t stride, int set); \
+    void ass_fill_halfplane_tile##size##_c(uint8_t *buf, ptrdiff_t stride, \
+                                           int32_t a, int32_t b, int64_t c, int32_t scale); \
+    void ass_fill_generic_tile##size##_c(uint8_t *buf, ptrdiff_t stride, \
+                                         const struct segment *line, size_t n_lines, \
+                                         int winding);
+DECLARE_TILE_FUNCS(16)
+DECLARE_TILE_FUNCS(32)
+DECLARE_TILE_FUNCS(64)
+
+static const struct {
+    FillSolidTileFunc fill_solid;
+    FillHalfplaneTileFunc fill_halfplane;
+    FillGenericTileFunc fill_generic;
+} tile_funcs_c[] = {
+    { ass_fill_solid_tile16_c, ass_fill_halfplane_tile16_c, ass_fill_generic_tile16_c },
+    { ass_fill_solid_tile32_c, ass_fill_halfplane_tile32_c, ass_fill_generic_tile32_c },
+    { ass_fill_solid_tile64_c, ass_fill_halfplane_tile64_c, ass_fill_generic_tile64_c },
+};
+
+#define ITERATIONS 64       // random inputs per function
+#define MAX_W 256           // limits of random bitmap sizes
+#define MAX_H 64
+#define MAX_ALIGN 64        // largest engine alignment
+#define BENCH_RUNS 256      // calls per benchmark measurement
+#define BENCH_REPEAT 16     // measurements, the fastest one is reported
+
+typedef struct {
+    const char *name;       // engine under test
+    const BitmapEngine *ref, *test;
+    int tile_order, align;
+
+    uint32_t seed, rnd_state;
+    bool bench;
+    int failed, checked;
+    char last_func[32];
+
+    // scratch buffers, allocated once with room for the largest inputs
+    uint8_t *src8[2], *ref8, *test8;
+    int16_t *src16, *ref16, *test16, *logical;
+    uint16_t *tmp_ref, *tmp_test;
+} CheckState;
+
+static CheckState state;
+
+static uint32_t rnd(void)
+{
+    // xorshift32
+    uint32_t x = state.rnd_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return state.rnd_state = x;
+}
+
+static int rnd_range(int min, int max)
+{
+    return min + rnd() % (max - min + 1);
+}
+
+static uint64_t timer(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return ass_time_ns();
+#endif
+}
+
+static const char *timer_unit(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+static size_t align_up(size_t val, size_t align)
+{
+    return (val + align - 1) & ~(align - 1);
+}
+
+static bool report(const char *func, bool ok, const char *fmt, ...)
+{
+    // called for every input, count each function once
+    if (strcmp(func, state.last_func)) {
+        snprintf(state.last_func, sizeof(state.last_func), "%s", func);
+        state.checked++;
+    }
+    if (ok)
+        return true;
+    state.failed++;
+    printf("  %s mismatch", func);
+    if (fmt) {
+        va_list va;
+        va_start(va, fmt);
+        printf(" (");
+        vprintf(fmt, va);
+        printf(")");
+        va_end(va);
+    }
+    printf("\n");
+    return false;
+}
+
+static void fill_random8(uint8_t *buf, size_t size)
+{
+    // mostly empty and full pixels like real coverage masks
+    for (size_t i = 0; i < size; i++) {
+        uint32_t r = rnd();
+        buf[i] = (r & 3) == 0 ? 0 : (r & 3) == 1 ? 255 : r >> 24;
+    }
+}
+
+static bool compare8(const uint8_t *a, const uint8_t *b, ptrdiff_t stride,
+                     int w, int h, int *x_out, int *y_out)
+{
+    *x_out = *y_out = 0;
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            if (a[y * stride + x] != b[y * stride + x]) {
+                *x_out = x;
+                *y_out = y;
+                return false;
+            }
+    return true;
+}
+
+
+/*
+ * Benchmarking
+ */
+
+typedef void (*BenchFunc)(const BitmapEngine *engine, void *arg);
+
+static uint64_t bench_one(const BitmapEngine *engine, BenchFunc func, void *arg)
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < BENCH_REPEAT; i++) {
+        uint64_t start = timer();
+        for (int j = 0; j < BENCH_RUNS; j++)
+            func(engine, arg);
+        uint64_t time = timer() - start;
+        if (time < best)
+            best = time;
+    }
+    return best / BENCH_RUNS;
+}
+
+static void bench(const char *func_name, BenchFunc func, void *arg)
+{
+    if (!state.bench)
+        return;
+    uint64_t ref = bench_one(state.ref, func, arg);
+    uint64_t test = bench_one(state.test, func, arg);
+    printf("  %-18s C %8llu %s, %s %8llu %s (%.2fx)\n", func_name,
+           (unsigned long long) ref, timer_unit(), state.name,
+           (unsigned long long) test, timer_unit(),
+           test ? (double) ref / test : 0);
+}
+
+
+/*
+ * Rasterizer
+ */
+
+// same setup as add_line() of the rasterizer
+static void make_segment(struct segment *line,
+                         int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    int32_t x = x1 - x0, y = y1 - y0;
+
+    line->flags = SEGFLAG_EXACT_LEFT | SEGFLAG_EXACT_RIGHT |
+                  SEGFLAG_EXACT_TOP | SEGFLAG_EXACT_BOTTOM;
+    if (x < 0)
+        line->flags ^= SEGFLAG_UL_DR;
+    if (y >= 0)
+        line->flags ^= SEGFLAG_DN | SEGFLAG_UL_DR;
+
+    line->x_min = FFMIN(x0, x1);
+    line->x_max = FFMAX(x0, x1);
+    line->y_min = FFMIN(y0, y1);
+    line->y_max = FFMAX(y0, y1);
+
+    line->a = y;
+    line->b = -x;
+    line->c = y * (int64_t) x0 - x * (int64_t) y0;
+
+    int32_t abs_x = x < 0 ? -x : x;
+    int32_t abs_y = y < 0 ? -y : y;
+    uint32_t max_ab = (abs_x > abs_y ? abs_x : abs_y);
+    int shift = 30;
+    for (uint32_t n = max_ab; n >>= 1;)
+        shift--;
+    max_ab <<= shift + 1;
+    line->a *= 1 << shift;
+    line->b *= 1 << shift;
+    line->c *= 1 << shift;
+    line->scale = (uint64_t) 0x53333333 * (uint32_t) (max_ab * (uint64_t) max_ab >> 32) >> 32;
+    line->scale += 0x8810624D - (0xBBC6A7EF * (uint64_t) max_ab >> 32);
+}
+
+typedef struct {
+    int set;
+    struct segment lines[16];
+    int n_lines, winding;
+} TileArgs;
+
+static void random_line(TileArgs *args, int size)
+{
+    // endpoints around the tile, so that the line may miss it
+    int32_t x0, y0, x1, y1;
+    do {
+        x0 = rnd_range(-size, 2 * size);
+        y0 = rnd_range(-size, 2 * size);
+        x1 = rnd_range(-size, 2 * size);
+        y1 = rnd_range(-size, 2 * size);
+    } while (x0 == x1 && y0 == y1);
+    make_segment(&args->lines[0], x0, y0, x1, y1);
+    if (rnd() & 1)
+        args->lines[0].scale = -args->lines[0].scale;
+}
+
+static void random_polygon(TileArgs *args, int size)
+{
+    // closed polygon inside the tile, as left by the rasterizer's splits
+    int n = rnd_range(2, 16);
+    int32_t x[16], y[16];
+    for (int i = 0; i < n; i++) {
+        x[i] = rnd_range(0, size);
+        y[i] = rnd_range(0, size);
+    }
+    args->n_lines = 0;
+    for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        if (x[i] != x[j] || y[i] != y[j])
+            make_segment(&args->lines[args->n_lines++], x[i], y[i], x[j], y[j]);
+    }
+    args->winding = rnd_range(-1, 1);
+}
+
+static FillSolidTileFunc ref_fill_solid(void)
+{
+    return tile_funcs_c[state.tile_order - 4].fill_solid;
+}
+
+static void bench_fill_solid(const BitmapEngine *engine, void *arg)
+{
+    TileArgs *args = arg;
+    FillSolidTileFunc func = engine == state.ref ? ref_fill_solid() : engine->fill_solid;
+    func(state.test8, MAX_W, args->set);
+}
+
+static void bench_fill_halfplane(const BitmapEngine *engine, void *arg)
+{
+    TileArgs *args = arg;
+    FillHalfplaneTileFunc func = engine == state.ref ?
+        tile_funcs_c[state.tile_order - 4].fill_halfplane : engine->fill_halfplane;
+    const struct segment *line = &args->lines[0];
+    func(state.test8, MAX_W, line->a, line->b, line->c, line->scale);
+}
+
+static void bench_fill_generic(const BitmapEngine *engine, void *arg)
+{
+    TileArgs *args = arg;
+    FillGenericTileFunc func = engine == state.ref ?
+        tile_funcs_c[state.tile_order - 4].fill_generic : engine->fill_generic;
+    func(state.test8, MAX_W, args->lines, args->n_lines, args->winding);
+}
+
+static void check_rasterizer(void)
+{
+    int tile = 1 << state.tile_order, size = tile << 6;
+    const BitmapEngine *test = state.test;
+    TileArgs args = {0};
+    int x, y;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        args.set = rnd() & 1;
+        memset(state.ref8, 0x55, MAX_W * tile);
+        memset(state.test8, 0x55, MAX_W * tile);
+        ref_fill_solid()(state.ref8, MAX_W, args.set);
+        test->fill_solid(state.test8, MAX_W, args.set);
+        // the whole stride to catch writes past the tile
+        bool ok = compare8(state.ref8, state.test8, MAX_W, MAX_W, tile, &x, &y);
+        if (!report("fill_solid", ok, "%d, %d", x, y))
+            break;
+    }
+    bench("fill_solid", bench_fill_solid, &args);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        random_line(&args, size);
+        const struct segment *line = &args.lines[0];
+        memset(state.ref8, 0x55, MAX_W * tile);
+        memset(state.test8, 0x55, MAX_W * tile);
+        tile_funcs_c[state.tile_order - 4].fill_halfplane(
+            state.ref8, MAX_W, line->a, line->b, line->c, line->scale);
+        test->fill_halfplane(state.test8, MAX_W, line->a, line->b, line->c, line->scale);
+        bool ok = compare8(state.ref8, state.test8, MAX_W, MAX_W, tile, &x, &y);
+        if (!report("fill_halfplane", ok, "%d, %d", x, y))
+            break;
+    }
+    bench("fill_halfplane", bench_fill_halfplane, &args);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        random_polygon(&args, size);
+        memset(state.ref8, 0x55, MAX_W * tile);
+        memset(state.test8, 0x55, MAX_W * tile);
+        tile_funcs_c[state.tile_order - 4].fill_generic(
+            state.ref8, MAX_W, args.lines, args.n_lines, args.winding);
+        test->fill_generic(state.test8, MAX_W, args.lines, args.n_lines, args.winding);
+        bool ok = compare8(state.ref8, state.test8, MAX_W, MAX_W, tile, &x, &y);
+        if (!report("fill_generic", ok, "%d lines, %d, %d", args.n_lines, x, y))
+            break;
+    }
+    bench("fill_generic", bench_fill_generic, &args);
+}
+
+
+/*
+ * Blending and box blur
+ */
+
+typedef struct {
+    int w, h;
+    ptrdiff_t stride;
+    uint32_t color;
+} BitmapArgs;
+
+static void random_size(BitmapArgs *args, int max_w, int max_h)
+{
+    args->w = rnd_range(1, max_w);
+    args->h = rnd_range(1, max_h);
+    args->stride = align_up(args->w, state.align);
+    if (rnd() & 1)
+        args->stride += state.align * rnd_range(1, 2);
+}
+
+static void bench_add(const BitmapEngine *engine, void *arg)
+{
+    BitmapArgs *args = arg;
+    engine->add_bitmaps(state.test8, args->stride, state.src8[0], args->stride,
+                        args->h, args->w);
+}
+
+static void bench_sub(const BitmapEngine *engine, void *arg)
+{
+    BitmapArgs *args = arg;
+    engine->sub_bitmaps(state.test8, args->stride, state.src8[0], args->stride,
+                        args->h, args->w);
+}
+
+static void bench_mul(const BitmapEngine *engine, void *arg)
+{
+    BitmapArgs *args = arg;
+    engine->mul_bitmaps(state.test8, args->stride, state.src8[0], args->stride,
+                        state.src8[1], args->stride, args->w, args->h);
+}
+
+static void bench_be_blur(const BitmapEngine *engine, void *arg)
+{
+    BitmapArgs *args = arg;
+    memset(state.tmp_test, 0, 2 * args->stride * sizeof(uint16_t));
+    engine->be_blur(state.test8, args->w, args->h, args->stride, state.tmp_test);
+}
+
+static void bench_blend_rgba(const BitmapEngine *engine, void *arg)
+{
+    BitmapArgs *args = arg;
+    engine->blend_rgba(state.test8, 4 * args->stride, state.src8[0], args->stride,
+                       args->w, args->h, args->color);
+}
+
+enum { BLEND_ADD, BLEND_SUB, BLEND_MUL };
+
+static void check_blend(int op)
+{
+    static const char *names[] = { "add_bitmaps", "sub_bitmaps", "mul_bitmaps" };
+    const BitmapEngine *ref = state.ref, *test = state.test;
+    if (op == BLEND_ADD ? test->add_bitmaps == ref->add_bitmaps :
+            op == BLEND_SUB ? test->sub_bitmaps == ref->sub_bitmaps :
+            test->mul_bitmaps == ref->mul_bitmaps)
+        return;
+
+    BitmapArgs args;
+    int x, y;
+    for (int i = 0; i < ITERATIONS; i++) {
+        random_size(&args, MAX_W, MAX_H);
+        size_t size = args.stride * args.h;
+        fill_random8(state.src8[0], size);
+        fill_random8(state.src8[1], size);
+        fill_random8(state.ref8, size);
+        memcpy(state.test8, state.ref8, size);
+        switch (op) {
+        case BLEND_ADD:
+            ref->add_bitmaps(state.ref8, args.stride, state.src8[0], args.stride,
+                             args.h, args.w);
+            test->add_bitmaps(state.test8, args.stride, state.src8[0], args.stride,
+                              args.h, args.w);
+            break;
+        case BLEND_SUB:
+            ref->sub_bitmaps(state.ref8, args.stride, state.src8[0], args.stride,
+                             args.h, args.w);
+            test->sub_bitmaps(state.test8, args.stride, state.src8[0], args.stride,
+                              args.h, args.w);
+            break;
+        case BLEND_MUL:
+            ref->mul_bitmaps(state.ref8, args.stride, state.src8[0], args.stride,
+                             state.src8[1], args.stride, args.w, args.h);
+            test->mul_bitmaps(state.test8, args.stride, state.src8[0], args.stride,
+                              state.src8[1], args.stride, args.w, args.h);
+            break;
+        }
+        bool ok = compare8(state.ref8, state.test8, args.stride, args.w, args.h, &x, &y);
+        if (!report(names[op], ok, "%dx%d, stride %d at %d, %d",
+                    args.w, args.h, (int) args.stride, x, y))
+            break;
+    }
+
+    args.w = MAX_W;
+    args.h = MAX_H;
+    args.stride = MAX_W;
+    bench(names[op], op == BLEND_ADD ? bench_add : op == BLEND_SUB ? bench_sub : bench_mul,
+          &args);
+}
+
+static void check_be_blur(void)
+{
+    const BitmapEngine *ref = state.ref, *test = state.test;
+    if (test->be_blur == ref->be_blur)
+        return;
+
+    BitmapArgs args;
+    int x, y;
+    for (int i = 0; i < ITERATIONS; i++) {
+        // real bitmaps have a margin of empty pixels
+        random_size(&args, MAX_W - 2 * MAX_ALIGN, MAX_H);
+        args.stride = align_up(args.w + 1, state.align) + state.align * (rnd() & 1);
+        size_t size = args.stride * args.h;
+        memset(state.ref8, 0, size);
+        for (int y = 0; y < args.h; y++)
+            fill_random8(state.ref8 + y * args.stride, args.w);
+        memcpy(state.test8, state.ref8, size);
+        memset(state.tmp_ref, 0, 2 * args.stride * sizeof(uint16_t));
+        memset(state.tmp_test, 0, 2 * args.stride * sizeof(uint16_t));
+        ref->be_blur(state.ref8, args.w, args.h, args.stride, state.tmp_ref);
+        test->be_blur(state.test8, args.w, args.h, args.stride, state.tmp_test);
+        bool ok = compare8(state.ref8, state.test8, args.stride, args.w, args.h, &x, &y);
+        if (!report("be_blur", ok, "%dx%d, stride %d at %d, %d",
+                    args.w, args.h, (int) args.stride, x, y))
+            break;
+    }
+
+    args.w = MAX_W - MAX_ALIGN;
+    args.h = MAX_H;
+    args.stride = MAX_W;
+    bench("be_blur", bench_be_blur, &args);
+}
+
+static void check_blend_rgba(void)
+{
+    const BitmapEngine *ref = state.ref, *test = state.test;
+    if (test->blend_rgba == ref->blend_rgba)
+        return;
+
+    BitmapArgs args;
+    int x, y;
+    for (int i = 0; i < ITERATIONS; i++) {
+        random_size(&args, MAX_W / 4, MAX_H);
+        args.color = rnd();
+        ptrdiff_t dst_stride = 4 * args.stride;
+        fill_random8(state.src8[0], args.stride * args.h);
+        fill_random8(state.ref8, dst_stride * args.h);
+        memcpy(state.test8, state.ref8, dst_stride * args.h);
+        ref->blend_rgba(state.ref8, dst_stride, state.src8[0], args.stride,
+                        args.w, args.h, args.color);
+        test->blend_rgba(state.test8, dst_stride, state.src8[0], args.stride,
+                         args.w, args.h, args.color);
+        bool ok = compare8(state.ref8, state.test8, dst_stride, 4 * args.w, args.h, &x, &y);
+        if (!report("blend_rgba", ok, "%dx%d at %d, %d", args.w, args.h, x / 4, y))
+            break;
+    }
+
+    args.w = MAX_W / 4;
+    args.h = MAX_H;
+    args.stride = MAX_W / 4;
+    args.color = 0x20406080;
+    bench("blend_rgba", bench_blend_rgba, &args);
+}
+
+
+/*
+ * Gaussian blur filters
+ *
+ * Engines store intermediate images in stripes of different width,
+ * so inputs are built from the same logical image for both engines
+ * and the outputs are compared pixel by pixel.
+ */
+
+static int stripe_width(const BitmapEngine *engine)
+{
+    return 1 << (engine->align_order - 1);
+}
+
+static void to_stripes(int16_t *dst, const int16_t *src, int w, int h, int sw)
+{
+    int aligned_w = align_up(w, sw);
+    for (int x = 0; x < aligned_w; x++)
+        for (int y = 0; y < h; y++)
+            dst[(x / sw) * sw * h + y * sw + x % sw] = x < w ? src[y * w + x] : 0;
+}
+
+static inline int16_t stripe_pixel(const int16_t *buf, int x, int y, int h, int sw)
+{
+    return buf[(x / sw) * sw * h + y * sw + x % sw];
+}
+
+static bool compare_stripes(const int16_t *a, int a_sw, const int16_t *b, int b_sw,
+                            int w, int h, int *x_out, int *y_out)
+{
+    *x_out = *y_out = 0;
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            if (stripe_pixel(a, x, y, h, a_sw) != stripe_pixel(b, x, y, h, b_sw)) {
+                *x_out = x;
+                *y_out = y;
+                return false;
+            }
+    return true;
+}
+
+typedef enum {
+    FILTER_SHRINK, FILTER_EXPAND, FILTER_PRE_BLUR, FILTER_MAIN_BLUR
+} FilterType;
+
+typedef struct {
+    FilterType type;
+    int index;              // pre_blur and main_blur variant
+    bool vert;
+    int w, h;
+    int16_t param[8];
+} FilterArgs;
+
+static void filter_dst_size(const FilterArgs *args, int *w, int *h)
+{
+    int n = args->vert ? args->h : args->w;
+    switch (args->type) {
+    case FILTER_SHRINK:     n = (n + 5) >> 1;                   break;
+    case FILTER_EXPAND:     n = 2 * n + 4;                      break;
+    case FILTER_PRE_BLUR:   n += 2 * (args->index + 1);         break;
+    case FILTER_MAIN_BLUR:  n += 8 + 2 * args->index;           break;
+    }
+    *w = args->vert ? args->w : n;
+    *h = args->vert ? n : args->h;
+}
+
+static void run_filter(const BitmapEngine *engine, const FilterArgs *args,
+                       int16_t *dst, const int16_t *src)
+{
+    int i = args->index;
+    switch (args->type) {
+    case FILTER_SHRINK:
+        (args->vert ? engine->shrink_vert : engine->shrink_horz)(dst, src, args->w, args->h);
+        break;
+    case FILTER_EXPAND:
+        (args->vert ? engine->expand_vert : engine->expand_horz)(dst, src, args->w, args->h);
+        break;
+    case FILTER_PRE_BLUR:
+        (args->vert ? engine->pre_blur_vert[i] : engine->pre_blur_horz[i])(dst, src, args->w, args->h);
+        break;
+    case FILTER_MAIN_BLUR:
+        (args->vert ? engine->main_blur_vert[i] : engine->main_blur_horz[i])(dst, src, args->w, args->h,
+                                                                            args->param);
+        break;
+    }
+}
+
+static void bench_filter(const BitmapEngine *engine, void *arg)
+{
+    int16_t *dst = engine == state.ref ? state.ref16 : state.test16;
+    run_filter(engine, arg, dst, state.src16);
+}
+
+static void check_filter(FilterArgs *args, const char *name)
+{
+    int ref_sw = stripe_width(state.ref), test_sw = stripe_width(state.test);
+    int16_t *ref_src = state.src16;
+    int16_t *test_src = state.src16 + align_up(2 * MAX_W + 64, MAX_ALIGN) * (2 * MAX_H + 64);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        args->w = rnd_range(1, MAX_W);
+        args->h = rnd_range(1, MAX_H);
+        for (int j = 0; j < 4; j++)
+            args->param[j] = rnd() % 8192;
+        for (int j = 0; j < args->w * args->h; j++)
+            state.logical[j] = rnd() % 0x4001;
+        to_stripes(ref_src, state.logical, args->w, args->h, ref_sw);
+        to_stripes(test_src, state.logical, args->w, args->h, test_sw);
+
+        run_filter(state.ref, args, state.ref16, ref_src);
+        run_filter(state.test, args, state.test16, test_src);
+
+        int dst_w, dst_h, x, y;
+        filter_dst_size(args, &dst_w, &dst_h);
+        bool ok = compare_stripes(state.ref16, ref_sw, state.test16, test_sw,
+                                  dst_w, dst_h, &x, &y);
+        if (!report(name, ok, "%dx%d at %d, %d", args->w, args->h, x, y))
+            break;
+    }
+
+    // benchmark on the reference layout, timings don't depend on values
+    args->w = MAX_W;
+    args->h = MAX_H;
+    for (int j = 0; j < MAX_W * MAX_H; j++)
+        state.logical[j] = rnd() % 0x4001;
+    to_stripes(state.src16, state.logical, MAX_W, MAX_H, FFMAX(ref_sw, test_sw));
+    bench(name, bench_filter, args);
+}
+
+static void bench_stripe_unpack(const BitmapEngine *engine, void *arg)
+{
+    engine->stripe_unpack(state.src16, state.src8[0], MAX_W, MAX_W, MAX_H);
+}
+
+static void bench_stripe_pack(const BitmapEngine *engine, void *arg)
+{
+    engine->stripe_pack(state.test8, MAX_W, state.src16, MAX_W, MAX_H);
+}
+
+static void check_stripe_pack(void)
+{
+    const BitmapEngine *ref = state.ref, *test = state.test;
+    int ref_sw = stripe_width(ref), test_sw = stripe_width(test);
+    int16_t *ref_src = state.src16;
+    int16_t *test_src = state.src16 + align_up(2 * MAX_W + 64, MAX_ALIGN) * (2 * MAX_H + 64);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int w = rnd_range(1, MAX_W), h = rnd_range(1, MAX_H);
+        ptrdiff_t stride = align_up(w, MAX_ALIGN);
+        fill_random8(state.src8[0], stride * h);
+        for (int y = 0; y < h; y++)
+            memset(state.src8[0] + y * stride + w, 0, stride - w);
+        ref->stripe_unpack(ref_src, state.src8[0], stride, w, h);
+        test->stripe_unpack(test_src, state.src8[0], stride, w, h);
+        int x, y;
+        bool ok = compare_stripes(ref_src, ref_sw, test_src, test_sw, w, h, &x, &y);
+        if (!report("stripe_unpack", ok, "%dx%d at %d, %d", w, h, x, y))
+            break;
+    }
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int w = rnd_range(1, MAX_W), h = rnd_range(1, MAX_H);
+        ptrdiff_t stride = align_up(w, MAX_ALIGN);
+        for (int j = 0; j < w * h; j++)
+            state.logical[j] = rnd() % 0x4001;
+        to_stripes(ref_src, state.logical, w, h, ref_sw);
+        to_stripes(test_src, state.logical, w, h, test_sw);
+        memset(state.ref8, 0x55, stride * h);
+        memset(state.test8, 0x55, stride * h);
+        int x, y;
+        ref->stripe_pack(state.ref8, stride, ref_src, w, h);
+        test->stripe_pack(state.test8, stride, test_src, w, h);
+        // pack clears the rest of the stride
+        bool ok = compare8(state.ref8, state.test8, stride, stride, h, &x, &y);
+        if (!report("stripe_pack", ok, "%dx%d at %d, %d", w, h, x, y))
+            break;
+    }
+
+    fill_random8(state.src8[0], MAX_W * MAX_H);
+    bench("stripe_unpack", bench_stripe_unpack, NULL);
+    bench("stripe_pack", bench_stripe_pack, NULL);
+}
+
+static void check_blur(void)
+{
+    check_stripe_pack();
+
+    static const char *names[2][4] = {
+        { "shrink_horz", "expand_horz", "pre_blur%d_horz", "main_blur%d_horz" },
+        { "shrink_vert", "expand_vert", "pre_blur%d_vert", "main_blur%d_vert" },
+    };
+    for (int vert = 0; vert < 2; vert++)
+        for (FilterType type = FILTER_SHRINK; type <= FILTER_MAIN_BLUR; type++) {
+            int count = type >= FILTER_PRE_BLUR ? 3 : 1;
+            for (int i = 0; i < count; i++) {
+                FilterArgs args = { .type = type, .index = i, .vert = vert };
+                char name[32];
+                snprintf(name, sizeof(name), names[vert][type], i + 1);
+                check_filter(&args, name);
+            }
+        }
+}
+
+
+/*
+ * Outline transforms
+ */
+
+#define MAX_POINTS 300      // covers every tail length of 16-point batches
+
+typedef struct {
+    size_t n;
+    ASS_Vector base;
+    double m[3][3];
+    uint16_t x[MAX_POINTS], y[MAX_POINTS];
+    ASS_Vector ref[MAX_POINTS], test[MAX_POINTS];
+} TransformArgs;
+
+// multiples of 1/256 hit exact halves, where rounding can differ
+static double rnd_coef(double range)
+{
+    return (rnd_range(-256, 256) / 256.0 + (rnd() & 1 ? 0 : rnd() * 0x1p-40)) * range;
+}
+
+static void random_transform(TransformArgs *args, bool perspective)
+{
+    args->n = rnd_range(1, MAX_POINTS);
+    args->base.x = rnd_range(-(1 << 22), 1 << 22);
+    args->base.y = rnd_range(-(1 << 22), 1 << 22);
+    for (size_t i = 0; i < args->n; i++) {
+        args->x[i] = rnd();
+        args->y[i] = rnd();
+    }
+    for (int k = 0; k < 3; k++) {
+        args->m[k][0] = rnd_coef(k < 2 ? 4 : 0x1p-16);
+        args->m[k][1] = rnd_coef(k < 2 ? 4 : 0x1p-16);
+        args->m[k][2] = rnd_coef(k < 2 ? 1 << 20 : 2);
+    }
+    if (!perspective)
+        return;
+    // keep the projected points in range of the outline coordinates
+    args->m[2][2] += 2;
+}
+
+static bool compare_points(const TransformArgs *args, size_t *pos)
+{
+    for (size_t i = 0; i < args->n; i++)
+        if (args->ref[i].x != args->test[i].x || args->ref[i].y != args->test[i].y) {
+            *pos = i;
+            return false;
+        }
+    return true;
+}
+
+static void bench_transform_affine(const BitmapEngine *engine, void *arg)
+{
+    TransformArgs *args = arg;
+    engine->transform_affine(args->test, args->x, args->y, args->n, args->base,
+                             (const double (*)[3]) args->m);
+}
+
+static void bench_transform_perspective(const BitmapEngine *engine, void *arg)
+{
+    TransformArgs *args = arg;
+    engine->transform_perspective(args->test, args->x, args->y, args->n, args->base,
+                                  (const double (*)[3]) args->m);
+}
+
+static void check_transform(void)
+{
+    const BitmapEngine *ref = state.ref, *test = state.test;
+    static TransformArgs args;
+    size_t pos = 0;
+
+    if (test->transform_affine != ref->transform_affine) {
+        for (int i = 0; i < ITERATIONS; i++) {
+            random_transform(&args, false);
+            ref->transform_affine(args.ref, args.x, args.y, args.n, args.base,
+                                  (const double (*)[3]) args.m);
+            test->transform_affine(args.test, args.x, args.y, args.n, args.base,
+                                   (const double (*)[3]) args.m);
+            if (!report("transform_affine", compare_points(&args, &pos),
+                        "%zu points at %zu", args.n, pos))
+                break;
+        }
+        args.n = MAX_POINTS;
+        bench("transform_affine", bench_transform_affine, &args);
+    }
+
+    if (test->transform_perspective != ref->transform_perspective) {
+        for (int i = 0; i < ITERATIONS; i++) {
+            random_transform(&args, true);
+            ref->transform_perspective(args.ref, args.x, args.y, args.n, args.base,
+                                       (const double (*)[3]) args.m);
+            test->transform_perspective(args.test, args.x, args.y, args.n, args.base,
+                                        (const double (*)[3]) args.m);
+            if (!report("transform_perspective", compare_points(&args, &pos),
+                        "%zu points at %zu", args.n, pos))
+                break;
+        }
+        args.n = MAX_POINTS;
+        bench("transform_perspective", bench_transform_perspective, &args);
+    }
+}
+
+
+static bool alloc_buffers(void)
+{
+    size_t size8 = 4 * MAX_W * (MAX_H + 1);
+    size_t size16 = align_up(2 * MAX_W + 64, MAX_ALIGN) * (2 * MAX_H + 64);
+    bool ok = true;
+    for (int i = 0; i < 2; i++)
+        ok &= !!(state.src8[i] = ass_aligned_alloc(MAX_ALIGN, size8, true));
+    ok &= !!(state.ref8 = ass_aligned_alloc(MAX_ALIGN, size8, true));
+    ok &= !!(state.test8 = ass_aligned_alloc(MAX_ALIGN, size8, true));
+    ok &= !!(state.src16 = ass_aligned_alloc(MAX_ALIGN, 2 * size16 * sizeof(int16_t), true));
+    ok &= !!(state.ref16 = ass_aligned_alloc(MAX_ALIGN, size16 * sizeof(int16_t), true));
+    ok &= !!(state.test16 = ass_aligned_alloc(MAX_ALIGN, size16 * sizeof(int16_t), true));
+    ok &= !!(state.logical = malloc(MAX_W * MAX_H * sizeof(int16_t)));
+    ok &= !!(state.tmp_ref = ass_aligned_alloc(MAX_ALIGN, 2 * MAX_W * sizeof(uint16_t), true));
+    ok &= !!(state.tmp_test = ass_aligned_alloc(MAX_ALIGN, 2 * MAX_W * sizeof(uint16_t), true));
+    return ok;
+}
+
+static void free_buffers(void)
+{
+    for (int i = 0; i < 2; i++)
+        ass_aligned_free(state.src8[i]);
+    ass_aligned_free(state.ref8);
+    ass_aligned_free(state.test8);
+    ass_aligned_free(state.src16);
+    ass_aligned_free(state.ref16);
+    ass_aligned_free(state.test16);
+    free(state.logical);
+    ass_aligned_free(state.tmp_ref);
+    ass_aligned_free(state.tmp_test);
+}
+
+static void check_engine(const char *name, const BitmapEngine *engine)
+{
+    state.name = name;
+    state.test = engine;
+    state.tile_order = engine->tile_order;
+    state.align = 1 << engine->align_order;
+    state.last_func[0] = '\0';
+    // same inputs whichever engines are selected
+    state.rnd_state = state.seed;
+    int failed = state.failed, checked = state.checked;
+
+    printf("%s:\n", name);
+    check_rasterizer();
+    check_blend(BLEND_ADD);
+    check_blend(BLEND_SUB);
+    check_blend(BLEND_MUL);
+    check_be_blur();
+    check_blend_rgba();
+    check_blur();
+    check_transform();
+    printf("  %d of %d functions failed\n",
+           state.failed - failed, state.checked - checked);
+}
+
+static int print_usage(const char *program)
+{
+    const char *fmt =
+        "Usage: %s [-s <seed>] [-e <engine>] [-b]\n"
+        "  -s  seed for the random inputs\n"
+        "  -e  check only one engine: sse2, avx2 or avx512\n"
+        "  -b  benchmark the functions against C\n";
+    printf(fmt, program);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *engine_names[] = { "sse2", "avx2", "avx512" };
+
+    const char *only = NULL;
+    state.seed = time(NULL);
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || !argv[i][1] || argv[i][2])
+            return print_usage(argv[0]);
+        switch (argv[i][1]) {
+        case 'b':
+            state.bench = true;
+            continue;
+        case 's':
+            if (++i >= argc)
+                return print_usage(argv[0]);
+            state.seed = strtoul(argv[i], NULL, 10);
+            break;
+        case 'e':
+            if (++i >= argc)
+                return print_usage(argv[0]);
+            only = argv[i];
+            break;
+        default:
+            return print_usage(argv[0]);
+        }
+    }
+    if (!state.seed)
+        state.seed = 1;
+    printf("checkasm: seed %u\n", state.seed);
+
+    state.ref = ass_bitmap_engine_init("c");
+    if (!alloc_buffers()) {
+        printf("Out of memory!\n");
+        return 1;
+    }
+
+    int n_engines = 0;
+    for (int i = 0; i < sizeof(engine_names) / sizeof(engine_names[0]); i++) {
+        if (only && strcmp(only, engine_names[i]))
+            continue;
+        const BitmapEngine *engine = ass_bitmap_engine_init(engine_names[i]);
+        if (!engine)
+            continue;
+        check_engine(engine_names[i], engine);
+        n_engines++;
+    }
+    if (!n_engines)
+        printf("No optimized bitmap engines available in this build or CPU\n");
+
+    free_buffers();
+    if (state.failed) {
+        printf("checkasm: %d of %d functions failed\n", state.failed, state.checked);
+        return 1;
+    }
+    return 0;
+}
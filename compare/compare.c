@@ -452,7 +452,8 @@ static bool add_img_item(ItemList *list, const char *file, int len)
 static int print_usage(const char *program)
 {
     const char *fmt =
-        "Usage: %s [-i] <input-dir> [-o <output-dir>] [-s <scale:1-8>]\n";
+        "Usage: %s [-i] <input-dir> [-o <output-dir>] [-s <scale:1-8>]"
+        " [-b <blur:accurate|fast>]\n";
     printf(fmt, program);
     return 1;
 }
@@ -469,9 +470,9 @@ void msg_callback(int level, const char *fmt, va_list va, void *data)
 int main(int argc, char *argv[])
 {
     enum {
-        INPUT, OUTPUT, SCALE
+        INPUT, OUTPUT, SCALE, BLUR
     };
-    int pos[3] = {0};
+    int pos[4] = {0};
     for (int i = 1; i < argc; i++) {
         if (argv[i][0] != '-') {
             if (pos[INPUT])
@@ -484,6 +485,7 @@ int main(int argc, char *argv[])
         case 'i':  index = INPUT;   break;
         case 'o':  index = OUTPUT;  break;
         case 's':  index = SCALE;   break;
+        case 'b':  index = BLUR;    break;
         default:  return print_usage(argv[0]);
         }
         if (argv[i][2] || ++i >= argc || pos[index])
@@ -503,6 +505,17 @@ int main(int argc, char *argv[])
         scale = arg[0] - '0';
     }
 
+    ASS_BlurQuality blur_quality = ASS_BLUR_ACCURATE;
+    if (pos[BLUR]) {
+        const char *arg = argv[pos[BLUR]];
+        if (!strcmp(arg, "fast"))
+            blur_quality = ASS_BLUR_FAST;
+        else if (strcmp(arg, "accurate")) {
+            printf("Invalid blur quality, should be accurate or fast!\n");
+            return 1;
+        }
+    }
+
     const char *input = argv[pos[INPUT]];
     DIR *dir = opendir(input);
     if (!dir) {
@@ -581,6 +594,7 @@ int main(int argc, char *argv[])
         return 1;
     }
     ass_set_fonts(renderer, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL, 0);
+    ass_set_blur_quality(renderer, blur_quality);
 
     int prefix;
     const char *prev = "";
@@ -27,6 +27,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <inttypes.h>
+#include <limits.h>
+#ifdef CONFIG_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #ifdef CONFIG_ICONV
 #include <iconv.h>
@@ -36,6 +45,7 @@
 #include "ass_utils.h"
 #include "ass_library.h"
 #include "ass_string.h"
+#include "ass_trace.h"
 
 #define ass_atof(STR) (ass_strtod((STR),NULL))
 
@@ -61,6 +71,11 @@ typedef enum {
     // max 32 enumerators
 } ScriptInfo;
 
+typedef struct {
+    long long start, end;
+    int id;
+} EventInterval;
+
 struct parser_priv {
     ParserState state;
     char *fontname;
@@ -68,15 +83,50 @@ struct parser_priv {
     int fontdata_size;
     int fontdata_used;
 
-    // contains bitmap of ReadOrder IDs of all read events
-    uint32_t *read_order_bitmap;
-    int read_order_elems; // size in uint32_t units of read_order_bitmap
+    // hash set of ReadOrder IDs of all read events, see test_and_set_read_order()
+    uint64_t *read_order_set;
+    size_t read_order_count;
+    size_t read_order_size;         // number of slots, power of two
     int check_readorder;
 
     int enable_extensions;
 
     // tracks [Script Info] headers set by the script
     uint32_t header_flags;
+
+    // time index over events [0, n_indexed), see ass_active_events()
+    EventInterval *event_index;     // sorted by start time
+    long long *event_index_end;     // max-tree of end times, 2 * event_index_cap
+    int event_index_cap;            // number of tree leaves, power of two
+    int n_indexed;
+    bool event_index_dirty;         // indexed events were freed or dropped
+    int *active_events;
+    int max_active_events;
+
+    // see ass_set_event_retention()
+    long long retention;
+    long long prune_time;           // now of the last pruning
+    bool pruned;
+
+    // parsed file contents kept by zero-copy mode (see ass_set_zero_copy()),
+    // strings inside of it belong to the buffer and are not freed separately
+    char *text;
+    size_t text_size;
+    bool text_mapped;               // file mapping instead of malloc'd memory
+
+    // ass_process_stream() state: incomplete last line of the data so far
+    char *stream_buf;
+    size_t stream_len, stream_cap;
+    int stream_read_order;          // ReadOrder of the next streamed event
+    bool stream_styles_done;        // force style applied to parsed styles
+
+    // Dialogue lines waiting for parallel parsing, see flush_event_batch()
+    bool batch_events;
+    char **batch_lines;
+    int n_batch, max_batch;
+    int batch_first_event;          // event id of batch_lines[0]
+
+    int trace_id;                   // see ass_set_trace_file()
 };
 
 static const char *const ass_style_format =
@@ -102,16 +152,45 @@ int ass_library_version(void)
     return LIBASS_VERSION;
 }
 
+static void free_text_buffer(char *buf, size_t size, bool mapped)
+{
+#ifdef HAVE_SYS_MMAN_H
+    if (mapped) {
+        munmap(buf, size);
+        return;
+    }
+#endif
+    free(buf);
+}
+
+static bool in_text_buffer(ASS_Track *track, const char *str)
+{
+    struct parser_priv *priv = track->parser_priv;
+    if (!priv || !priv->text || !str)
+        return false;
+    return (uintptr_t) str - (uintptr_t) priv->text < priv->text_size;
+}
+
+/**
+ * \brief Duplicate a parsed string unless it can stay in the text buffer
+ */
+static char *track_strdup(ASS_Track *track, char *str)
+{
+    return in_text_buffer(track, str) ? str : strdup(str);
+}
+
+static void track_free(ASS_Track *track, char *str)
+{
+    if (!in_text_buffer(track, str))
+        free(str);
+}
+
 void ass_free_track(ASS_Track *track)
 {
     int i;
 
-    if (track->parser_priv) {
-        free(track->parser_priv->read_order_bitmap);
-        free(track->parser_priv->fontname);
-        free(track->parser_priv->fontdata);
-        free(track->parser_priv);
-    }
+    ASS_TRACE(track->library, TRACE_FREE_TRACK, track->parser_priv->trace_id);
+
     free(track->style_format);
     free(track->event_format);
     free(track->Language);
@@ -126,6 +205,20 @@ void ass_free_track(ASS_Track *track)
     }
     free(track->events);
     free(track->name);
+    if (track->parser_priv) {
+        struct parser_priv *priv = track->parser_priv;
+        free(priv->read_order_set);
+        free(priv->event_index);
+        free(priv->event_index_end);
+        free(priv->active_events);
+        free(priv->fontname);
+        free(priv->fontdata);
+        free(priv->stream_buf);
+        free(priv->batch_lines);
+        if (priv->text)
+            free_text_buffer(priv->text, priv->text_size, priv->text_mapped);
+        free(priv);
+    }
     free(track);
 }
 
@@ -177,9 +270,12 @@ void ass_free_event(ASS_Track *track, int eid)
 {
     ASS_Event *event = track->events + eid;
 
-    free(event->Name);
-    free(event->Effect);
-    free(event->Text);
+    if (track->parser_priv && eid < track->parser_priv->n_indexed)
+        track->parser_priv->event_index_dirty = true;
+
+    track_free(track, event->Name);
+    track_free(track, event->Effect);
+    track_free(track, event->Text);
     free(event->render_priv);
 }
 
@@ -187,50 +283,324 @@ void ass_free_style(ASS_Track *track, int sid)
 {
     ASS_Style *style = track->styles + sid;
 
-    free(style->Name);
-    free(style->FontName);
-}
-
-static int resize_read_order_bitmap(ASS_Track *track, int max_id)
-{
-    // Don't allow malicious files to OOM us easily. Also avoids int overflows.
-    if (max_id < 0 || max_id >= 10 * 1024 * 1024 * 8)
-        goto fail;
-    assert(track->parser_priv->read_order_bitmap || !track->parser_priv->read_order_elems);
-    if (max_id >= track->parser_priv->read_order_elems * 32) {
-        int oldelems = track->parser_priv->read_order_elems;
-        int elems = ((max_id + 31) / 32 + 1) * 2;
-        assert(elems >= oldelems);
-        track->parser_priv->read_order_elems = elems;
-        void *new_bitmap =
-            realloc(track->parser_priv->read_order_bitmap, elems * 4);
-        if (!new_bitmap)
-            goto fail;
-        track->parser_priv->read_order_bitmap = new_bitmap;
-        memset(track->parser_priv->read_order_bitmap + oldelems, 0,
-               (elems - oldelems) * 4);
-    }
-    return 0;
+    track_free(track, style->Name);
+    track_free(track, style->FontName);
+}
+
+/*
+ * ReadOrder IDs can be anything from sequential numbers to huge sparse
+ * values, so they are kept in an open addressing hash set with linear
+ * probing. A slot holds the ID with bit 32 set, zero marks an empty slot.
+ */
+#define READ_ORDER_USED ((uint64_t) 1 << 32)
+
+static void free_read_order_set(struct parser_priv *priv)
+{
+    free(priv->read_order_set);
+    priv->read_order_set = NULL;
+    priv->read_order_count = priv->read_order_size = 0;
+}
+
+static inline size_t read_order_slot(uint32_t id, size_t mask)
+{
+    return (id * 2654435761u) & mask;
+}
 
-fail:
-    free(track->parser_priv->read_order_bitmap);
-    track->parser_priv->read_order_bitmap = NULL;
-    track->parser_priv->read_order_elems = 0;
-    return -1;
+static bool resize_read_order_set(struct parser_priv *priv)
+{
+    size_t size = FFMAX(2 * priv->read_order_size, 64);
+    uint64_t *set = calloc(size, sizeof(*set));
+    if (!set)
+        return false;
+    for (size_t i = 0; i < priv->read_order_size; i++) {
+        uint64_t item = priv->read_order_set[i];
+        if (!item)
+            continue;
+        size_t slot = read_order_slot(item, size - 1);
+        while (set[slot])
+            slot = (slot + 1) & (size - 1);
+        set[slot] = item;
+    }
+    free(priv->read_order_set);
+    priv->read_order_set = set;
+    priv->read_order_size = size;
+    return true;
 }
 
-static int test_and_set_read_order_bit(ASS_Track *track, int id)
+/**
+ * \brief Add a ReadOrder ID to the set
+ * \return 1 if it was already there, 0 if added, -1 on allocation failure
+ */
+static int test_and_set_read_order(ASS_Track *track, int id)
 {
-    if (resize_read_order_bitmap(track, id) < 0)
+    struct parser_priv *priv = track->parser_priv;
+    if (2 * (priv->read_order_count + 1) > priv->read_order_size &&
+            !resize_read_order_set(priv)) {
+        free_read_order_set(priv);
         return -1;
-    int index = id / 32;
-    uint32_t bit = 1u << (id % 32);
-    if (track->parser_priv->read_order_bitmap[index] & bit)
-        return 1;
-    track->parser_priv->read_order_bitmap[index] |= bit;
+    }
+
+    uint64_t item = (uint32_t) id | READ_ORDER_USED;
+    size_t mask = priv->read_order_size - 1;
+    size_t slot = read_order_slot(id, mask);
+    for (; priv->read_order_set[slot]; slot = (slot + 1) & mask)
+        if (priv->read_order_set[slot] == item)
+            return 1;
+    priv->read_order_set[slot] = item;
+    priv->read_order_count++;
     return 0;
 }
 
+static void remove_read_order(ASS_ParserPriv *priv, int id)
+{
+    uint64_t *set = priv->read_order_set;
+    if (!set)
+        return;
+    uint64_t item = (uint32_t) id | READ_ORDER_USED;
+    size_t mask = priv->read_order_size - 1;
+    size_t slot = read_order_slot(id, mask);
+    for (; set[slot] != item; slot = (slot + 1) & mask)
+        if (!set[slot])
+            return;
+
+    // shift following IDs of the probe run back into the hole
+    size_t hole = slot;
+    while (true) {
+        slot = (slot + 1) & mask;
+        if (!set[slot])
+            break;
+        size_t home = read_order_slot(set[slot], mask);
+        if (((slot - home) & mask) < ((slot - hole) & mask))
+            continue;
+        set[hole] = set[slot];
+        hole = slot;
+    }
+    set[hole] = 0;
+    priv->read_order_count--;
+}
+
+// ==============================================================================================
+
+/*
+ * Time index of events. Events [0, n_indexed) are kept as intervals sorted
+ * by start time, together with a max-tree over their end times. Active events
+ * are found by a binary search for the last interval that has started and
+ * a descent into the subtrees that have not ended yet, which costs
+ * O(log n + k log n) instead of a scan over the whole track.
+ *
+ * Events allocated after the index was built are appended while they keep
+ * coming in start time order (the common case for ass_process_chunk()),
+ * and otherwise scanned linearly until there are enough of them to warrant
+ * a rebuild.
+ */
+
+#define EVENT_INDEX_MIN_CAP 16
+#define EVENT_INDEX_MAX_PENDING(n) (64 + (n) / 128)
+
+static int cmp_event_interval(const void *p1, const void *p2)
+{
+    const EventInterval *a = p1, *b = p2;
+    if (a->start != b->start)
+        return a->start < b->start ? -1 : 1;
+    return a->id - b->id;
+}
+
+static int cmp_event_id(const void *p1, const void *p2)
+{
+    return *(const int *) p1 - *(const int *) p2;
+}
+
+static bool rebuild_event_index(ASS_Track *track)
+{
+    ASS_ParserPriv *priv = track->parser_priv;
+    priv->n_indexed = 0;
+    priv->event_index_dirty = false;
+
+    int cap = FFMAX(priv->event_index_cap, EVENT_INDEX_MIN_CAP);
+    while (cap < track->n_events) {
+        if (cap > INT_MAX / 4)
+            return false;
+        cap *= 2;
+    }
+    if (cap > priv->event_index_cap) {
+        if (!ASS_REALLOC_ARRAY(priv->event_index, cap) ||
+                !ASS_REALLOC_ARRAY(priv->event_index_end, 2 * cap))
+            return false;
+        priv->event_index_cap = cap;
+    }
+
+    int n = track->n_events;
+    for (int i = 0; i < n; i++) {
+        ASS_Event *event = track->events + i;
+        priv->event_index[i].start = event->Start;
+        priv->event_index[i].end = event->Start + event->Duration;
+        priv->event_index[i].id = i;
+    }
+    qsort(priv->event_index, n, sizeof(EventInterval), cmp_event_interval);
+
+    long long *tree = priv->event_index_end;
+    for (int i = 0; i < cap; i++)
+        tree[cap + i] = i < n ? priv->event_index[i].end : LLONG_MIN;
+    for (int i = cap - 1; i > 0; i--)
+        tree[i] = FFMAX(tree[2 * i], tree[2 * i + 1]);
+    priv->n_indexed = n;
+    return true;
+}
+
+/**
+ * \brief Add the next event to the index without a rebuild
+ * \return false if the event doesn't fit in start time order or capacity
+ */
+static bool append_event_index(ASS_Track *track, int eid)
+{
+    ASS_ParserPriv *priv = track->parser_priv;
+    ASS_Event *event = track->events + eid;
+    int n = priv->n_indexed;
+    assert(eid == n);
+    if (priv->event_index_dirty || n >= priv->event_index_cap ||
+            (n && event->Start < priv->event_index[n - 1].start))
+        return false;
+
+    long long end = event->Start + event->Duration;
+    priv->event_index[n].start = event->Start;
+    priv->event_index[n].end = end;
+    priv->event_index[n].id = eid;
+
+    long long *tree = priv->event_index_end;
+    for (int i = priv->event_index_cap + n; i && tree[i] < end; i /= 2)
+        tree[i] = end;
+    priv->n_indexed++;
+    return true;
+}
+
+static void update_event_index(ASS_Track *track)
+{
+    ASS_ParserPriv *priv = track->parser_priv;
+    if (track->n_events < priv->n_indexed)
+        priv->event_index_dirty = true;
+    if (!priv->event_index_dirty)
+        while (priv->n_indexed < track->n_events)
+            if (!append_event_index(track, priv->n_indexed))
+                break;
+    int pending = track->n_events - priv->n_indexed;
+    if (priv->event_index_dirty ||
+            pending > EVENT_INDEX_MAX_PENDING(priv->n_indexed)) {
+        if (!rebuild_event_index(track))
+            ass_msg(track->library, MSGL_WARN,
+                    "Failed to index events, falling back to linear search");
+    }
+}
+
+static void collect_active_events(ASS_ParserPriv *priv, int *count,
+                                  int node, int lo, int hi, int limit,
+                                  long long now)
+{
+    if (lo >= limit || priv->event_index_end[node] <= now)
+        return;
+    if (hi - lo == 1) {
+        priv->active_events[(*count)++] = priv->event_index[lo].id;
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    collect_active_events(priv, count, 2 * node, lo, mid, limit, now);
+    collect_active_events(priv, count, 2 * node + 1, mid, hi, limit, now);
+}
+
+/**
+ * \brief Find the events displayed at a given time
+ * \param track track
+ * \param now timestamp (ms)
+ * \param count output, number of active events
+ * \return ids of active events in increasing order, owned by the track and
+ * valid until the next call; NULL on allocation failure
+ */
+const int *ass_active_events(ASS_Track *track, long long now, int *count)
+{
+    ASS_ParserPriv *priv = track->parser_priv;
+    *count = 0;
+
+    if (track->n_events > priv->max_active_events) {
+        if (!ASS_REALLOC_ARRAY(priv->active_events, track->n_events))
+            return NULL;
+        priv->max_active_events = track->n_events;
+    }
+
+    update_event_index(track);
+
+    // first interval that has not started yet
+    int lo = 0, hi = priv->n_indexed;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (priv->event_index[mid].start <= now)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo) {
+        collect_active_events(priv, count, 1, 0, priv->event_index_cap,
+                              lo, now);
+        qsort(priv->active_events, *count, sizeof(int), cmp_event_id);
+    }
+
+    for (int i = priv->n_indexed; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        if (event->Start <= now && now < event->Start + event->Duration)
+            priv->active_events[(*count)++] = i;
+    }
+    return priv->active_events;
+}
+
+// first indexed interval starting at or after t
+static int find_event_start(ASS_ParserPriv *priv, long long t)
+{
+    int lo = 0, hi = priv->n_indexed;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (priv->event_index[mid].start < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * \brief Find the events starting in a time range
+ * \param track track
+ * \param start start of the range (ms)
+ * \param end end of the range (ms), exclusive
+ * \param count output, number of events found
+ * \return ids of the events, ordered by start time and shared with
+ * ass_active_events(), valid until the next call of either;
+ * NULL on allocation failure
+ */
+const int *ass_starting_events(ASS_Track *track, long long start,
+                               long long end, int *count)
+{
+    ASS_ParserPriv *priv = track->parser_priv;
+    *count = 0;
+
+    if (track->n_events > priv->max_active_events) {
+        if (!ASS_REALLOC_ARRAY(priv->active_events, track->n_events))
+            return NULL;
+        priv->max_active_events = track->n_events;
+    }
+
+    update_event_index(track);
+
+    int first = find_event_start(priv, start);
+    int last = find_event_start(priv, end);
+    for (int i = first; i < last; i++)
+        priv->active_events[(*count)++] = priv->event_index[i].id;
+
+    for (int i = priv->n_indexed; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        if (event->Start >= start && event->Start < end)
+            priv->active_events[(*count)++] = i;
+    }
+    return priv->active_events;
+}
+
 // ==============================================================================================
 
 /**
@@ -299,14 +669,14 @@ static long long string2timecode(ASS_Library *library, char *p)
 
 #define STRVAL(name) \
     } else if (ass_strcasecmp(tname, #name) == 0) { \
-        if (target->name != NULL) free(target->name); \
-        target->name = strdup(token);
+        track_free(track, target->name); \
+        target->name = track_strdup(track, token);
 
 #define STARREDSTRVAL(name) \
     } else if (ass_strcasecmp(tname, #name) == 0) { \
-        if (target->name != NULL) free(target->name); \
+        track_free(track, target->name); \
         while (*token == '*') ++token; \
-        target->name = strdup(token);
+        target->name = track_strdup(track, token);
 
 #define COLORVAL(name) ANYVAL(name,parse_color_header)
 #define INTVAL(name) ANYVAL(name,atoi)
@@ -383,7 +753,7 @@ static int process_event_tail(ASS_Track *track, ASS_Event *event,
         NEXT(q, tname);
         if (ass_strcasecmp(tname, "Text") == 0) {
             char *last;
-            event->Text = strdup(p);
+            event->Text = track_strdup(track, p);
             if (*event->Text != 0) {
                 last = event->Text + strlen(event->Text) - 1;
                 if (last >= event->Text && *last == '\r')
@@ -790,9 +1160,128 @@ static bool detect_legacy_conv_subs(ASS_Track *track)
 }
 
 
+#define MIN_BATCH_PER_THREAD 1024
+
+typedef struct {
+    ASS_Track *track;
+    char **lines;
+    int first_event, n_lines;
+} EventBatchJob;
+
+static void *parse_event_batch(void *arg)
+{
+    EventBatchJob *job = arg;
+    for (int i = 0; i < job->n_lines; i++)
+        process_event_tail(job->track,
+                           job->track->events + job->first_event + i,
+                           job->lines[i], 0);
+    return NULL;
+}
+
+#ifdef CONFIG_PTHREAD
+/**
+ * \brief Parse a batch of Dialogue lines on the library's parse threads.
+ * The events were allocated in order when queued, so each thread fills its
+ * own range of them.
+ * \return false if the batch is left to the calling thread
+ */
+static bool parse_batch_parallel(ASS_Track *track, int n)
+{
+    struct parser_priv *priv = track->parser_priv;
+    int threads = FFMIN(track->library->parse_threads,
+                        n / MIN_BATCH_PER_THREAD);
+    EventBatchJob *job = threads > 1 ? calloc(threads, sizeof(*job)) : NULL;
+    pthread_t *thread = job ? calloc(threads, sizeof(*thread)) : NULL;
+    if (!thread) {
+        free(job);
+        return false;
+    }
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        int begin = (int64_t) n * i / threads;
+        int end = (int64_t) n * (i + 1) / threads;
+        job[i] = (EventBatchJob) {
+            .track = track,
+            .lines = priv->batch_lines + begin,
+            .first_event = priv->batch_first_event + begin,
+            .n_lines = end - begin,
+        };
+    }
+    // the calling thread takes the first range, and the ranges of
+    // threads that could not be created
+    for (int i = 1; i < threads; i++)
+        if (pthread_create(&thread[started], NULL,
+                           parse_event_batch, &job[i]) == 0)
+            started++;
+        else
+            parse_event_batch(&job[i]);
+    parse_event_batch(&job[0]);
+    for (int i = 0; i < started; i++)
+        pthread_join(thread[i], NULL);
+    free(thread);
+    free(job);
+    return true;
+}
+#else
+static bool parse_batch_parallel(ASS_Track *track, int n)
+{
+    return false;
+}
+#endif
+
+/**
+ * \brief Parse the queued Dialogue lines, in parallel if possible.
+ * Tails only read the track (styles, formats), which is why the batch
+ * has to be flushed before any other line is processed.
+ */
+static void flush_event_batch(ASS_Track *track)
+{
+    struct parser_priv *priv = track->parser_priv;
+    int n = priv->n_batch;
+    if (!n)
+        return;
+    priv->n_batch = 0;
+
+    if (track->n_styles == 0) {
+        // add "Default" style to the end, as process_event_tail() would
+        int sid = ass_alloc_style(track);
+        set_default_style(&track->styles[sid]);
+        track->default_style = sid;
+    }
+
+    if (parse_batch_parallel(track, n))
+        return;
+    EventBatchJob all = {
+        .track = track,
+        .lines = priv->batch_lines,
+        .first_event = priv->batch_first_event,
+        .n_lines = n,
+    };
+    parse_event_batch(&all);
+}
+
+static bool queue_event_line(ASS_Track *track, int eid, char *str)
+{
+    struct parser_priv *priv = track->parser_priv;
+    if (priv->n_batch == priv->max_batch) {
+        int max = FFMAX(2 * priv->max_batch, 256);
+        char **lines = realloc(priv->batch_lines, max * sizeof(char *));
+        if (!lines)
+            return false;
+        priv->batch_lines = lines;
+        priv->max_batch = max;
+    }
+    if (!priv->n_batch)
+        priv->batch_first_event = eid;
+    priv->batch_lines[priv->n_batch++] = str;
+    return true;
+}
+
 static int process_events_line(ASS_Track *track, char *str)
 {
     if (!strncmp(str, "Format:", 7)) {
+        flush_event_batch(track);
         char *p = str + 7;
         skip_spaces(&p);
         free(track->event_format);
@@ -827,7 +1316,11 @@ static int process_events_line(ASS_Track *track, char *str)
         if (!track->event_format)
             event_format_fallback(track);
 
-        process_event_tail(track, event, str, 0);
+        if (!track->parser_priv->batch_events ||
+                !queue_event_line(track, eid, str)) {
+            flush_event_batch(track);
+            process_event_tail(track, event, str, 0);
+        }
     } else {
         ass_msg(track->library, MSGL_V, "Not understood: '%.30s'", str);
     }
@@ -882,8 +1375,10 @@ static int decode_font(ASS_Track *track)
     assert(dsize == size / 4 * 3 + FFMAX(size % 4 - 1, 0));
 
     if (track->library->extract_fonts) {
-        ass_add_font(track->library, track->parser_priv->fontname,
-                     (char *) buf, dsize);
+        // the library takes over the decoded data
+        ass_add_font_data(track->library, track->parser_priv->fontname,
+                          (char *) buf, dsize);
+        buf = NULL;
     }
 
 error_decode_font:
@@ -941,6 +1436,8 @@ static int process_fonts_line(ASS_Track *track, char *str)
 static int process_line(ASS_Track *track, char *str)
 {
     skip_spaces(&str);
+    if (*str == '[' || track->parser_priv->state != PST_EVENTS)
+        flush_event_batch(track);
     if (!ass_strncasecmp(str, "[Script Info]", 13)) {
         track->parser_priv->state = PST_INFO;
     } else if (!ass_strncasecmp(str, "[V4 Styles]", 11)) {
@@ -974,7 +1471,7 @@ static int process_line(ASS_Track *track, char *str)
     return 0;
 }
 
-static int process_text(ASS_Track *track, char *str)
+static void process_lines(ASS_Track *track, char *str)
 {
     char *p = str;
     while (1) {
@@ -998,6 +1495,11 @@ static int process_text(ASS_Track *track, char *str)
             break;
         p = q;
     }
+}
+
+static int process_text(ASS_Track *track, char *str)
+{
+    process_lines(track, str);
     // there is no explicit end-of-font marker in ssa/ass
     if (track->parser_priv->fontname)
         decode_font(track);
@@ -1010,7 +1512,7 @@ static int process_text(ASS_Track *track, char *str)
  * \param data string to parse
  * \param size length of data
 */
-void ass_process_data(ASS_Track *track, char *data, int size)
+static void process_data(ASS_Track *track, char *data, int size)
 {
     char *str = malloc(size + 1);
     if (!str)
@@ -1024,6 +1526,13 @@ void ass_process_data(ASS_Track *track, char *data, int size)
     free(str);
 }
 
+void ass_process_data(ASS_Track *track, char *data, int size)
+{
+    ASS_TRACE(track->library, TRACE_PROCESS_DATA,
+              track->parser_priv->trace_id, data, (size_t) size);
+    process_data(track, data, size);
+}
+
 /**
  * \brief Process CodecPrivate section of subtitle stream
  * \param track track
@@ -1033,7 +1542,9 @@ void ass_process_data(ASS_Track *track, char *data, int size)
 */
 void ass_process_codec_private(ASS_Track *track, char *data, int size)
 {
-    ass_process_data(track, data, size);
+    ASS_TRACE(track->library, TRACE_PROCESS_CODEC_PRIVATE,
+              track->parser_priv->trace_id, data, (size_t) size);
+    process_data(track, data, size);
 
     // probably an mkv produced by ancient mkvtoolnix
     // such files don't have [Events] and Format: headers
@@ -1043,11 +1554,89 @@ void ass_process_codec_private(ASS_Track *track, char *data, int size)
     ass_process_force_style(track);
 }
 
+static void stream_new_events(ASS_Track *track, int first_event)
+{
+    struct parser_priv *priv = track->parser_priv;
+
+    // external SSA/ASS subs does not have ReadOrder field
+    for (int i = first_event; i < track->n_events; i++)
+        track->events[i].ReadOrder = priv->stream_read_order++;
+
+    if (!priv->stream_styles_done && priv->state == PST_EVENTS) {
+        ass_process_force_style(track);
+        priv->stream_styles_done = true;
+    }
+}
+
+int ass_process_stream(ASS_Track *track, const char *data, size_t size)
+{
+    struct parser_priv *priv = track->parser_priv;
+    ASS_TRACE(track->library, TRACE_PROCESS_STREAM, priv->trace_id, data, size);
+
+    size_t end = size;
+    while (end && data[end - 1] != '\n' && data[end - 1] != '\r')
+        end--;
+
+    if (priv->stream_len + size + 1 > priv->stream_cap) {
+        size_t cap = FFMAX(2 * priv->stream_cap, priv->stream_len + size + 1);
+        char *buf = realloc(priv->stream_buf, cap);
+        if (!buf)
+            return priv->stream_styles_done;
+        priv->stream_buf = buf;
+        priv->stream_cap = cap;
+    }
+    memcpy(priv->stream_buf + priv->stream_len, data, size);
+    if (!end) {
+        // no line is complete yet
+        priv->stream_len += size;
+        return priv->stream_styles_done;
+    }
+
+    // parse all complete lines and keep the rest for the next chunk
+    size_t len = priv->stream_len + end;
+    size_t tail = size - end;
+    char saved = priv->stream_buf[len];
+    priv->stream_buf[len] = '\0';
+    int first_event = track->n_events;
+    process_lines(track, priv->stream_buf);
+    priv->stream_buf[len] = saved;
+    memmove(priv->stream_buf, priv->stream_buf + len, tail);
+    priv->stream_len = tail;
+
+    stream_new_events(track, first_event);
+    return priv->stream_styles_done;
+}
+
+void ass_process_stream_end(ASS_Track *track)
+{
+    struct parser_priv *priv = track->parser_priv;
+    ASS_TRACE(track->library, TRACE_PROCESS_STREAM_END, priv->trace_id);
+
+    int first_event = track->n_events;
+    if (priv->stream_len) {
+        priv->stream_buf[priv->stream_len] = '\0';
+        process_lines(track, priv->stream_buf);
+        priv->stream_len = 0;
+    }
+    // there is no explicit end-of-font marker in ssa/ass
+    if (priv->fontname)
+        decode_font(track);
+
+    stream_new_events(track, first_event);
+    // styles may also come after the events or be the only section
+    ass_process_force_style(track);
+    priv->stream_styles_done = true;
+}
+
 static int check_duplicate_event(ASS_Track *track, int ReadOrder)
 {
-    if (track->parser_priv->read_order_bitmap)
-        return test_and_set_read_order_bit(track, ReadOrder) > 0;
-    // ignoring last event, it is the one we are comparing with
+    if (track->parser_priv->read_order_set) {
+        int res = test_and_set_read_order(track, ReadOrder);
+        if (res >= 0)
+            return res;
+    }
+    // no memory for the set, ignoring last event,
+    // it is the one we are comparing with
     for (int i = 0; i < track->n_events - 1; i++)
         if (track->events[i].ReadOrder == ReadOrder)
             return 1;
@@ -1056,6 +1645,8 @@ static int check_duplicate_event(ASS_Track *track, int ReadOrder)
 
 void ass_set_check_readorder(ASS_Track *track, int check_readorder)
 {
+    ASS_TRACE(track->library, TRACE_SET_CHECK_READORDER,
+              track->parser_priv->trace_id, check_readorder);
     track->parser_priv->check_readorder = check_readorder == 1;
 }
 
@@ -1077,9 +1668,13 @@ void ass_process_chunk(ASS_Track *track, char *data, int size,
     ASS_Event *event;
     int check_readorder = track->parser_priv->check_readorder;
 
-    if (check_readorder && !track->parser_priv->read_order_bitmap) {
+    ASS_TRACE(track->library, TRACE_PROCESS_CHUNK, track->parser_priv->trace_id,
+              data, (size_t) size, timecode, duration);
+    if (check_readorder && !track->parser_priv->read_order_set &&
+            resize_read_order_set(track->parser_priv)) {
+        // include events that were read without duplicate checks
         for (int i = 0; i < track->n_events; i++) {
-            if (test_and_set_read_order_bit(track, track->events[i].ReadOrder) < 0)
+            if (test_and_set_read_order(track, track->events[i].ReadOrder) < 0)
                 break;
         }
     }
@@ -1115,6 +1710,8 @@ void ass_process_chunk(ASS_Track *track, char *data, int size,
 
         event->Start = timecode;
         event->Duration = duration;
+        if (eid == track->parser_priv->n_indexed)
+            append_event_index(track, eid);
 
         free(str);
         return;
@@ -1132,15 +1729,66 @@ void ass_process_chunk(ASS_Track *track, char *data, int size,
 */
 void ass_flush_events(ASS_Track *track)
 {
+    ASS_TRACE(track->library, TRACE_FLUSH_EVENTS, track->parser_priv->trace_id);
     if (track->events) {
         int eid;
         for (eid = 0; eid < track->n_events; eid++)
             ass_free_event(track, eid);
         track->n_events = 0;
     }
-    free(track->parser_priv->read_order_bitmap);
-    track->parser_priv->read_order_bitmap = NULL;
-    track->parser_priv->read_order_elems = 0;
+    free_read_order_set(track->parser_priv);
+    track->parser_priv->n_indexed = 0;
+    track->parser_priv->event_index_dirty = true;
+    track->parser_priv->pruned = false;
+}
+
+void ass_set_event_retention(ASS_Track *track, long long retention)
+{
+    ASS_TRACE(track->library, TRACE_SET_EVENT_RETENTION,
+              track->parser_priv->trace_id, retention);
+    track->parser_priv->retention = FFMAX(retention, 0);
+    track->parser_priv->pruned = false;
+}
+
+/*
+ * Events are pruned in bulk when the time has moved by 1/8 of the retention
+ * since the last time, so that compacting the event array costs little per
+ * frame. The compaction keeps the order of events, but changes their ids,
+ * which takes a rebuild of the time index.
+ */
+#define PRUNE_STEP(retention) FFMAX((retention) / 8, 1)
+
+void ass_prune_events(ASS_Track *track, long long now)
+{
+    ASS_ParserPriv *priv = track->parser_priv;
+    if (!priv->retention || priv->n_batch)
+        return;
+    if (priv->pruned && now > priv->prune_time - PRUNE_STEP(priv->retention) &&
+            now < priv->prune_time + PRUNE_STEP(priv->retention))
+        return;
+    priv->pruned = true;
+    priv->prune_time = now;
+
+    long long limit = now - priv->retention;
+    int n = 0;
+    for (int i = 0; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        if (event->Start + event->Duration < limit) {
+            remove_read_order(priv, event->ReadOrder);
+            ass_free_event(track, i);
+            continue;
+        }
+        if (n != i)
+            track->events[n] = *event;
+        n++;
+    }
+    if (n == track->n_events)
+        return;
+
+    ass_msg(track->library, MSGL_DBG2, "Freed %d events ended before %lld ms",
+            track->n_events - n, limit);
+    track->n_events = n;
+    priv->event_index_dirty = true;
 }
 
 #ifdef CONFIG_ICONV
@@ -1280,18 +1928,124 @@ char *read_file(ASS_Library *library, char *fname, size_t *bufsize)
     return buf;
 }
 
+#ifdef HAVE_SYS_MMAN_H
+/**
+ * \brief Map file contents into memory as a private writable copy.
+ * The terminating zero comes from the zero-filled rest of the last page,
+ * so files with a size that is a multiple of the page size are not mapped.
+ * \return mapped contents or NULL to fall back to read_file()
+ */
+static char *map_file(char *fname, size_t *bufsize)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    char *buf = NULL;
+    struct stat st;
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 &&
+            page_size > 0 && st.st_size % page_size &&
+            (uintmax_t) st.st_size < SIZE_MAX) {
+        void *ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            buf = ptr;
+            *bufsize = st.st_size;
+        }
+    }
+    close(fd);
+    return buf;
+}
+#endif
+
+static char *read_file_recode(ASS_Library *library, char *fname,
+                              char *codepage, size_t *size, bool *mapped)
+{
+    char *buf = NULL;
+    size_t bufsize;
+
+    *mapped = false;
+#ifdef HAVE_SYS_MMAN_H
+    buf = map_file(fname, &bufsize);
+    if (buf) {
+        ass_msg(library, MSGL_V, "File size: %zu", bufsize);
+        *mapped = true;
+    }
+#endif
+    if (!buf)
+        buf = read_file(library, fname, &bufsize);
+    if (!buf)
+        return 0;
+#ifdef CONFIG_ICONV
+    if (codepage) {
+        char *tmpbuf = sub_recode(library, buf, bufsize, codepage);
+        free_text_buffer(buf, bufsize, *mapped);
+        *mapped = false;
+        buf = tmpbuf;
+        if (!buf)
+            return 0;
+        bufsize = strlen(buf);
+    }
+#endif
+    *size = bufsize;
+    return buf;
+}
+
+static ASS_Track *new_track(ASS_Library *library)
+{
+    ASS_Track *track = calloc(1, sizeof(ASS_Track));
+    if (!track)
+        return NULL;
+    track->library = library;
+    track->ScaledBorderAndShadow = 0;
+    track->parser_priv = calloc(1, sizeof(ASS_ParserPriv));
+    if (!track->parser_priv) {
+        free(track);
+        return NULL;
+    }
+    track->parser_priv->check_readorder = 1;
+    track->parser_priv->trace_id = ass_trace_new_id(library->trace);
+    return track;
+}
+
 /*
- * \param buf pointer to subtitle text in utf-8
+ * \param buf pointer to subtitle text in utf-8, zero-terminated,
+ *            ownership is transferred
+ * \param bufsize size of buf without the terminating zero
+ * \param mapped whether buf is a file mapping from map_file()
  */
-static ASS_Track *parse_memory(ASS_Library *library, char *buf)
+static ASS_Track *parse_memory(ASS_Library *library, char *buf,
+                               size_t bufsize, bool mapped)
 {
     ASS_Track *track;
     int i;
 
-    track = ass_new_track(library);
+    track = new_track(library);
+    if (!track) {
+        free_text_buffer(buf, bufsize, mapped);
+        return 0;
+    }
+    // recorded after recoding, so that replays need no codepage
+    ASS_TRACE(library, TRACE_READ_MEMORY, track->parser_priv->trace_id,
+              buf, bufsize);
+
+    // in zero-copy mode the track keeps the buffer and parsed strings
+    // point into it, otherwise they are duplicated
+    if (library->zero_copy) {
+        track->parser_priv->text = buf;
+        track->parser_priv->text_size = bufsize + 1;
+        track->parser_priv->text_mapped = mapped;
+    }
 
     // process header
+    track->parser_priv->batch_events = library->parse_threads > 1;
     process_text(track, buf);
+    flush_event_batch(track);
+    track->parser_priv->batch_events = false;
+
+    if (!library->zero_copy)
+        free_text_buffer(buf, bufsize, mapped);
 
     // external SSA/ASS subs does not have ReadOrder field
     for (i = 0; i < track->n_events; ++i)
@@ -1331,6 +2085,7 @@ ASS_Track *ass_read_memory(ASS_Library *library, char *buf,
             return 0;
         else
             copied = 1;
+        bufsize = strlen(buf);
     }
 #endif
     if (!copied) {
@@ -1341,8 +2096,7 @@ ASS_Track *ass_read_memory(ASS_Library *library, char *buf,
         newbuf[bufsize] = '\0';
         buf = newbuf;
     }
-    track = parse_memory(library, buf);
-    free(buf);
+    track = parse_memory(library, buf, bufsize, false);
     if (!track)
         return 0;
 
@@ -1352,28 +2106,6 @@ ASS_Track *ass_read_memory(ASS_Library *library, char *buf,
     return track;
 }
 
-static char *read_file_recode(ASS_Library *library, char *fname,
-                              char *codepage, size_t *size)
-{
-    char *buf;
-    size_t bufsize;
-
-    buf = read_file(library, fname, &bufsize);
-    if (!buf)
-        return 0;
-#ifdef CONFIG_ICONV
-    if (codepage) {
-        char *tmpbuf = sub_recode(library, buf, bufsize, codepage);
-        free(buf);
-        buf = tmpbuf;
-    }
-    if (!buf)
-        return 0;
-#endif
-    *size = bufsize;
-    return buf;
-}
-
 /**
  * \brief Read subtitles from file.
  * \param library libass library object
@@ -1387,12 +2119,12 @@ ASS_Track *ass_read_file(ASS_Library *library, char *fname,
     char *buf;
     ASS_Track *track;
     size_t bufsize;
+    bool mapped;
 
-    buf = read_file_recode(library, fname, codepage, &bufsize);
+    buf = read_file_recode(library, fname, codepage, &bufsize, &mapped);
     if (!buf)
         return 0;
-    track = parse_memory(library, buf);
-    free(buf);
+    track = parse_memory(library, buf, bufsize, mapped);
     if (!track)
         return 0;
 
@@ -1489,22 +2221,21 @@ long long ass_step_sub(ASS_Track *track, long long now, int movement)
 
 ASS_Track *ass_new_track(ASS_Library *library)
 {
-    ASS_Track *track = calloc(1, sizeof(ASS_Track));
-    if (!track)
-        return NULL;
-    track->library = library;
-    track->ScaledBorderAndShadow = 0;
-    track->parser_priv = calloc(1, sizeof(ASS_ParserPriv));
-    if (!track->parser_priv) {
-        free(track);
-        return NULL;
-    }
-    track->parser_priv->check_readorder = 1;
+    ASS_Track *track = new_track(library);
+    if (track)
+        ASS_TRACE(library, TRACE_NEW_TRACK, track->parser_priv->trace_id);
     return track;
 }
 
+int ass_track_trace_id(ASS_Track *track)
+{
+    return track->parser_priv->trace_id;
+}
+
 int ass_track_set_feature(ASS_Track *track, ASS_Feature feature, int enable)
 {
+    ASS_TRACE(track->library, TRACE_TRACK_SET_FEATURE,
+              track->parser_priv->trace_id, (int) feature, enable);
     switch (feature) {
     case ASS_FEATURE_INCOMPATIBLE_EXTENSIONS:
         track->parser_priv->enable_extensions = !!enable;
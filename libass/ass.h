@@ -59,6 +59,55 @@ typedef struct ass_image {
     // New fields can be added here in new ABI-compatible library releases.
 } ASS_Image;
 
+/*
+ * Rectangle of the video frame (see ass_get_dirty_rects).
+ */
+typedef struct ass_dirty_rect {
+    int x, y, w, h;
+} ASS_DirtyRect;
+
+/*
+ * A frame or a part of it composited into a single bitmap
+ * (see ass_render_frame_rgba).
+ */
+typedef struct ass_image_rgba {
+    int w, h;                   // Bitmap width/height
+    int stride;                 // Bitmap stride in bytes
+    unsigned char *buffer;      // 4 bytes per pixel in R, G, B, A order,
+                                // colors premultiplied by alpha
+    int dst_x, dst_y;           // Bitmap placement inside the video frame
+} ASS_ImageRGBA;
+
+/*
+ * Location of a bitmap in the atlas, see ass_render_frame_atlas().
+ */
+typedef struct ass_atlas_region {
+    int page;                   // atlas page, -1 if the bitmap didn't fit
+    int x, y;                   // top left corner in the page
+    int w, h;                   // bitmap size
+} ASS_AtlasRegion;
+
+typedef struct ass_atlas_quad {
+    const ASS_Image *image;     // image with its color and placement
+    ASS_AtlasRegion region;     // where its bitmap is in the atlas
+} ASS_AtlasQuad;
+
+/*
+ * A frame placed in the atlas. Pages are square, 8-bit alpha textures
+ * kept by the caller; the number of pages only grows.
+ */
+typedef struct ass_atlas_frame {
+    int page_size;              // width and height of a page
+    int n_pages;                // pages used so far
+    int n_quads;
+    const ASS_AtlasQuad *quads;     // all images of the frame, in order
+    int n_uploads;
+    const ASS_AtlasQuad *uploads;   // images whose bitmap has to be copied
+                                    // into its region before drawing
+    int n_evicted;
+    const ASS_AtlasRegion *evicted; // regions given up since the last frame
+} ASS_AtlasFrame;
+
 /*
  * Hinting type. (see ass_set_hinting below)
  *
@@ -93,6 +142,72 @@ typedef enum {
     ASS_SHAPING_COMPLEX
 } ASS_ShapingLevel;
 
+/**
+ * \brief Gaussian blur quality.
+ *
+ * ACCURATE renders the full extent of the blur.
+ * FAST drops the faint outer tail of large blurs (\blur above a few pixels
+ * after scaling), where the result is at most one level above zero. This
+ * makes the output bitmaps and the work spent on them noticeably smaller.
+ *
+ * ACCURATE is the default.
+ */
+typedef enum {
+    ASS_BLUR_ACCURATE = 0,
+    ASS_BLUR_FAST
+} ASS_BlurQuality;
+
+/**
+ * \brief Renderer statistics (see ass_get_render_stat).
+ *
+ * Times are in nanoseconds and only measured while enabled with
+ * ass_set_render_stats(). Events rendered by worker threads add their
+ * times too, so stage times can exceed the wall-clock frame time.
+ * Work done by ass_prefetch() is counted with the next frame.
+ */
+typedef enum {
+    ASS_STAT_FRAMES = 0,        // rendered frames
+    ASS_STAT_EVENTS,            // events in the rendered frames
+    ASS_STAT_TIME_FRAME,        // whole ass_render_frame() calls
+    ASS_STAT_TIME_PARSE,        // parsing of event text and override tags
+    ASS_STAT_TIME_SHAPE,        // text shaping
+    ASS_STAT_TIME_OUTLINE,      // glyph and drawing outline lookup
+    ASS_STAT_TIME_BITMAP,       // outline transformation, stroking, rasterization
+    ASS_STAT_TIME_COMPOSITE,    // combining, blurring and shadows, bitmaps excluded
+    ASS_STAT_TIME_COLLISIONS,   // collision handling
+    ASS_STAT_ALLOC_BYTES,       // bytes of new bitmap, composite, shadow and event cache entries
+    ASS_STAT_DEGRADED           // events rendered at reduced quality, see ass_set_frame_budget()
+} ASS_RenderStat;
+
+/**
+ * \brief Renderer caches (see ass_get_cache_stats).
+ */
+typedef enum {
+    ASS_CACHE_FONT = 0,
+    ASS_CACHE_OUTLINE,
+    ASS_CACHE_BITMAP,
+    ASS_CACHE_COMPOSITE,
+    ASS_CACHE_SHADOW,
+    ASS_CACHE_EVENT,
+    ASS_CACHE_TAGS,             // compiled override tag blocks
+    ASS_CACHE_SHAPED_RUN        // only with HarfBuzz
+} ASS_CacheType;
+
+/*
+ * Counters of a cache, since it was created or last emptied.
+ */
+typedef struct ass_cache_stats {
+    uint64_t hits;              // lookups that found an entry
+    uint64_t misses;            // lookups that created an entry
+    uint64_t evictions;         // entries dropped to stay within the limit
+    uint64_t items;             // current number of entries
+    uint64_t size;              // current size, in bytes for the bitmap,
+                                // composite, shadow and event caches and
+                                // in entries for the others
+    uint64_t memory;            // current memory use in bytes, as counted
+                                // by ass_set_cache_budget()
+} ASS_CacheStats;
+
 /**
  * \brief Style override options. See
  * ass_set_selective_style_override_enabled() for details.
@@ -199,6 +314,23 @@ typedef enum {
     ASS_FONTPROVIDER_DIRECTWRITE,
 } ASS_DefaultFontProvider;
 
+/**
+ * \brief How ass_set_fonts() builds the font database, see
+ * ass_set_font_init_mode()
+ *
+ * SYNC scan the fonts directory and set up the default font provider
+ * before ass_set_fonts() returns
+ * ASYNC_WAIT do it on a separate thread; the first frame rendered for a
+ * track with events waits until it's done
+ * ASYNC_EMBEDDED do it on a separate thread; frames are rendered with the
+ * memory fonts of the library only until it's done
+ */
+typedef enum {
+    ASS_FONT_INIT_SYNC = 0,
+    ASS_FONT_INIT_ASYNC_WAIT,
+    ASS_FONT_INIT_ASYNC_EMBEDDED,
+} ASS_FontInitMode;
+
 typedef enum {
     /**
      * Enable libass extensions that would display ASS subtitles incorrectly.
@@ -235,6 +367,18 @@ void ass_library_done(ASS_Library *priv);
  */
 void ass_set_fonts_dir(ASS_Library *priv, const char *fonts_dir);
 
+/**
+ * \brief Set a cache file for the metadata of the fonts directory.
+ * Names, attributes and glyph coverage of the fonts are stored there, and
+ * font files whose size and modification time didn't change are not
+ * opened again when the fonts are set up. The file is created or updated
+ * as needed. It is only used for the fonts directory.
+ *
+ * \param priv library handle
+ * \param cache_file path of the cache file, NULL to disable (default)
+ */
+void ass_set_fonts_dir_cache(ASS_Library *priv, const char *cache_file);
+
 /**
  * \brief Whether fonts should be extracted from track data.
  * \param priv library handle
@@ -242,6 +386,47 @@ void ass_set_fonts_dir(ASS_Library *priv, const char *fonts_dir);
  */
 void ass_set_extract_fonts(ASS_Library *priv, int extract);
 
+/**
+ * \brief Keep the text of files read by ass_read_file() and ass_read_memory()
+ * instead of copying every parsed string.
+ * The Text, Name and Effect fields of events and the Name and FontName fields
+ * of styles then point into a buffer owned by the track. Such strings must not
+ * be freed or reallocated by the application; ass_free_event(),
+ * ass_free_style() and ass_free_track() handle them. Where memory mapping is
+ * available, ass_read_file() maps the file, which must then not be truncated
+ * while the track exists. Off by default.
+ * \param priv library handle
+ * \param enable whether to enable zero-copy parsing
+ */
+void ass_set_zero_copy(ASS_Library *priv, int enable);
+
+/**
+ * \brief Set the number of threads used to parse events of large files.
+ * ass_read_file() and ass_read_memory() then parse runs of Dialogue lines
+ * in parallel. The resulting track is the same as with a single thread.
+ * The message callback may be called from these threads.
+ * \param priv library handle
+ * \param threads total number of threads; 0 or 1 (the default) parses on
+ * the calling thread only
+ */
+void ass_set_parse_threads(ASS_Library *priv, int threads);
+
+/**
+ * \brief Record the API calls made on a library to a trace file.
+ * Calls on renderers and tracks created after this are logged with their
+ * arguments and times, including the subtitle data and fonts passed to
+ * ass_read_file(), ass_read_memory(), ass_process_data(),
+ * ass_process_chunk() and ass_add_font(), so the trace can be replayed
+ * by the profile tool. Direct changes to track structures,
+ * ass_read_styles(), ass_set_selective_style_override() and shared caches
+ * are not recorded. Tracing must not be started or stopped while other
+ * threads use the library.
+ * \param priv library handle
+ * \param path trace file to create, NULL to stop recording
+ * \return 0 on success, -1 if the file cannot be created
+ */
+int ass_set_trace_file(ASS_Library *priv, const char *path);
+
 /**
  * \brief Register style overrides with a library instance.
  * The overrides should have the form [Style.]Param=Value, e.g.
@@ -405,6 +590,39 @@ void ass_set_font_scale(ASS_Renderer *priv, double font_scale);
  */
 void ass_set_hinting(ASS_Renderer *priv, ASS_Hinting ht);
 
+/**
+ * \brief Set gaussian blur quality.
+ * \param priv renderer handle
+ * \param quality blur quality, see ASS_BlurQuality
+ */
+void ass_set_blur_quality(ASS_Renderer *priv, ASS_BlurQuality quality);
+
+/**
+ * \brief Round glyph rotation and shear to a step.
+ * Every glyph is turned to the nearest multiple of the step around its
+ * own center, positions stay exact. Smooth rotation and shear animations
+ * then reuse glyph bitmaps between frames instead of rasterizing every
+ * frame anew. Steps up to about 0.25 degrees are hardly visible at usual
+ * glyph sizes.
+ * \param priv renderer handle
+ * \param step rounding step in degrees, 0 to disable (default);
+ * shear factors are rounded to the same step in radians
+ */
+void ass_set_rotation_step(ASS_Renderer *priv, double step);
+
+/**
+ * \brief Render moving events by shifting cached images.
+ * Events whose only animation is a \move or a Banner effect are rendered
+ * once, and the images are shifted by whole pixels for every frame. Events
+ * that differ only in \move arguments share their images, so overlays of
+ * many scrolling comments only render each distinct text once. Moving
+ * events then lose subpixel positioning, and ones with \t, \fad, karaoke,
+ * \org or \clip are rendered normally.
+ * \param priv renderer handle
+ * \param enable 1 to enable, 0 to disable (default)
+ */
+void ass_set_motion_cache(ASS_Renderer *priv, int enable);
+
 /**
  * \brief Set line spacing. Will not be scaled with frame size.
  * \param priv renderer handle
@@ -455,6 +673,30 @@ void ass_set_fonts(ASS_Renderer *priv, const char *default_font,
                    const char *default_family, int dfp,
                    const char *config, int update);
 
+/**
+ * \brief Set how the next ass_set_fonts() calls build the font database.
+ * With an asynchronous mode, the fonts directory is scanned and the default
+ * font provider is set up on a separate thread, so a slow fontconfig cache
+ * update doesn't block the caller. The message callback of the library may
+ * be called from that thread. Memory fonts are added when the loaded fonts
+ * are put to use, so fonts added to the library meanwhile are included.
+ * Renderers using a shared cache and builds without thread support always
+ * load fonts synchronously.
+ * \param priv renderer handle
+ * \param mode one of ASS_FontInitMode, ASS_FONT_INIT_SYNC by default
+ */
+void ass_set_font_init_mode(ASS_Renderer *priv, int mode);
+
+/**
+ * \brief Check whether fonts loaded in the background are ready. Once they
+ * are, the next rendered frame uses them. When switching away from the
+ * memory fonts of ASS_FONT_INIT_ASYNC_EMBEDDED, that frame is reported as
+ * changed and renders from scratch.
+ * \param priv renderer handle
+ * \return 1 if no fonts are being loaded, 0 otherwise
+ */
+int ass_fonts_ready(ASS_Renderer *priv);
+
 /**
  * \brief Set selective style override mode.
  * If enabled, the renderer attempts to override the ASS script's styling of
@@ -501,6 +743,68 @@ int ass_fonts_update(ASS_Renderer *priv);
 void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
                           int bitmap_max_size);
 
+/**
+ * \brief Set a single memory budget for the caches of a renderer.
+ * While set, it replaces the limits of ass_set_cache_limits() for the font,
+ * outline, bitmap, composite, shadow, event and override tag caches, which
+ * share it as needed. Entries that were cheap to build for their size are
+ * evicted before expensive ones, like blurred borders and shadows. The
+ * caches are trimmed at once and whenever they outgrow the budget, also in
+ * the middle of a frame. Unlike other functions, this can be called from
+ * any thread at any time, e.g. from a memory pressure handler.
+ * Fonts count against the budget but are never evicted by it, they are only
+ * dropped by ass_set_fonts(). Font, outline and override tag caches shared
+ * with ass_set_shared_cache() are not counted, they keep their own limit.
+ * \param priv renderer handle
+ * \param max_bytes budget in bytes, 0 to go back to per-cache limits
+ */
+void ass_set_cache_budget(ASS_Renderer *priv, size_t max_bytes);
+
+/**
+ * \brief Set the number of threads used to render a frame.
+ * Events displayed at the same time are rendered in parallel by a pool of
+ * worker threads owned by the renderer, the calling thread takes part as
+ * well. Collision handling and image list assembly are unaffected, so the
+ * output is the same as with a single thread. The renderer itself must
+ * still not be used from several threads at once.
+ * \param priv renderer handle
+ * \param threads total number of threads; 0 or 1 (the default) renders on
+ * the calling thread only
+ */
+void ass_set_threads(ASS_Renderer *priv, int threads);
+
+/**
+ * \brief Create a font, glyph outline and override tag cache that can be
+ * shared by several renderers of the same library, so that fonts are opened,
+ * outlines are built and override tags are parsed only once. Font
+ * configuration is shared as well: the first ass_set_fonts() call on any
+ * attached renderer sets up the fonts for all of them, later calls only
+ * affect per-renderer state.
+ * \param library library handle
+ * \param glyph_max maximum number of cached outlines and override blocks,
+ * 0 for the default
+ * \return shared cache handle or NULL if failed
+ */
+ASS_SharedCache *ass_shared_cache_new(ASS_Library *library, int glyph_max);
+
+/**
+ * \brief Release a shared cache. It stays alive until all renderers using
+ * it are detached or destroyed.
+ * \param cache shared cache handle, can be NULL
+ */
+void ass_shared_cache_done(ASS_SharedCache *cache);
+
+/**
+ * \brief Make a renderer use a shared font, outline and override tag cache
+ * instead of its own. Renderers sharing a cache may be used from different
+ * threads. Caches built so far by the renderer are discarded.
+ * \param priv renderer handle
+ * \param cache shared cache handle, or NULL to switch back to private caches
+ * \return 0 on success, -1 on error (e.g. the cache belongs to a different
+ * library)
+ */
+int ass_set_shared_cache(ASS_Renderer *priv, ASS_SharedCache *cache);
+
 /**
  * \brief Render a frame, producing a list of ASS_Image.
  * \param priv renderer handle
@@ -512,6 +816,242 @@ void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
 ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
                             long long now, int *detect_change);
 
+/**
+ * \brief Prepare the rendering of events that will appear soon.
+ * Events starting in the given time range are rendered as they look when
+ * they appear and thrown away, so that ass_render_frame() later finds
+ * their outlines, bitmaps and composites in the caches. Uses the threads
+ * set with ass_set_threads(). Meant to be called between frames while the
+ * player is idle; like other renderer functions, it must not be called
+ * concurrently with ass_render_frame() on the same renderer.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param start start of the time range (ms)
+ * \param end end of the time range (ms), exclusive
+ */
+void ass_prefetch(ASS_Renderer *priv, ASS_Track *track,
+                  long long start, long long end);
+
+/**
+ * \brief Get the parts of the video frame that changed with the last
+ * ass_render_frame() call, made with detect_change set. These are the
+ * union of bounding boxes of the images that were added, removed, moved
+ * or recolored, merged into a few rectangles that don't overlap.
+ * \param priv renderer handle
+ * \param rects output, owned by the renderer and valid until the next
+ * ass_render_frame() call
+ * \return number of rectangles, 0 if nothing changed
+ */
+int ass_get_dirty_rects(ASS_Renderer *priv, const ASS_DirtyRect **rects);
+
+/**
+ * \brief Composite an image list into a premultiplied RGBA buffer.
+ * The images are drawn over the existing contents in list order, clipped
+ * to the given rectangle of the video frame.
+ * \param priv renderer handle
+ * \param img image list, e.g. returned by ass_render_frame()
+ * \param buffer w * h pixels in R, G, B, A order, premultiplied
+ * \param stride buffer stride in bytes
+ * \param x, y, w, h rectangle of the video frame covered by the buffer
+ */
+void ass_blend_images(ASS_Renderer *priv, const ASS_Image *img,
+                      unsigned char *buffer, int stride,
+                      int x, int y, int w, int h);
+
+/**
+ * \brief Render a frame composited into a single RGBA bitmap.
+ * Same as ass_render_frame(), but the images are blended by libass into
+ * one bitmap covering their bounding box. The result is owned by the
+ * renderer and valid until the next call of ass_render_frame_rgba() or
+ * ass_render_frame().
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param detect_change same as for ass_render_frame()
+ * \return the bitmap, or NULL if there is nothing to display or on error
+ */
+const ASS_ImageRGBA *ass_render_frame_rgba(ASS_Renderer *priv,
+                                           ASS_Track *track, long long now,
+                                           int *detect_change);
+
+/**
+ * \brief Render the changed parts of a frame as RGBA bitmaps.
+ * Same as ass_render_frame_rgba(), but there is one bitmap for each
+ * rectangle reported by ass_get_dirty_rects(), covering all of it. Drawing
+ * them over the previous frame, replacing its pixels, gives the new frame;
+ * the frame before the first one is transparent. After a failure the
+ * whole video frame is reported as one transparent bitmap.
+ * The results are owned by the renderer and valid until the next call of
+ * ass_render_frame_rgba_rects() or any ass_render_frame() variant.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param rects output array of bitmaps
+ * \return number of bitmaps, 0 if nothing changed, -1 on error
+ */
+int ass_render_frame_rgba_rects(ASS_Renderer *priv, ASS_Track *track,
+                                long long now, const ASS_ImageRGBA **rects);
+
+/**
+ * \brief Render a frame into an array of images.
+ * Same as ass_render_frame(), but the images are copied in list order
+ * into a contiguous array provided by the caller. The next pointers of
+ * the copies link the array entries, so it can also be used as a list.
+ * Bitmaps are owned by the renderer and valid until the next call of
+ * ass_render_frame() or any of its variants.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param detect_change same as for ass_render_frame()
+ * \param images output array
+ * \param max_images size of the array
+ * \return number of images in the frame, only the first max_images of
+ * them are stored if that is larger. Calling again with the same time
+ * and a big enough array reuses the rendered frame.
+ */
+int ass_render_frame_array(ASS_Renderer *priv, ASS_Track *track,
+                           long long now, int *detect_change,
+                           ASS_Image *images, int max_images);
+
+/**
+ * \brief Callback receiving the frames of ass_render_frames().
+ * \param data user data given to ass_render_frames()
+ * \param frame index of the timestamp
+ * \param renderer index of the renderer
+ * \param img image list, valid until the callback returns
+ * \param detect_change compared to the previous frame of the same
+ * renderer, see ass_render_frame()
+ * \return 0 to continue, anything else to stop the batch
+ */
+typedef int (*ASS_FrameCallback)(void *data, int frame, int renderer,
+                                 ASS_Image *img, int detect_change);
+
+/**
+ * \brief Render a track at several timestamps, with several renderers.
+ * Gives the same images as calling ass_render_frame() for each timestamp
+ * and renderer in turn. A renderer renders a number of timestamps in a row
+ * before the next one takes over, so that it keeps its cached events, and
+ * the frames rendered so far are delivered while the next ones are being
+ * rendered on another thread. The callback is called on the calling thread
+ * in timestamp order, and for each timestamp in renderer order.
+ * The renderers and the track must not be used otherwise until the
+ * function returns, including from the callback. The message callback may
+ * be called from a different thread. Renderers attached to the same
+ * ass_set_shared_cache() parse each override block and load each glyph
+ * only once for all of them. Layouts are not shared between renderers.
+ * \param renderers renderers, e.g. set up for different frame sizes
+ * \param n_renderers number of renderers
+ * \param track subtitle track
+ * \param times video timestamps in milliseconds
+ * \param n_times number of timestamps
+ * \param callback function receiving the frames
+ * \param data user data for the callback
+ * \return number of timestamps whose frames were all delivered, or -1 on
+ * allocation failure
+ */
+int ass_render_frames(ASS_Renderer **renderers, int n_renderers,
+                      ASS_Track *track, const long long *times, int n_times,
+                      ASS_FrameCallback callback, void *data);
+
+/**
+ * \brief Set up the texture atlas used by ass_render_frame_atlas().
+ * Bitmaps are packed into pages of the given size. A bitmap keeps its
+ * region for as long as it is used, and for some frames after that, so
+ * only new bitmaps have to be uploaded. Calling this again discards the
+ * atlas and all of its regions.
+ * \param priv renderer handle
+ * \param page_size width and height of a page in pixels, 0 disables the
+ * atlas
+ * \param max_pages maximum number of pages; once they are full, the least
+ * recently used regions are given up for new bitmaps
+ * \return 0 on success, -1 on error
+ */
+int ass_set_atlas(ASS_Renderer *priv, int page_size, int max_pages);
+
+/**
+ * \brief Render a frame placed in the texture atlas.
+ * Same as ass_render_frame(), but every image is also assigned a region in
+ * the atlas set up with ass_set_atlas(). Images sharing a bitmap share the
+ * region, and a bitmap listed in uploads keeps its region in later frames
+ * until it is listed in evicted. Images too big for a page, or for the
+ * room left by the rest of the frame, get page -1 and have to be drawn
+ * from their own bitmap. The result is owned by the
+ * renderer and valid until the next call of ass_render_frame() or any of
+ * its variants.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param detect_change same as for ass_render_frame()
+ * \return the frame, or NULL if the atlas isn't set up or on error
+ */
+const ASS_AtlasFrame *ass_render_frame_atlas(ASS_Renderer *priv,
+                                             ASS_Track *track, long long now,
+                                             int *detect_change);
+
+/**
+ * \brief Set a time budget for rendering a frame.
+ * Once ass_render_frame() has used most of the budget, the events that
+ * are left get cheaper versions of expensive effects unless their full
+ * quality images are already cached: \blur uses ASS_BLUR_FAST, large \be
+ * values get half the passes, thick borders are stroked less accurately
+ * and glyphs are rasterized together with their borders. Frames rendered
+ * at full quality never reuse such images, so the events look right again
+ * as soon as a frame has time for them.
+ * The events affected are counted by ASS_STAT_DEGRADED.
+ * \param priv renderer handle
+ * \param budget_us budget in microseconds, 0 to always render at full
+ * quality (default)
+ */
+void ass_set_frame_budget(ASS_Renderer *priv, int budget_us);
+
+/**
+ * \brief Get the events of the last ass_render_frame() call that were
+ * rendered at reduced quality to meet the frame budget.
+ * \param priv renderer handle
+ * \param events output, indices into the events of the track, or NULL
+ * \param max_events size of events
+ * \return number of degraded events, which may exceed max_events
+ */
+int ass_get_degraded_events(ASS_Renderer *priv, int *events, int max_events);
+
+/**
+ * \brief Enable timing of the render pipeline stages.
+ * Counters that aren't times are always collected.
+ * \param priv renderer handle
+ * \param enable 1 to measure stage times, 0 to stop (default)
+ */
+void ass_set_render_stats(ASS_Renderer *priv, int enable);
+
+/**
+ * \brief Get a renderer statistic.
+ * \param priv renderer handle
+ * \param stat statistic to get
+ * \param last_frame 1 for the value of the last ass_render_frame() call,
+ * 0 for the total since the renderer was created or the stats were reset
+ * \return the value, or -1 if stat is unknown
+ */
+int64_t ass_get_render_stat(ASS_Renderer *priv, ASS_RenderStat stat,
+                            int last_frame);
+
+/**
+ * \brief Reset all totals of ass_get_render_stat() and the counters of
+ * ass_get_cache_stats() to zero. Cached entries are kept.
+ * \param priv renderer handle
+ */
+void ass_reset_render_stats(ASS_Renderer *priv);
+
+/**
+ * \brief Get the counters of one of the renderer's caches. Font and
+ * outline caches are those of the shared cache if one is set.
+ * \param priv renderer handle
+ * \param cache cache to query
+ * \param stats output
+ * \return 1 on success, 0 if the cache is unknown or not available
+ * in this build (stats are zeroed then)
+ */
+int ass_get_cache_stats(ASS_Renderer *priv, ASS_CacheType cache,
+                        ASS_CacheStats *stats);
+
 
 /*
  * The following functions operate on track objects and do not need
@@ -586,6 +1126,32 @@ void ass_free_event(ASS_Track *track, int eid);
  */
 void ass_process_data(ASS_Track *track, char *data, int size);
 
+/**
+ * \brief Parse a subtitle file incrementally, one chunk at a time.
+ * Chunks can be of any size and lines may be split between them; the
+ * incomplete last line is kept until more data arrives. Parsed styles and
+ * events are added to the track right away, so rendering can start before
+ * the whole file is read. The track must not be rendered or otherwise used
+ * while this function runs, so calls from another thread need to be
+ * serialized with rendering by the application.
+ * Style overrides are applied as soon as the [Events] section is reached
+ * and again by ass_process_stream_end().
+ * \param track track, usually created by ass_new_track()
+ * \param data chunk of the file in UTF-8
+ * \param size length of data
+ * \return 1 if [Script Info] and styles are done because the [Events]
+ *         section was reached, 0 otherwise
+ */
+int ass_process_stream(ASS_Track *track, const char *data, size_t size);
+
+/**
+ * \brief Finish parsing started by ass_process_stream().
+ * Parses the remaining incomplete line, decodes the last embedded font
+ * and applies style overrides.
+ * \param track track
+ */
+void ass_process_stream_end(ASS_Track *track);
+
 /**
  * \brief Parse Codec Private section of the subtitle stream, in Matroska
  * format.  See the Matroska specification for details.
@@ -629,6 +1195,19 @@ void ass_set_check_readorder(ASS_Track *track, int check_readorder);
 */
 void ass_flush_events(ASS_Track *track);
 
+/**
+ * \brief Free events automatically once they are old enough, to bound the
+ * memory of tracks fed by ass_process_chunk() for an indefinite time.
+ * When a frame is rendered, events that ended more than retention ms before
+ * its time are freed, in batches. Their ReadOrder IDs are forgotten as
+ * well, so that packets sent again after seeking back are accepted.
+ * Rendering an earlier time afterwards doesn't bring freed events back.
+ * Like other functions manipulating the event list, this renumbers events.
+ * \param track track
+ * \param retention time to keep ended events (ms), 0 to keep all (default)
+ */
+void ass_set_event_retention(ASS_Track *track, long long retention);
+
 /**
  * \brief Read subtitles from file.
  * \param library library handle
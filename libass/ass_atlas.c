@@ -0,0 +1,711 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_utils.h"
+#include "ass_cache.h"
+#include "ass_render.h"
+#include "ass_atlas.h"
+
+#define ATLAS_PADDING 1      // empty pixels right of and below every region
+#define ATLAS_SHELF_STEP 8   // shelf heights are rounded up to this
+#define ATLAS_MAX_AGE 64     // frames a region is kept without being used
+
+/*
+ * Pages are split into horizontal shelves, each holding regions of
+ * similar height side by side. A shelf lists its free horizontal spans.
+ * Shelves stack from the bottom of the page without gaps. A shelf whose
+ * regions were all freed merges with empty neighbours, is given back if
+ * it is at the top of the page and otherwise can be cut to another height.
+ */
+
+typedef struct {
+    int x, w;
+} AtlasSpan;
+
+typedef struct {
+    int page, y, h;             // h is 0 for unused slots
+    int n_spans, max_spans;
+    AtlasSpan *spans;           // free parts, sorted by x
+    int n_regions;
+} AtlasShelf;
+
+typedef struct {
+    int top;                    // height taken by shelves
+} AtlasPage;
+
+typedef struct {
+    const unsigned char *bitmap;    // NULL for unused entries
+    int w, h, stride;
+    void *source;               // cache value owning the bitmap, if any
+    ASS_AtlasRegion region;
+    int shelf;
+    unsigned last_used;         // frame number
+} AtlasEntry;
+
+typedef struct {
+    unsigned last_used;
+    int id;
+} EvictCandidate;
+
+typedef struct {
+    int page, y, id;
+} ShelfPos;
+
+typedef struct {
+    int shelf, x, w;
+} KeptSpan;
+
+enum {
+    SHELF_KEPT   = 1,           // has regions used in the current frame
+    SHELF_USEFUL = 2,           // evicting from it can make room
+};
+
+struct atlas {
+    ASS_Library *library;
+    int page_size, max_pages;
+    unsigned frame;
+
+    int n_pages;
+    AtlasPage *pages;
+    int n_shelves, max_shelves;
+    AtlasShelf *shelves;
+    uint8_t *shelf_flags;       // scratch for eviction, see mark_useful_shelves()
+    ShelfPos *shelf_pos;
+
+    int n_entries, max_entries;
+    AtlasEntry *entries;
+    int n_free, *free_ids;      // unused entry slots
+    int n_transient, max_transient;
+    int *transient;             // entries of images without a cached source
+
+    // open addressing table of entry id + 1, 0 for empty slots
+    uint32_t *table;
+    size_t table_size, n_used;
+
+    // output of the current frame
+    ASS_AtlasFrame frame_info;
+    int max_quads, max_uploads, max_evicted;
+    ASS_AtlasQuad *quads, *uploads;
+    ASS_AtlasRegion *evicted;
+    EvictCandidate *candidates; // scratch for eviction order
+    KeptSpan *kept;
+};
+
+Atlas *ass_atlas_create(ASS_Library *library, int page_size, int max_pages)
+{
+    Atlas *atlas = calloc(1, sizeof(*atlas));
+    if (!atlas)
+        return NULL;
+    atlas->library = library;
+    atlas->page_size = page_size;
+    atlas->max_pages = max_pages;
+    atlas->frame_info.page_size = page_size;
+    return atlas;
+}
+
+void ass_atlas_free(Atlas *atlas)
+{
+    if (!atlas)
+        return;
+    for (int i = 0; i < atlas->n_entries; i++)
+        if (atlas->entries[i].bitmap)
+            ass_cache_dec_ref(atlas->entries[i].source);
+    for (int i = 0; i < atlas->n_shelves; i++)
+        free(atlas->shelves[i].spans);
+    free(atlas->pages);
+    free(atlas->shelves);
+    free(atlas->shelf_flags);
+    free(atlas->shelf_pos);
+    free(atlas->entries);
+    free(atlas->free_ids);
+    free(atlas->transient);
+    free(atlas->table);
+    free(atlas->quads);
+    free(atlas->uploads);
+    free(atlas->evicted);
+    free(atlas->candidates);
+    free(atlas->kept);
+    free(atlas);
+}
+
+static inline size_t entry_hash(const unsigned char *bitmap, int w, int h)
+{
+    uint64_t v = (uintptr_t) bitmap ^ ((uint64_t) w << 32) ^ (uint64_t) h << 48;
+    return (v * UINT64_C(0x9E3779B97F4A7C15)) >> 32;
+}
+
+static size_t find_slot(Atlas *atlas, const unsigned char *bitmap,
+                        int w, int h, int stride)
+{
+    size_t mask = atlas->table_size - 1;
+    size_t i = entry_hash(bitmap, w, h) & mask;
+    while (atlas->table[i]) {
+        AtlasEntry *e = &atlas->entries[atlas->table[i] - 1];
+        if (e->bitmap == bitmap && e->w == w && e->h == h && e->stride == stride)
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static bool table_grow(Atlas *atlas)
+{
+    size_t size = atlas->table_size ? 2 * atlas->table_size : 256;
+    uint32_t *table = calloc(size, sizeof(uint32_t));
+    if (!table)
+        return false;
+    uint32_t *old = atlas->table;
+    size_t old_size = atlas->table_size;
+    atlas->table = table;
+    atlas->table_size = size;
+    for (size_t i = 0; i < old_size; i++) {
+        if (!old[i])
+            continue;
+        AtlasEntry *e = &atlas->entries[old[i] - 1];
+        table[find_slot(atlas, e->bitmap, e->w, e->h, e->stride)] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+// backward shift deletion keeps probe chains intact without tombstones
+static void table_remove(Atlas *atlas, size_t i)
+{
+    size_t mask = atlas->table_size - 1;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!atlas->table[j])
+            break;
+        AtlasEntry *e = &atlas->entries[atlas->table[j] - 1];
+        size_t k = entry_hash(e->bitmap, e->w, e->h) & mask;
+        // move entry j into the hole if its home slot isn't in (i, j]
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        atlas->table[i] = atlas->table[j];
+        i = j;
+    }
+    atlas->table[i] = 0;
+    atlas->n_used--;
+}
+
+static bool span_insert(AtlasShelf *shelf, int pos, AtlasSpan span)
+{
+    if (shelf->n_spans == shelf->max_spans) {
+        int max = FFMAX(2 * shelf->max_spans, 4);
+        if (!ASS_REALLOC_ARRAY(shelf->spans, max))
+            return false;
+        shelf->max_spans = max;
+    }
+    memmove(shelf->spans + pos + 1, shelf->spans + pos,
+            (shelf->n_spans - pos) * sizeof(AtlasSpan));
+    shelf->spans[pos] = span;
+    shelf->n_spans++;
+    return true;
+}
+
+// Merge an emptied shelf with its empty neighbours, give it back
+// if it ends up at the top of its page
+static void release_shelf(Atlas *atlas, int id)
+{
+    AtlasShelf *shelf = &atlas->shelves[id];
+    // this also recovers space lost to failed span_insert()
+    shelf->spans[0] = (AtlasSpan) { 0, atlas->page_size };
+    shelf->n_spans = 1;
+
+    // empty shelves are always merged, so there is at most one on each side
+    for (int i = 0; i < atlas->n_shelves; i++) {
+        AtlasShelf *other = &atlas->shelves[i];
+        if (i == id || !other->h || other->n_regions || other->page != shelf->page)
+            continue;
+        if (other->y + other->h == shelf->y) {
+            shelf->y = other->y;
+            shelf->h += other->h;
+            other->h = 0;
+        } else if (shelf->y + shelf->h == other->y) {
+            shelf->h += other->h;
+            other->h = 0;
+        }
+    }
+
+    AtlasPage *page = &atlas->pages[shelf->page];
+    if (shelf->y + shelf->h == page->top) {
+        page->top = shelf->y;
+        shelf->h = 0;
+    }
+}
+
+static void free_region(Atlas *atlas, int shelf_id, ASS_AtlasRegion *r)
+{
+    AtlasShelf *shelf = &atlas->shelves[shelf_id];
+    AtlasSpan span = { r->x, r->w + ATLAS_PADDING };
+
+    int pos = 0;
+    while (pos < shelf->n_spans && shelf->spans[pos].x < span.x)
+        pos++;
+    bool merge_prev = pos > 0 &&
+        shelf->spans[pos - 1].x + shelf->spans[pos - 1].w == span.x;
+    bool merge_next = pos < shelf->n_spans &&
+        span.x + span.w == shelf->spans[pos].x;
+    if (merge_prev && merge_next) {
+        shelf->spans[pos - 1].w += span.w + shelf->spans[pos].w;
+        memmove(shelf->spans + pos, shelf->spans + pos + 1,
+                (shelf->n_spans - pos - 1) * sizeof(AtlasSpan));
+        shelf->n_spans--;
+    } else if (merge_prev) {
+        shelf->spans[pos - 1].w += span.w;
+    } else if (merge_next) {
+        shelf->spans[pos].x = span.x;
+        shelf->spans[pos].w += span.w;
+    } else {
+        // on failure, the space is lost until the shelf is emptied
+        span_insert(shelf, pos, span);
+    }
+    if (!--shelf->n_regions)
+        release_shelf(atlas, shelf_id);
+}
+
+static bool take_span(AtlasShelf *shelf, int w, ASS_AtlasRegion *r)
+{
+    for (int i = 0; i < shelf->n_spans; i++) {
+        AtlasSpan *span = &shelf->spans[i];
+        if (span->w < w)
+            continue;
+        r->page = shelf->page;
+        r->x = span->x;
+        r->y = shelf->y;
+        span->x += w;
+        span->w -= w;
+        if (!span->w) {
+            memmove(span, span + 1,
+                    (shelf->n_spans - i - 1) * sizeof(AtlasSpan));
+            shelf->n_spans--;
+        }
+        shelf->n_regions++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * \brief Set up an empty shelf at the given place
+ * \return shelf id, or -1 on allocation failure
+ */
+static int add_shelf(Atlas *atlas, int page, int y, int h)
+{
+    int id = 0;
+    while (id < atlas->n_shelves && atlas->shelves[id].h)
+        id++;
+    if (id == atlas->max_shelves) {
+        int max = FFMAX(2 * atlas->max_shelves, 16);
+        if (!ASS_REALLOC_ARRAY(atlas->shelves, max) ||
+                !ASS_REALLOC_ARRAY(atlas->shelf_flags, max) ||
+                !ASS_REALLOC_ARRAY(atlas->shelf_pos, max))
+            return -1;
+        atlas->max_shelves = max;
+    }
+    if (id == atlas->n_shelves)
+        atlas->shelves[atlas->n_shelves++] = (AtlasShelf) {0};
+
+    AtlasShelf *shelf = &atlas->shelves[id];
+    shelf->n_spans = 0;
+    AtlasSpan all = { 0, atlas->page_size };
+    if (!span_insert(shelf, 0, all))
+        return -1;
+    shelf->page = page;
+    shelf->y = y;
+    shelf->h = h;
+    shelf->n_regions = 0;
+    return id;
+}
+
+static int new_shelf(Atlas *atlas, int page, int h)
+{
+    int id = add_shelf(atlas, page, atlas->pages[page].top, h);
+    if (id >= 0)
+        atlas->pages[page].top += h;
+    return id;
+}
+
+// Cut an empty shelf down to h, the rest of it stays an empty shelf
+static void split_shelf(Atlas *atlas, int id, int h)
+{
+    AtlasShelf *shelf = &atlas->shelves[id];
+    if (shelf->h == h)
+        return;
+    int page = shelf->page, y = shelf->y + h, rest = shelf->h - h;
+    // on failure, the whole shelf is used
+    if (add_shelf(atlas, page, y, rest) >= 0)
+        atlas->shelves[id].h = h;
+}
+
+/**
+ * \brief Find space for a w x h bitmap
+ * \return shelf id, or -1 if there is no room
+ */
+static int alloc_region(Atlas *atlas, int w, int h, ASS_AtlasRegion *r)
+{
+    int aw = w + ATLAS_PADDING;
+    int ah = ass_align(ATLAS_SHELF_STEP, h + ATLAS_PADDING);
+    if (aw > atlas->page_size || ah > atlas->page_size)
+        return -1;
+
+    // existing shelves that don't waste more than a quarter of their height,
+    // else the smallest empty one that is high enough
+    int empty = -1;
+    for (int i = 0; i < atlas->n_shelves; i++) {
+        AtlasShelf *shelf = &atlas->shelves[i];
+        if (shelf->h < ah)
+            continue;
+        if (!shelf->n_regions) {
+            if (empty < 0 || shelf->h < atlas->shelves[empty].h)
+                empty = i;
+            continue;
+        }
+        if (shelf->h - ah > shelf->h / 4)
+            continue;
+        if (take_span(shelf, aw, r))
+            return i;
+    }
+    if (empty >= 0) {
+        split_shelf(atlas, empty, ah);
+        if (take_span(&atlas->shelves[empty], aw, r))
+            return empty;
+    }
+
+    int page = 0;
+    while (page < atlas->n_pages &&
+            atlas->pages[page].top + ah > atlas->page_size)
+        page++;
+    if (page == atlas->n_pages) {
+        if (atlas->n_pages >= atlas->max_pages ||
+                !ASS_REALLOC_ARRAY(atlas->pages, atlas->n_pages + 1))
+            return -1;
+        atlas->pages[atlas->n_pages++] = (AtlasPage) {0};
+    }
+    int id = new_shelf(atlas, page, ah);
+    if (id < 0 || !take_span(&atlas->shelves[id], aw, r))
+        return -1;
+    return id;
+}
+
+static bool add_evicted(Atlas *atlas, const ASS_AtlasRegion *r)
+{
+    ASS_AtlasFrame *info = &atlas->frame_info;
+    if (info->n_evicted == atlas->max_evicted) {
+        int max = FFMAX(2 * atlas->max_evicted, 64);
+        if (!ASS_REALLOC_ARRAY(atlas->evicted, max))
+            return false;
+        atlas->max_evicted = max;
+    }
+    atlas->evicted[info->n_evicted++] = *r;
+    return true;
+}
+
+static void evict_entry(Atlas *atlas, int id)
+{
+    AtlasEntry *e = &atlas->entries[id];
+    if (e->source)
+        table_remove(atlas, find_slot(atlas, e->bitmap, e->w, e->h, e->stride));
+    free_region(atlas, e->shelf, &e->region);
+    add_evicted(atlas, &e->region);
+    ass_cache_dec_ref(e->source);
+    e->bitmap = NULL;
+    e->source = NULL;
+    // free_ids has room for all entries
+    atlas->free_ids[atlas->n_free++] = id;
+}
+
+static int cmp_last_used(const void *a, const void *b)
+{
+    unsigned ua = ((const EvictCandidate *) a)->last_used;
+    unsigned ub = ((const EvictCandidate *) b)->last_used;
+    return ua < ub ? -1 : ua > ub;
+}
+
+static int cmp_shelf_pos(const void *a, const void *b)
+{
+    const ShelfPos *pa = a, *pb = b;
+    if (pa->page != pb->page)
+        return pa->page < pb->page ? -1 : 1;
+    return pa->y < pb->y ? -1 : pa->y > pb->y;
+}
+
+static int cmp_kept_span(const void *a, const void *b)
+{
+    const KeptSpan *sa = a, *sb = b;
+    if (sa->shelf != sb->shelf)
+        return sa->shelf < sb->shelf ? -1 : 1;
+    return sa->x < sb->x ? -1 : sa->x > sb->x;
+}
+
+/**
+ * \brief Flag the shelves that get room for an aw x ah region
+ * (padded and rounded like in alloc_region()) once all their regions
+ * not used in the current frame are evicted
+ * \return false if there are none
+ */
+static bool mark_useful_shelves(Atlas *atlas, int aw, int ah)
+{
+    if (!atlas->n_shelves)
+        return false;
+    uint8_t *flags = atlas->shelf_flags;
+    memset(flags, 0, atlas->n_shelves);
+    int n_kept = 0;
+    for (int i = 0; i < atlas->n_entries; i++) {
+        AtlasEntry *e = &atlas->entries[i];
+        if (!e->bitmap || e->last_used != atlas->frame)
+            continue;
+        flags[e->shelf] |= SHELF_KEPT;
+        atlas->kept[n_kept++] = (KeptSpan) {
+            e->shelf, e->region.x, e->region.w + ATLAS_PADDING
+        };
+    }
+    bool found = false;
+
+    // runs of shelves without kept regions merge into one empty shelf,
+    // the top one also gets the free space above it
+    int n = 0;
+    for (int i = 0; i < atlas->n_shelves; i++) {
+        AtlasShelf *shelf = &atlas->shelves[i];
+        if (shelf->h)
+            atlas->shelf_pos[n++] = (ShelfPos) { shelf->page, shelf->y, i };
+    }
+    qsort(atlas->shelf_pos, n, sizeof(ShelfPos), cmp_shelf_pos);
+    for (int i = 0; i < n;) {
+        int page = atlas->shelf_pos[i].page;
+        int start = i, run = 0;
+        for (; i < n && atlas->shelf_pos[i].page == page; i++) {
+            int id = atlas->shelf_pos[i].id;
+            if (!(flags[id] & SHELF_KEPT)) {
+                run += atlas->shelves[id].h;
+                continue;
+            }
+            if (run >= ah) {
+                for (int j = start; j < i; j++)
+                    flags[atlas->shelf_pos[j].id] |= SHELF_USEFUL;
+                found = true;
+            }
+            start = i + 1;
+            run = 0;
+        }
+        if (run + atlas->page_size - atlas->pages[page].top >= ah) {
+            for (int j = start; j < i; j++)
+                flags[atlas->shelf_pos[j].id] |= SHELF_USEFUL;
+            found = true;
+        }
+    }
+
+    // gaps between kept regions of shelves that alloc_region() would use
+    qsort(atlas->kept, n_kept, sizeof(KeptSpan), cmp_kept_span);
+    for (int i = 0; i < n_kept;) {
+        int id = atlas->kept[i].shelf;
+        AtlasShelf *shelf = &atlas->shelves[id];
+        bool usable = shelf->h >= ah && shelf->h - ah <= shelf->h / 4;
+        int end = 0, gap = 0;
+        for (; i < n_kept && atlas->kept[i].shelf == id; i++) {
+            gap = FFMAX(gap, atlas->kept[i].x - end);
+            end = atlas->kept[i].x + atlas->kept[i].w;
+        }
+        gap = FFMAX(gap, atlas->page_size - end);
+        if (usable && gap >= aw) {
+            flags[id] |= SHELF_USEFUL;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static int alloc_evicting(Atlas *atlas, int w, int h, ASS_AtlasRegion *r)
+{
+    int shelf = alloc_region(atlas, w, h, r);
+    if (shelf >= 0)
+        return shelf;
+
+    int aw = w + ATLAS_PADDING;
+    int ah = ass_align(ATLAS_SHELF_STEP, h + ATLAS_PADDING);
+    if (aw > atlas->page_size || ah > atlas->page_size ||
+            !mark_useful_shelves(atlas, aw, ah))
+        return -1;
+
+    // give back the regions used least recently, but not in this frame,
+    // and only where that can make room
+    int n = 0;
+    for (int i = 0; i < atlas->n_entries; i++) {
+        AtlasEntry *e = &atlas->entries[i];
+        if (e->bitmap && e->last_used != atlas->frame &&
+                (atlas->shelf_flags[e->shelf] & SHELF_USEFUL))
+            atlas->candidates[n++] = (EvictCandidate) { e->last_used, i };
+    }
+    qsort(atlas->candidates, n, sizeof(EvictCandidate), cmp_last_used);
+    for (int i = 0; i < n; i++) {
+        evict_entry(atlas, atlas->candidates[i].id);
+        shelf = alloc_region(atlas, w, h, r);
+        if (shelf >= 0)
+            return shelf;
+    }
+    return -1;
+}
+
+static int new_entry(Atlas *atlas)
+{
+    if (atlas->n_free)
+        return atlas->free_ids[--atlas->n_free];
+    if (atlas->n_entries == atlas->max_entries) {
+        int max = FFMAX(2 * atlas->max_entries, 256);
+        if (!ASS_REALLOC_ARRAY(atlas->entries, max) ||
+                !ASS_REALLOC_ARRAY(atlas->free_ids, max) ||
+                !ASS_REALLOC_ARRAY(atlas->candidates, max) ||
+                !ASS_REALLOC_ARRAY(atlas->kept, max))
+            return -1;
+        atlas->max_entries = max;
+    }
+    atlas->entries[atlas->n_entries].bitmap = NULL;
+    return atlas->n_entries++;
+}
+
+static bool add_transient(Atlas *atlas, int id)
+{
+    if (atlas->n_transient == atlas->max_transient) {
+        int max = FFMAX(2 * atlas->max_transient, 16);
+        if (!ASS_REALLOC_ARRAY(atlas->transient, max))
+            return false;
+        atlas->max_transient = max;
+    }
+    atlas->transient[atlas->n_transient++] = id;
+    return true;
+}
+
+/**
+ * \brief Get the region of an image, allocating it if it is new
+ * \param upload set if the bitmap has to be copied into the region
+ */
+static bool place_image(Atlas *atlas, ASS_Image *img,
+                        ASS_AtlasRegion *region, bool *upload)
+{
+    void *source = ((ASS_ImagePriv *) img)->source;
+    *upload = false;
+    region->page = -1;
+    region->x = region->y = 0;
+    region->w = img->w;
+    region->h = img->h;
+
+    size_t slot = 0;
+    if (source) {
+        if (2 * (atlas->n_used + 1) > atlas->table_size && !table_grow(atlas))
+            return false;
+        slot = find_slot(atlas, img->bitmap, img->w, img->h, img->stride);
+        if (atlas->table[slot]) {
+            AtlasEntry *e = &atlas->entries[atlas->table[slot] - 1];
+            e->last_used = atlas->frame;
+            *region = e->region;
+            return true;
+        }
+    }
+
+    int id = new_entry(atlas);
+    if (id < 0)
+        return false;
+    AtlasEntry *e = &atlas->entries[id];
+    e->shelf = alloc_evicting(atlas, img->w, img->h, &e->region);
+    if (e->shelf < 0) {
+        // doesn't fit, the image has to be drawn on its own
+        atlas->free_ids[atlas->n_free++] = id;
+        return true;
+    }
+    e->region.w = img->w;
+    e->region.h = img->h;
+    e->bitmap = img->bitmap;
+    e->w = img->w;
+    e->h = img->h;
+    e->stride = img->stride;
+    e->last_used = atlas->frame;
+    e->source = source;
+    if (source) {
+        ass_cache_inc_ref(source);
+        // evictions may have moved table entries
+        slot = find_slot(atlas, img->bitmap, img->w, img->h, img->stride);
+        atlas->table[slot] = id + 1;
+        atlas->n_used++;
+    } else if (!add_transient(atlas, id)) {
+        evict_entry(atlas, id);
+        return false;
+    }
+    *region = e->region;
+    *upload = true;
+    return true;
+}
+
+const ASS_AtlasFrame *ass_atlas_update(Atlas *atlas, ASS_Image *images)
+{
+    ASS_AtlasFrame *info = &atlas->frame_info;
+    atlas->frame++;
+    info->n_quads = info->n_uploads = info->n_evicted = 0;
+
+    // bitmaps without a cached source are freed with their frame
+    for (int i = 0; i < atlas->n_transient; i++)
+        evict_entry(atlas, atlas->transient[i]);
+    atlas->n_transient = 0;
+
+    int n_images = 0;
+    for (ASS_Image *img = images; img; img = img->next)
+        n_images++;
+    if (n_images > atlas->max_quads) {
+        if (!ASS_REALLOC_ARRAY(atlas->quads, n_images) ||
+                !ASS_REALLOC_ARRAY(atlas->uploads, n_images))
+            goto fail;
+        atlas->max_quads = n_images;
+    }
+
+    for (ASS_Image *img = images; img; img = img->next) {
+        if (!img->w || !img->h)
+            continue;
+        ASS_AtlasQuad *quad = &atlas->quads[info->n_quads++];
+        bool upload;
+        quad->image = img;
+        if (!place_image(atlas, img, &quad->region, &upload))
+            goto fail;
+        if (upload)
+            atlas->uploads[info->n_uploads++] = *quad;
+    }
+
+    // stop holding bitmaps that went out of use
+    for (int i = 0; i < atlas->n_entries; i++) {
+        AtlasEntry *e = &atlas->entries[i];
+        if (e->bitmap && atlas->frame - e->last_used > ATLAS_MAX_AGE)
+            evict_entry(atlas, i);
+    }
+
+    info->n_pages = atlas->n_pages;
+    info->quads = atlas->quads;
+    info->uploads = atlas->uploads;
+    info->evicted = atlas->evicted;
+    return info;
+
+fail:
+    ass_msg(atlas->library, MSGL_ERR, "Failed to place images in the atlas");
+    return NULL;
+}
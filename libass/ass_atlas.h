@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_ATLAS_H
+#define LIBASS_ATLAS_H
+
+#include "ass.h"
+
+/*
+ * Placement of frame bitmaps in texture pages kept by the consumer.
+ * Every bitmap gets a region when it first appears and keeps it while it
+ * is used, holding a reference to the cache value that owns it, so the
+ * same bitmap pointer always maps to the same region. Regions of bitmaps
+ * left unused for a while, or needed for new ones, are given back.
+ */
+
+typedef struct atlas Atlas;
+
+Atlas *ass_atlas_create(ASS_Library *library, int page_size, int max_pages);
+void ass_atlas_free(Atlas *atlas);
+
+/**
+ * \brief Find or allocate the regions of a frame's images
+ * \param images image list of the frame, must stay alive until the next
+ * call or ass_atlas_free()
+ * \return frame description owned by the atlas, NULL on allocation failure
+ */
+const ASS_AtlasFrame *ass_atlas_update(Atlas *atlas, ASS_Image *images);
+
+#endif                          /* LIBASS_ATLAS_H */
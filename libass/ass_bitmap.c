@@ -56,25 +56,67 @@
 #undef ALIGN
 #undef DECORATE
 
+#if defined(__x86_64__) && CONFIG_AVX512
+#define ALIGN           6
+#define DECORATE(func)  ass_##func##_avx512
+#include "ass_func_template.h"
+#undef ALIGN
+#undef DECORATE
+#endif
+
 #endif
 
 
-void ass_synth_blur(const BitmapEngine *engine, Bitmap *bm,
-                    int be, double blur_r2)
+/**
+ * \brief Get a bitmap engine supported by this build and CPU
+ * \param name "c", "sse2", "avx2" or "avx512", NULL for the best one
+ * \return the engine, or NULL if the named one isn't available
+ */
+const BitmapEngine *ass_bitmap_engine_init(const char *name)
+{
+    static const struct {
+        const char *name;
+        const BitmapEngine *engine;
+        int (*supported)(void);
+    } engines[] = {
+#if (defined(__i386__) || defined(__x86_64__)) && CONFIG_ASM
+#if defined(__x86_64__) && CONFIG_AVX512
+        { "avx512", &ass_bitmap_engine_avx512, has_avx512bw },
+#endif
+        { "avx2", &ass_bitmap_engine_avx2, has_avx2 },
+        { "sse2", &ass_bitmap_engine_sse2, has_sse2 },
+#endif
+        { "c", &ass_bitmap_engine_c, NULL },
+    };
+
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (name && strcmp(name, engines[i].name))
+            continue;
+        if (!engines[i].supported || engines[i].supported())
+            return engines[i].engine;
+        if (name)
+            break;
+    }
+    return NULL;
+}
+
+void ass_synth_blur(const BitmapEngine *engine, Arena *arena, Bitmap *bm,
+                    int be, double blur_r2, ASS_BlurQuality quality)
 {
     if (!bm->buffer)
         return;
 
     // Apply gaussian blur
     if (blur_r2 > 0.001)
-        ass_gaussian_blur(engine, bm, blur_r2);
+        ass_gaussian_blur(engine, arena, bm, blur_r2, quality);
 
     if (!be)
         return;
 
     // Apply box blur (multiple passes, if requested)
+    ArenaMark mark = ass_arena_mark(arena);
     size_t size = sizeof(uint16_t) * bm->stride * 2;
-    uint16_t *tmp = ass_aligned_alloc(32, size, false);
+    uint16_t *tmp = ass_arena_alloc(arena, size, 32);
     if (!tmp)
         return;
 
@@ -92,7 +134,7 @@ void ass_synth_blur(const BitmapEngine *engine, Bitmap *bm,
     }
     memset(tmp, 0, stride * 2);
     engine->be_blur(buf, w, h, stride, tmp);
-    ass_aligned_free(tmp);
+    ass_arena_release(arena, mark);
 }
 
 bool alloc_bitmap(const BitmapEngine *engine, Bitmap *bm,
@@ -110,21 +152,24 @@ bool alloc_bitmap(const BitmapEngine *engine, Bitmap *bm,
     bm->h = h;
     bm->stride = s;
     bm->buffer = buf;
+    bm->tiles = NULL;
     return true;
 }
 
 bool realloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32_t h)
 {
-    uint8_t *old = bm->buffer;
+    uint8_t *old = bm->buffer, *old_tiles = bm->tiles;
     if (!alloc_bitmap(engine, bm, w, h, false))
         return false;
     ass_aligned_free(old);
+    free(old_tiles);
     return true;
 }
 
 void ass_free_bitmap(Bitmap *bm)
 {
     ass_aligned_free(bm->buffer);
+    free(bm->tiles);
 }
 
 bool copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src)
@@ -137,32 +182,119 @@ bool copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src)
         return false;
     dst->left = src->left;
     dst->top  = src->top;
-    memcpy(dst->buffer, src->buffer, src->stride * src->h);
+    if (dst->stride == src->stride) {
+        memcpy(dst->buffer, src->buffer, src->stride * src->h);
+        return true;
+    }
+    for (int32_t y = 0; y < src->h; y++)
+        memcpy(dst->buffer + y * dst->stride, src->buffer + y * src->stride, src->w);
     return true;
 }
 
-bool outline_to_bitmap(ASS_Renderer *render_priv, Bitmap *bm,
-                       ASS_Outline *outline1, ASS_Outline *outline2)
+static int classify_tile(const uint8_t *buf, ptrdiff_t stride, int w, int h)
+{
+    uint8_t any = 0, all = 255;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            any |= buf[x];
+            all &= buf[x];
+        }
+        buf += stride;
+    }
+    return !any ? TILE_EMPTY : all == 255 ? TILE_SOLID : TILE_MIXED;
+}
+
+/**
+ * \brief Fill tile classes of a freshly rendered bitmap
+ * Leaves bm->tiles NULL on allocation failure, that's not an error.
+ */
+static void classify_tiles(const BitmapEngine *engine, Bitmap *bm)
+{
+    int order = engine->tile_order, size = 1 << order;
+    int32_t n_x = (bm->w + size - 1) >> order;
+    int32_t n_y = (bm->h + size - 1) >> order;
+    bm->tiles = malloc(n_x * n_y);
+    if (!bm->tiles)
+        return;
+
+    uint8_t *tile = bm->tiles;
+    for (int32_t y = 0; y < n_y; y++) {
+        const uint8_t *buf = bm->buffer + ((ptrdiff_t) y << order) * bm->stride;
+        int h = FFMIN(size, bm->h - (y << order));
+        for (int32_t x = 0; x < n_x; x++)
+            *tile++ = classify_tile(buf + (x << order), bm->stride,
+                                    FFMIN(size, bm->w - (x << order)), h);
+    }
+}
+
+void bitmap_content(const BitmapEngine *engine, const Bitmap *bm, Bitmap *view)
+{
+    *view = *bm;
+    view->tiles = NULL;
+    if (!bm->tiles)
+        return;
+
+    int order = engine->tile_order, size = 1 << order;
+    int32_t n_x = (bm->w + size - 1) >> order;
+    int32_t n_y = (bm->h + size - 1) >> order;
+    int32_t start_x = n_x, start_y = n_y, end_x = 0, end_y = 0;
+    const uint8_t *tile = bm->tiles;
+    for (int32_t y = 0; y < n_y; y++)
+        for (int32_t x = 0; x < n_x; x++)
+            if (*tile++ != TILE_EMPTY) {
+                start_x = FFMIN(start_x, x);
+                end_x = FFMAX(end_x, x + 1);
+                start_y = FFMIN(start_y, y);
+                end_y = y + 1;
+            }
+    if (!end_x) {
+        view->w = view->h = 0;
+        return;
+    }
+    // keep the view aligned for engine functions
+    if (engine->align_order > order)
+        start_x &= ~((1 << (engine->align_order - order)) - 1);
+    int32_t x = start_x << order, y = start_y << order;
+    view->buffer += y * bm->stride + x;
+    view->left += x;
+    view->top  += y;
+    view->w = FFMIN(bm->w, (end_x << order) + 1) - x;
+    view->h = FFMIN(bm->h, (end_y << order) + 1) - y;
+}
+
+static bool set_outlines(ASS_Renderer *render_priv, bool second,
+                         ASS_Outline *outline1, ASS_Outline *outline2)
 {
     RasterizerData *rst = &render_priv->rasterizer;
-    if (outline1 && !rasterizer_set_outline(rst, outline1, false)) {
+    bool (*set_outline)(RasterizerData *, const ASS_Outline *, bool) =
+        second ? rasterizer_set_outline2 : rasterizer_set_outline;
+    if (outline1 && !set_outline(rst, outline1, false)) {
         ass_msg(render_priv->library, MSGL_WARN, "Failed to process glyph outline!\n");
         return false;
     }
-    if (outline2 && !rasterizer_set_outline(rst, outline2, !!outline1)) {
+    if (outline2 && !set_outline(rst, outline2, !!outline1)) {
         ass_msg(render_priv->library, MSGL_WARN, "Failed to process glyph outline!\n");
         return false;
     }
-    if (rst->bbox.x_min > rst->bbox.x_max || rst->bbox.y_min > rst->bbox.y_max)
-        return false;
+    return rst->bbox.x_min <= rst->bbox.x_max && rst->bbox.y_min <= rst->bbox.y_max;
+}
 
+/**
+ * \brief Calculate bitmap placement for outline bounds
+ * \param rect out: pixel bounds of the outline
+ * \param tile_w, tile_h out: tile-aligned bitmap size
+ */
+static bool calc_bitmap_rect(ASS_Renderer *render_priv, const ASS_Rect *bbox,
+                             const ASS_Rect *window, ASS_Rect *rect,
+                             int32_t *tile_w, int32_t *tile_h)
+{
     // enlarge by 1/64th of pixel to bypass slow rasterizer path, add 1 pixel for shift_bitmap
-    int32_t x_min = (rst->bbox.x_min -   1) >> 6;
-    int32_t y_min = (rst->bbox.y_min -   1) >> 6;
-    int32_t x_max = (rst->bbox.x_max + 127) >> 6;
-    int32_t y_max = (rst->bbox.y_max + 127) >> 6;
-    int32_t w = x_max - x_min;
-    int32_t h = y_max - y_min;
+    rect->x_min = (bbox->x_min -   1) >> 6;
+    rect->y_min = (bbox->y_min -   1) >> 6;
+    rect->x_max = (bbox->x_max + 127) >> 6;
+    rect->y_max = (bbox->y_max + 127) >> 6;
+    int32_t w = rect->x_max - rect->x_min;
+    int32_t h = rect->y_max - rect->y_min;
 
     int mask = (1 << render_priv->engine->tile_order) - 1;
 
@@ -173,20 +305,120 @@ bool outline_to_bitmap(ASS_Renderer *render_priv, Bitmap *bm,
         return false;
     }
 
-    int32_t tile_w = (w + mask) & ~mask;
-    int32_t tile_h = (h + mask) & ~mask;
+    // Drop whole tiles outside of the window,
+    // the remaining ones stay on the same grid.
+    if (window->x_min > rect->x_min)
+        rect->x_min += FFMIN(window->x_min - rect->x_min, w) & ~mask;
+    if (window->y_min > rect->y_min)
+        rect->y_min += FFMIN(window->y_min - rect->y_min, h) & ~mask;
+    rect->x_max = FFMIN(rect->x_max, window->x_max);
+    rect->y_max = FFMIN(rect->y_max, window->y_max);
+    w = rect->x_max - rect->x_min;
+    h = rect->y_max - rect->y_min;
+    if (w <= 0 || h <= 0)
+        return false;
+
+    *tile_w = (w + mask) & ~mask;
+    *tile_h = (h + mask) & ~mask;
+    return true;
+}
+
+bool outline_to_bitmap(ASS_Renderer *render_priv, Bitmap *bm,
+                       ASS_Outline *outline1, ASS_Outline *outline2,
+                       const ASS_Rect *window)
+{
+    RasterizerData *rst = &render_priv->rasterizer;
+    if (!set_outlines(render_priv, false, outline1, outline2))
+        return false;
+
+    ASS_Rect rect;
+    int32_t tile_w, tile_h;
+    if (!calc_bitmap_rect(render_priv, &rst->bbox, window, &rect, &tile_w, &tile_h))
+        return false;
     if (!alloc_bitmap(render_priv->engine, bm, tile_w, tile_h, false))
         return false;
-    bm->left = x_min;
-    bm->top  = y_min;
+    bm->left = rect.x_min;
+    bm->top  = rect.y_min;
 
-    if (!rasterizer_fill(render_priv->engine, rst, bm->buffer,
-                         x_min, y_min, bm->stride, tile_h, bm->stride)) {
+    if (!ass_rasterize(render_priv, bm->buffer, NULL,
+                       rect.x_min, rect.y_min, bm->stride, tile_h, bm->stride)) {
         ass_msg(render_priv->library, MSGL_WARN, "Failed to rasterize glyph!\n");
         ass_free_bitmap(bm);
         return false;
     }
 
+    classify_tiles(render_priv->engine, bm);
+    return true;
+}
+
+bool outline_to_bitmap2(ASS_Renderer *render_priv,
+                        Bitmap *bm, ASS_Outline *outline1, ASS_Outline *outline2,
+                        Bitmap *bm2, ASS_Outline *outline3, ASS_Outline *outline4,
+                        const ASS_Rect *window)
+{
+    const BitmapEngine *engine = render_priv->engine;
+    RasterizerData *rst = &render_priv->rasterizer;
+    memset(bm2, 0, sizeof(*bm2));
+    if (!set_outlines(render_priv, false, outline1, outline2))
+        return false;
+
+    ASS_Rect rect, rect2;
+    int32_t tile_w, tile_h, tile_w2, tile_h2;
+    if (!calc_bitmap_rect(render_priv, &rst->bbox, window, &rect, &tile_w, &tile_h))
+        return false;
+
+    // The first bitmap gets rasterized in the window of the second one,
+    // that's only possible if it fits there.
+    Bitmap tmp = {0};
+    bool fit = set_outlines(render_priv, true, outline3, outline4) &&
+        calc_bitmap_rect(render_priv, &rst->bbox, window, &rect2, &tile_w2, &tile_h2);
+    if (fit && (rect.x_min < rect2.x_min || rect.y_min < rect2.y_min)) {
+        // tiles can be cut on a different grid, anything left of
+        // or above the visible area can be dropped regardless
+        int mask = (1 << engine->tile_order) - 1;
+        if (rect2.x_min <= window->x_min)
+            rect.x_min = FFMAX(rect.x_min, rect2.x_min);
+        if (rect2.y_min <= window->y_min)
+            rect.y_min = FFMAX(rect.y_min, rect2.y_min);
+        fit = rect.x_max > rect.x_min && rect.y_max > rect.y_min;
+        tile_w = (rect.x_max - rect.x_min + mask) & ~mask;
+        tile_h = (rect.y_max - rect.y_min + mask) & ~mask;
+    }
+    if (!fit || !alloc_bitmap(engine, bm2, tile_w2, tile_h2, false) ||
+            rect.x_min < rect2.x_min || rect.x_max > rect2.x_min + bm2->stride ||
+            rect.y_min < rect2.y_min || rect.y_max > rect2.y_min + tile_h2 ||
+            !alloc_bitmap(engine, &tmp, tile_w2, tile_h2, false)) {
+        ass_free_bitmap(bm2);
+        memset(bm2, 0, sizeof(*bm2));
+        return outline_to_bitmap(render_priv, bm, outline1, outline2, window);
+    }
+    bm2->left = rect2.x_min;
+    bm2->top  = rect2.y_min;
+
+    if (!ass_rasterize(render_priv, tmp.buffer, bm2->buffer,
+                       rect2.x_min, rect2.y_min, bm2->stride, tile_h2, bm2->stride) ||
+            !alloc_bitmap(engine, bm, tile_w, tile_h, true)) {
+        ass_msg(render_priv->library, MSGL_WARN, "Failed to rasterize glyph!\n");
+        ass_free_bitmap(&tmp);
+        ass_free_bitmap(bm2);
+        memset(bm2, 0, sizeof(*bm2));
+        return false;
+    }
+    bm->left = rect.x_min;
+    bm->top  = rect.y_min;
+
+    // everything outside of rect is empty
+    const uint8_t *src = tmp.buffer + (rect.y_min - rect2.y_min) * tmp.stride
+                                    + (rect.x_min - rect2.x_min);
+    uint8_t *dst = bm->buffer;
+    for (int32_t y = rect.y_min; y < rect.y_max; y++) {
+        memcpy(dst, src, rect.x_max - rect.x_min);
+        src += tmp.stride;
+        dst += bm->stride;
+    }
+    ass_free_bitmap(&tmp);
+    classify_tiles(engine, bm);
+    classify_tiles(engine, bm2);
     return true;
 }
 
@@ -415,6 +647,42 @@ void ass_sub_bitmaps_c(uint8_t *dst, intptr_t dst_stride,
     }
 }
 
+// x / 255 rounded to nearest, exact for x <= 255 * 255
+static inline unsigned div255(unsigned x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/**
+ * \brief Composite an alpha bitmap onto premultiplied RGBA
+ * \param color RGBA color as in ASS_Image, the lowest byte is transparency
+ * Pixels are 4 bytes in R, G, B, A order, the source is drawn
+ * over the destination. Pure C implementation.
+ */
+void ass_blend_rgba_c(uint8_t *dst, ptrdiff_t dst_stride,
+                      const uint8_t *src, ptrdiff_t src_stride,
+                      uintptr_t width, uintptr_t height, uint32_t color)
+{
+    unsigned r = color >> 24;
+    unsigned g = (color >> 16) & 0xFF;
+    unsigned b = (color >> 8) & 0xFF;
+    unsigned opacity = 255 - (color & 0xFF);
+    for (uintptr_t y = 0; y < height; y++) {
+        for (uintptr_t x = 0; x < width; x++) {
+            unsigned k = div255(src[x] * opacity);
+            unsigned ik = 255 - k;
+            uint8_t *p = dst + 4 * x;
+            p[0] = div255(r * k + p[0] * ik);
+            p[1] = div255(g * k + p[1] * ik);
+            p[2] = div255(b * k + p[2] * ik);
+            p[3] = k + div255(p[3] * ik);
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
 void ass_mul_bitmaps_c(uint8_t *dst, intptr_t dst_stride,
                        uint8_t *src1, intptr_t src1_stride,
                        uint8_t *src2, intptr_t src2_stride,
@@ -46,6 +46,12 @@ typedef void (*BitmapMulFunc)(uint8_t *dst, intptr_t dst_stride,
 typedef void (*BeBlurFunc)(uint8_t *buf, intptr_t w, intptr_t h,
                            intptr_t stride, uint16_t *tmp);
 
+// composite an alpha bitmap of a single color onto premultiplied RGBA
+typedef void (*BlendRGBAFunc)(uint8_t *dst, ptrdiff_t dst_stride,
+                              const uint8_t *src, ptrdiff_t src_stride,
+                              uintptr_t width, uintptr_t height,
+                              uint32_t color);
+
 // intermediate bitmaps represented as sets of verical stripes of int16_t[alignment / 2]
 typedef void (*Convert8to16Func)(int16_t *dst, const uint8_t *src, ptrdiff_t src_stride,
                                  uintptr_t width, uintptr_t height);
@@ -75,6 +81,9 @@ typedef struct {
     // be blur function
     BeBlurFunc be_blur;
 
+    // output composition function
+    BlendRGBAFunc blend_rgba;
+
     // gaussian blur functions
     Convert8to16Func stripe_unpack;
     Convert16to8Func stripe_pack;
@@ -82,18 +91,35 @@ typedef struct {
     FilterFunc expand_horz, expand_vert;
     FilterFunc pre_blur_horz[3], pre_blur_vert[3];
     ParamFilterFunc main_blur_horz[3], main_blur_vert[3];
+
+    // outline transform functions
+    TransformAffineFunc transform_affine;
+    TransformPerspectiveFunc transform_perspective;
 } BitmapEngine;
 
 extern const BitmapEngine ass_bitmap_engine_c;
 extern const BitmapEngine ass_bitmap_engine_sse2;
 extern const BitmapEngine ass_bitmap_engine_avx2;
+extern const BitmapEngine ass_bitmap_engine_avx512;
+
+const BitmapEngine *ass_bitmap_engine_init(const char *name);
+
 
+// Tile classes, see Bitmap.tiles
+enum {
+    TILE_EMPTY,  // all pixels are 0
+    TILE_SOLID,  // all pixels are 255
+    TILE_MIXED,
+};
 
 typedef struct {
     int32_t left, top;
     int32_t w, h;         // width, height
     ptrdiff_t stride;
     uint8_t *buffer;      // h * stride buffer
+    // Class of every engine tile, row by row, or NULL if unknown.
+    // Only set for rasterized bitmaps and dropped on reallocation.
+    uint8_t *tiles;
 } Bitmap;
 
 bool alloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32_t h, bool zero);
@@ -101,18 +127,51 @@ bool realloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32_t h
 bool copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src);
 void ass_free_bitmap(Bitmap *bm);
 
+/**
+ * \brief Get the part of the bitmap that can have nonzero pixels
+ * \param view out: shares the buffer with bm, mustn't be freed
+ * Leading empty tiles get cut off as far as the buffer stays aligned,
+ * trailing ones except for 1 pixel of margin required by shift_bitmap().
+ * Without tile classes the view is the whole bitmap.
+ */
+void bitmap_content(const BitmapEngine *engine, const Bitmap *bm, Bitmap *view);
+
+/**
+ * \brief Render outlines into a bitmap
+ * \param window visible area, only whole tiles intersecting it get rasterized
+ * \return false on error or if nothing is visible
+ */
 bool outline_to_bitmap(ASS_Renderer *render_priv, Bitmap *bm,
-                       ASS_Outline *outline1, ASS_Outline *outline2);
+                       ASS_Outline *outline1, ASS_Outline *outline2,
+                       const ASS_Rect *window);
+/**
+ * \brief Render two bitmaps in a single rasterizer pass
+ * \param bm, outline1, outline2 first bitmap and its outlines
+ * \param bm2, outline3, outline4 second bitmap and its outlines
+ * \param window visible area of both bitmaps
+ * \return false on error
+ * The first bitmap gets the same placement as from outline_to_bitmap(),
+ * but is rasterized in the window of the second one, so pixel values can
+ * slightly differ. If it doesn't fit there, the first bitmap is rendered
+ * on its own and bm2 is left empty.
+ */
+bool outline_to_bitmap2(ASS_Renderer *render_priv,
+                        Bitmap *bm, ASS_Outline *outline1, ASS_Outline *outline2,
+                        Bitmap *bm2, ASS_Outline *outline3, ASS_Outline *outline4,
+                        const ASS_Rect *window);
 
-void ass_synth_blur(const BitmapEngine *engine, Bitmap *bm,
-                    int be, double blur_r2);
+void ass_synth_blur(const BitmapEngine *engine, Arena *arena, Bitmap *bm,
+                    int be, double blur_r2, ASS_BlurQuality quality);
 
 int be_padding(int be);
 void be_blur_pre(uint8_t *buf, intptr_t w,
                  intptr_t h, intptr_t stride);
 void be_blur_post(uint8_t *buf, intptr_t w,
                   intptr_t h, intptr_t stride);
-bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2);
+int ass_blur_padding(double r2);
+int ass_blur_alignment(double r2);
+bool ass_gaussian_blur(const BitmapEngine *engine, Arena *arena, Bitmap *bm,
+                       double r2, ASS_BlurQuality quality);
 void shift_bitmap(Bitmap *bm, int shift_x, int shift_y);
 void fix_outline(Bitmap *bm_g, Bitmap *bm_o);
 
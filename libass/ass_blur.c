@@ -40,6 +40,12 @@
  * combined with one of optional prefilters with fixed kernels. Kernel coefficients
  * of the main filter are obtained from solution of least squares problem
  * for Fourier transform of resulting kernel.
+ *
+ * Most of the work is done on the full resolution by the last upscaling steps,
+ * so its cost depends mainly on the output size, which grows with the radius.
+ * For ASS_BLUR_FAST the downscaled image is cropped before upscaling
+ * to about 3 sigma around the source, dropping the tail where the result
+ * is below one 8-bit step anyway.
  */
 
 
@@ -835,15 +841,74 @@ static void find_best_method(BlurMethod *blur, double r2)
         blur->coeff[i - 1] = (int) (0x10000 * mu[i] + 0.5);
 }
 
+/**
+ * \brief Cut off the margin of an image in internal format
+ * \param order log2 of stripe width
+ * \param crop_x, crop_y margin removed from left/right and top/bottom sides
+ */
+static void crop_stripes(int16_t *dst, const int16_t *src, int order,
+                         uintptr_t width, uintptr_t height,
+                         uintptr_t crop_x, uintptr_t crop_y)
+{
+    uintptr_t stripe_width = (uintptr_t) 1 << order;
+    uintptr_t mask = stripe_width - 1;
+    uintptr_t size = ((width + mask) & ~mask) * height;
+    uintptr_t dst_width = width - 2 * crop_x;
+    uintptr_t dst_height = height - 2 * crop_y;
+
+    for (uintptr_t x = 0; x < dst_width; x += stripe_width) {
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            for (uintptr_t k = 0; k < stripe_width; ++k) {
+                uintptr_t sx = x + k + crop_x;
+                uintptr_t offs = ((sx & ~mask) * height) +
+                    ((y + crop_y) << order) + (sx & mask);
+                *dst++ = offs < size ? src[offs] : 0;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Calculate how far gaussian blur spreads pixels on each side
+ */
+int ass_blur_padding(double r2)
+{
+    BlurMethod blur;
+    find_best_method(&blur, r2);
+    // left side grows by ((prefilter + filter + 8) << level) - 4,
+    // right side can get up to one more downscaled pixel
+    return (blur.prefilter + blur.filter + 9) << blur.level;
+}
+
+/**
+ * \brief Get the step of the downscaled grid of gaussian blur
+ * Input shifted by multiples of it gives exactly the shifted result.
+ */
+int ass_blur_alignment(double r2)
+{
+    BlurMethod blur;
+    find_best_method(&blur, r2);
+    return 1 << blur.level;
+}
+
 /**
  * \brief Perform approximate gaussian blur
  * \param r2 in: desired standard deviation squared
+ * \param quality in: whether the faint outer tail can be dropped
  */
-bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2)
+bool ass_gaussian_blur(const BitmapEngine *engine, Arena *arena, Bitmap *bm,
+                       double r2, ASS_BlurQuality quality)
 {
     BlurMethod blur;
     find_best_method(&blur, r2);
 
+    // margin cut off on every side of the downscaled image
+    int crop = 0;
+    if (quality == ASS_BLUR_FAST && blur.level >= 2) {
+        int margin = ((blur.prefilter + blur.filter + 8) << blur.level) - 4;
+        crop = FFMAX(0, margin - (int) ceil(3 * sqrt(r2))) >> blur.level;
+    }
+
     int w = bm->w, h = bm->h;
     int offset = ((2 * (blur.prefilter + blur.filter) + 17) << blur.level) - 5;
     int end_w = ((w + offset) & ~((1 << blur.level) - 1)) - 4;
@@ -857,7 +922,8 @@ bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2)
     if (end_h >= INT_MAX / 8 / aligned_end_w)
         return false;
     int size = end_h * aligned_end_w;
-    int16_t *tmp = ass_aligned_alloc(2 * stripe_width, 4 * size, false);
+    ArenaMark mark = ass_arena_mark(arena);
+    int16_t *tmp = ass_arena_alloc(arena, 4 * size, 2 * stripe_width);
     if (!tmp)
         return false;
 
@@ -883,6 +949,11 @@ bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2)
     engine->main_blur_horz[blur.filter](buf[index ^ 1], buf[index], w, h, blur.coeff);
     w += 2 * blur.filter + 8;
     index ^= 1;
+    if (crop) {
+        crop_stripes(buf[index ^ 1], buf[index], engine->align_order - 1, w, h, crop, 0);
+        w -= 2 * crop;
+        index ^= 1;
+    }
     for (int i = 0; i < blur.level; ++i) {
         engine->expand_horz(buf[index ^ 1], buf[index], w, h);
         w = 2 * w + 4;
@@ -896,23 +967,29 @@ bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2)
     engine->main_blur_vert[blur.filter](buf[index ^ 1], buf[index], w, h, blur.coeff);
     h += 2 * blur.filter + 8;
     index ^= 1;
+    if (crop) {
+        crop_stripes(buf[index ^ 1], buf[index], engine->align_order - 1, w, h, 0, crop);
+        h -= 2 * crop;
+        index ^= 1;
+    }
     for (int i = 0; i < blur.level; ++i) {
         engine->expand_vert(buf[index ^ 1], buf[index], w, h);
         h = 2 * h + 4;
         index ^= 1;
     }
-    assert(w == end_w && h == end_h);
+    int cut = crop << (blur.level + 1);
+    assert(w == end_w - cut && h == end_h - cut);
 
     if (!realloc_bitmap(engine, bm, w, h)) {
-        ass_aligned_free(tmp);
+        ass_arena_release(arena, mark);
         return false;
     }
-    offset = ((blur.prefilter + blur.filter + 8) << blur.level) - 4;
+    offset = ((blur.prefilter + blur.filter + 8 - crop) << blur.level) - 4;
     bm->left -= offset;
     bm->top  -= offset;
 
     engine->stripe_pack(bm->buffer, bm->stride, buf[index], w, h);
-    ass_aligned_free(tmp);
+    ass_arena_release(arena, mark);
     return true;
 }
 
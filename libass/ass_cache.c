@@ -24,6 +24,9 @@
 #include <ft2build.h>
 #include FT_OUTLINE_H
 #include <assert.h>
+#ifdef CONFIG_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "ass_utils.h"
 #include "ass_font.h"
@@ -78,6 +81,13 @@ static void font_destruct(void *key, void *value)
     ass_font_clear(value);
 }
 
+// face data is owned by FreeType and the font provider
+static size_t font_memory(void *key, void *value)
+{
+    ASS_FontDesc *k = key;
+    return k->family ? strlen(k->family) + 1 : 0;
+}
+
 size_t ass_font_construct(void *key, void *value, void *priv);
 
 const CacheDesc font_cache_desc = {
@@ -86,6 +96,7 @@ const CacheDesc font_cache_desc = {
     .key_move_func = font_key_move,
     .construct_func = ass_font_construct,
     .destruct_func = font_destruct,
+    .memory_func = font_memory,
     .key_size = sizeof(ASS_FontDesc),
     .value_size = sizeof(ASS_Font)
 };
@@ -95,10 +106,12 @@ const CacheDesc font_cache_desc = {
 static bool bitmap_key_move(void *dst, void *src)
 {
     BitmapHashKey *k = src;
-    if (dst)
+    if (dst) {
         memcpy(dst, src, sizeof(BitmapHashKey));
-    else
+    } else {
         ass_cache_dec_ref(k->outline);
+        ass_cache_dec_ref(k->border);
+    }
     return true;
 }
 
@@ -107,6 +120,7 @@ static void bitmap_destruct(void *key, void *value)
     BitmapHashKey *k = key;
     ass_free_bitmap(value);
     ass_cache_dec_ref(k->outline);
+    ass_cache_dec_ref(k->border);
 }
 
 size_t ass_bitmap_construct(void *key, void *value, void *priv);
@@ -148,17 +162,21 @@ static bool composite_compare(void *a, void *b)
 
 static bool composite_key_move(void *dst, void *src)
 {
+    CompositeHashKey *d = dst, *k = src;
     if (dst) {
+        // the bitmap list of a lookup key is scratch memory of the caller
         memcpy(dst, src, sizeof(CompositeHashKey));
-        return true;
+        d->bitmaps = ass_realloc_array(NULL, k->bitmap_count, sizeof(BitmapRef));
+        if (d->bitmaps) {
+            memcpy(d->bitmaps, k->bitmaps, k->bitmap_count * sizeof(BitmapRef));
+            return true;
+        }
     }
-    CompositeHashKey *k = src;
     for (size_t i = 0; i < k->bitmap_count; i++) {
         ass_cache_dec_ref(k->bitmaps[i].bm);
         ass_cache_dec_ref(k->bitmaps[i].bm_o);
     }
-    free(k->bitmaps);
-    return true;
+    return !dst;
 }
 
 static void composite_destruct(void *key, void *value)
@@ -188,6 +206,68 @@ const CacheDesc composite_cache_desc = {
 };
 
 
+// shadow cache
+static bool shadow_key_move(void *dst, void *src)
+{
+    if (dst)
+        memcpy(dst, src, sizeof(ShadowHashKey));
+    return true;
+}
+
+static void shadow_destruct(void *key, void *value)
+{
+    ass_free_bitmap(value);
+}
+
+size_t ass_shadow_construct(void *key, void *value, void *priv);
+
+const CacheDesc shadow_cache_desc = {
+    .hash_func = shadow_hash,
+    .compare_func = shadow_compare,
+    .key_move_func = shadow_key_move,
+    .construct_func = ass_shadow_construct,
+    .destruct_func = shadow_destruct,
+    .key_size = sizeof(ShadowHashKey),
+    .value_size = sizeof(Bitmap)
+};
+
+
+// event cache
+static bool event_key_move(void *dst, void *src)
+{
+    if (!dst)
+        return true;
+    EventHashKey *d = dst, *s = src;
+    memcpy(d, s, sizeof(EventHashKey));
+    d->text = strdup(s->text);
+    return d->text;
+}
+
+void ass_frame_unref(ASS_Image *img);
+void ass_event_layout_free(struct event_layout *layout);
+
+static void event_destruct(void *key, void *value)
+{
+    EventHashKey *k = key;
+    EventHashValue *v = value;
+    ass_frame_unref(v->imgs);
+    ass_event_layout_free(v->layout);
+    free(k->text);
+}
+
+size_t ass_event_construct(void *key, void *value, void *priv);
+
+const CacheDesc event_cache_desc = {
+    .hash_func = event_hash,
+    .compare_func = event_compare,
+    .key_move_func = event_key_move,
+    .construct_func = ass_event_construct,
+    .destruct_func = event_destruct,
+    .key_size = sizeof(EventHashKey),
+    .value_size = sizeof(EventHashValue)
+};
+
+
 // outline cache
 static uint32_t outline_hash(void *key, uint32_t hval)
 {
@@ -244,8 +324,8 @@ static void outline_destruct(void *key, void *value)
 {
     OutlineHashValue *v = value;
     OutlineHashKey *k = key;
-    outline_free(&v->outline[0]);
-    outline_free(&v->outline[1]);
+    outline_free_packed(&v->outline[0]);
+    outline_free_packed(&v->outline[1]);
     switch (k->type) {
     case OUTLINE_GLYPH:
         ass_cache_dec_ref(k->u.glyph.font);
@@ -261,6 +341,18 @@ static void outline_destruct(void *key, void *value)
     }
 }
 
+static size_t outline_memory(void *key, void *value)
+{
+    OutlineHashValue *v = value;
+    OutlineHashKey *k = key;
+    size_t size = 0;
+    for (int i = 0; i < 2; i++)
+        size += outline_packed_size(&v->outline[i]);
+    if (k->type == OUTLINE_DRAWING)
+        size += strlen(k->u.drawing.text) + 1;
+    return size;
+}
+
 size_t ass_outline_construct(void *key, void *value, void *priv);
 
 const CacheDesc outline_cache_desc = {
@@ -269,6 +361,7 @@ const CacheDesc outline_cache_desc = {
     .key_move_func = outline_key_move,
     .construct_func = ass_outline_construct,
     .destruct_func = outline_destruct,
+    .memory_func = outline_memory,
     .key_size = sizeof(OutlineHashKey),
     .value_size = sizeof(OutlineHashValue)
 };
@@ -291,6 +384,11 @@ static void glyph_metrics_destruct(void *key, void *value)
     ass_cache_dec_ref(k->font);
 }
 
+static size_t glyph_metrics_memory(void *key, void *value)
+{
+    return 0;
+}
+
 size_t ass_glyph_metrics_construct(void *key, void *value, void *priv);
 
 const CacheDesc glyph_metrics_cache_desc = {
@@ -299,6 +397,7 @@ const CacheDesc glyph_metrics_cache_desc = {
     .key_move_func = glyph_metrics_key_move,
     .construct_func = ass_glyph_metrics_construct,
     .destruct_func = glyph_metrics_destruct,
+    .memory_func = glyph_metrics_memory,
     .key_size = sizeof(GlyphMetricsHashKey),
     .value_size = sizeof(FT_Glyph_Metrics)
 };
@@ -306,25 +405,83 @@ const CacheDesc glyph_metrics_cache_desc = {
 
 
 // Cache data
+typedef struct cache_shard CacheShard;
+
 typedef struct cache_item {
-    Cache *cache;
+    CacheShard *shard;
     const CacheDesc *desc;
-    struct cache_item *next, **prev;
+    struct cache_item *next;    // only used to collect items to destroy
     struct cache_item *queue_next, **queue_prev;
-    size_t size, ref_count;
+    size_t size;        // zero while the value is being constructed
+    size_t bytes;       // memory used, including bookkeeping
+    size_t ref_count;   // accessed atomically
+    uint32_t hash;
+    uint8_t cost;       // eviction credits, from the construction time
+    uint8_t credit;     // credits left until the next use
 } CacheItem;
 
-struct cache {
-    unsigned buckets;
-    CacheItem **map;
+// Hash table slot, the stored hash rejects most mismatched keys
+// without calling compare_func
+typedef struct {
+    uint32_t hash;
+    CacheItem *item;    // NULL for free slots
+} CacheSlot;
+
+// Items are striped over shards by hash, each shard with its own lock,
+// LRU queue and open addressing table with linear probing.
+// A shard lock protects its table, queue and statistics, and is never
+// held while running type-specific functions other than key comparison
+// and key moving.
+struct cache_shard {
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_t lock;
+    pthread_cond_t constructed;  // signaled when a pending item is done
+#endif
+    CacheSlot *slots;
+    unsigned mask;      // number of slots minus one
     CacheItem *queue_first, **queue_last;
 
-    const CacheDesc *desc;
-
     size_t cache_size;
-    unsigned hits;
-    unsigned misses;
+    size_t cache_bytes;
+    CacheBudget *budget;    // same for all shards of a cache
     unsigned items;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t total_size;    // size of all items constructed so far
+};
+
+#define CACHE_SHARD_BITS 4
+#define CACHE_SHARDS (1 << CACHE_SHARD_BITS)
+#define CACHE_MIN_SLOTS 16
+
+struct cache {
+    CacheShard shards[CACHE_SHARDS];
+
+    const CacheDesc *desc;
+};
+
+#define CACHE_BUDGET_MAX_CACHES 16
+#define CACHE_MAX_CREDIT 7
+
+// Memory limit shared by several caches. Items are evicted by a sweep
+// over the LRU queues of all its caches, which is a CLOCK variant:
+// items spend credits to survive a pass of the sweep, and get them back
+// on use. Credits grow with the time per byte spent constructing an item,
+// so that cheap items are evicted before expensive ones of the same size.
+struct cache_budget {
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_t lock;   // protects the cache list and the sweep
+#endif
+    Cache *caches[CACHE_BUDGET_MAX_CACHES];
+    bool evict[CACHE_BUDGET_MAX_CACHES];    // whether the sweep may evict
+    unsigned n_caches;
+    unsigned cursor;        // next shard of the sweep
+    size_t limit;           // accessed atomically, 0 for no limit
+    size_t used;            // accessed atomically
+    // accessed atomically, items in use can keep the caches above the
+    // limit, then trimming again is put off until they grow further
+    size_t next_trim;
 };
 
 #define CACHE_ALIGN 8
@@ -340,6 +497,157 @@ static inline CacheItem *value_to_item(void *value)
     return (CacheItem *) ((char *) value - CACHE_ITEM_SIZE);
 }
 
+static inline void shard_lock(CacheShard *shard)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&shard->lock);
+#endif
+}
+
+static inline void shard_unlock(CacheShard *shard)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_unlock(&shard->lock);
+#endif
+}
+
+static inline size_t size_load(size_t *val)
+{
+#ifdef CONFIG_PTHREAD
+    return __atomic_load_n(val, __ATOMIC_RELAXED);
+#else
+    return *val;
+#endif
+}
+
+static inline void size_store(size_t *val, size_t new_val)
+{
+#ifdef CONFIG_PTHREAD
+    __atomic_store_n(val, new_val, __ATOMIC_RELAXED);
+#else
+    *val = new_val;
+#endif
+}
+
+static inline size_t size_add(size_t *val, size_t delta)
+{
+#ifdef CONFIG_PTHREAD
+    return __atomic_add_fetch(val, delta, __ATOMIC_RELAXED);
+#else
+    return *val += delta;
+#endif
+}
+
+static inline void size_sub(size_t *val, size_t delta)
+{
+#ifdef CONFIG_PTHREAD
+    __atomic_sub_fetch(val, delta, __ATOMIC_RELAXED);
+#else
+    *val -= delta;
+#endif
+}
+
+static inline void queue_append(CacheShard *shard, CacheItem *item)
+{
+    *shard->queue_last = item;
+    item->queue_prev = shard->queue_last;
+    shard->queue_last = &item->queue_next;
+    item->queue_next = NULL;
+}
+
+// low hash bits select the shard, the rest the home slot
+static inline CacheShard *hash_shard(Cache *cache, uint32_t hash)
+{
+    return &cache->shards[hash & (CACHE_SHARDS - 1)];
+}
+
+static inline unsigned home_slot(CacheShard *shard, uint32_t hash)
+{
+    return (hash >> CACHE_SHARD_BITS) & shard->mask;
+}
+
+/**
+ * \brief Reallocate the table of a shard
+ * Items are moved by their stored hashes, keys are not hashed again.
+ */
+static bool resize_shard(CacheShard *shard, unsigned n_slots)
+{
+    CacheSlot *slots = calloc(n_slots, sizeof(CacheSlot));
+    if (!slots)
+        return false;
+    CacheSlot *old = shard->slots;
+    unsigned old_size = old ? shard->mask + 1 : 0;
+    shard->slots = slots;
+    shard->mask = n_slots - 1;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (!old[i].item)
+            continue;
+        unsigned pos = home_slot(shard, old[i].hash);
+        while (slots[pos].item)
+            pos = (pos + 1) & shard->mask;
+        slots[pos] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+// keep the load factor between 1/8 and 1/2
+static inline bool shard_grow(CacheShard *shard)
+{
+    if (2 * (shard->items + 1) <= shard->mask + 1)
+        return true;
+    if (resize_shard(shard, 2 * (shard->mask + 1)))
+        return true;
+    // a full table would make probing loop forever
+    return shard->items + 1 < shard->mask + 1;
+}
+
+static inline void shard_shrink(CacheShard *shard)
+{
+    unsigned n_slots = shard->mask + 1;
+    if (n_slots > CACHE_MIN_SLOTS && 8 * shard->items < n_slots)
+        resize_shard(shard, n_slots / 2);
+}
+
+static inline void insert_item(CacheShard *shard, CacheItem *item)
+{
+    unsigned pos = home_slot(shard, item->hash);
+    while (shard->slots[pos].item)
+        pos = (pos + 1) & shard->mask;
+    shard->slots[pos].hash = item->hash;
+    shard->slots[pos].item = item;
+    shard->items++;
+}
+
+static inline void unlink_item(CacheShard *shard, CacheItem *item)
+{
+    CacheSlot *slots = shard->slots;
+    unsigned mask = shard->mask;
+    unsigned pos = home_slot(shard, item->hash);
+    while (slots[pos].item != item)
+        pos = (pos + 1) & mask;
+
+    // shift following items of the probe run back into the hole
+    unsigned hole = pos;
+    while (true) {
+        pos = (pos + 1) & mask;
+        if (!slots[pos].item)
+            break;
+        unsigned home = home_slot(shard, slots[pos].hash);
+        if (((pos - home) & mask) < ((pos - hole) & mask))
+            continue;
+        slots[hole] = slots[pos];
+        hole = pos;
+    }
+    slots[hole].item = NULL;
+
+    shard->items--;
+    shard->cache_size -= item->size;
+    shard->cache_bytes -= item->bytes;
+    if (shard->budget)
+        size_sub(&shard->budget->used, item->bytes);
+}
+
 
 // Create a cache with type-specific hash/compare/destruct/size functions
 Cache *ass_cache_create(const CacheDesc *desc)
@@ -347,81 +655,169 @@ Cache *ass_cache_create(const CacheDesc *desc)
     Cache *cache = calloc(1, sizeof(*cache));
     if (!cache)
         return NULL;
-    cache->buckets = 0xFFFF;
-    cache->queue_last = &cache->queue_first;
     cache->desc = desc;
-    cache->map = calloc(cache->buckets, sizeof(CacheItem *));
-    if (!cache->map) {
-        free(cache);
-        return NULL;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        if (!resize_shard(shard, CACHE_MIN_SLOTS)) {
+            while (i--)
+                free(cache->shards[i].slots);
+            free(cache);
+            return NULL;
+        }
+        shard->queue_last = &shard->queue_first;
+#ifdef CONFIG_PTHREAD
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->constructed, NULL);
+#endif
     }
 
     return cache;
 }
 
-void *ass_cache_get(Cache *cache, void *key, void *priv)
+/**
+ * \brief Find an item and take a reference to it
+ * Must be called with the shard lock held.
+ */
+static CacheItem *find_item(Cache *cache, CacheShard *shard,
+                            uint32_t hash, void *key)
 {
     const CacheDesc *desc = cache->desc;
     size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
-    unsigned bucket = desc->hash_func(key, FNV1_32A_INIT) % cache->buckets;
-    CacheItem *item = cache->map[bucket];
-    while (item) {
-        if (desc->compare_func(key, (char *) item + key_offs)) {
-            assert(item->size);
-            if (!item->queue_prev || item->queue_next) {
-                if (item->queue_prev) {
-                    item->queue_next->queue_prev = item->queue_prev;
-                    *item->queue_prev = item->queue_next;
-                } else
-                    item->ref_count++;
-                *cache->queue_last = item;
-                item->queue_prev = cache->queue_last;
-                cache->queue_last = &item->queue_next;
-                item->queue_next = NULL;
-            }
-            cache->hits++;
-            desc->key_move_func(NULL, key);
-            item->ref_count++;
-            return (char *) item + CACHE_ITEM_SIZE;
+    for (unsigned pos = home_slot(shard, hash); shard->slots[pos].item;
+         pos = (pos + 1) & shard->mask) {
+        CacheItem *item = shard->slots[pos].item;
+        if (shard->slots[pos].hash != hash ||
+                !desc->compare_func(key, (char *) item + key_offs))
+            continue;
+        if (!ref_inc_not_zero(&item->ref_count))
+            continue;
+        item->credit = item->cost;
+        if (item->size && (!item->queue_prev || item->queue_next)) {
+            if (item->queue_prev) {
+                item->queue_next->queue_prev = item->queue_prev;
+                *item->queue_prev = item->queue_next;
+            } else
+                ref_inc(&item->ref_count);
+            queue_append(shard, item);
         }
-        item = item->next;
+        return item;
     }
-    cache->misses++;
+    return NULL;
+}
 
-    item = malloc(key_offs + desc->key_size);
+// eviction credits for an item, about log2 of its construction time
+// in nanoseconds per byte
+static inline unsigned cost_credit(int64_t time, size_t bytes)
+{
+    uint64_t cost = time > 0 ? time / FFMAX(bytes, 1) : 0;
+    unsigned credit = 0;
+    while (cost && credit < CACHE_MAX_CREDIT) {
+        cost >>= 1;
+        credit++;
+    }
+    return credit;
+}
+
+void *ass_cache_get(Cache *cache, void *key, void *priv)
+{
+    const CacheDesc *desc = cache->desc;
+    size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
+    uint32_t hash = desc->hash_func(key, FNV1_32A_INIT);
+    CacheShard *shard = hash_shard(cache, hash);
+
+    shard_lock(shard);
+    CacheItem *item = find_item(cache, shard, hash, key);
+    if (item) {
+        shard->hits++;
+#ifdef CONFIG_PTHREAD
+        // another thread is constructing this value
+        while (!item->size)
+            pthread_cond_wait(&shard->constructed, &shard->lock);
+#endif
+        shard_unlock(shard);
+        desc->key_move_func(NULL, key);
+        return (char *) item + CACHE_ITEM_SIZE;
+    }
+    shard->misses++;
+
+    item = shard_grow(shard) ? malloc(key_offs + desc->key_size) : NULL;
     if (!item) {
+        shard_unlock(shard);
         desc->key_move_func(NULL, key);
         return NULL;
     }
-    item->cache = cache;
+    item->shard = shard;
     item->desc = desc;
+    item->hash = hash;
     void *new_key = (char *) item + key_offs;
     if (!desc->key_move_func(new_key, key)) {
+        shard_unlock(shard);
         free(item);
         return NULL;
     }
-    void *value = (char *) item + CACHE_ITEM_SIZE;
-    item->size = desc->construct_func(new_key, value, priv);
-    assert(item->size);
-
-    CacheItem **bucketptr = &cache->map[bucket];
-    if (*bucketptr)
-        (*bucketptr)->prev = &item->next;
-    item->prev = bucketptr;
-    item->next = *bucketptr;
-    *bucketptr = item;
-
-    *cache->queue_last = item;
-    item->queue_prev = cache->queue_last;
-    cache->queue_last = &item->queue_next;
+
+    // publish the pending item, so that concurrent lookups of
+    // the same key wait for it instead of constructing it again
+    item->queue_prev = NULL;
     item->queue_next = NULL;
-    item->ref_count = 2;
+    item->size = 0;
+    item->ref_count = 1;
+    insert_item(shard, item);
+    CacheBudget *budget = shard->budget;
+    shard_unlock(shard);
 
-    cache->cache_size += item->size;
-    cache->items++;
+    void *value = (char *) item + CACHE_ITEM_SIZE;
+    int64_t start = budget ? ass_time_ns() : 0;
+    size_t size = desc->construct_func(new_key, value, priv);
+    assert(size);
+    size_t bytes = desc->memory_func ?
+        key_offs + desc->key_size + desc->memory_func(new_key, value) : size;
+    unsigned cost = budget ? cost_credit(ass_time_ns() - start, bytes) : 0;
+
+    shard_lock(shard);
+    item->size = size;
+    item->bytes = bytes;
+    item->cost = item->credit = cost;
+    ref_inc(&item->ref_count);
+    queue_append(shard, item);
+    shard->cache_size += size;
+    shard->cache_bytes += bytes;
+    shard->total_size += size;
+    size_t used = shard->budget ? size_add(&shard->budget->used, bytes) : 0;
+#ifdef CONFIG_PTHREAD
+    pthread_cond_broadcast(&shard->constructed);
+#endif
+    shard_unlock(shard);
+
+    // trim with some slack to not sweep after every new item
+    size_t limit = budget ? size_load(&budget->limit) : 0;
+    if (limit && used > FFMAX(limit, size_load(&budget->next_trim)))
+        ass_cache_budget_trim(budget, limit - limit / 8);
     return value;
 }
 
+void *ass_cache_find(Cache *cache, void *key)
+{
+    const CacheDesc *desc = cache->desc;
+    uint32_t hash = desc->hash_func(key, FNV1_32A_INIT);
+    CacheShard *shard = hash_shard(cache, hash);
+
+    shard_lock(shard);
+    CacheItem *item = find_item(cache, shard, hash, key);
+    if (!item) {
+        shard_unlock(shard);
+        return NULL;
+    }
+    shard->hits++;
+#ifdef CONFIG_PTHREAD
+    while (!item->size)
+        pthread_cond_wait(&shard->constructed, &shard->lock);
+#endif
+    shard_unlock(shard);
+    desc->key_move_func(NULL, key);
+    return (char *) item + CACHE_ITEM_SIZE;
+}
+
 void *ass_cache_key(void *value)
 {
     CacheItem *item = value_to_item(value);
@@ -441,8 +837,8 @@ void ass_cache_inc_ref(void *value)
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
-    assert(item->size && item->ref_count);
-    item->ref_count++;
+    assert(item->size && ref_get(&item->ref_count));
+    ref_inc(&item->ref_count);
 }
 
 void ass_cache_dec_ref(void *value)
@@ -450,93 +846,469 @@ void ass_cache_dec_ref(void *value)
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
-    assert(item->size && item->ref_count);
-    if (--item->ref_count)
+    assert(item->size && ref_get(&item->ref_count));
+    if (ref_dec(&item->ref_count))
         return;
 
-    Cache *cache = item->cache;
-    if (cache) {
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
-
-        cache->items--;
-        cache->cache_size -= item->size;
+    CacheShard *shard = item->shard;
+    if (shard) {
+        shard_lock(shard);
+        unlink_item(shard, item);
+        shard_shrink(shard);
+        shard_unlock(shard);
     }
     destroy_item(item->desc, item);
 }
 
+static void cut_shard(Cache *cache, CacheShard *shard, size_t max_size)
+{
+    // destructors can release items of this cache,
+    // so run them after the lock is dropped
+    CacheItem *dead = NULL;
+    shard_lock(shard);
+    while (shard->cache_size > max_size) {
+        CacheItem *item = shard->queue_first;
+        if (!item)
+            break;
+        assert(item->size);
+
+        shard->queue_first = item->queue_next;
+        item->queue_prev = NULL;
+        if (ref_dec(&item->ref_count))
+            continue;
+
+        unlink_item(shard, item);
+        shard->evictions++;
+        item->next = dead;
+        dead = item;
+    }
+    if (shard->queue_first)
+        shard->queue_first->queue_prev = &shard->queue_first;
+    else
+        shard->queue_last = &shard->queue_first;
+    shard_shrink(shard);
+    shard_unlock(shard);
+
+    while (dead) {
+        CacheItem *next = dead->next;
+        destroy_item(cache->desc, dead);
+        dead = next;
+    }
+}
+
 void ass_cache_cut(Cache *cache, size_t max_size)
 {
-    if (cache->cache_size <= max_size)
+    size_t sizes[CACHE_SHARDS], total = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        shard_lock(&cache->shards[i]);
+        sizes[i] = cache->shards[i].cache_size;
+        shard_unlock(&cache->shards[i]);
+        total += sizes[i];
+    }
+    if (total <= max_size)
+        return;
+
+    // shrink every shard by the same factor
+    double scale = (double) max_size / total;
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        cut_shard(cache, &cache->shards[i], sizes[i] * scale);
+}
+
+void ass_cache_stats(Cache *cache, ASS_CacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        shard_lock(shard);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->items += shard->items;
+        stats->size += shard->cache_size;
+        stats->memory += shard->cache_bytes;
+        shard_unlock(shard);
+    }
+}
+
+uint64_t ass_cache_constructed(Cache *cache)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        shard_lock(shard);
+        total += shard->total_size;
+        shard_unlock(shard);
+    }
+    return total;
+}
+
+void ass_cache_reset_stats(Cache *cache)
+{
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        shard_lock(shard);
+        shard->hits = shard->misses = shard->evictions = 0;
+        shard_unlock(shard);
+    }
+}
+
+CacheBudget *ass_cache_budget_create(void)
+{
+    CacheBudget *budget = calloc(1, sizeof(*budget));
+    if (!budget)
+        return NULL;
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_init(&budget->lock, NULL);
+#endif
+    return budget;
+}
+
+// all caches must have been detached
+void ass_cache_budget_done(CacheBudget *budget)
+{
+    if (!budget)
         return;
+    assert(!budget->n_caches);
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_destroy(&budget->lock);
+#endif
+    free(budget);
+}
+
+static inline void budget_lock(CacheBudget *budget)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&budget->lock);
+#endif
+}
+
+static inline void budget_unlock(CacheBudget *budget)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_unlock(&budget->lock);
+#endif
+}
+
+/**
+ * \brief Make a cache share a budget, or detach it with NULL
+ * \param evict whether the budget may evict items of the cache,
+ * otherwise they are only counted
+ * Must not be called while other threads use the cache.
+ */
+bool ass_cache_set_budget(Cache *cache, CacheBudget *budget, bool evict)
+{
+    CacheBudget *old = cache->shards[0].budget;
+    if (old == budget)
+        return true;
+
+    if (old) {
+        budget_lock(old);
+        unsigned i = 0;
+        while (old->caches[i] != cache)
+            i++;
+        old->n_caches--;
+        old->caches[i] = old->caches[old->n_caches];
+        old->evict[i] = old->evict[old->n_caches];
+        old->cursor = 0;
+        for (int j = 0; j < CACHE_SHARDS; j++) {
+            size_sub(&old->used, cache->shards[j].cache_bytes);
+            cache->shards[j].budget = NULL;
+        }
+        budget_unlock(old);
+    }
+    if (!budget)
+        return true;
+
+    budget_lock(budget);
+    if (budget->n_caches == CACHE_BUDGET_MAX_CACHES) {
+        budget_unlock(budget);
+        return false;
+    }
+    budget->evict[budget->n_caches] = evict;
+    budget->caches[budget->n_caches++] = cache;
+    for (int j = 0; j < CACHE_SHARDS; j++) {
+        size_add(&budget->used, cache->shards[j].cache_bytes);
+        cache->shards[j].budget = budget;
+    }
+    budget_unlock(budget);
+    return true;
+}
+
+void ass_cache_budget_set_limit(CacheBudget *budget, size_t max_bytes)
+{
+    size_store(&budget->limit, max_bytes);
+    size_store(&budget->next_trim, 0);
+}
+
+size_t ass_cache_budget_limit(CacheBudget *budget)
+{
+    return size_load(&budget->limit);
+}
+
+static inline CacheItem *queue_pop(CacheShard *shard)
+{
+    CacheItem *item = shard->queue_first;
+    if (!item)
+        return NULL;
+    shard->queue_first = item->queue_next;
+    if (shard->queue_first)
+        shard->queue_first->queue_prev = &shard->queue_first;
+    else
+        shard->queue_last = &shard->queue_first;
+    return item;
+}
 
-    do {
-        CacheItem *item = cache->queue_first;
+/**
+ * \brief Advance the sweep by one item of a shard
+ * The least recently used item that isn't in use is evicted, or spends
+ * a credit and goes to the queue end. Evicting items in use frees nothing,
+ * so they are skipped.
+ * \return false if no item could be evicted or spend a credit
+ */
+static bool sweep_shard(Cache *cache, CacheShard *shard)
+{
+    CacheItem *dead = NULL;
+    bool progress = false;
+    shard_lock(shard);
+    for (unsigned n = shard->items; n && !progress; n--) {
+        CacheItem *item = queue_pop(shard);
         if (!item)
             break;
         assert(item->size);
 
-        cache->queue_first = item->queue_next;
-        if (--item->ref_count) {
-            item->queue_prev = NULL;
+        // the queue holds one reference
+        if (ref_get(&item->ref_count) > 1) {
+            queue_append(shard, item);
             continue;
         }
+        progress = true;
+        if (item->credit) {
+            item->credit--;
+            queue_append(shard, item);
+            continue;
+        }
+        item->queue_prev = NULL;
+        if (!ref_dec(&item->ref_count)) {
+            unlink_item(shard, item);
+            shard->evictions++;
+            shard_shrink(shard);
+            dead = item;
+        }
+    }
+    shard_unlock(shard);
 
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
-
-        cache->items--;
-        cache->cache_size -= item->size;
-        destroy_item(cache->desc, item);
-    } while (cache->cache_size > max_size);
-    if (cache->queue_first)
-        cache->queue_first->queue_prev = &cache->queue_first;
-    else
-        cache->queue_last = &cache->queue_first;
+    if (dead)
+        destroy_item(cache->desc, dead);
+    return progress;
 }
 
-void ass_cache_stats(Cache *cache, size_t *size, unsigned *hits,
-                     unsigned *misses, unsigned *count)
+/**
+ * \brief Evict items of all caches of a budget until they fit in max_bytes
+ * Safe to call from any thread. Returns at once if another thread
+ * is already trimming, which is as good as trimming again.
+ */
+void ass_cache_budget_trim(CacheBudget *budget, size_t max_bytes)
 {
-    if (size)
-        *size = cache->cache_size;
-    if (hits)
-        *hits = cache->hits;
-    if (misses)
-        *misses = cache->misses;
-    if (count)
-        *count = cache->items;
+#ifdef CONFIG_PTHREAD
+    if (pthread_mutex_trylock(&budget->lock))
+        return;
+#endif
+    // interleave caches and shards, stop after a full round without progress
+    unsigned n = budget->n_caches * CACHE_SHARDS, idle = 0;
+    size_t used;
+    while ((used = size_load(&budget->used)) > max_bytes && idle < n) {
+        unsigned pos = budget->cursor;
+        budget->cursor = (pos + 1) % n;
+        Cache *cache = budget->caches[pos % budget->n_caches];
+        CacheShard *shard = &cache->shards[pos / budget->n_caches];
+        bool progress = budget->evict[pos % budget->n_caches] &&
+            sweep_shard(cache, shard);
+        idle = progress ? 0 : idle + 1;
+    }
+    size_t limit = size_load(&budget->limit);
+    size_store(&budget->next_trim, FFMAX(used, limit) + limit / 8);
+    budget_unlock(budget);
 }
 
+// Not thread-safe, other threads must not use the cache at the same time,
+// except for trimming the budget it shares
 void ass_cache_empty(Cache *cache)
 {
-    for (int i = 0; i < cache->buckets; i++) {
-        CacheItem *item = cache->map[i];
-        while (item) {
+    // destructors can release items of this cache, so detach
+    // everything first and only then destroy unreferenced items
+    CacheItem *dead = NULL;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        shard_lock(shard);
+        for (unsigned j = 0; j <= shard->mask; j++) {
+            CacheItem *item = shard->slots[j].item;
+            if (!item)
+                continue;
             assert(item->size);
-            CacheItem *next = item->next;
+            item->shard = NULL;
             if (item->queue_prev)
                 item->ref_count--;
-            if (item->ref_count)
-                item->cache = NULL;
-            else
-                destroy_item(cache->desc, item);
-            item = next;
+            if (!item->ref_count) {
+                item->next = dead;
+                dead = item;
+            }
+            shard->slots[j].item = NULL;
         }
-        cache->map[i] = NULL;
+        if (shard->mask + 1 > CACHE_MIN_SLOTS)
+            resize_shard(shard, CACHE_MIN_SLOTS);
+
+        shard->queue_first = NULL;
+        shard->queue_last = &shard->queue_first;
+        if (shard->budget)
+            size_sub(&shard->budget->used, shard->cache_bytes);
+        shard->cache_bytes = 0;
+        shard->items = shard->cache_size = 0;
+        shard->hits = shard->misses = shard->evictions = 0;
+        shard_unlock(shard);
+    }
+
+    while (dead) {
+        CacheItem *next = dead->next;
+        destroy_item(cache->desc, dead);
+        dead = next;
     }
+}
+
+
+
+// shaped run cache
+static uint32_t shaped_run_hash(void *key, uint32_t hval)
+{
+    ShapedRunHashKey *k = key;
+    hval = shape_props_hash(&k->props, hval);
+    return fnv_32a_buf(k->text, k->length * sizeof(*k->text), hval);
+}
+
+static bool shaped_run_compare(void *a, void *b)
+{
+    ShapedRunHashKey *ak = a;
+    ShapedRunHashKey *bk = b;
+    return shape_props_compare(&ak->props, &bk->props) &&
+        ak->length == bk->length &&
+        !memcmp(ak->text, bk->text, ak->length * sizeof(*ak->text));
+}
+
+static bool shaped_run_key_move(void *dst, void *src)
+{
+    if (!dst)
+        return true;
+    ShapedRunHashKey *d = dst, *k = src;
+    // the text of a lookup key points into the shaper's buffers
+    memcpy(d, k, sizeof(ShapedRunHashKey));
+    d->text = ass_realloc_array(NULL, k->length, sizeof(*k->text));
+    if (!d->text)
+        return false;
+    memcpy(d->text, k->text, k->length * sizeof(*k->text));
+    ass_cache_inc_ref(k->props.font);
+    return true;
+}
+
+static void shaped_run_destruct(void *key, void *value)
+{
+    ShapedRunHashKey *k = key;
+    ShapedRunHashValue *v = value;
+    free(v->glyphs);
+    free(k->text);
+    ass_cache_dec_ref(k->props.font);
+}
+
+static size_t shaped_run_memory(void *key, void *value)
+{
+    ShapedRunHashKey *k = key;
+    ShapedRunHashValue *v = value;
+    return k->length * sizeof(*k->text) + v->n_glyphs * sizeof(ShapedGlyph);
+}
+
+size_t ass_shaped_run_construct(void *key, void *value, void *priv);
+
+const CacheDesc shaped_run_cache_desc = {
+    .hash_func = shaped_run_hash,
+    .compare_func = shaped_run_compare,
+    .key_move_func = shaped_run_key_move,
+    .construct_func = ass_shaped_run_construct,
+    .destruct_func = shaped_run_destruct,
+    .memory_func = shaped_run_memory,
+    .key_size = sizeof(ShapedRunHashKey),
+    .value_size = sizeof(ShapedRunHashValue)
+};
+
+// override tags cache
+static uint32_t tags_hash(void *key, uint32_t hval)
+{
+    TagsHashKey *k = key;
+    return fnv_32a_buf(k->text, k->length, hval);
+}
+
+static bool tags_compare(void *a, void *b)
+{
+    TagsHashKey *ak = a;
+    TagsHashKey *bk = b;
+    return ak->length == bk->length &&
+        !memcmp(ak->text, bk->text, ak->length);
+}
 
-    cache->queue_first = NULL;
-    cache->queue_last = &cache->queue_first;
-    cache->items = cache->hits = cache->misses = cache->cache_size = 0;
+static bool tags_key_move(void *dst, void *src)
+{
+    if (!dst)
+        return true;
+    TagsHashKey *d = dst, *k = src;
+    // the copy is zero-terminated, so that parsing can't run past the end
+    d->length = k->length;
+    d->text = malloc(k->length + 1);
+    if (!d->text)
+        return false;
+    memcpy(d->text, k->text, k->length);
+    d->text[k->length] = '\0';
+    return true;
 }
 
+static void tags_destruct(void *key, void *value)
+{
+    TagsHashKey *k = key;
+    TagsHashValue *v = value;
+    free(v->tags);
+    free(v->args);
+    free(k->text);
+}
+
+static size_t tags_memory(void *key, void *value)
+{
+    TagsHashKey *k = key;
+    TagsHashValue *v = value;
+    return k->length + 1 + v->n_tags * sizeof(ParsedTag) +
+        v->n_args * sizeof(TagArg);
+}
+
+size_t ass_tags_construct(void *key, void *value, void *priv);
+
+const CacheDesc tags_cache_desc = {
+    .hash_func = tags_hash,
+    .compare_func = tags_compare,
+    .key_move_func = tags_key_move,
+    .construct_func = ass_tags_construct,
+    .destruct_func = tags_destruct,
+    .memory_func = tags_memory,
+    .key_size = sizeof(TagsHashKey),
+    .value_size = sizeof(TagsHashValue)
+};
+
 void ass_cache_done(Cache *cache)
 {
     ass_cache_empty(cache);
-    free(cache->map);
+    ass_cache_set_budget(cache, NULL, false);
+#ifdef CONFIG_PTHREAD
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        pthread_cond_destroy(&cache->shards[i].constructed);
+        pthread_mutex_destroy(&cache->shards[i].lock);
+    }
+#endif
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        free(cache->shards[i].slots);
     free(cache);
 }
 
@@ -556,6 +1328,16 @@ Cache *ass_glyph_metrics_cache_create(void)
     return ass_cache_create(&glyph_metrics_cache_desc);
 }
 
+Cache *ass_shaped_run_cache_create(void)
+{
+    return ass_cache_create(&shaped_run_cache_desc);
+}
+
+Cache *ass_tags_cache_create(void)
+{
+    return ass_cache_create(&tags_cache_desc);
+}
+
 Cache *ass_bitmap_cache_create(void)
 {
     return ass_cache_create(&bitmap_cache_desc);
@@ -565,3 +1347,13 @@ Cache *ass_composite_cache_create(void)
 {
     return ass_cache_create(&composite_cache_desc);
 }
+
+Cache *ass_shadow_cache_create(void)
+{
+    return ass_cache_create(&shadow_cache_desc);
+}
+
+Cache *ass_event_cache_create(void)
+{
+    return ass_cache_create(&event_cache_desc);
+}
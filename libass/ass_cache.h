@@ -26,21 +26,76 @@
 #include "ass_bitmap.h"
 
 typedef struct cache Cache;
+typedef struct cache_budget CacheBudget;
 
 // cache values
 
 typedef struct {
-    Bitmap bm, bm_o, bm_s;
+    Bitmap bm, bm_o;
+    Bitmap bm_s;    // unshifted shadow, if it's neither bm nor bm_o
+    uint64_t id;    // unique per construction, keys the shadow cache
 } CompositeHashValue;
 
 typedef struct {
     bool valid;
-    ASS_Outline outline[2];
+    ASS_PackedOutline outline[2];
     ASS_Rect cbox;  // bounding box of all control points
     int advance;    // 26.6, advance distance to the next outline in line
     int asc, desc;  // ascender/descender
+    // glyphs only: whether FreeType returned the glyph, and the direction
+    // its contours run in, which decoration lines have to follow
+    bool glyph_loaded;
+    bool truetype_orientation;
 } OutlineHashValue;
 
+typedef struct {
+    bool valid;
+    ASS_Image *imgs;            // owned image list, copied for every use
+    int top, height, left, width;
+    int detect_collisions;
+    int shift_direction;
+    // moving events: images are shifted from origin to the current
+    // position and then cropped to clip
+    bool movable;
+    ASS_DVector origin;         // position in script coordinates
+    ASS_Rect clip;
+    // without images: laid out text that only needs to be placed
+    struct event_layout *layout;
+} EventHashValue;
+
+typedef struct {
+    unsigned glyph_index;
+    unsigned cluster;           // index of the first character, within the run
+    int x_advance, y_advance;   // in scaled font units
+    int x_offset, y_offset;
+} ShapedGlyph;
+
+typedef struct {
+    bool valid;
+    size_t n_glyphs;
+    ShapedGlyph *glyphs;
+} ShapedRunHashValue;
+
+typedef struct {
+    int start, end;             // offsets into the override block
+    double value;               // number at start
+} TagArg;
+
+typedef struct {
+    int type;                   // see ass_parse.c
+    int nargs, first_arg;       // arguments in TagsHashValue.args
+    int n_nested;               // \t: number of following tags it applies
+    bool tail;                  // \t: applies to the rest of the block
+} ParsedTag;
+
+typedef struct {
+    bool valid;
+    size_t n_tags;
+    ParsedTag *tags;
+    size_t n_args;
+    TagArg *args;
+} TagsHashValue;
+
 // Create definitions for bitmap, outline and composite hash keys
 #define CREATE_STRUCT_DEFINITIONS
 #include "ass_cache_template.h"
@@ -51,6 +106,7 @@ typedef bool (*HashCompare)(void *a, void *b);
 typedef bool (*CacheKeyMove)(void *dst, void *src);
 typedef size_t (*CacheValueConstructor)(void *key, void *value, void *priv);
 typedef void (*CacheItemDestructor)(void *key, void *value);
+typedef size_t (*CacheItemMemory)(void *key, void *value);
 
 // cache hash keys
 
@@ -72,6 +128,7 @@ enum {
     FILTER_BORDER_STYLE_3 = 1,
     FILTER_NONZERO_BORDER = 2,
     FILTER_NONZERO_SHADOW = 4,
+    FILTER_DEGRADED = 8,        // cheaper blur to meet the frame budget
 };
 
 typedef struct {
@@ -80,6 +137,18 @@ typedef struct {
     BitmapRef *bitmaps;
 } CompositeHashKey;
 
+typedef struct {
+    ShapeProps props;
+    size_t length;
+    uint32_t *text;
+} ShapedRunHashKey;
+
+// override block from '{' to '}', not zero-terminated in lookup keys
+typedef struct {
+    size_t length;
+    char *text;
+} TagsHashKey;
+
 typedef struct
 {
     HashFunction hash_func;
@@ -87,24 +156,43 @@ typedef struct
     CacheKeyMove key_move_func;
     CacheValueConstructor construct_func;
     CacheItemDestructor destruct_func;
+    // heap memory owned by an item, for caches whose construct_func
+    // returns something other than bytes
+    CacheItemMemory memory_func;
     size_t key_size;
     size_t value_size;
 } CacheDesc;
 
 Cache *ass_cache_create(const CacheDesc *desc);
 void *ass_cache_get(Cache *cache, void *key, void *priv);
+// like ass_cache_get(), but leaves the key to the caller on a miss
+// instead of constructing the value
+void *ass_cache_find(Cache *cache, void *key);
 void *ass_cache_key(void *value);
 void ass_cache_inc_ref(void *value);
 void ass_cache_dec_ref(void *value);
 void ass_cache_cut(Cache *cache, size_t max_size);
-void ass_cache_stats(Cache *cache, size_t *size, unsigned *hits,
-                     unsigned *misses, unsigned *count);
+void ass_cache_stats(Cache *cache, ASS_CacheStats *stats);
+uint64_t ass_cache_constructed(Cache *cache);
+void ass_cache_reset_stats(Cache *cache);
 void ass_cache_empty(Cache *cache);
 void ass_cache_done(Cache *cache);
+
+CacheBudget *ass_cache_budget_create(void);
+void ass_cache_budget_done(CacheBudget *budget);
+bool ass_cache_set_budget(Cache *cache, CacheBudget *budget, bool evict);
+void ass_cache_budget_set_limit(CacheBudget *budget, size_t max_bytes);
+size_t ass_cache_budget_limit(CacheBudget *budget);
+void ass_cache_budget_trim(CacheBudget *budget, size_t max_bytes);
+
 Cache *ass_font_cache_create(void);
 Cache *ass_outline_cache_create(void);
 Cache *ass_glyph_metrics_cache_create(void);
+Cache *ass_shaped_run_cache_create(void);
+Cache *ass_tags_cache_create(void);
 Cache *ass_bitmap_cache_create(void);
 Cache *ass_composite_cache_create(void);
+Cache *ass_shadow_cache_create(void);
+Cache *ass_event_cache_create(void);
 
 #endif                          /* LIBASS_CACHE_H */
@@ -58,6 +58,16 @@ START(bitmap, bitmap_hash_key)
     VECTOR(matrix_x)
     VECTOR(matrix_y)
     VECTOR(matrix_z)
+    // border rendered in the same rasterizer pass, glyph bitmaps only
+    GENERIC(OutlineHashValue *, border)
+    VECTOR(border_offset)
+    VECTOR(border_matrix_x)
+    VECTOR(border_matrix_y)
+    VECTOR(border_matrix_z)
+    // visible part in pixels relative to the bitmap position,
+    // content outside of it may be left out
+    VECTOR(window_min)
+    VECTOR(window_max)
 END(BitmapHashKey)
 
 START(glyph_metrics, glyph_metrics_hash_key)
@@ -76,6 +86,7 @@ START(glyph, glyph_hash_key)
     GENERIC(int, bold)
     GENERIC(int, italic)
     GENERIC(unsigned, flags) // glyph decoration flags
+    GENERIC(int, hinting)
 END(GlyphHashKey)
 
 // describes an outline drawing
@@ -93,14 +104,45 @@ START(border, border_hash_key)
     VECTOR(border)  // border size in STROKER_ACCURACY units
 END(BorderHashKey)
 
+// describes a static event
+START(event, event_hash_key)
+    GENERIC(ASS_RenderPriv *, render_priv)
+    GENERIC(int, cache_id)  // distinguishes reuses of render_priv
+    // moving events are shared by content, render_priv is NULL for them
+    GENERIC(int, motion)    // EventMotion.type
+    GENERIC(int, layout)    // only the text layout is kept, see EventLayout
+    GENERIC(int, margin_l)
+    GENERIC(int, margin_r)
+    GENERIC(int, margin_v)
+    GENERIC(int, style)
+    GENERIC(uint32_t, styles_hash)
+    STRING(text)
+END(EventHashKey)
+
 // describes post-combining effects
 START(filter, filter_desc)
     GENERIC(int, flags)
     GENERIC(int, be)
     GENERIC(int, blur)
-    VECTOR(shadow)
 END(FilterDesc)
 
+// describes a shadow placed from a blurred composite
+START(shadow, shadow_hash_key)
+    GENERIC(uint64_t, composite_id)
+    VECTOR(shadow)  // offset, 26.6
+END(ShadowHashKey)
+
+// describes properties of a shaped run of text
+START(shape_props, shape_props_key)
+    GENERIC(ASS_Font *, font)
+    GENERIC(double, size)
+    GENERIC(int, face_index)
+    GENERIC(unsigned, script)
+    GENERIC(const void *, language)
+    GENERIC(int, rtl)
+    GENERIC(unsigned, features) // enabled optional OpenType features
+END(ShapeProps)
+
 // describes glyph bitmap reference
 START(bitmap_ref, bitmap_ref_key)
     GENERIC(Bitmap *, bm)
@@ -24,6 +24,7 @@
 #include <math.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <string.h>
 
 #include "ass_utils.h"
 #include "ass_drawing.h"
@@ -32,48 +33,207 @@
 #define DRAWING_INITIAL_POINTS 100
 #define DRAWING_INITIAL_SEGMENTS 100
 
+typedef enum {
+    TOKEN_MOVE,
+    TOKEN_MOVE_NC,
+    TOKEN_LINE,
+    TOKEN_CUBIC_BEZIER,
+    TOKEN_CONIC_BEZIER,
+    TOKEN_B_SPLINE,
+} ASS_TokenType;
+
+typedef struct {
+    ASS_TokenType type;
+    ASS_Vector point;
+} ASS_DrawingToken;
+
 /*
- * \brief Check whether a number of items on the list is available
+ * Tokens are turned into outline segments as soon as they are read.
+ * Commands look at most two tokens ahead and one token back,
+ * so only that window is kept instead of the whole token list.
  */
-static bool token_check_values(ASS_DrawingToken *token, int i, int type)
+typedef struct {
+    ASS_Outline *outline;
+    ASS_Rect *cbox;
+
+    bool started;
+    ASS_Vector pen;
+
+    // token before queue[0], used as the start of curves
+    bool has_prev;
+    ASS_Vector prev;
+    ASS_DrawingToken queue[3];
+    int n_queued;
+
+    // last token read and the start of the open b-spline:
+    // the token before its first point and the two tokens after that one
+    bool has_last;
+    ASS_DrawingToken last;
+    int n_spline;
+    ASS_Vector spline[3];
+    bool spline_closable;
+} DrawingState;
+
+/*
+ * \brief Add curve to drawing
+ */
+static bool drawing_add_curve(DrawingState *state, bool spline)
 {
-    for (int j = 0; j < i; j++) {
-        if (!token || token->type != type) return false;
-        token = token->next;
+    ASS_Vector p[4];
+    p[0] = state->prev;
+    for (int i = 1; i < 4; i++)
+        p[i] = state->queue[i - 1].point;
+    for (int i = 0; i < 4; i++)
+        rectangle_update(state->cbox, p[i].x, p[i].y, p[i].x, p[i].y);
+
+    if (spline) {
+        int x01 = (p[1].x - p[0].x) / 3;
+        int y01 = (p[1].y - p[0].y) / 3;
+        int x12 = (p[2].x - p[1].x) / 3;
+        int y12 = (p[2].y - p[1].y) / 3;
+        int x23 = (p[3].x - p[2].x) / 3;
+        int y23 = (p[3].y - p[2].y) / 3;
+
+        p[0].x = p[1].x + ((x12 - x01) >> 1);
+        p[0].y = p[1].y + ((y12 - y01) >> 1);
+        p[3].x = p[2].x + ((x23 - x12) >> 1);
+        p[3].y = p[2].y + ((y23 - y12) >> 1);
+        p[1].x += x12;
+        p[1].y += y12;
+        p[2].x -= x12;
+        p[2].y -= y12;
     }
 
+    ASS_Outline *outline = state->outline;
+    bool ok = (state->started ||
+        outline_add_point(outline, p[0], 0)) &&
+        outline_add_point(outline, p[1], 0) &&
+        outline_add_point(outline, p[2], 0) &&
+        outline_add_point(outline, p[3], OUTLINE_CUBIC_SPLINE);
+    state->started = true;
+    return ok;
+}
+
+static bool queued_all(const DrawingState *state, ASS_TokenType type)
+{
+    if (state->n_queued < 3)
+        return false;
+    for (int i = 0; i < 3; i++)
+        if (state->queue[i].type != type)
+            return false;
     return true;
 }
 
 /*
- * \brief Tokenize a drawing string into a list of ASS_DrawingToken
- * This also expands points for closing b-splines
+ * \brief Run the command of the first queued token and drop the tokens it used
  */
-static ASS_DrawingToken *drawing_tokenize(const char *str)
+static bool drawing_execute(DrawingState *state)
+{
+    ASS_DrawingToken *token = &state->queue[0];
+    ASS_Outline *outline = state->outline;
+    ASS_Rect *cbox = state->cbox;
+    int used = 1;
+
+    switch (token->type) {
+    case TOKEN_MOVE_NC:
+        state->pen = token->point;
+        rectangle_update(cbox, state->pen.x, state->pen.y, state->pen.x, state->pen.y);
+        break;
+    case TOKEN_MOVE:
+        state->pen = token->point;
+        rectangle_update(cbox, state->pen.x, state->pen.y, state->pen.x, state->pen.y);
+        if (state->started) {
+            if (!outline_add_segment(outline, OUTLINE_LINE_SEGMENT))
+                return false;
+            if (!outline_close_contour(outline))
+                return false;
+            state->started = false;
+        }
+        break;
+    case TOKEN_LINE: {
+        ASS_Vector to = token->point;
+        rectangle_update(cbox, to.x, to.y, to.x, to.y);
+        if (!state->started && !outline_add_point(outline, state->pen, 0))
+            return false;
+        if (!outline_add_point(outline, to, OUTLINE_LINE_SEGMENT))
+            return false;
+        state->started = true;
+        break;
+    }
+    case TOKEN_CUBIC_BEZIER:
+        if (queued_all(state, TOKEN_CUBIC_BEZIER) && state->has_prev) {
+            if (!drawing_add_curve(state, false))
+                return false;
+            used = 3;
+        }
+        break;
+    case TOKEN_B_SPLINE:
+        if (queued_all(state, TOKEN_B_SPLINE) && state->has_prev) {
+            if (!drawing_add_curve(state, true))
+                return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    state->has_prev = true;
+    state->prev = state->queue[used - 1].point;
+    state->n_queued -= used;
+    memmove(state->queue, state->queue + used, state->n_queued * sizeof(*token));
+    return true;
+}
+
+static bool drawing_add_token(DrawingState *state, ASS_TokenType type, ASS_Vector point)
+{
+    if (state->n_spline == 2) {
+        state->spline[state->n_spline++] = point;
+        state->spline_closable = type == TOKEN_B_SPLINE;
+    } else if (!state->n_spline && type == TOKEN_B_SPLINE && state->has_last) {
+        state->spline[0] = state->last.point;
+        state->spline[1] = point;
+        state->n_spline = 2;
+    }
+    state->has_last = true;
+    state->last.type = type;
+    state->last.point = point;
+
+    ASS_DrawingToken *token = &state->queue[state->n_queued++];
+    token->type = type;
+    token->point = point;
+    return state->n_queued < 3 || drawing_execute(state);
+}
+
+/*
+ * \brief Close the open b-spline: add its first three points back to the end
+ */
+static bool drawing_close_spline(DrawingState *state)
+{
+    if (state->n_spline < 3 || !state->spline_closable)
+        return true;
+    ASS_Vector *spline = state->spline;
+    for (int i = 0; i < 3; i++)
+        if (!drawing_add_token(state, TOKEN_B_SPLINE, spline[i]))
+            return false;
+    state->n_spline = 0;
+    return true;
+}
+
+/*
+ * \brief Tokenize a drawing string and convert it to outline on the fly
+ */
+static bool drawing_tokenize(DrawingState *state, const char *str)
 {
     char *p = (char *) str;
     int type = -1, is_set = 0;
     double val;
     ASS_Vector point = {0, 0};
 
-    ASS_DrawingToken *root = NULL, *tail = NULL, *spline_start = NULL;
-
     while (p && *p) {
         int got_coord = 0;
-        if (*p == 'c' && spline_start) {
-            // Close b-splines: add the first three points of the b-spline
-            // back to the end
-            if (token_check_values(spline_start->next, 2, TOKEN_B_SPLINE)) {
-                for (int i = 0; i < 3; i++) {
-                    tail->next = calloc(1, sizeof(ASS_DrawingToken));
-                    tail->next->prev = tail;
-                    tail = tail->next;
-                    tail->type = TOKEN_B_SPLINE;
-                    tail->point = spline_start->point;
-                    spline_start = spline_start->next;
-                }
-                spline_start = NULL;
-            }
+        if (*p == 'c' && state->n_spline) {
+            if (!drawing_close_spline(state))
+                return false;
         } else if (!is_set && mystrtod(&p, &val)) {
             point.x = double_to_d6(val);
             is_set = 1;
@@ -105,76 +265,21 @@ static ASS_DrawingToken *drawing_tokenize(const char *str)
             is_set = 0;
 
         if (type != -1 && is_set == 2) {
-            if (root) {
-                tail->next = calloc(1, sizeof(ASS_DrawingToken));
-                tail->next->prev = tail;
-                tail = tail->next;
-            } else
-                root = tail = calloc(1, sizeof(ASS_DrawingToken));
-            tail->type = type;
-            tail->point = point;
+            if (!drawing_add_token(state, type, point))
+                return false;
             is_set = 0;
-            if (type == TOKEN_B_SPLINE && !spline_start)
-                spline_start = tail->prev;
         }
         p++;
     }
 
-    return root;
-}
-
-/*
- * \brief Free a list of tokens
- */
-static void drawing_free_tokens(ASS_DrawingToken *token)
-{
-    while (token) {
-        ASS_DrawingToken *at = token;
-        token = token->next;
-        free(at);
-    }
-}
-
-/*
- * \brief Add curve to drawing
- */
-static bool drawing_add_curve(ASS_Outline *outline, ASS_Rect *cbox,
-                              ASS_DrawingToken *token, bool spline, int started)
-{
-    ASS_Vector p[4];
-    for (int i = 0; i < 4; ++i) {
-        p[i] = token->point;
-        rectangle_update(cbox, p[i].x, p[i].y, p[i].x, p[i].y);
-        token = token->next;
-    }
-
-    if (spline) {
-        int x01 = (p[1].x - p[0].x) / 3;
-        int y01 = (p[1].y - p[0].y) / 3;
-        int x12 = (p[2].x - p[1].x) / 3;
-        int y12 = (p[2].y - p[1].y) / 3;
-        int x23 = (p[3].x - p[2].x) / 3;
-        int y23 = (p[3].y - p[2].y) / 3;
-
-        p[0].x = p[1].x + ((x12 - x01) >> 1);
-        p[0].y = p[1].y + ((y12 - y01) >> 1);
-        p[3].x = p[2].x + ((x23 - x12) >> 1);
-        p[3].y = p[2].y + ((y23 - y12) >> 1);
-        p[1].x += x12;
-        p[1].y += y12;
-        p[2].x -= x12;
-        p[2].y -= y12;
-    }
-
-    return (started ||
-        outline_add_point(outline, p[0], 0)) &&
-        outline_add_point(outline, p[1], 0) &&
-        outline_add_point(outline, p[2], 0) &&
-        outline_add_point(outline, p[3], OUTLINE_CUBIC_SPLINE);
+    while (state->n_queued)
+        if (!drawing_execute(state))
+            return false;
+    return true;
 }
 
 /*
- * \brief Convert token list to outline.  Calls the line and curve evaluators.
+ * \brief Parse drawing text straight into outline
  */
 bool ass_drawing_parse(ASS_Outline *outline, ASS_Rect *cbox,
                        const char *text, ASS_Library *lib)
@@ -183,72 +288,14 @@ bool ass_drawing_parse(ASS_Outline *outline, ASS_Rect *cbox,
         return false;
     rectangle_reset(cbox);
 
-    ASS_DrawingToken *tokens = drawing_tokenize(text);
-
-    bool started = false;
-    ASS_Vector pen = {0, 0};
-    ASS_DrawingToken *token = tokens;
-    while (token) {
-        // Draw something according to current command
-        switch (token->type) {
-        case TOKEN_MOVE_NC:
-            pen = token->point;
-            rectangle_update(cbox, pen.x, pen.y, pen.x, pen.y);
-            token = token->next;
-            break;
-        case TOKEN_MOVE:
-            pen = token->point;
-            rectangle_update(cbox, pen.x, pen.y, pen.x, pen.y);
-            if (started) {
-                if (!outline_add_segment(outline, OUTLINE_LINE_SEGMENT))
-                    goto error;
-                if (!outline_close_contour(outline))
-                    goto error;
-                started = false;
-            }
-            token = token->next;
-            break;
-        case TOKEN_LINE: {
-            ASS_Vector to = token->point;
-            rectangle_update(cbox, to.x, to.y, to.x, to.y);
-            if (!started && !outline_add_point(outline, pen, 0))
-                goto error;
-            if (!outline_add_point(outline, to, OUTLINE_LINE_SEGMENT))
-                goto error;
-            started = true;
-            token = token->next;
-            break;
-        }
-        case TOKEN_CUBIC_BEZIER:
-            if (token_check_values(token, 3, TOKEN_CUBIC_BEZIER) &&
-                token->prev) {
-                if (!drawing_add_curve(outline, cbox, token->prev, false, started))
-                    goto error;
-                token = token->next;
-                token = token->next;
-                token = token->next;
-                started = true;
-            } else
-                token = token->next;
-            break;
-        case TOKEN_B_SPLINE:
-            if (token_check_values(token, 3, TOKEN_B_SPLINE) &&
-                token->prev) {
-                if (!drawing_add_curve(outline, cbox, token->prev, true, started))
-                    goto error;
-                token = token->next;
-                started = true;
-            } else
-                token = token->next;
-            break;
-        default:
-            token = token->next;
-            break;
-        }
-    }
+    DrawingState state = {0};
+    state.outline = outline;
+    state.cbox = cbox;
+    if (!drawing_tokenize(&state, text))
+        goto error;
 
     // Close the last contour
-    if (started) {
+    if (state.started) {
         if (!outline_add_segment(outline, OUTLINE_LINE_SEGMENT))
             goto error;
         if (!outline_close_contour(outline))
@@ -260,11 +307,9 @@ bool ass_drawing_parse(ASS_Outline *outline, ASS_Rect *cbox,
                 "Parsed drawing with %d points and %d segments",
                 outline->n_points, outline->n_segments);
 
-    drawing_free_tokens(tokens);
     return true;
 
 error:
-    drawing_free_tokens(tokens);
     outline_free(outline);
     return false;
 }
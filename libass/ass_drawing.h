@@ -23,24 +23,6 @@
 #include "ass_outline.h"
 #include "ass_bitmap.h"
 
-typedef enum {
-    TOKEN_MOVE,
-    TOKEN_MOVE_NC,
-    TOKEN_LINE,
-    TOKEN_CUBIC_BEZIER,
-    TOKEN_CONIC_BEZIER,
-    TOKEN_B_SPLINE,
-    TOKEN_EXTEND_SPLINE,
-    TOKEN_CLOSE
-} ASS_TokenType;
-
-typedef struct ass_drawing_token {
-    ASS_TokenType type;
-    ASS_Vector point;
-    struct ass_drawing_token *next;
-    struct ass_drawing_token *prev;
-} ASS_DrawingToken;
-
 bool ass_drawing_parse(ASS_Outline *outline, ASS_Rect *cbox,
                        const char *text, ASS_Library *lib);
 
@@ -26,7 +26,6 @@
 #include FT_GLYPH_H
 #include FT_TRUETYPE_TABLES_H
 #include FT_OUTLINE_H
-#include <limits.h>
 
 #include "ass.h"
 #include "ass_library.h"
@@ -258,7 +257,7 @@ size_t ass_font_construct(void *key, void *value, void *priv)
     ASS_Font *font = value;
 
     font->library = render_priv->library;
-    font->ftlibrary = render_priv->ftlibrary;
+    font->ftlibrary = ass_renderer_ftlibrary(render_priv);
     font->shaper_priv = NULL;
     font->n_faces = 0;
     font->desc.family = desc->family;
@@ -268,7 +267,7 @@ size_t ass_font_construct(void *key, void *value, void *priv)
 
     font->size = 0.;
 
-    int error = add_face(render_priv->fontselect, font, 0);
+    int error = add_face(ass_renderer_fontselect(render_priv), font, 0);
     if (error == -1)
         font->desc.family = NULL;
     return 1;
@@ -327,91 +326,44 @@ void ass_font_get_asc_desc(ASS_Font *font, int face_index,
     *desc = FT_MulFix(-face->descender, y_scale);
 }
 
-static void add_line(FT_Outline *ol, int bear, int advance, int dir, int pos, int size) {
-    FT_Vector points[4] = {
-        {.x = bear,      .y = pos + size},
-        {.x = advance,   .y = pos + size},
-        {.x = advance,   .y = pos - size},
-        {.x = bear,      .y = pos - size},
-    };
-
-    if (dir == FT_ORIENTATION_TRUETYPE) {
-        int i;
-        for (i = 0; i < 4; i++) {
-            ol->points[ol->n_points] = points[i];
-            ol->tags[ol->n_points++] = 1;
-        }
-    } else {
-        int i;
-        for (i = 3; i >= 0; i--) {
-            ol->points[ol->n_points] = points[i];
-            ol->tags[ol->n_points++] = 1;
-        }
-    }
-
-    ol->contours[ol->n_contours++] = ol->n_points - 1;
-}
-
 /*
- * Strike a glyph with a horizontal line; it's possible to underline it
- * and/or strike through it.  For the line's position and size, truetype
- * tables are consulted.  Obviously this relies on the data in the tables
- * being accurate.
- *
+ * Get the lines to underline a glyph and/or strike through it.
+ * For the line's position and size, truetype tables are consulted.
+ * Obviously this relies on the data in the tables being accurate.
+ * The face must be set to the glyph size.
  */
-static int ass_strike_outline_glyph(FT_Face face, ASS_Font *font,
-                                    FT_Glyph glyph, int under, int through)
+int ass_font_get_decorations(ASS_Font *font, int face_index, int deco,
+                             ASS_DecorationLine lines[2])
 {
+    FT_Face face = font->faces[face_index];
     TT_OS2 *os2 = FT_Get_Sfnt_Table(face, ft_sfnt_os2);
     TT_Postscript *ps = FT_Get_Sfnt_Table(face, ft_sfnt_post);
-    FT_Outline *ol = &((FT_OutlineGlyph) glyph)->outline;
-    int advance, y_scale, i, dir;
-
-    if (!under && !through)
-        return 0;
-
-    // Grow outline
-    i = (under ? 4 : 0) + (through ? 4 : 0);
-    if (ol->n_points > SHRT_MAX - i)
-        return 0;
-    if (!ASS_REALLOC_ARRAY(ol->points, ol->n_points + i))
-        return 0;
-    if (!ASS_REALLOC_ARRAY(ol->tags, ol->n_points + i))
-        return 0;
-    i = !!under + !!through;
-    if (ol->n_contours > SHRT_MAX - i)
-        return 0;
-    if (!ASS_REALLOC_ARRAY(ol->contours, ol->n_contours + i))
-        return 0;
-
-    advance = d16_to_d6(glyph->advance.x);
-    y_scale = face->size->metrics.y_scale;
-
-    // Reverse drawing direction for non-truetype fonts
-    dir = FT_Outline_Get_Orientation(ol);
+    int y_scale = face->size->metrics.y_scale;
+    int n = 0;
 
-    // Add points to the outline
-    if (under && ps) {
+    if ((deco & DECO_UNDERLINE) && ps) {
         int pos = FT_MulFix(ps->underlinePosition, y_scale);
         int size = FT_MulFix(ps->underlineThickness, y_scale / 2);
 
         if (pos > 0 || size <= 0)
-            return 1;
+            return n;
 
-        add_line(ol, 0, advance, dir, pos, size);
+        lines[n].pos = pos;
+        lines[n++].size = size;
     }
 
-    if (through && os2) {
+    if ((deco & DECO_STRIKETHROUGH) && os2) {
         int pos = FT_MulFix(os2->yStrikeoutPosition, y_scale);
         int size = FT_MulFix(os2->yStrikeoutSize, y_scale / 2);
 
         if (pos < 0 || size <= 0)
-            return 1;
+            return n;
 
-        add_line(ol, 0, advance, dir, pos, size);
+        lines[n].pos = pos;
+        lines[n++].size = size;
     }
 
-    return 0;
+    return n;
 }
 
 /**
@@ -570,9 +522,6 @@ FT_Glyph ass_font_get_glyph(ASS_Font *font, int face_index, int index,
         glyph->advance.x = face->glyph->linearVertAdvance;
     }
 
-    ass_strike_outline_glyph(face, font, glyph, deco & DECO_UNDERLINE,
-                             deco & DECO_STRIKETHROUGH);
-
     return glyph;
 }
 
@@ -39,6 +39,12 @@ typedef struct ass_font_desc ASS_FontDesc;
 #define DECO_STRIKETHROUGH 2
 #define DECO_ROTATE        4
 
+// horizontal line of a glyph decoration, in FreeType coordinates
+typedef struct {
+    int pos;        // 26.6, center
+    int size;       // 26.6, half thickness
+} ASS_DecorationLine;
+
 struct ass_font_desc {
     char *family;
     unsigned bold;
@@ -69,6 +75,8 @@ int ass_font_get_index(ASS_FontSelector *fontsel, ASS_Font *font,
 uint32_t ass_font_index_magic(FT_Face face, uint32_t symbol);
 FT_Glyph ass_font_get_glyph(ASS_Font *font, int face_index, int index,
                             ASS_Hinting hinting, int deco);
+int ass_font_get_decorations(ASS_Font *font, int face_index, int deco,
+                             ASS_DecorationLine lines[2]);
 void ass_font_clear(ASS_Font *font);
 
 #endif                          /* LIBASS_FONT_H */
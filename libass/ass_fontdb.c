@@ -0,0 +1,506 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_utils.h"
+#include "ass_fontdb.h"
+
+/*
+ * File layout, all integers little-endian:
+ *   magic, u32 version, u32 file count, then for every file
+ *     str path, i64 mtime, i64 size, u32 face count, then for every face
+ *       i32 index, i32 slant, i32 weight, i32 width, u8 postscript,
+ *       u32 family count, str families..., u32 fullname count, str fullnames...,
+ *       u8 has PostScript name, [str PostScript name],
+ *       u32 range count, u32 first, u32 last...
+ * A string is a u32 length followed by that many bytes.
+ */
+#define FONTDB_MAGIC "libass fontdb\n"
+#define FONTDB_VERSION 1
+#define FONTDB_MAX_SIZE (256 * 1024 * 1024)
+
+typedef struct {
+    const uint8_t *pos, *end;
+    bool error;
+} Reader;
+
+typedef struct {
+    uint8_t *buf;
+    size_t size, capacity;
+    bool error;
+} Writer;
+
+static const uint8_t *read_bytes(Reader *r, size_t size)
+{
+    if (r->error || r->end - r->pos < size) {
+        r->error = true;
+        return NULL;
+    }
+    const uint8_t *res = r->pos;
+    r->pos += size;
+    return res;
+}
+
+static uint64_t read_uint(Reader *r, int size)
+{
+    const uint8_t *p = read_bytes(r, size);
+    uint64_t val = 0;
+    if (p)
+        for (int i = size - 1; i >= 0; i--)
+            val = val << 8 | p[i];
+    return val;
+}
+
+static char *read_string(Reader *r)
+{
+    uint32_t len = read_uint(r, 4);
+    const uint8_t *p = read_bytes(r, len);
+    if (!p)
+        return NULL;
+    char *str = malloc(len + 1);
+    if (!str) {
+        r->error = true;
+        return NULL;
+    }
+    memcpy(str, p, len);
+    str[len] = '\0';
+    return str;
+}
+
+// Read a count of elements that take at least elem_size bytes each
+static uint32_t read_count(Reader *r, size_t elem_size)
+{
+    uint32_t count = read_uint(r, 4);
+    if ((r->end - r->pos) / elem_size < count)
+        r->error = true;
+    return r->error ? 0 : count;
+}
+
+static void write_bytes(Writer *w, const void *data, size_t size)
+{
+    if (w->error)
+        return;
+    if (size > w->capacity - w->size) {
+        size_t capacity = FFMAX(4096, 2 * w->capacity);
+        while (capacity - w->size < size)
+            capacity *= 2;
+        uint8_t *buf = realloc(w->buf, capacity);
+        if (!buf) {
+            w->error = true;
+            return;
+        }
+        w->buf = buf;
+        w->capacity = capacity;
+    }
+    memcpy(w->buf + w->size, data, size);
+    w->size += size;
+}
+
+static void write_uint(Writer *w, uint64_t val, int size)
+{
+    uint8_t buf[8];
+    for (int i = 0; i < size; i++, val >>= 8)
+        buf[i] = val;
+    write_bytes(w, buf, size);
+}
+
+static void write_string(Writer *w, const char *str)
+{
+    size_t len = strlen(str);
+    write_uint(w, len, 4);
+    write_bytes(w, str, len);
+}
+
+static void free_face(FontDBFace *face)
+{
+    ASS_FontProviderMetaData *meta = &face->meta;
+    for (int i = 0; i < meta->n_family; i++)
+        free(meta->families[i]);
+    for (int i = 0; i < meta->n_fullname; i++)
+        free(meta->fullnames[i]);
+    free(meta->families);
+    free(meta->fullnames);
+    free(meta->postscript_name);
+    free(face->ranges);
+}
+
+static void free_file(FontDBFile *file)
+{
+    for (int i = 0; i < file->n_faces; i++)
+        free_face(file->faces + i);
+    free(file->faces);
+    free(file->path);
+}
+
+static char **read_names(Reader *r, int *count)
+{
+    *count = 0;
+    uint32_t n = read_count(r, 4);
+    char **names = ass_realloc_array(NULL, n, sizeof(char *));
+    if (n && !names) {
+        r->error = true;
+        return NULL;
+    }
+    for (; *count < n; ++*count) {
+        names[*count] = read_string(r);
+        if (!names[*count])
+            break;
+    }
+    return names;
+}
+
+static void read_face(Reader *r, FontDBFace *face)
+{
+    ASS_FontProviderMetaData *meta = &face->meta;
+    face->index = (int32_t) read_uint(r, 4);
+    meta->slant = (int32_t) read_uint(r, 4);
+    meta->weight = (int32_t) read_uint(r, 4);
+    meta->width = (int32_t) read_uint(r, 4);
+    face->postscript = read_uint(r, 1);
+    meta->families = read_names(r, &meta->n_family);
+    meta->fullnames = read_names(r, &meta->n_fullname);
+    if (read_uint(r, 1))
+        meta->postscript_name = read_string(r);
+    if (!meta->n_family)
+        r->error = true;
+
+    uint32_t n = read_count(r, 8);
+    face->ranges = ass_realloc_array(NULL, n, sizeof(CodepointRange));
+    if (n && !face->ranges) {
+        r->error = true;
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        face->ranges[i].first = read_uint(r, 4);
+        face->ranges[i].last = read_uint(r, 4);
+    }
+    face->n_ranges = n;
+}
+
+static void read_file_entry(Reader *r, FontDBFile *file)
+{
+    file->path = read_string(r);
+    file->mtime = read_uint(r, 8);
+    file->size = read_uint(r, 8);
+    uint32_t n = read_count(r, 4 * 4 + 1 + 4 + 4 + 1 + 4);
+    file->faces = calloc(n ? n : 1, sizeof(FontDBFace));
+    if (!file->faces) {
+        r->error = true;
+        return;
+    }
+    for (; file->n_faces < n && !r->error; file->n_faces++)
+        read_face(r, file->faces + file->n_faces);
+}
+
+/**
+ * \brief Load a cache file. A missing or broken file leaves the
+ * database empty, to be written again.
+ * \return whether the file was read successfully
+ */
+bool ass_fontdb_read(FontDB *db, ASS_Library *lib, const char *cache_file)
+{
+    memset(db, 0, sizeof(*db));
+    db->dirty = true;
+
+    FILE *fp = fopen(cache_file, "rb");
+    if (!fp) {
+        ass_msg(lib, MSGL_V, "No font cache '%s'", cache_file);
+        return false;
+    }
+
+    uint8_t *buf = NULL;
+    long size = -1;
+    if (!fseek(fp, 0, SEEK_END))
+        size = ftell(fp);
+    if (size > 0 && size <= FONTDB_MAX_SIZE && !fseek(fp, 0, SEEK_SET)) {
+        buf = malloc(size);
+        if (buf && fread(buf, 1, size, fp) != size) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+    if (!buf) {
+        ass_msg(lib, MSGL_WARN, "Failed to read font cache '%s'", cache_file);
+        return false;
+    }
+
+    Reader r = { buf, buf + size, false };
+    const uint8_t *magic = read_bytes(&r, strlen(FONTDB_MAGIC));
+    if (!magic || memcmp(magic, FONTDB_MAGIC, strlen(FONTDB_MAGIC)) ||
+            read_uint(&r, 4) != FONTDB_VERSION)
+        r.error = true;
+
+    uint32_t n = read_count(&r, 4 + 8 + 8 + 4);
+    db->files = calloc(n ? n : 1, sizeof(FontDBFile));
+    if (!db->files)
+        r.error = true;
+    else
+        db->max_files = n ? n : 1;
+    for (; db->n_files < n && !r.error; db->n_files++)
+        read_file_entry(&r, db->files + db->n_files);
+    free(buf);
+
+    if (r.error) {
+        ass_msg(lib, MSGL_WARN, "Ignoring invalid font cache '%s'", cache_file);
+        ass_fontdb_done(db);
+        db->dirty = true;
+        return false;
+    }
+    db->dirty = false;
+    return true;
+}
+
+/**
+ * \brief Write the files seen during the current scan to a cache file.
+ * The file is replaced atomically.
+ */
+bool ass_fontdb_write(FontDB *db, ASS_Library *lib, const char *cache_file)
+{
+    Writer w = {0};
+    uint32_t n_files = 0;
+    for (size_t i = 0; i < db->n_files; i++)
+        n_files += db->files[i].used;
+
+    write_bytes(&w, FONTDB_MAGIC, strlen(FONTDB_MAGIC));
+    write_uint(&w, FONTDB_VERSION, 4);
+    write_uint(&w, n_files, 4);
+    for (size_t i = 0; i < db->n_files; i++) {
+        FontDBFile *file = db->files + i;
+        if (!file->used)
+            continue;
+        write_string(&w, file->path);
+        write_uint(&w, file->mtime, 8);
+        write_uint(&w, file->size, 8);
+        write_uint(&w, file->n_faces, 4);
+        for (int j = 0; j < file->n_faces; j++) {
+            FontDBFace *face = file->faces + j;
+            ASS_FontProviderMetaData *meta = &face->meta;
+            write_uint(&w, face->index, 4);
+            write_uint(&w, meta->slant, 4);
+            write_uint(&w, meta->weight, 4);
+            write_uint(&w, meta->width, 4);
+            write_uint(&w, face->postscript, 1);
+            write_uint(&w, meta->n_family, 4);
+            for (int k = 0; k < meta->n_family; k++)
+                write_string(&w, meta->families[k]);
+            write_uint(&w, meta->n_fullname, 4);
+            for (int k = 0; k < meta->n_fullname; k++)
+                write_string(&w, meta->fullnames[k]);
+            write_uint(&w, !!meta->postscript_name, 1);
+            if (meta->postscript_name)
+                write_string(&w, meta->postscript_name);
+            write_uint(&w, face->n_ranges, 4);
+            for (size_t k = 0; k < face->n_ranges; k++) {
+                write_uint(&w, face->ranges[k].first, 4);
+                write_uint(&w, face->ranges[k].last, 4);
+            }
+        }
+    }
+
+    bool ok = false;
+    size_t len = strlen(cache_file);
+    char *tmp = malloc(len + 5);
+    if (!w.error && tmp) {
+        memcpy(tmp, cache_file, len);
+        memcpy(tmp + len, ".tmp", 5);
+        FILE *fp = fopen(tmp, "wb");
+        if (fp) {
+            ok = fwrite(w.buf, 1, w.size, fp) == w.size;
+            ok = !fclose(fp) && ok;
+            ok = ok && !rename(tmp, cache_file);
+            if (!ok)
+                remove(tmp);
+        }
+    }
+    if (ok)
+        ass_msg(lib, MSGL_INFO, "Wrote font cache '%s'", cache_file);
+    else
+        ass_msg(lib, MSGL_WARN, "Failed to write font cache '%s'", cache_file);
+
+    free(tmp);
+    free(w.buf);
+    if (ok)
+        db->dirty = false;
+    return ok;
+}
+
+void ass_fontdb_done(FontDB *db)
+{
+    for (size_t i = 0; i < db->n_files; i++)
+        free_file(db->files + i);
+    free(db->files);
+    memset(db, 0, sizeof(*db));
+}
+
+/**
+ * \brief Find an unchanged font file and mark it as used.
+ * \return the file entry, or NULL if it is missing or stale
+ */
+FontDBFile *ass_fontdb_find(FontDB *db, const char *path,
+                            int64_t mtime, int64_t size)
+{
+    for (size_t i = 0; i < db->n_files; i++) {
+        FontDBFile *file = db->files + i;
+        if (file->used || strcmp(file->path, path))
+            continue;
+        if (file->mtime != mtime || file->size != size)
+            return NULL;
+        file->used = true;
+        return file;
+    }
+    return NULL;
+}
+
+/**
+ * \brief Add a new or changed font file, with no faces yet.
+ */
+FontDBFile *ass_fontdb_add_file(FontDB *db, const char *path,
+                                int64_t mtime, int64_t size)
+{
+    if (db->n_files >= db->max_files) {
+        size_t max = FFMAX(16, 2 * db->max_files);
+        if (!ASS_REALLOC_ARRAY(db->files, max))
+            return NULL;
+        db->max_files = max;
+    }
+    FontDBFile *file = db->files + db->n_files;
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    if (!file->path)
+        return NULL;
+    file->mtime = mtime;
+    file->size = size;
+    file->used = true;
+    db->n_files++;
+    db->dirty = true;
+    return file;
+}
+
+static char **copy_names(char **names, int count)
+{
+    char **res = ass_realloc_array(NULL, count, sizeof(char *));
+    if (!res)
+        return NULL;
+    for (int i = 0; i < count; i++) {
+        res[i] = strdup(names[i]);
+        if (!res[i]) {
+            while (i--)
+                free(res[i]);
+            free(res);
+            return NULL;
+        }
+    }
+    return res;
+}
+
+/**
+ * \brief Add a face to a font file, copying its metadata.
+ * \return the face, to fill in the coverage, or NULL on failure
+ */
+FontDBFace *ass_fontdb_add_face(FontDBFile *file, int index,
+                                ASS_FontProviderMetaData *meta,
+                                bool postscript)
+{
+    if (!ASS_REALLOC_ARRAY(file->faces, file->n_faces + 1))
+        return NULL;
+    FontDBFace *face = file->faces + file->n_faces;
+    memset(face, 0, sizeof(*face));
+    face->index = index;
+    face->postscript = postscript;
+    face->meta.slant = meta->slant;
+    face->meta.weight = meta->weight;
+    face->meta.width = meta->width;
+
+    face->meta.families = copy_names(meta->families, meta->n_family);
+    if (!face->meta.families)
+        goto fail;
+    face->meta.n_family = meta->n_family;
+    if (meta->n_fullname) {
+        face->meta.fullnames = copy_names(meta->fullnames, meta->n_fullname);
+        if (!face->meta.fullnames)
+            goto fail;
+        face->meta.n_fullname = meta->n_fullname;
+    }
+    if (meta->postscript_name) {
+        face->meta.postscript_name = strdup(meta->postscript_name);
+        if (!face->meta.postscript_name)
+            goto fail;
+    }
+
+    file->n_faces++;
+    return face;
+
+fail:
+    free_face(face);
+    return NULL;
+}
+
+/**
+ * \brief Collect the codepoints the selected charmap of a face maps
+ * to glyphs, as sorted ranges.
+ */
+bool ass_fontdb_get_coverage(FT_Face face, CodepointRange **ranges,
+                             size_t *n_ranges)
+{
+    CodepointRange *res = NULL;
+    size_t n = 0, max = 0;
+
+    FT_UInt glyph;
+    FT_ULong code = FT_Get_First_Char(face, &glyph);
+    while (glyph) {
+        if (n && res[n - 1].last + 1 == code) {
+            res[n - 1].last = code;
+        } else {
+            if (n >= max) {
+                max = FFMAX(16, 2 * max);
+                if (!ASS_REALLOC_ARRAY(res, max)) {
+                    free(res);
+                    return false;
+                }
+            }
+            res[n].first = res[n].last = code;
+            n++;
+        }
+        code = FT_Get_Next_Char(face, code, &glyph);
+    }
+
+    *ranges = res;
+    *n_ranges = n;
+    return true;
+}
+
+bool ass_fontdb_has_codepoint(const CodepointRange *ranges, size_t n_ranges,
+                              uint32_t code)
+{
+    size_t lo = 0, hi = n_ranges;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ranges[mid].last < code)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < n_ranges && ranges[lo].first <= code;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_FONTDB_H
+#define LIBASS_FONTDB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ass_types.h"
+#include "ass_fontselect.h"
+
+/*
+ * Font metadata cache file for the fonts directory. Every font file is
+ * stored with its size and modification time, and all of its faces with
+ * their names, attributes and glyph coverage. Fonts whose files didn't
+ * change can then be registered without opening them.
+ */
+
+typedef struct {
+    uint32_t first, last;
+} CodepointRange;
+
+typedef struct {
+    int index;                      // face index inside the file
+    ASS_FontProviderMetaData meta;
+    bool postscript;
+    size_t n_ranges;
+    CodepointRange *ranges;         // sorted glyph coverage
+} FontDBFace;
+
+typedef struct {
+    char *path;
+    int64_t mtime, size;
+    int n_faces;
+    FontDBFace *faces;
+    bool used;                      // seen during the current scan
+} FontDBFile;
+
+typedef struct {
+    size_t n_files, max_files;
+    FontDBFile *files;
+    bool dirty;                     // needs to be written back
+} FontDB;
+
+bool ass_fontdb_read(FontDB *db, ASS_Library *lib, const char *cache_file);
+bool ass_fontdb_write(FontDB *db, ASS_Library *lib, const char *cache_file);
+void ass_fontdb_done(FontDB *db);
+
+FontDBFile *ass_fontdb_find(FontDB *db, const char *path,
+                            int64_t mtime, int64_t size);
+FontDBFile *ass_fontdb_add_file(FontDB *db, const char *path,
+                                int64_t mtime, int64_t size);
+FontDBFace *ass_fontdb_add_face(FontDBFile *file, int index,
+                                ASS_FontProviderMetaData *meta,
+                                bool postscript);
+
+bool ass_fontdb_get_coverage(FT_Face face, CodepointRange **ranges,
+                             size_t *n_ranges);
+bool ass_fontdb_has_codepoint(const CodepointRange *ranges, size_t n_ranges,
+                              uint32_t code);
+
+#endif                          /* LIBASS_FONTDB_H */
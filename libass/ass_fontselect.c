@@ -31,7 +31,11 @@
 #include <limits.h>
 #include <ft2build.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
+#ifdef CONFIG_PTHREAD
+#include <pthread.h>
+#endif
 #include FT_FREETYPE_H
 #include FT_SFNT_NAMES_H
 #include FT_TRUETYPE_IDS_H
@@ -41,6 +45,7 @@
 #include "ass.h"
 #include "ass_library.h"
 #include "ass_fontselect.h"
+#include "ass_fontdb.h"
 #include "ass_fontconfig.h"
 #include "ass_coretext.h"
 #include "ass_directwrite.h"
@@ -49,6 +54,28 @@
 
 #define ABS(x) ((x) < 0 ? -(x) : (x))
 #define MAX_FULLNAME 100
+#define MAX_SELECT_MEMO 4096
+
+// memoized check_glyph() results for 256 codepoints
+typedef struct {
+    uint32_t block;         // codepoint >> 8
+    uint32_t checked[8];    // bit set if the codepoint was checked
+    uint32_t covered[8];    // bit set if the font has a glyph for it
+} CoverageBlock;
+
+// memoized result of ass_font_select()
+typedef struct {
+    char *family;           // NULL if the slot is free
+    unsigned bold, italic;
+    uint32_t code;
+    uint32_t hash;
+
+    char *path;
+    int index;
+    char *postscript_name;
+    int uid;
+    ASS_FontStream stream;
+} FontSelectMemo;
 
 // internal font database element
 // all strings are utf-8
@@ -76,8 +103,19 @@ struct font_info {
 
     // private data for callbacks
     void *priv;
+
+    // glyph coverage known so far, sorted by block
+    CoverageBlock *coverage;
+    int n_coverage;
+    int max_coverage;
 };
 
+// slot of the font name index
+typedef struct {
+    uint32_t hash;  // ass_strcasehash() of the name
+    int font;       // index into font_infos, -1 if the slot is free
+} FontNameSlot;
+
 struct font_selector {
     // uid counter
     int uid;
@@ -92,8 +130,26 @@ struct font_selector {
     int alloc_font;
     ASS_FontInfo *font_infos;
 
+    // hash index of family, full and PostScript names of all fonts
+    size_t n_names;
+    size_t max_names;   // power of two
+    FontNameSlot *names;
+    bool names_incomplete;  // a rebuild failed, the index can't be used
+
+    // scratch list of fonts matching a name
+    int *candidates;
+    size_t max_candidates;
+
+    // results of ass_font_select(), valid until the font list changes
+    size_t n_memo;
+    size_t max_memo;    // power of two
+    FontSelectMemo *memo;
+
     ASS_FontProvider *default_provider;
     ASS_FontProvider *embedded_provider;
+
+    // FreeType library of a selector built by a font loader, NULL otherwise
+    FT_Library ftlibrary;
 };
 
 struct font_provider {
@@ -102,18 +158,53 @@ struct font_provider {
     void *priv;
 };
 
+// Faces of embedded and directory fonts are only opened to read their
+// names at registration, and opened again once they are needed.
 typedef struct font_data_ft FontDataFT;
 struct font_data_ft {
     ASS_Library *lib;
-    FT_Face face;
-    int idx;
+    FT_Library ftlib;
+    FT_Face face;       // NULL until opened by get_face_ft()
+    int idx;            // index into lib->fontdata, -1 for font files
+    char *path;         // font file, NULL for memory fonts
+    int face_index;
+    bool postscript;
+
+    // glyph coverage from the font cache, if known
+    bool has_coverage;
+    size_t n_ranges;
+    CodepointRange *ranges;
 };
 
+static FT_Face get_face_ft(FontDataFT *fd)
+{
+    if (fd->face)
+        return fd->face;
+
+    int rc;
+    if (fd->path) {
+        rc = FT_New_Face(fd->ftlib, fd->path, fd->face_index, &fd->face);
+    } else {
+        ASS_Fontdata *data = fd->lib->fontdata + fd->idx;
+        rc = FT_New_Memory_Face(fd->ftlib, (unsigned char *) data->data,
+                                data->size, fd->face_index, &fd->face);
+    }
+    if (rc) {
+        ass_msg(fd->lib, MSGL_WARN, "Error opening font: '%s', %d",
+                fd->path ? fd->path : fd->lib->fontdata[fd->idx].name,
+                fd->face_index);
+        fd->face = NULL;
+        return NULL;
+    }
+
+    charmap_magic(fd->lib, fd->face);
+    return fd->face;
+}
+
 static bool check_postscript_ft(void *data)
 {
     FontDataFT *fd = (FontDataFT *)data;
-    PS_FontInfoRec postscript_info;
-    return !FT_Get_PS_Font_Info(fd->face, &postscript_info);
+    return fd->postscript;
 }
 
 static bool check_glyph_ft(void *data, uint32_t codepoint)
@@ -123,14 +214,21 @@ static bool check_glyph_ft(void *data, uint32_t codepoint)
     if (!codepoint)
         return true;
 
-    return !!FT_Get_Char_Index(fd->face, codepoint);
+    if (fd->has_coverage)
+        return ass_fontdb_has_codepoint(fd->ranges, fd->n_ranges, codepoint);
+
+    FT_Face face = get_face_ft(fd);
+    return face && FT_Get_Char_Index(face, codepoint);
 }
 
 static void destroy_font_ft(void *data)
 {
     FontDataFT *fd = (FontDataFT *)data;
 
-    FT_Done_Face(fd->face);
+    if (fd->face)
+        FT_Done_Face(fd->face);
+    free(fd->path);
+    free(fd->ranges);
     free(fd);
 }
 
@@ -161,11 +259,70 @@ static ASS_FontProviderFuncs ft_funcs = {
     .destroy_font      = destroy_font_ft,
 };
 
-static void load_fonts_from_dir(ASS_Library *library, const char *dir)
+static void add_fonts_ft(ASS_FontProvider *priv, ASS_Library *library,
+                         FT_Library ftlibrary, const char *path, int idx,
+                         FontDBFile *cache);
+
+static bool set_coverage(FontDataFT *ft, const CodepointRange *ranges,
+                         size_t n_ranges)
+{
+    ft->ranges = ass_realloc_array(NULL, n_ranges, sizeof(CodepointRange));
+    if (n_ranges && !ft->ranges)
+        return false;
+    if (n_ranges)
+        memcpy(ft->ranges, ranges, n_ranges * sizeof(CodepointRange));
+    ft->n_ranges = n_ranges;
+    ft->has_coverage = true;
+    return true;
+}
+
+/**
+ * \brief Register the faces of an unchanged font file from the font cache.
+ */
+static void add_cached_fonts(ASS_FontProvider *priv, ASS_Library *library,
+                             FT_Library ftlibrary, FontDBFile *file)
+{
+    for (int i = 0; i < file->n_faces; i++) {
+        FontDBFace *face = file->faces + i;
+        FontDataFT *ft = calloc(1, sizeof(FontDataFT));
+        if (!ft)
+            continue;
+        ft->lib = library;
+        ft->ftlib = ftlibrary;
+        ft->idx = -1;
+        ft->face_index = face->index;
+        ft->postscript = face->postscript;
+        ft->path = strdup(file->path);
+        if (!ft->path || !set_coverage(ft, face->ranges, face->n_ranges)) {
+            destroy_font_ft(ft);
+            continue;
+        }
+
+        if (!ass_font_provider_add_font(priv, &face->meta, file->path,
+                                        face->index, ft))
+            ass_msg(library, MSGL_WARN, "Failed to add embedded font '%s'",
+                    file->path);
+    }
+}
+
+/**
+ * \brief Register all font files of a directory. Only the names are
+ * read here, faces are opened from the files when they're selected.
+ * With a font cache file, unchanged files aren't opened at all.
+ * \param cache_file font cache file, or NULL
+ */
+static void load_fonts_from_dir(ASS_FontProvider *priv, ASS_Library *library,
+                                FT_Library ftlibrary, const char *dir,
+                                const char *cache_file)
 {
     DIR *d = opendir(dir);
     if (!d)
         return;
+
+    FontDB db;
+    if (cache_file)
+        ass_fontdb_read(&db, library, cache_file);
+
     while (1) {
         struct dirent *entry = readdir(d);
         if (!entry)
@@ -174,15 +331,34 @@ static void load_fonts_from_dir(ASS_Library *library, const char *dir)
             continue;
         char fullname[4096];
         snprintf(fullname, sizeof(fullname), "%s/%s", dir, entry->d_name);
-        size_t bufsize = 0;
-        ass_msg(library, MSGL_INFO, "Loading font file '%s'", fullname);
-        void *data = read_file(library, fullname, &bufsize);
-        if (data) {
-            ass_add_font(library, entry->d_name, data, bufsize);
-            free(data);
+
+        FontDBFile *file = NULL;
+        if (cache_file) {
+            struct stat st;
+            if (stat(fullname, &st))
+                continue;
+            file = ass_fontdb_find(&db, fullname, st.st_mtime, st.st_size);
+            if (file) {
+                add_cached_fonts(priv, library, ftlibrary, file);
+                continue;
+            }
+            file = ass_fontdb_add_file(&db, fullname, st.st_mtime, st.st_size);
         }
+
+        ass_msg(library, MSGL_INFO, "Loading font file '%s'", fullname);
+        add_fonts_ft(priv, library, ftlibrary, fullname, -1, file);
     }
     closedir(d);
+
+    if (cache_file) {
+        // files that are gone have to be dropped from the cache too
+        for (size_t i = 0; i < db.n_files; i++)
+            if (!db.files[i].used)
+                db.dirty = true;
+        if (db.dirty)
+            ass_fontdb_write(&db, library, cache_file);
+        ass_fontdb_done(&db);
+    }
 }
 
 /**
@@ -235,6 +411,180 @@ static void ass_font_provider_free_fontinfo(ASS_FontInfo *info)
     if (info->postscript_name)
         free(info->postscript_name);
 
+    free(info->coverage);
+}
+
+/**
+ * \brief Forget all memoized font selections. Must be called whenever
+ * fonts are added or removed.
+ */
+static void memo_clear(ASS_FontSelector *selector)
+{
+    for (size_t i = 0; i < selector->max_memo; i++) {
+        free(selector->memo[i].family);
+        selector->memo[i].family = NULL;
+    }
+    selector->n_memo = 0;
+}
+
+static uint32_t memo_hash(const char *family, unsigned bold, unsigned italic,
+                          uint32_t code)
+{
+    uint32_t hval = fnv_32a_str(family, FNV1_32A_INIT);
+    hval = fnv_32a_buf(&bold, sizeof(bold), hval);
+    hval = fnv_32a_buf(&italic, sizeof(italic), hval);
+    return fnv_32a_buf(&code, sizeof(code), hval);
+}
+
+/**
+ * \brief Find the memo slot of a request.
+ * \return the matching slot, or the empty slot to store it in
+ */
+static FontSelectMemo *memo_find(ASS_FontSelector *selector, uint32_t hash,
+                                 const char *family, unsigned bold,
+                                 unsigned italic, uint32_t code)
+{
+    size_t mask = selector->max_memo - 1;
+    for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+        FontSelectMemo *memo = selector->memo + pos;
+        if (!memo->family)
+            return memo;
+        if (memo->hash == hash && memo->code == code &&
+                memo->bold == bold && memo->italic == italic &&
+                !strcmp(memo->family, family))
+            return memo;
+    }
+}
+
+/**
+ * \brief Make room for one more memo entry.
+ * Starts over instead of growing past MAX_SELECT_MEMO.
+ */
+static bool memo_reserve(ASS_FontSelector *selector)
+{
+    if (2 * (selector->n_memo + 1) <= selector->max_memo)
+        return true;
+    if (selector->n_memo >= MAX_SELECT_MEMO) {
+        memo_clear(selector);
+        return true;
+    }
+
+    size_t max_memo = FFMAX(64, 2 * selector->max_memo);
+    FontSelectMemo *memo = ass_realloc_array(NULL, max_memo, sizeof(*memo));
+    if (!memo)
+        return false;
+    for (size_t i = 0; i < max_memo; i++)
+        memo[i].family = NULL;
+    for (size_t i = 0; i < selector->max_memo; i++) {
+        FontSelectMemo *entry = selector->memo + i;
+        if (!entry->family)
+            continue;
+        size_t pos = entry->hash & (max_memo - 1);
+        while (memo[pos].family)
+            pos = (pos + 1) & (max_memo - 1);
+        memo[pos] = *entry;
+    }
+    free(selector->memo);
+    selector->memo = memo;
+    selector->max_memo = max_memo;
+    return true;
+}
+
+static bool index_insert(ASS_FontSelector *selector, uint32_t hash, int font)
+{
+    if (2 * (selector->n_names + 1) > selector->max_names) {
+        size_t max_names = FFMAX(64, 2 * selector->max_names);
+        FontNameSlot *names = ass_realloc_array(NULL, max_names, sizeof(*names));
+        if (!names)
+            return false;
+        for (size_t i = 0; i < max_names; i++)
+            names[i].font = -1;
+        for (size_t i = 0; i < selector->max_names; i++) {
+            FontNameSlot *slot = selector->names + i;
+            if (slot->font < 0)
+                continue;
+            size_t pos = slot->hash & (max_names - 1);
+            while (names[pos].font >= 0)
+                pos = (pos + 1) & (max_names - 1);
+            names[pos] = *slot;
+        }
+        free(selector->names);
+        selector->names = names;
+        selector->max_names = max_names;
+    }
+
+    size_t mask = selector->max_names - 1;
+    size_t pos = hash & mask;
+    while (selector->names[pos].font >= 0) {
+        // a font with several names hashing equal needs only one entry
+        if (selector->names[pos].hash == hash &&
+                selector->names[pos].font == font)
+            return true;
+        pos = (pos + 1) & mask;
+    }
+    selector->names[pos].hash = hash;
+    selector->names[pos].font = font;
+    selector->n_names++;
+    return true;
+}
+
+/**
+ * \brief Add all names of a font to the name index.
+ * \param font index of the font in font_infos
+ */
+static bool index_add_font(ASS_FontSelector *selector, int font)
+{
+    ASS_FontInfo *info = selector->font_infos + font;
+    for (int i = 0; i < info->n_family; i++)
+        if (!index_insert(selector, ass_strcasehash(info->families[i]), font))
+            return false;
+    for (int i = 0; i < info->n_fullname; i++)
+        if (!index_insert(selector, ass_strcasehash(info->fullnames[i]), font))
+            return false;
+    if (info->postscript_name &&
+            !index_insert(selector, ass_strcasehash(info->postscript_name), font))
+        return false;
+    return true;
+}
+
+static int compare_font_index(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+/**
+ * \brief Collect the fonts that may have the given family, full
+ * or PostScript name, in font list order. These are all fonts
+ * that can match the name, but matches still need to be verified.
+ * \return number of candidates, or -1 on allocation failure
+ */
+static int find_candidates(ASS_FontSelector *selector, const char *name)
+{
+    size_t n = 0;
+    if (selector->names_incomplete)
+        return -1;
+    if (!selector->max_names)
+        return 0;
+
+    uint32_t hash = ass_strcasehash(name);
+    size_t mask = selector->max_names - 1;
+    for (size_t pos = hash & mask; selector->names[pos].font >= 0;
+            pos = (pos + 1) & mask) {
+        // skip leftovers of fonts that failed to be added
+        if (selector->names[pos].hash != hash ||
+                selector->names[pos].font >= selector->n_font)
+            continue;
+        if (n >= selector->max_candidates) {
+            size_t max = FFMAX(16, 2 * selector->max_candidates);
+            if (!ASS_REALLOC_ARRAY(selector->candidates, max))
+                return -1;
+            selector->max_candidates = max;
+        }
+        selector->candidates[n++] = selector->names[pos].font;
+    }
+
+    qsort(selector->candidates, n, sizeof(int), compare_font_index);
+    return n;
 }
 
 /**
@@ -344,7 +694,11 @@ ass_font_provider_add_font(ASS_FontProvider *provider,
     info->priv  = data;
     info->provider = provider;
 
+    if (!index_add_font(selector, selector->n_font))
+        goto error;
+
     selector->n_font++;
+    memo_clear(selector);
     return true;
 
 error:
@@ -356,6 +710,23 @@ error:
     return false;
 }
 
+/**
+ * \brief Rebuild the name index and forget memoized selections
+ * after fonts have moved in the font list.
+ */
+static void index_rebuild(ASS_FontSelector *selector)
+{
+    memo_clear(selector);
+
+    free(selector->names);
+    selector->names = NULL;
+    selector->n_names = selector->max_names = 0;
+    selector->names_incomplete = false;
+    for (int i = 0; i < selector->n_font; i++)
+        if (!index_add_font(selector, i))
+            selector->names_incomplete = true;
+}
+
 /**
  * \brief Clean up font database. Deletes all fonts that have an invalid
  * font provider (NULL).
@@ -380,6 +751,9 @@ static void ass_fontselect_cleanup(ASS_FontSelector *selector)
     }
 
     selector->n_font = w;
+
+    // fonts moved, so rebuild the name index
+    index_rebuild(selector);
 }
 
 void ass_font_provider_free(ASS_FontProvider *provider)
@@ -507,12 +881,59 @@ static void font_info_dump(ASS_FontInfo *font_infos, size_t len)
 }
 #endif
 
+/**
+ * \brief Find or add the coverage block of a codepoint.
+ * \return the block, or NULL on allocation failure
+ */
+static CoverageBlock *get_coverage_block(ASS_FontInfo *fi, uint32_t code)
+{
+    uint32_t block = code >> 8;
+    int lo = 0, hi = fi->n_coverage;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (fi->coverage[mid].block < block)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < fi->n_coverage && fi->coverage[lo].block == block)
+        return fi->coverage + lo;
+
+    if (fi->n_coverage >= fi->max_coverage) {
+        int max = FFMAX(4, 2 * fi->max_coverage);
+        if (!ASS_REALLOC_ARRAY(fi->coverage, max))
+            return NULL;
+        fi->max_coverage = max;
+    }
+    CoverageBlock *res = fi->coverage + lo;
+    memmove(res + 1, res, (fi->n_coverage - lo) * sizeof(CoverageBlock));
+    fi->n_coverage++;
+    memset(res, 0, sizeof(CoverageBlock));
+    res->block = block;
+    return res;
+}
+
+/**
+ * \brief Check whether a font has a glyph for a codepoint.
+ * Asks the provider only once for every font and codepoint.
+ */
 static bool check_glyph(ASS_FontInfo *fi, uint32_t code)
 {
     ASS_FontProvider *provider = fi->provider;
     assert(provider && provider->funcs.check_glyph);
 
-    return provider->funcs.check_glyph(fi->priv, code);
+    CoverageBlock *block = get_coverage_block(fi, code);
+    if (!block)
+        return provider->funcs.check_glyph(fi->priv, code);
+
+    int word = (code >> 5) & 7;
+    uint32_t bit = (uint32_t) 1 << (code & 31);
+    if (!(block->checked[word] & bit)) {
+        block->checked[word] |= bit;
+        if (provider->funcs.check_glyph(fi->priv, code))
+            block->covered[word] |= bit;
+    }
+    return block->covered[word] & bit;
 }
 
 static char *
@@ -538,8 +959,16 @@ find_font(ASS_FontSelector *priv, ASS_Library *library,
     for (int i = 0; i < meta.n_fullname; i++) {
         const char *fullname = meta.fullnames[i];
 
-        for (int x = 0; x < priv->n_font; x++) {
-            ASS_FontInfo *font = &priv->font_infos[x];
+        // only fonts listed in the name index can match,
+        // scan the whole list if the lookup failed
+        int n_candidates = find_candidates(priv, fullname);
+        bool scan_all = n_candidates < 0;
+        if (scan_all)
+            n_candidates = priv->n_font;
+
+        for (int x = 0; x < n_candidates; x++) {
+            ASS_FontInfo *font =
+                &priv->font_infos[scan_all ? x : priv->candidates[x]];
             unsigned score = UINT_MAX;
 
             if (matches_family_name(font, fullname)) {
@@ -687,14 +1116,13 @@ static char *select_font(ASS_FontSelector *priv, ASS_Library *library,
  * \param code: the character that should be present in the font, can be 0
  * \return font file path
 */
-char *ass_font_select(ASS_FontSelector *priv, ASS_Library *library,
-                      ASS_Font *font, int *index, char **postscript_name,
-                      int *uid, ASS_FontStream *data, uint32_t code)
+static char *
+select_font_uncached(ASS_FontSelector *priv, ASS_Library *library,
+                     const char *family, unsigned bold, unsigned italic,
+                     int *index, char **postscript_name,
+                     int *uid, ASS_FontStream *data, uint32_t code)
 {
     char *res = 0;
-    const char *family = font->desc.family;
-    unsigned bold = font->desc.bold;
-    unsigned italic = font->desc.italic;
     ASS_FontProvider *default_provider = priv->default_provider;
 
     if (family && *family)
@@ -742,6 +1170,54 @@ char *ass_font_select(ASS_FontSelector *priv, ASS_Library *library,
     return res;
 }
 
+char *ass_font_select(ASS_FontSelector *priv, ASS_Library *library,
+                      ASS_Font *font, int *index, char **postscript_name,
+                      int *uid, ASS_FontStream *data, uint32_t code)
+{
+    const char *family = font->desc.family;
+    unsigned bold = font->desc.bold;
+    unsigned italic = font->desc.italic;
+
+    // NULL and empty family select the same font
+    const char *key = family ? family : "";
+    uint32_t hash = memo_hash(key, bold, italic, code);
+    FontSelectMemo *memo = NULL;
+    if (memo_reserve(priv)) {
+        memo = memo_find(priv, hash, key, bold, italic, code);
+        if (memo->family) {
+            *index = memo->index;
+            *postscript_name = memo->postscript_name;
+            *uid = memo->uid;
+            *data = memo->stream;
+            return memo->path;
+        }
+    }
+
+    *uid = 0;
+    char *res = select_font_uncached(priv, library, family, bold, italic,
+                                     index, postscript_name, uid, data, code);
+
+    // fonts added on demand while selecting cleared the memo,
+    // so the slot has to be looked up again
+    if (!memo || !memo_reserve(priv))
+        return res;
+    memo = memo_find(priv, hash, key, bold, italic, code);
+    memo->family = strdup(key);
+    if (!memo->family)
+        return res;
+    memo->hash = hash;
+    memo->bold = bold;
+    memo->italic = italic;
+    memo->code = code;
+    memo->path = res;
+    memo->index = *index;
+    memo->postscript_name = *postscript_name;
+    memo->uid = *uid;
+    memo->stream = *data;
+    priv->n_memo++;
+    return res;
+}
+
 
 /**
  * \brief Read basic metadata (names, weight, slant) from a FreeType face,
@@ -918,13 +1394,18 @@ static void free_font_info(ASS_FontProviderMetaData *meta)
  *
  * Builds a FontInfo with FreeType and some table reading.
 */
-static void process_fontdata(ASS_FontProvider *priv, ASS_Library *library,
-                             FT_Library ftlibrary, int idx)
+/**
+ * \brief Add all faces of a font file or memory font to the provider.
+ * \param path font file, or NULL for memory fonts
+ * \param idx index into library->fontdata for memory fonts
+ * \param cache font cache entry to record the faces in, or NULL
+ */
+static void add_fonts_ft(ASS_FontProvider *priv, ASS_Library *library,
+                         FT_Library ftlibrary, const char *path, int idx,
+                         FontDBFile *cache)
 {
     int rc;
-    const char *name = library->fontdata[idx].name;
-    const char *data = library->fontdata[idx].data;
-    int data_size = library->fontdata[idx].size;
+    const char *name = path ? path : library->fontdata[idx].name;
 
     FT_Face face;
     int face_index, num_faces = 1;
@@ -933,11 +1414,16 @@ static void process_fontdata(ASS_FontProvider *priv, ASS_Library *library,
         ASS_FontProviderMetaData info;
         FontDataFT *ft;
 
-        rc = FT_New_Memory_Face(ftlibrary, (unsigned char *) data,
-                                data_size, face_index, &face);
+        if (path) {
+            rc = FT_New_Face(ftlibrary, path, face_index, &face);
+        } else {
+            rc = FT_New_Memory_Face(ftlibrary,
+                                    (unsigned char *) library->fontdata[idx].data,
+                                    library->fontdata[idx].size, face_index, &face);
+        }
         if (rc) {
-            ass_msg(library, MSGL_WARN, "Error opening memory font '%s'",
-                   name);
+            ass_msg(library, MSGL_WARN, "Error opening %s font '%s'",
+                    path ? "file" : "memory", name);
             continue;
         }
 
@@ -954,6 +1440,13 @@ static void process_fontdata(ASS_FontProvider *priv, ASS_Library *library,
         }
 
         ft = calloc(1, sizeof(FontDataFT));
+        if (ft && path) {
+            ft->path = strdup(path);
+            if (!ft->path) {
+                free(ft);
+                ft = NULL;
+            }
+        }
 
         if (ft == NULL) {
             free_font_info(&info);
@@ -961,17 +1454,32 @@ static void process_fontdata(ASS_FontProvider *priv, ASS_Library *library,
             continue;
         }
 
+        PS_FontInfoRec postscript_info;
         ft->lib  = library;
-        ft->face = face;
+        ft->ftlib = ftlibrary;
         ft->idx  = idx;
+        ft->face_index = face_index;
+        ft->postscript = !FT_Get_PS_Font_Info(face, &postscript_info);
+
+        if (cache) {
+            FontDBFace *entry =
+                ass_fontdb_add_face(cache, face_index, &info, ft->postscript);
+            if (!entry || !ass_fontdb_get_coverage(face, &entry->ranges,
+                                                   &entry->n_ranges) ||
+                    !set_coverage(ft, entry->ranges, entry->n_ranges)) {
+                // don't store an incomplete entry
+                cache->used = false;
+                cache = NULL;
+            }
+        }
 
-        if (!ass_font_provider_add_font(priv, &info, NULL, face_index, ft)) {
+        if (!ass_font_provider_add_font(priv, &info, path, face_index, ft))
             ass_msg(library, MSGL_WARN, "Failed to add embedded font '%s'",
                     name);
-            free(ft);
-        }
 
+        // info points into the face's name table
         free_font_info(&info);
+        FT_Done_Face(face);
     }
 }
 
@@ -981,23 +1489,28 @@ static void process_fontdata(ASS_FontProvider *priv, ASS_Library *library,
  * \param lib library
  * \param selector font selector
  * \param ftlib FreeType library - used for querying fonts
+ * \param memory_fonts whether to add the memory fonts of the library
+ * \param dir fonts directory to scan, or NULL
+ * \param dir_cache font cache file of the directory, or NULL
  * \return font provider
  */
 static ASS_FontProvider *
 ass_embedded_fonts_add_provider(ASS_Library *lib, ASS_FontSelector *selector,
-                                FT_Library ftlib)
+                                FT_Library ftlib, bool memory_fonts,
+                                const char *dir, const char *dir_cache)
 {
     int i;
     ASS_FontProvider *priv = ass_font_provider_new(selector, &ft_funcs, NULL);
     if (priv == NULL)
         return NULL;
 
-    if (lib->fonts_dir && lib->fonts_dir[0]) {
-        load_fonts_from_dir(lib, lib->fonts_dir);
-    }
+    if (memory_fonts)
+        for (i = 0; i < lib->num_fontdata; ++i)
+            add_fonts_ft(priv, lib, ftlib, NULL, i, NULL);
 
-    for (i = 0; i < lib->num_fontdata; ++i)
-        process_fontdata(priv, lib, ftlib, i);
+    if (dir && dir[0]) {
+        load_fonts_from_dir(priv, lib, ftlib, dir, dir_cache);
+    }
 
     return priv;
 }
@@ -1023,18 +1536,16 @@ struct font_constructors font_constructors[] = {
 };
 
 /**
- * \brief Init font selector.
- * \param library libass library object
- * \param ftlibrary freetype library object
- * \param family default font family
- * \param path default font path
- * \return newly created font selector
+ * \brief Create a font selector with the given sources of fonts.
+ * \param memory_fonts whether to add the memory fonts of the library
+ * \param dir fonts directory to scan, or NULL
+ * \param dir_cache font cache file of the directory, or NULL
  */
-ASS_FontSelector *
-ass_fontselect_init(ASS_Library *library,
-                    FT_Library ftlibrary, const char *family,
-                    const char *path, const char *config,
-                    ASS_DefaultFontProvider dfp)
+static ASS_FontSelector *
+fontselect_create(ASS_Library *library, FT_Library ftlibrary,
+                  const char *family, const char *path, const char *config,
+                  ASS_DefaultFontProvider dfp, bool memory_fonts,
+                  const char *dir, const char *dir_cache)
 {
     ASS_FontSelector *priv = calloc(1, sizeof(ASS_FontSelector));
     if (priv == NULL)
@@ -1046,7 +1557,7 @@ ass_fontselect_init(ASS_Library *library,
     priv->index_default = 0;
 
     priv->embedded_provider = ass_embedded_fonts_add_provider(library, priv,
-            ftlibrary);
+            ftlibrary, memory_fonts, dir, dir_cache);
 
     if (priv->embedded_provider == NULL) {
         ass_msg(library, MSGL_WARN, "failed to create embedded font provider");
@@ -1073,6 +1584,202 @@ ass_fontselect_init(ASS_Library *library,
     return priv;
 }
 
+/**
+ * \brief Init font selector.
+ * \param library libass library object
+ * \param ftlibrary freetype library object
+ * \param family default font family
+ * \param path default font path
+ * \return newly created font selector
+ */
+ASS_FontSelector *
+ass_fontselect_init(ASS_Library *library,
+                    FT_Library ftlibrary, const char *family,
+                    const char *path, const char *config,
+                    ASS_DefaultFontProvider dfp)
+{
+    return fontselect_create(library, ftlibrary, family, path, config, dfp,
+                             true, library->fonts_dir,
+                             library->fonts_dir_cache);
+}
+
+ASS_FontSelector *
+ass_fontselect_init_embedded(ASS_Library *library, FT_Library ftlibrary,
+                             const char *family, const char *path)
+{
+    return fontselect_create(library, ftlibrary, family, path, NULL,
+                             ASS_FONTPROVIDER_NONE, true, NULL, NULL);
+}
+
+static void reverse_fonts(ASS_FontInfo *fonts, int start, int end)
+{
+    for (int i = start, j = end - 1; i < j; i++, j--) {
+        ASS_FontInfo tmp = fonts[i];
+        fonts[i] = fonts[j];
+        fonts[j] = tmp;
+    }
+}
+
+void ass_fontselect_add_memory_fonts(ASS_FontSelector *selector,
+                                     ASS_Library *library,
+                                     FT_Library ftlibrary)
+{
+    ASS_FontProvider *provider = selector->embedded_provider;
+    if (!provider || !library->num_fontdata)
+        return;
+
+    int n_font = selector->n_font;
+    for (int i = 0; i < library->num_fontdata; i++)
+        add_fonts_ft(provider, library, ftlibrary, NULL, i, NULL);
+
+    // move them in front of the others, where ass_fontselect_init()
+    // would have put them, so they win ties in find_font()
+    reverse_fonts(selector->font_infos, 0, n_font);
+    reverse_fonts(selector->font_infos, n_font, selector->n_font);
+    reverse_fonts(selector->font_infos, 0, selector->n_font);
+    index_rebuild(selector);
+}
+
+#ifdef CONFIG_PTHREAD
+
+struct font_loader {
+    ASS_Library *library;
+    char *family;
+    char *path;
+    char *config;
+    char *dir;
+    char *dir_cache;
+    ASS_DefaultFontProvider dfp;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    bool done;                      // protected by lock
+    ASS_FontSelector *result;       // valid once done
+};
+
+static void *font_loader_thread(void *arg)
+{
+    ASS_FontLoader *loader = arg;
+    ASS_FontSelector *selector = NULL;
+
+    // FreeType libraries can't be shared between threads, so the fonts
+    // found here keep a library of their own for as long as they live
+    FT_Library ftlibrary;
+    if (FT_Init_FreeType(&ftlibrary)) {
+        ass_msg(loader->library, MSGL_ERR, "%s failed", "FT_Init_FreeType");
+    } else {
+        selector = fontselect_create(loader->library, ftlibrary,
+                                     loader->family, loader->path,
+                                     loader->config, loader->dfp, false,
+                                     loader->dir, loader->dir_cache);
+        if (selector)
+            selector->ftlibrary = ftlibrary;
+        else
+            FT_Done_FreeType(ftlibrary);
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    loader->result = selector;
+    loader->done = true;
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+static void font_loader_free(ASS_FontLoader *loader)
+{
+    free(loader->family);
+    free(loader->path);
+    free(loader->config);
+    free(loader->dir);
+    free(loader->dir_cache);
+    free(loader);
+}
+
+static bool copy_string(char **dst, const char *src)
+{
+    *dst = NULL;
+    return !src || (*dst = strdup(src));
+}
+
+ASS_FontLoader *
+ass_font_loader_start(ASS_Library *library, const char *family,
+                      const char *path, const char *config,
+                      ASS_DefaultFontProvider dfp)
+{
+    ASS_FontLoader *loader = calloc(1, sizeof(ASS_FontLoader));
+    if (!loader)
+        return NULL;
+    loader->library = library;
+    loader->dfp = dfp;
+    if (!copy_string(&loader->family, family) ||
+            !copy_string(&loader->path, path) ||
+            !copy_string(&loader->config, config) ||
+            !copy_string(&loader->dir, library->fonts_dir) ||
+            !copy_string(&loader->dir_cache, library->fonts_dir_cache)) {
+        font_loader_free(loader);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&loader->lock, NULL)) {
+        font_loader_free(loader);
+        return NULL;
+    }
+    if (pthread_create(&loader->thread, NULL, font_loader_thread, loader)) {
+        pthread_mutex_destroy(&loader->lock);
+        font_loader_free(loader);
+        return NULL;
+    }
+    return loader;
+}
+
+bool ass_font_loader_ready(ASS_FontLoader *loader)
+{
+    pthread_mutex_lock(&loader->lock);
+    bool done = loader->done;
+    pthread_mutex_unlock(&loader->lock);
+    return done;
+}
+
+ASS_FontSelector *ass_font_loader_finish(ASS_FontLoader *loader)
+{
+    pthread_join(loader->thread, NULL);
+    pthread_mutex_destroy(&loader->lock);
+    ASS_FontSelector *selector = loader->result;
+    font_loader_free(loader);
+    return selector;
+}
+
+#else
+
+ASS_FontLoader *
+ass_font_loader_start(ASS_Library *library, const char *family,
+                      const char *path, const char *config,
+                      ASS_DefaultFontProvider dfp)
+{
+    return NULL;
+}
+
+bool ass_font_loader_ready(ASS_FontLoader *loader)
+{
+    return true;
+}
+
+ASS_FontSelector *ass_font_loader_finish(ASS_FontLoader *loader)
+{
+    return NULL;
+}
+
+#endif
+
+void ass_font_loader_free(ASS_FontLoader *loader)
+{
+    if (!loader)
+        return;
+    ASS_FontSelector *selector = ass_font_loader_finish(loader);
+    if (selector)
+        ass_fontselect_free(selector);
+}
+
 void ass_get_available_font_providers(ASS_Library *priv,
                                       ASS_DefaultFontProvider **providers,
                                       size_t *size)
@@ -1107,8 +1814,14 @@ void ass_fontselect_free(ASS_FontSelector *priv)
         ass_font_provider_free(priv->default_provider);
     if (priv->embedded_provider)
         ass_font_provider_free(priv->embedded_provider);
+    if (priv->ftlibrary)
+        FT_Done_FreeType(priv->ftlibrary);
 
     free(priv->font_infos);
+    memo_clear(priv);
+    free(priv->memo);
+    free(priv->names);
+    free(priv->candidates);
     free(priv->path_default);
     free(priv->family_default);
 
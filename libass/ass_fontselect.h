@@ -234,6 +234,48 @@ char *ass_font_select(ASS_FontSelector *priv, ASS_Library *library,
                       int *uid, ASS_FontStream *data, uint32_t code);
 void ass_fontselect_free(ASS_FontSelector *priv);
 
+/**
+ * \brief Init a font selector with the memory fonts of the library only.
+ */
+ASS_FontSelector *
+ass_fontselect_init_embedded(ASS_Library *library, FT_Library ftlibrary,
+                             const char *family, const char *path);
+
+/**
+ * \brief Add the memory fonts of the library to a selector made by a
+ * font loader, ahead of its other fonts.
+ */
+void ass_fontselect_add_memory_fonts(ASS_FontSelector *selector,
+                                     ASS_Library *library,
+                                     FT_Library ftlibrary);
+
+// Background construction of a font selector
+typedef struct font_loader ASS_FontLoader;
+
+/**
+ * \brief Start building a font selector on a separate thread, with the
+ * fonts directory and default provider but without memory fonts.
+ * The library is then only used for messages until the loader is finished.
+ * \return the loader, NULL if it can't run in the background
+ */
+ASS_FontLoader *
+ass_font_loader_start(ASS_Library *library, const char *family,
+                      const char *path, const char *config,
+                      ASS_DefaultFontProvider dfp);
+bool ass_font_loader_ready(ASS_FontLoader *loader);
+
+/**
+ * \brief Wait for the loader and free it.
+ * \return the font selector, owning the FreeType library its fonts
+ * were read with, or NULL on failure
+ */
+ASS_FontSelector *ass_font_loader_finish(ASS_FontLoader *loader);
+
+/**
+ * \brief Wait for the loader and free it along with its result.
+ */
+void ass_font_loader_free(ASS_FontLoader *loader);
+
 // Font provider functions
 ASS_FontProvider *ass_font_provider_new(ASS_FontSelector *selector,
         ASS_FontProviderFuncs *funcs, void *data);
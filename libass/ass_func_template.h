@@ -20,16 +20,22 @@
 
 void DECORATE(fill_solid_tile16)(uint8_t *buf, ptrdiff_t stride, int set);
 void DECORATE(fill_solid_tile32)(uint8_t *buf, ptrdiff_t stride, int set);
+void DECORATE(fill_solid_tile64)(uint8_t *buf, ptrdiff_t stride, int set);
 void DECORATE(fill_halfplane_tile16)(uint8_t *buf, ptrdiff_t stride,
                                      int32_t a, int32_t b, int64_t c, int32_t scale);
 void DECORATE(fill_halfplane_tile32)(uint8_t *buf, ptrdiff_t stride,
                                      int32_t a, int32_t b, int64_t c, int32_t scale);
+void DECORATE(fill_halfplane_tile64)(uint8_t *buf, ptrdiff_t stride,
+                                     int32_t a, int32_t b, int64_t c, int32_t scale);
 void DECORATE(fill_generic_tile16)(uint8_t *buf, ptrdiff_t stride,
                                    const struct segment *line, size_t n_lines,
                                    int winding);
 void DECORATE(fill_generic_tile32)(uint8_t *buf, ptrdiff_t stride,
                                    const struct segment *line, size_t n_lines,
                                    int winding);
+void DECORATE(fill_generic_tile64)(uint8_t *buf, ptrdiff_t stride,
+                                   const struct segment *line, size_t n_lines,
+                                   int winding);
 
 void DECORATE(add_bitmaps)(uint8_t *dst, intptr_t dst_stride,
                            uint8_t *src, intptr_t src_stride,
@@ -45,6 +51,10 @@ void DECORATE(mul_bitmaps)(uint8_t *dst, intptr_t dst_stride,
 void DECORATE(be_blur)(uint8_t *buf, intptr_t w, intptr_t h,
                        intptr_t stride, uint16_t *tmp);
 
+void DECORATE(blend_rgba)(uint8_t *dst, ptrdiff_t dst_stride,
+                          const uint8_t *src, ptrdiff_t src_stride,
+                          uintptr_t width, uintptr_t height, uint32_t color);
+
 void DECORATE(stripe_unpack)(int16_t *dst, const uint8_t *src, ptrdiff_t src_stride,
                              uintptr_t width, uintptr_t height);
 void DECORATE(stripe_pack)(uint8_t *dst, ptrdiff_t dst_stride, const int16_t *src,
@@ -88,15 +98,33 @@ void DECORATE(blur1246_vert)(int16_t *dst, const int16_t *src,
                              uintptr_t src_width, uintptr_t src_height,
                              const int16_t *param);
 
+void DECORATE(transform_affine)(ASS_Vector *dst,
+                                const uint16_t *x, const uint16_t *y,
+                                size_t n, ASS_Vector base, const double m[2][3]);
+void DECORATE(transform_perspective)(ASS_Vector *dst,
+                                     const uint16_t *x, const uint16_t *y,
+                                     size_t n, ASS_Vector base, const double m[3][3]);
+
 
 const BitmapEngine DECORATE(bitmap_engine) = {
     .align_order = ALIGN,
 
-#if CONFIG_LARGE_TILES
+#if CONFIG_LARGE_TILES && ALIGN >= 6
+    .tile_order = 6,
+    .fill_solid = DECORATE(fill_solid_tile64),
+    .fill_halfplane = DECORATE(fill_halfplane_tile64),
+    .fill_generic = DECORATE(fill_generic_tile64),
+#elif CONFIG_LARGE_TILES
     .tile_order = 5,
     .fill_solid = DECORATE(fill_solid_tile32),
     .fill_halfplane = DECORATE(fill_halfplane_tile32),
     .fill_generic = DECORATE(fill_generic_tile32),
+#elif ALIGN >= 6
+    // 16-pixel rows are too short to gain anything from 512-bit vectors
+    .tile_order = 4,
+    .fill_solid = ass_fill_solid_tile16_avx2,
+    .fill_halfplane = ass_fill_halfplane_tile16_avx2,
+    .fill_generic = ass_fill_generic_tile16_avx2,
 #else
     .tile_order = 4,
     .fill_solid = DECORATE(fill_solid_tile16),
@@ -119,6 +147,13 @@ const BitmapEngine DECORATE(bitmap_engine) = {
     .be_blur = ass_be_blur_c,
 #endif
 
+#if ALIGN >= 6
+    .blend_rgba = DECORATE(blend_rgba),
+#else
+    // written so that compilers can vectorize it well
+    .blend_rgba = ass_blend_rgba_c,
+#endif
+
     .stripe_unpack = DECORATE(stripe_unpack),
     .stripe_pack = DECORATE(stripe_pack),
     .shrink_horz = DECORATE(shrink_horz),
@@ -129,4 +164,13 @@ const BitmapEngine DECORATE(bitmap_engine) = {
     .pre_blur_vert = { DECORATE(pre_blur1_vert), DECORATE(pre_blur2_vert), DECORATE(pre_blur3_vert) },
     .main_blur_horz = { DECORATE(blur1234_horz), DECORATE(blur1235_horz), DECORATE(blur1246_horz) },
     .main_blur_vert = { DECORATE(blur1234_vert), DECORATE(blur1235_vert), DECORATE(blur1246_vert) },
+
+#if ALIGN >= 6
+    .transform_affine = DECORATE(transform_affine),
+    .transform_perspective = DECORATE(transform_perspective),
+#else
+    // double arithmetic only pays off with 8-wide vectors
+    .transform_affine = ass_transform_affine_c,
+    .transform_perspective = ass_transform_perspective_c,
+#endif
 };
@@ -29,6 +29,7 @@
 #include "ass_library.h"
 #include "ass_utils.h"
 #include "ass_string.h"
+#include "ass_trace.h"
 
 static void ass_msg_handler(int level, const char *fmt, va_list va, void *data)
 {
@@ -50,7 +51,9 @@ ASS_Library *ass_library_init(void)
 void ass_library_done(ASS_Library *priv)
 {
     if (priv) {
+        ass_set_trace_file(priv, NULL);
         ass_set_fonts_dir(priv, NULL);
+        ass_set_fonts_dir_cache(priv, NULL);
         ass_set_style_overrides(priv, NULL);
         ass_clear_fonts(priv);
         free(priv);
@@ -59,22 +62,46 @@ void ass_library_done(ASS_Library *priv)
 
 void ass_set_fonts_dir(ASS_Library *priv, const char *fonts_dir)
 {
+    ASS_TRACE(priv, TRACE_SET_FONTS_DIR, fonts_dir);
     free(priv->fonts_dir);
 
     priv->fonts_dir = fonts_dir ? strdup(fonts_dir) : 0;
 }
 
+void ass_set_fonts_dir_cache(ASS_Library *priv, const char *cache_file)
+{
+    ASS_TRACE(priv, TRACE_SET_FONTS_DIR_CACHE, cache_file);
+    free(priv->fonts_dir_cache);
+
+    priv->fonts_dir_cache = cache_file ? strdup(cache_file) : 0;
+}
+
 void ass_set_extract_fonts(ASS_Library *priv, int extract)
 {
+    ASS_TRACE(priv, TRACE_SET_EXTRACT_FONTS, extract);
     priv->extract_fonts = !!extract;
 }
 
+void ass_set_zero_copy(ASS_Library *priv, int enable)
+{
+    ASS_TRACE(priv, TRACE_SET_ZERO_COPY, enable);
+    priv->zero_copy = !!enable;
+}
+
+void ass_set_parse_threads(ASS_Library *priv, int threads)
+{
+    ASS_TRACE(priv, TRACE_SET_PARSE_THREADS, threads);
+    priv->parse_threads = FFMAX(threads, 1);
+}
+
 void ass_set_style_overrides(ASS_Library *priv, char **list)
 {
     char **p;
     char **q;
     int cnt;
 
+    ASS_TRACE(priv, TRACE_SET_STYLE_OVERRIDES, list);
+
     if (priv->style_overrides) {
         for (p = priv->style_overrides; *p; ++p)
             free(*p);
@@ -106,36 +133,51 @@ static int grow_array(void **array, int nelem, size_t elsize)
     return 1;
 }
 
-void ass_add_font(ASS_Library *priv, char *name, char *data, int size)
+/**
+ * \brief Add a memory font, taking ownership of data
+ * \return success, data is freed on failure
+ */
+bool ass_add_font_data(ASS_Library *priv, const char *name, char *data,
+                       int size)
 {
     int idx = priv->num_fontdata;
     if (!name || !data || !size)
-        return;
+        goto error;
     if (!grow_array((void **) &priv->fontdata, priv->num_fontdata,
                     sizeof(*priv->fontdata)))
-        return;
+        goto error;
 
     priv->fontdata[idx].name = strdup(name);
-    priv->fontdata[idx].data = malloc(size);
-
-    if (!priv->fontdata[idx].name || !priv->fontdata[idx].data)
+    if (!priv->fontdata[idx].name)
         goto error;
 
-    memcpy(priv->fontdata[idx].data, data, size);
-
+    priv->fontdata[idx].data = data;
     priv->fontdata[idx].size = size;
 
     priv->num_fontdata++;
-    return;
+    return true;
 
 error:
-    free(priv->fontdata[idx].name);
-    free(priv->fontdata[idx].data);
+    free(data);
+    return false;
+}
+
+void ass_add_font(ASS_Library *priv, char *name, char *data, int size)
+{
+    if (!name || !data || !size)
+        return;
+    ASS_TRACE(priv, TRACE_ADD_FONT, name, data, (size_t) size);
+    char *copy = malloc(size);
+    if (!copy)
+        return;
+    memcpy(copy, data, size);
+    ass_add_font_data(priv, name, copy, size);
 }
 
 void ass_clear_fonts(ASS_Library *priv)
 {
     int i;
+    ASS_TRACE(priv, TRACE_CLEAR_FONTS);
     for (i = 0; i < priv->num_fontdata; ++i) {
         free(priv->fontdata[i].name);
         free(priv->fontdata[i].data);
@@ -145,6 +187,16 @@ void ass_clear_fonts(ASS_Library *priv)
     priv->num_fontdata = 0;
 }
 
+int ass_set_trace_file(ASS_Library *priv, const char *path)
+{
+    ass_trace_close(priv->trace);
+    priv->trace = NULL;
+    if (!path)
+        return 0;
+    priv->trace = ass_trace_open(priv, path);
+    return priv->trace ? 0 : -1;
+}
+
 /*
  * Register a message callback function with libass.  Without setting one,
  * a default handler is used which prints everything with MSGL_INFO or
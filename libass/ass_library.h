@@ -20,6 +20,7 @@
 #define LIBASS_LIBRARY_H
 
 #include <stdarg.h>
+#include <stdbool.h>
 
 typedef struct {
     char *name;
@@ -29,15 +30,22 @@ typedef struct {
 
 struct ass_library {
     char *fonts_dir;
+    char *fonts_dir_cache;
     int extract_fonts;
+    int zero_copy;
+    int parse_threads;
     char **style_overrides;
 
     ASS_Fontdata *fontdata;
     int num_fontdata;
     void (*msg_callback)(int, const char *, va_list, void *);
     void *msg_callback_data;
+
+    struct ass_trace *trace;        // see ass_set_trace_file()
 };
 
 char *read_file(struct ass_library *library, char *fname, size_t *bufsize);
+bool ass_add_font_data(struct ass_library *priv, const char *name, char *data,
+                       int size);
 
 #endif                          /* LIBASS_LIBRARY_H */
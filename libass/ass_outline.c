@@ -48,6 +48,25 @@ static void outline_clear(ASS_Outline *outline)
     outline->n_segments = outline->max_segments = 0;
 }
 
+static bool outline_alloc_copy(ASS_Outline *outline,
+                               const ASS_PackedOutline *source, Arena *arena)
+{
+    size_t n_points = source->n_points, n_segments = source->n_segments;
+    outline->points = ass_arena_alloc(arena, sizeof(ASS_Vector) * n_points,
+                                      sizeof(int32_t));
+    outline->segments = ass_arena_alloc(arena, n_segments, 1);
+    if (!outline->points || !outline->segments) {
+        outline_clear(outline);
+        return false;
+    }
+
+    for (size_t i = 0; i < n_segments; i++)
+        outline->segments[i] = outline_packed_segment(source, i);
+    outline->n_points = outline->max_points = n_points;
+    outline->n_segments = outline->max_segments = n_segments;
+    return true;
+}
+
 bool outline_convert(ASS_Outline *outline, const FT_Outline *source)
 {
     if (!source || !source->n_points) {
@@ -201,86 +220,197 @@ fail:
     return false;
 }
 
-bool outline_scale_pow2(ASS_Outline *outline, const ASS_Outline *source,
-                        int scale_ord_x, int scale_ord_y)
+/*
+ * \brief Store an outline in compact form
+ * The source outline is left as is.
+ */
+bool outline_pack(ASS_PackedOutline *packed, const ASS_Outline *source)
+{
+    memset(packed, 0, sizeof(*packed));
+    if (!source || !source->n_points)
+        return true;
+
+    ASS_Rect cbox;
+    rectangle_reset(&cbox);
+    outline_update_cbox(source, &cbox);
+    bool wide = (int64_t) cbox.x_max - cbox.x_min > UINT16_MAX ||
+                (int64_t) cbox.y_max - cbox.y_min > UINT16_MAX;
+
+    size_t n_points = source->n_points, n_segments = source->n_segments;
+    size_t point_size = wide ? sizeof(ASS_Vector) : 2 * sizeof(uint16_t);
+    uint8_t *buf = malloc(n_points * point_size + (n_segments + 1) / 2);
+    if (!buf)
+        return false;
+
+    packed->n_points = n_points;
+    packed->n_segments = n_segments;
+    packed->base.x = cbox.x_min;
+    packed->base.y = cbox.y_min;
+    if (wide) {
+        packed->points = (ASS_Vector *) buf;
+        memcpy(packed->points, source->points, n_points * sizeof(ASS_Vector));
+    } else {
+        packed->x = (uint16_t *) buf;
+        packed->y = packed->x + n_points;
+        for (size_t i = 0; i < n_points; i++) {
+            packed->x[i] = source->points[i].x - cbox.x_min;
+            packed->y[i] = source->points[i].y - cbox.y_min;
+        }
+    }
+    packed->segments = buf + n_points * point_size;
+    for (size_t i = 0; i < n_segments; i += 2) {
+        uint8_t lo = source->segments[i];
+        uint8_t hi = i + 1 < n_segments ? source->segments[i + 1] : 0;
+        packed->segments[i >> 1] = lo | hi << 4;
+    }
+    return true;
+}
+
+size_t outline_packed_size(const ASS_PackedOutline *outline)
+{
+    size_t point_size = outline->points ? sizeof(ASS_Vector) : 2 * sizeof(uint16_t);
+    return outline->n_points * point_size + (outline->n_segments + 1) / 2;
+}
+
+void outline_free_packed(ASS_PackedOutline *outline)
+{
+    // everything lives in one allocation
+    free(outline->points ? (void *) outline->points : (void *) outline->x);
+    memset(outline, 0, sizeof(*outline));
+}
+
+bool outline_unpack(ASS_Outline *outline, const ASS_PackedOutline *source,
+                    size_t reserve)
+{
+    size_t n_points = source->n_points, n_segments = source->n_segments;
+    if (!outline_alloc(outline, n_points + reserve, n_segments + reserve))
+        return false;
+
+    for (size_t i = 0; i < n_points; i++)
+        outline->points[i] = outline_packed_point(source, i);
+    for (size_t i = 0; i < n_segments; i++)
+        outline->segments[i] = outline_packed_segment(source, i);
+    outline->n_points = n_points;
+    outline->n_segments = n_segments;
+    return true;
+}
+
+bool outline_scale_pow2(ASS_Outline *outline, const ASS_PackedOutline *source,
+                        int scale_ord_x, int scale_ord_y, Arena *arena)
 {
     if (!source || !source->n_points) {
         outline_clear(outline);
         return true;
     }
 
-    if (!outline_alloc(outline, source->n_points, source->n_segments))
+    if (!outline_alloc_copy(outline, source, arena))
         return false;
 
     int sx = scale_ord_x + 32;
     int sy = scale_ord_y + 32;
-    const ASS_Vector *pt = source->points;
     for (size_t i = 0; i < source->n_points; i++) {
-        // that's equivalent to pt[i].x << scale_ord_x,
+        ASS_Vector pt = outline_packed_point(source, i);
+        // that's equivalent to pt.x << scale_ord_x,
         // but works even for negative coordinate and/or shift amount
-        outline->points[i].x = pt[i].x * ((int64_t) 1 << sx) >> 32;
-        outline->points[i].y = pt[i].y * ((int64_t) 1 << sy) >> 32;
+        outline->points[i].x = pt.x * ((int64_t) 1 << sx) >> 32;
+        outline->points[i].y = pt.y * ((int64_t) 1 << sy) >> 32;
     }
-    memcpy(outline->segments, source->segments, source->n_segments);
-    outline->n_points = source->n_points;
-    outline->n_segments = source->n_segments;
     return true;
 }
 
-bool outline_transform_2d(ASS_Outline *outline, const ASS_Outline *source,
-                         const double m[2][3])
+void ass_transform_affine_c(ASS_Vector *dst,
+                            const uint16_t *x, const uint16_t *y,
+                            size_t n, ASS_Vector base, const double m[2][3])
+{
+    for (size_t i = 0; i < n; i++) {
+        int32_t px = base.x + x[i], py = base.y + y[i];
+        double v[2];
+        for (int k = 0; k < 2; k++)
+            v[k] = m[k][0] * px + m[k][1] * py + m[k][2];
+
+        dst[i].x = lrint(v[0]);
+        dst[i].y = lrint(v[1]);
+    }
+}
+
+void ass_transform_perspective_c(ASS_Vector *dst,
+                                 const uint16_t *x, const uint16_t *y,
+                                 size_t n, ASS_Vector base, const double m[3][3])
+{
+    for (size_t i = 0; i < n; i++) {
+        int32_t px = base.x + x[i], py = base.y + y[i];
+        double v[3];
+        for (int k = 0; k < 3; k++)
+            v[k] = m[k][0] * px + m[k][1] * py + m[k][2];
+
+        double w = 1 / FFMAX(v[2], 0.1);
+        dst[i].x = lrint(v[0] * w);
+        dst[i].y = lrint(v[1] * w);
+    }
+}
+
+bool outline_transform_2d(ASS_Outline *outline, const ASS_PackedOutline *source,
+                          const double m[2][3], TransformAffineFunc transform,
+                          Arena *arena)
 {
     if (!source || !source->n_points) {
         outline_clear(outline);
         return true;
     }
 
-    if (!outline_alloc(outline, source->n_points, source->n_segments))
+    if (!outline_alloc_copy(outline, source, arena))
         return false;
 
-    const ASS_Vector *pt = source->points;
+    if (!source->points) {
+        transform(outline->points, source->x, source->y,
+                  source->n_points, source->base, m);
+        return true;
+    }
+
+    // large outlines are rare, no need for batch versions
     for (size_t i = 0; i < source->n_points; i++) {
+        ASS_Vector pt = source->points[i];
         double v[2];
         for (int k = 0; k < 2; k++)
-            v[k] = m[k][0] * pt[i].x + m[k][1] * pt[i].y + m[k][2];
+            v[k] = m[k][0] * pt.x + m[k][1] * pt.y + m[k][2];
 
         outline->points[i].x = lrint(v[0]);
         outline->points[i].y = lrint(v[1]);
     }
-    memcpy(outline->segments, source->segments, source->n_segments);
-    outline->n_points = source->n_points;
-    outline->n_segments = source->n_segments;
     return true;
 }
 
-bool outline_transform_3d(ASS_Outline *outline, const ASS_Outline *source,
-                         const double m[3][3])
+bool outline_transform_3d(ASS_Outline *outline, const ASS_PackedOutline *source,
+                          const double m[3][3], TransformPerspectiveFunc transform,
+                          Arena *arena)
 {
     if (!source || !source->n_points) {
         outline_clear(outline);
         return true;
     }
 
-    if (!outline_alloc(outline, source->n_points, source->n_segments))
+    if (!outline_alloc_copy(outline, source, arena))
         return false;
 
-    const ASS_Vector *pt = source->points;
+    if (!source->points) {
+        transform(outline->points, source->x, source->y,
+                  source->n_points, source->base, m);
+        return true;
+    }
+
     for (size_t i = 0; i < source->n_points; i++) {
+        ASS_Vector pt = source->points[i];
         double v[3];
         for (int k = 0; k < 3; k++)
-            v[k] = m[k][0] * pt[i].x + m[k][1] * pt[i].y + m[k][2];
+            v[k] = m[k][0] * pt.x + m[k][1] * pt.y + m[k][2];
 
         double w = 1 / FFMAX(v[2], 0.1);
         outline->points[i].x = lrint(v[0] * w);
         outline->points[i].y = lrint(v[1] * w);
     }
-    memcpy(outline->segments, source->segments, source->n_segments);
-    outline->n_points = source->n_points;
-    outline->n_segments = source->n_segments;
     return true;
 }
 
-
 void outline_free(ASS_Outline *outline)
 {
     if (!outline)
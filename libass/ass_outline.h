@@ -83,17 +83,71 @@ typedef struct {
     char *segments;
 } ASS_Outline;
 
+/*
+ * Read-only outline in compact form, as kept in the outline cache.
+ * Points are stored as offsets from the bounding box corner in separate
+ * 16-bit x and y arrays, and segments are packed two per byte, low half
+ * first. Outlines too large for 16-bit offsets keep 32-bit points.
+ */
+
+typedef struct {
+    size_t n_points, n_segments;
+    ASS_Vector base;            // bounding box corner
+    uint16_t *x, *y;            // offsets from base, unless points is set
+    ASS_Vector *points;         // only for large outlines
+    uint8_t *segments;
+} ASS_PackedOutline;
+
+static inline ASS_Vector outline_packed_point(const ASS_PackedOutline *outline,
+                                              size_t i)
+{
+    if (outline->points)
+        return outline->points[i];
+    ASS_Vector pt = {
+        outline->base.x + outline->x[i],
+        outline->base.y + outline->y[i],
+    };
+    return pt;
+}
+
+static inline char outline_packed_segment(const ASS_PackedOutline *outline,
+                                          size_t i)
+{
+    return (outline->segments[i >> 1] >> (i & 1 ? 4 : 0)) & 0xF;
+}
+
 #define OUTLINE_MIN  (-((int32_t) 1 << 28))
 #define OUTLINE_MAX  (((int32_t) 1 << 28) - 1)
 
+// Transform n points stored as 16-bit offsets from base (see ASS_PackedOutline).
+// Versions must round exactly like the C ones, so work in double precision.
+typedef void (*TransformAffineFunc)(ASS_Vector *dst,
+                                    const uint16_t *x, const uint16_t *y,
+                                    size_t n, ASS_Vector base,
+                                    const double m[2][3]);
+typedef void (*TransformPerspectiveFunc)(ASS_Vector *dst,
+                                         const uint16_t *x, const uint16_t *y,
+                                         size_t n, ASS_Vector base,
+                                         const double m[3][3]);
+
 bool outline_alloc(ASS_Outline *outline, size_t n_points, size_t n_segments);
 bool outline_convert(ASS_Outline *outline, const FT_Outline *source);
-bool outline_scale_pow2(ASS_Outline *outline, const ASS_Outline *source,
-                        int scale_ord_x, int scale_ord_y);
-bool outline_transform_2d(ASS_Outline *outline, const ASS_Outline *source,
-                          const double m[2][3]);
-bool outline_transform_3d(ASS_Outline *outline, const ASS_Outline *source,
-                          const double m[3][3]);
+bool outline_pack(ASS_PackedOutline *packed, const ASS_Outline *source);
+size_t outline_packed_size(const ASS_PackedOutline *outline);
+void outline_free_packed(ASS_PackedOutline *outline);
+// growable copy, with room for reserve more points and segments
+bool outline_unpack(ASS_Outline *outline, const ASS_PackedOutline *source,
+                    size_t reserve);
+// Transformed copies are temporary, they are allocated from the arena
+// and must not be passed to outline_free() or grown.
+bool outline_scale_pow2(ASS_Outline *outline, const ASS_PackedOutline *source,
+                        int scale_ord_x, int scale_ord_y, Arena *arena);
+bool outline_transform_2d(ASS_Outline *outline, const ASS_PackedOutline *source,
+                          const double m[2][3], TransformAffineFunc transform,
+                          Arena *arena);
+bool outline_transform_3d(ASS_Outline *outline, const ASS_PackedOutline *source,
+                          const double m[3][3], TransformPerspectiveFunc transform,
+                          Arena *arena);
 void outline_free(ASS_Outline *outline);
 
 bool outline_add_point(ASS_Outline *outline, ASS_Vector pt, char segment);
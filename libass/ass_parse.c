@@ -33,27 +33,23 @@
 
 struct arg {
     char *start, *end;
+    double value;       // number at start, converted when the tag is compiled
 };
 
+// same rounding as mystrtoi() and mystrtoll()
 static inline int argtoi(struct arg arg)
 {
-    int value;
-    mystrtoi(&arg.start, &value);
-    return value;
+    return (int) (arg.value + (arg.value > 0 ? 0.5 : -0.5));
 }
 
 static inline long long argtoll(struct arg arg)
 {
-    long long value;
-    mystrtoll(&arg.start, &value);
-    return value;
+    return (long long) (arg.value + (arg.value > 0 ? 0.5 : -0.5));
 }
 
 static inline double argtod(struct arg arg)
 {
-    double value;
-    mystrtod(&arg.start, &value);
-    return value;
+    return arg.value;
 }
 
 static inline void push_arg(struct arg *args, int *nargs, char *start, char *end)
@@ -61,7 +57,10 @@ static inline void push_arg(struct arg *args, int *nargs, char *start, char *end
     if (*nargs <= MAX_VALID_NARGS) {
         rskip_spaces(&end, start);
         if (end > start) {
-            args[*nargs] = (struct arg) {start, end};
+            double value;
+            char *num = start;
+            mystrtod(&num, &value);
+            args[*nargs] = (struct arg) {start, end, value};
             ++*nargs;
         }
     }
@@ -203,15 +202,107 @@ static bool parse_vector_clip(ASS_Renderer *render_priv,
     return true;
 }
 
+enum {
+    TAG_NONE,
+    TAG_XBORD,
+    TAG_YBORD,
+    TAG_XSHAD,
+    TAG_YSHAD,
+    TAG_FAX,
+    TAG_FAY,
+    TAG_ICLIP,
+    TAG_BLUR,
+    TAG_FSCX,
+    TAG_FSCY,
+    TAG_FSC,
+    TAG_FSP,
+    TAG_FS,
+    TAG_BORD,
+    TAG_MOVE,
+    TAG_FRX,
+    TAG_FRY,
+    TAG_FRZ,
+    TAG_FN,
+    TAG_ALPHA,
+    TAG_AN,
+    TAG_A,
+    TAG_POS,
+    TAG_FADE,
+    TAG_ORG,
+    TAG_T,
+    TAG_CLIP,
+    TAG_1C,
+    TAG_2C,
+    TAG_3C,
+    TAG_4C,
+    TAG_1A,
+    TAG_2A,
+    TAG_3A,
+    TAG_4A,
+    TAG_R,
+    TAG_BE,
+    TAG_B,
+    TAG_I,
+    TAG_KF,
+    TAG_KO,
+    TAG_K,
+    TAG_SHAD,
+    TAG_S,
+    TAG_U,
+    TAG_PBO,
+    TAG_P,
+    TAG_Q,
+    TAG_FE,
+};
+
+typedef struct {
+    char *base;                 // start of the override block
+    ParsedTag *tags;
+    size_t n_tags, max_tags;
+    TagArg *args;
+    size_t n_args, max_args;
+} TagCompiler;
+
+static ParsedTag *add_tag(TagCompiler *c, int type,
+                          struct arg *args, int nargs)
+{
+    if (c->n_tags == c->max_tags) {
+        size_t max = FFMAX(2 * c->max_tags, 16);
+        if (!ASS_REALLOC_ARRAY(c->tags, max))
+            return NULL;
+        c->max_tags = max;
+    }
+    if (c->n_args + nargs > c->max_args) {
+        size_t max = FFMAX(2 * c->max_args, c->n_args + nargs + 16);
+        if (!ASS_REALLOC_ARRAY(c->args, max))
+            return NULL;
+        c->max_args = max;
+    }
+
+    ParsedTag *tag = c->tags + c->n_tags++;
+    *tag = (ParsedTag) {
+        .type = type,
+        .nargs = nargs,
+        .first_arg = c->n_args,
+    };
+    for (int i = 0; i < nargs; i++)
+        c->args[c->n_args++] = (TagArg) {
+            .start = args[i].start - c->base,
+            .end = args[i].end - c->base,
+            .value = args[i].value,
+        };
+    return tag;
+}
+
 /**
- * \brief Parse style override tags.
+ * \brief Split style override tags into a list of tags and their arguments.
+ * This is the part of tag parsing that doesn't depend on the render state,
+ * it's done once per distinct override block, see ass_tags_construct().
  * \param p string to parse
  * \param end end of string to parse, which must be '}', ')', or the first
  *            of a number of spaces immediately preceding '}' or ')'
- * \param pwr multiplier for some tag effects (comes from \t tags)
  */
-char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
-                 bool nested)
+static bool compile_tags(TagCompiler *c, char *p, char *end)
 {
     for (char *q; p < end; p = q) {
         while (*p != '\\' && p != end)
@@ -233,8 +324,6 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
         // Store one extra element to be able to detect excess arguments
         struct arg args[MAX_VALID_NARGS + 1];
         int nargs = 0;
-        for (int i = 0; i <= MAX_VALID_NARGS; ++i)
-            args[i].start = args[i].end = "";
 
         // Split parenthesized arguments. Do this for all tags and before
         // any non-parenthesized argument because that's what VSFilter does.
@@ -270,12 +359,240 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 }
             }
         }
-
 #define tag(name) (mystrcmp(&p, (name)) && (push_arg(args, &nargs, p, name_end), 1))
 #define complex_tag(name) mystrcmp(&p, (name))
 
+        int type;
+        // New tags introduced in vsfilter 2.39
+        if (tag("xbord"))
+            type = TAG_XBORD;
+        else if (tag("ybord"))
+            type = TAG_YBORD;
+        else if (tag("xshad"))
+            type = TAG_XSHAD;
+        else if (tag("yshad"))
+            type = TAG_YSHAD;
+        else if (tag("fax"))
+            type = TAG_FAX;
+        else if (tag("fay"))
+            type = TAG_FAY;
+        else if (complex_tag("iclip"))
+            type = TAG_ICLIP;
+        else if (tag("blur"))
+            type = TAG_BLUR;
+        else if (tag("fscx"))
+            type = TAG_FSCX;
+        else if (tag("fscy"))
+            type = TAG_FSCY;
+        else if (tag("fsc"))
+            type = TAG_FSC;
+        else if (tag("fsp"))
+            type = TAG_FSP;
+        else if (tag("fs"))
+            type = TAG_FS;
+        else if (tag("bord"))
+            type = TAG_BORD;
+        else if (complex_tag("move"))
+            type = TAG_MOVE;
+        else if (tag("frx"))
+            type = TAG_FRX;
+        else if (tag("fry"))
+            type = TAG_FRY;
+        else if (tag("frz") || tag("fr"))
+            type = TAG_FRZ;
+        else if (tag("fn"))
+            type = TAG_FN;
+        else if (tag("alpha"))
+            type = TAG_ALPHA;
+        else if (tag("an"))
+            type = TAG_AN;
+        else if (tag("a"))
+            type = TAG_A;
+        else if (complex_tag("pos"))
+            type = TAG_POS;
+        else if (complex_tag("fade") || complex_tag("fad"))
+            type = TAG_FADE;
+        else if (complex_tag("org"))
+            type = TAG_ORG;
+        else if (complex_tag("t"))
+            type = TAG_T;
+        else if (complex_tag("clip"))
+            type = TAG_CLIP;
+        else if (tag("c") || tag("1c"))
+            type = TAG_1C;
+        else if (tag("2c"))
+            type = TAG_2C;
+        else if (tag("3c"))
+            type = TAG_3C;
+        else if (tag("4c"))
+            type = TAG_4C;
+        else if (tag("1a"))
+            type = TAG_1A;
+        else if (tag("2a"))
+            type = TAG_2A;
+        else if (tag("3a"))
+            type = TAG_3A;
+        else if (tag("4a"))
+            type = TAG_4A;
+        else if (tag("r"))
+            type = TAG_R;
+        else if (tag("be"))
+            type = TAG_BE;
+        else if (tag("b"))
+            type = TAG_B;
+        else if (tag("i"))
+            type = TAG_I;
+        else if (tag("kf") || tag("K"))
+            type = TAG_KF;
+        else if (tag("ko"))
+            type = TAG_KO;
+        else if (tag("k"))
+            type = TAG_K;
+        else if (tag("shad"))
+            type = TAG_SHAD;
+        else if (tag("s"))
+            type = TAG_S;
+        else if (tag("u"))
+            type = TAG_U;
+        else if (tag("pbo"))
+            type = TAG_PBO;
+        else if (tag("p"))
+            type = TAG_P;
+        else if (tag("q"))
+            type = TAG_Q;
+        else if (tag("fe"))
+            type = TAG_FE;
+        else
+            continue;
+
+#undef tag
+#undef complex_tag
+
+        ParsedTag *tag = add_tag(c, type, args, nargs);
+        if (!tag)
+            return false;
+        if (type != TAG_T)
+            continue;
+
+        int cnt = nargs - 1;
+        if (cnt < 0 || cnt > 3)
+            continue;
+        p = args[cnt].start;
+        if (args[cnt].end < end) {
+            size_t index = tag - c->tags;
+            if (!compile_tags(c, p, args[cnt].end))
+                return false;
+            c->tags[index].n_nested = c->n_tags - index - 1;
+        } else {
+            assert(q == end);
+            tag->tail = true;
+            q = p;
+        }
+    }
+    return true;
+}
+
+size_t ass_tags_construct(void *key, void *value, void *priv)
+{
+    TagsHashKey *k = key;
+    TagsHashValue *v = value;
+
+    TagCompiler c = { .base = k->text };
+    v->valid = compile_tags(&c, k->text, k->text + k->length - 1);
+    v->n_tags = c.n_tags;
+    v->tags = c.tags;
+    v->n_args = c.n_args;
+    v->args = c.args;
+    if (!v->valid) {
+        free(c.tags);
+        free(c.args);
+        v->n_tags = v->n_args = 0;
+        v->tags = NULL;
+        v->args = NULL;
+    }
+    return 1;
+}
+
+// expand the compiled arguments of a tag, returns their number
+static int load_args(struct arg *args, char *base,
+                     const TagsHashValue *block, const ParsedTag *tag)
+{
+    int nargs = tag->nargs;
+    for (int j = 0; j < nargs; j++) {
+        const TagArg *arg = block->args + tag->first_arg + j;
+        args[j] = (struct arg) {
+            base + arg->start, base + arg->end, arg->value
+        };
+    }
+    for (int j = nargs; j <= MAX_VALID_NARGS; j++)
+        args[j] = (struct arg) { "", "", 0 };
+    return nargs;
+}
+
+/**
+ * \brief Calculate the position of \move at the current time
+ * \return false if the tag has to be ignored
+ */
+static bool move_position(ASS_Renderer *render_priv, ASS_Event *event,
+                          struct arg *args, int nargs, double *x, double *y)
+{
+    double x1, x2, y1, y2;
+    long long t1, t2, delta_t, t;
+    double k;
+    if (nargs != 4 && nargs != 6)
+        return false;
+    x1 = argtod(args[0]);
+    y1 = argtod(args[1]);
+    x2 = argtod(args[2]);
+    y2 = argtod(args[3]);
+    t1 = t2 = 0;
+    if (nargs == 6) {
+        t1 = argtoll(args[4]);
+        t2 = argtoll(args[5]);
+        if (t1 > t2) {
+            long long tmp = t2;
+            t2 = t1;
+            t1 = tmp;
+        }
+    }
+    if (t1 <= 0 && t2 <= 0) {
+        t1 = 0;
+        t2 = event->Duration;
+    }
+    delta_t = t2 - t1;
+    t = render_priv->time - event->Start;
+    if (t <= t1)
+        k = 0.;
+    else if (t >= t2)
+        k = 1.;
+    else
+        k = ((double) (t - t1)) / delta_t;
+    *x = k * (x2 - x1) + x1;
+    *y = k * (y2 - y1) + y1;
+    return true;
+}
+
+/**
+ * \brief Apply compiled style override tags to the render state.
+ * \param base start of the override block in the event text
+ * \param first index of the first tag in block
+ * \param n_tags number of tags to apply
+ * \param pwr multiplier for some tag effects (comes from \t tags)
+ */
+static void apply_tags(ASS_Renderer *render_priv, char *base,
+                       const TagsHashValue *block, size_t first,
+                       size_t n_tags, double pwr, bool nested)
+{
+    for (size_t i = first; i < first + n_tags; i++) {
+        const ParsedTag *tag = block->tags + i;
+
+        // Store one extra element to be able to detect excess arguments
+        struct arg args[MAX_VALID_NARGS + 1];
+        int nargs = load_args(args, base, block, tag);
+
+        switch (tag->type) {
         // New tags introduced in vsfilter 2.39
-        if (tag("xbord")) {
+        case TAG_XBORD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -284,7 +601,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 val = render_priv->state.style->Outline;
             render_priv->state.border_x = val;
-        } else if (tag("ybord")) {
+            break;
+        }
+        case TAG_YBORD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -293,7 +612,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 val = render_priv->state.style->Outline;
             render_priv->state.border_y = val;
-        } else if (tag("xshad")) {
+            break;
+        }
+        case TAG_XSHAD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -301,7 +622,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 val = render_priv->state.style->Shadow;
             render_priv->state.shadow_x = val;
-        } else if (tag("yshad")) {
+            break;
+        }
+        case TAG_YSHAD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -309,7 +632,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 val = render_priv->state.style->Shadow;
             render_priv->state.shadow_y = val;
-        } else if (tag("fax")) {
+            break;
+        }
+        case TAG_FAX: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -317,7 +642,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                     val * pwr + render_priv->state.fax * (1 - pwr);
             } else
                 render_priv->state.fax = 0.;
-        } else if (tag("fay")) {
+            break;
+        }
+        case TAG_FAY: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -325,7 +652,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                     val * pwr + render_priv->state.fay * (1 - pwr);
             } else
                 render_priv->state.fay = 0.;
-        } else if (complex_tag("iclip")) {
+            break;
+        }
+        case TAG_ICLIP: {
             if (nargs == 4) {
                 int x0, y0, x1, y1;
                 x0 = argtoi(args[0]);
@@ -345,7 +674,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 if (parse_vector_clip(render_priv, args, nargs))
                     render_priv->state.clip_drawing_mode = 1;
             }
-        } else if (tag("blur")) {
+            break;
+        }
+        case TAG_BLUR: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -355,8 +686,10 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.blur = val;
             } else
                 render_priv->state.blur = 0.0;
-            // ASS standard tags
-        } else if (tag("fscx")) {
+            break;
+        }
+        // ASS standard tags
+        case TAG_FSCX: {
             double val;
             if (nargs) {
                 val = argtod(*args) / 100;
@@ -365,7 +698,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 val = render_priv->state.style->ScaleX;
             render_priv->state.scale_x = val;
-        } else if (tag("fscy")) {
+            break;
+        }
+        case TAG_FSCY: {
             double val;
             if (nargs) {
                 val = argtod(*args) / 100;
@@ -374,10 +709,14 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 val = render_priv->state.style->ScaleY;
             render_priv->state.scale_y = val;
-        } else if (tag("fsc")) {
+            break;
+        }
+        case TAG_FSC: {
             render_priv->state.scale_x = render_priv->state.style->ScaleX;
             render_priv->state.scale_y = render_priv->state.style->ScaleY;
-        } else if (tag("fsp")) {
+            break;
+        }
+        case TAG_FSP: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -385,7 +724,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                     render_priv->state.hspacing * (1 - pwr) + val * pwr;
             } else
                 render_priv->state.hspacing = render_priv->state.style->Spacing;
-        } else if (tag("fs")) {
+            break;
+        }
+        case TAG_FS: {
             double val = 0;
             if (nargs) {
                 val = argtod(*args);
@@ -397,7 +738,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             if (val <= 0)
                 val = render_priv->state.style->FontSize;
             render_priv->state.font_size = val;
-        } else if (tag("bord")) {
+            break;
+        }
+        case TAG_BORD: {
             double val, xval, yval;
             if (nargs) {
                 val = argtod(*args);
@@ -409,49 +752,22 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 xval = yval = render_priv->state.style->Outline;
             render_priv->state.border_x = xval;
             render_priv->state.border_y = yval;
-        } else if (complex_tag("move")) {
-            double x1, x2, y1, y2;
-            long long t1, t2, delta_t, t;
+            break;
+        }
+        case TAG_MOVE: {
             double x, y;
-            double k;
-            if (nargs == 4 || nargs == 6) {
-                x1 = argtod(args[0]);
-                y1 = argtod(args[1]);
-                x2 = argtod(args[2]);
-                y2 = argtod(args[3]);
-                t1 = t2 = 0;
-                if (nargs == 6) {
-                    t1 = argtoll(args[4]);
-                    t2 = argtoll(args[5]);
-                    if (t1 > t2) {
-                        long long tmp = t2;
-                        t2 = t1;
-                        t1 = tmp;
-                    }
-                }
-            } else
+            if (!move_position(render_priv, render_priv->state.event,
+                               args, nargs, &x, &y))
                 continue;
-            if (t1 <= 0 && t2 <= 0) {
-                t1 = 0;
-                t2 = render_priv->state.event->Duration;
-            }
-            delta_t = t2 - t1;
-            t = render_priv->time - render_priv->state.event->Start;
-            if (t <= t1)
-                k = 0.;
-            else if (t >= t2)
-                k = 1.;
-            else
-                k = ((double) (t - t1)) / delta_t;
-            x = k * (x2 - x1) + x1;
-            y = k * (y2 - y1) + y1;
             if (render_priv->state.evt_type != EVENT_POSITIONED) {
                 render_priv->state.pos_x = x;
                 render_priv->state.pos_y = y;
                 render_priv->state.detect_collisions = 0;
                 render_priv->state.evt_type = EVENT_POSITIONED;
             }
-        } else if (tag("frx")) {
+            break;
+        }
+        case TAG_FRX: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -460,7 +776,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                     val * pwr + render_priv->state.frx * (1 - pwr);
             } else
                 render_priv->state.frx = 0.;
-        } else if (tag("fry")) {
+            break;
+        }
+        case TAG_FRY: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -469,7 +787,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                     val * pwr + render_priv->state.fry * (1 - pwr);
             } else
                 render_priv->state.fry = 0.;
-        } else if (tag("frz") || tag("fr")) {
+            break;
+        }
+        case TAG_FRZ: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -479,7 +799,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             } else
                 render_priv->state.frz =
                     M_PI * render_priv->state.style->Angle / 180.;
-        } else if (tag("fn")) {
+            break;
+        }
+        case TAG_FN: {
             char *family;
             char *start = args->start;
             if (nargs && strncmp(start, "0", args->end - start)) {
@@ -490,7 +812,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
             free(render_priv->state.family);
             render_priv->state.family = family;
             update_font(render_priv);
-        } else if (tag("alpha")) {
+            break;
+        }
+        case TAG_ALPHA: {
             int i;
             if (nargs) {
                 int32_t a = parse_alpha_tag(args->start);
@@ -506,8 +830,10 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 change_alpha(&render_priv->state.c[3],
                              _a(render_priv->state.style->BackColour), 1);
             }
-            // FIXME: simplify
-        } else if (tag("an")) {
+            break;
+        }
+        // FIXME: simplify
+        case TAG_AN: {
             int val = argtoi(*args);
             if ((render_priv->state.parsed_tags & PARSED_A) == 0) {
                 if (val >= 1 && val <= 9)
@@ -517,7 +843,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                         render_priv->state.style->Alignment;
                 render_priv->state.parsed_tags |= PARSED_A;
             }
-        } else if (tag("a")) {
+            break;
+        }
+        case TAG_A: {
             int val = argtoi(*args);
             if ((render_priv->state.parsed_tags & PARSED_A) == 0) {
                 if (val >= 1 && val <= 11)
@@ -529,7 +857,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                         render_priv->state.style->Alignment;
                 render_priv->state.parsed_tags |= PARSED_A;
             }
-        } else if (complex_tag("pos")) {
+            break;
+        }
+        case TAG_POS: {
             double v1, v2;
             if (nargs == 2) {
                 v1 = argtod(args[0]);
@@ -545,7 +875,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.pos_x = v1;
                 render_priv->state.pos_y = v2;
             }
-        } else if (complex_tag("fade") || complex_tag("fad")) {
+            break;
+        }
+        case TAG_FADE: {
             int a1, a2, a3;
             long long t1, t2, t3, t4;
             if (nargs == 2) {
@@ -580,7 +912,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                             t3, t4, a1, a2, a3);
                 render_priv->state.parsed_tags |= PARSED_FADE;
             }
-        } else if (complex_tag("org")) {
+            break;
+        }
+        case TAG_ORG: {
             double v1, v2;
             if (nargs == 2) {
                 v1 = argtod(args[0]);
@@ -593,7 +927,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.have_origin = 1;
                 render_priv->state.detect_collisions = 0;
             }
-        } else if (complex_tag("t")) {
+            break;
+        }
+        case TAG_T: {
             double accel;
             int cnt = nargs - 1;
             long long t1, t2, t, delta_t;
@@ -632,20 +968,21 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 pwr = k;
             if (cnt < 0 || cnt > 3)
                 continue;
-            p = args[cnt].start;
-            if (args[cnt].end < end) {
-                p = parse_tags(render_priv, p, args[cnt].end, k, true);
-            } else {
-                assert(q == end);
+            if (tag->tail) {
                 // No other tags can possibly follow this \t tag,
                 // so we don't need to restore pwr after parsing \t.
-                // The recursive call is now essentially a tail call,
-                // so optimize it away.
+                // The tags of its last argument were compiled in line
+                // with the rest of the block as if by a tail call.
                 pwr = k;
                 nested = true;
-                q = p;
+            } else {
+                apply_tags(render_priv, base, block, tag + 1 - block->tags,
+                           tag->n_nested, k, true);
+                i += tag->n_nested;
             }
-        } else if (complex_tag("clip")) {
+            break;
+        }
+        case TAG_CLIP: {
             if (nargs == 4) {
                 int x0, y0, x1, y1;
                 x0 = argtoi(args[0]);
@@ -665,70 +1002,90 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 if (parse_vector_clip(render_priv, args, nargs))
                     render_priv->state.clip_drawing_mode = 0;
             }
-        } else if (tag("c") || tag("1c")) {
+            break;
+        }
+        case TAG_1C: {
             if (nargs) {
                 uint32_t val = parse_color_tag(args->start);
                 change_color(&render_priv->state.c[0], val, pwr);
             } else
                 change_color(&render_priv->state.c[0],
                              render_priv->state.style->PrimaryColour, 1);
-        } else if (tag("2c")) {
+            break;
+        }
+        case TAG_2C: {
             if (nargs) {
                 uint32_t val = parse_color_tag(args->start);
                 change_color(&render_priv->state.c[1], val, pwr);
             } else
                 change_color(&render_priv->state.c[1],
                              render_priv->state.style->SecondaryColour, 1);
-        } else if (tag("3c")) {
+            break;
+        }
+        case TAG_3C: {
             if (nargs) {
                 uint32_t val = parse_color_tag(args->start);
                 change_color(&render_priv->state.c[2], val, pwr);
             } else
                 change_color(&render_priv->state.c[2],
                              render_priv->state.style->OutlineColour, 1);
-        } else if (tag("4c")) {
+            break;
+        }
+        case TAG_4C: {
             if (nargs) {
                 uint32_t val = parse_color_tag(args->start);
                 change_color(&render_priv->state.c[3], val, pwr);
             } else
                 change_color(&render_priv->state.c[3],
                              render_priv->state.style->BackColour, 1);
-        } else if (tag("1a")) {
+            break;
+        }
+        case TAG_1A: {
             if (nargs) {
                 uint32_t val = parse_alpha_tag(args->start);
                 change_alpha(&render_priv->state.c[0], val, pwr);
             } else
                 change_alpha(&render_priv->state.c[0],
                              _a(render_priv->state.style->PrimaryColour), 1);
-        } else if (tag("2a")) {
+            break;
+        }
+        case TAG_2A: {
             if (nargs) {
                 uint32_t val = parse_alpha_tag(args->start);
                 change_alpha(&render_priv->state.c[1], val, pwr);
             } else
                 change_alpha(&render_priv->state.c[1],
                              _a(render_priv->state.style->SecondaryColour), 1);
-        } else if (tag("3a")) {
+            break;
+        }
+        case TAG_3A: {
             if (nargs) {
                 uint32_t val = parse_alpha_tag(args->start);
                 change_alpha(&render_priv->state.c[2], val, pwr);
             } else
                 change_alpha(&render_priv->state.c[2],
                              _a(render_priv->state.style->OutlineColour), 1);
-        } else if (tag("4a")) {
+            break;
+        }
+        case TAG_4A: {
             if (nargs) {
                 uint32_t val = parse_alpha_tag(args->start);
                 change_alpha(&render_priv->state.c[3], val, pwr);
             } else
                 change_alpha(&render_priv->state.c[3],
                              _a(render_priv->state.style->BackColour), 1);
-        } else if (tag("r")) {
+            break;
+        }
+        case TAG_R: {
             if (nargs) {
                 int len = args->end - args->start;
                 reset_render_context(render_priv,
                         lookup_style_strict(render_priv->track, args->start, len));
             } else
                 reset_render_context(render_priv, NULL);
-        } else if (tag("be")) {
+            break;
+        }
+        case TAG_BE: {
             double dval;
             if (nargs) {
                 int val;
@@ -741,19 +1098,25 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.be = val;
             } else
                 render_priv->state.be = 0;
-        } else if (tag("b")) {
+            break;
+        }
+        case TAG_B: {
             int val = argtoi(*args);
             if (!nargs || !(val == 0 || val == 1 || val >= 100))
                 val = render_priv->state.style->Bold;
             render_priv->state.bold = val;
             update_font(render_priv);
-        } else if (tag("i")) {
+            break;
+        }
+        case TAG_I: {
             int val = argtoi(*args);
             if (!nargs || !(val == 0 || val == 1))
                 val = render_priv->state.style->Italic;
             render_priv->state.italic = val;
             update_font(render_priv);
-        } else if (tag("kf") || tag("K")) {
+            break;
+        }
+        case TAG_KF: {
             double val = 100;
             if (nargs)
                 val = argtod(*args);
@@ -762,7 +1125,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.effect_skip_timing +=
                     render_priv->state.effect_timing;
             render_priv->state.effect_timing = val * 10;
-        } else if (tag("ko")) {
+            break;
+        }
+        case TAG_KO: {
             double val = 100;
             if (nargs)
                 val = argtod(*args);
@@ -771,7 +1136,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.effect_skip_timing +=
                     render_priv->state.effect_timing;
             render_priv->state.effect_timing = val * 10;
-        } else if (tag("k")) {
+            break;
+        }
+        case TAG_K: {
             double val = 100;
             if (nargs)
                 val = argtod(*args);
@@ -780,7 +1147,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.effect_skip_timing +=
                     render_priv->state.effect_timing;
             render_priv->state.effect_timing = val * 10;
-        } else if (tag("shad")) {
+            break;
+        }
+        case TAG_SHAD: {
             double val, xval, yval;
             if (nargs) {
                 val = argtod(*args);
@@ -793,7 +1162,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 xval = yval = render_priv->state.style->Shadow;
             render_priv->state.shadow_x = xval;
             render_priv->state.shadow_y = yval;
-        } else if (tag("s")) {
+            break;
+        }
+        case TAG_S: {
             int val = argtoi(*args);
             if (!nargs || !(val == 0 || val == 1))
                 val = render_priv->state.style->StrikeOut;
@@ -801,7 +1172,9 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.flags |= DECO_STRIKETHROUGH;
             else
                 render_priv->state.flags &= ~DECO_STRIKETHROUGH;
-        } else if (tag("u")) {
+            break;
+        }
+        case TAG_U: {
             int val = argtoi(*args);
             if (!nargs || !(val == 0 || val == 1))
                 val = render_priv->state.style->Underline;
@@ -809,29 +1182,192 @@ char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
                 render_priv->state.flags |= DECO_UNDERLINE;
             else
                 render_priv->state.flags &= ~DECO_UNDERLINE;
-        } else if (tag("pbo")) {
+            break;
+        }
+        case TAG_PBO: {
             double val = argtod(*args);
             render_priv->state.pbo = val;
-        } else if (tag("p")) {
+            break;
+        }
+        case TAG_P: {
             int val = argtoi(*args);
             val = (val < 0) ? 0 : val;
             render_priv->state.drawing_scale = val;
-        } else if (tag("q")) {
+            break;
+        }
+        case TAG_Q: {
             int val = argtoi(*args);
             if (!nargs || !(val >= 0 && val <= 3))
                 val = render_priv->track->WrapStyle;
             render_priv->state.wrap_style = val;
-        } else if (tag("fe")) {
+            break;
+        }
+        case TAG_FE: {
             int val;
             if (nargs)
                 val = argtoi(*args);
             else
                 val = render_priv->state.style->Encoding;
             render_priv->state.font_encoding = val;
+            break;
+        }
         }
     }
+}
 
-    return p;
+/**
+ * \brief Parse style override tags.
+ * \param p start of the override block, pointing at '{'
+ * \param end end of the override block, pointing at the matching '}'
+ */
+void parse_tags(ASS_Renderer *render_priv, char *p, char *end)
+{
+    TagsHashKey key = {
+        .text = p,
+        .length = end - p + 1,
+    };
+    TagsHashValue *val =
+        ass_cache_get(render_priv->cache.tags_cache, &key, NULL);
+    if (!val)
+        return;
+    if (val->valid)
+        apply_tags(render_priv, p, val, 0, val->n_tags, 1., false);
+    ass_cache_dec_ref(val);
+}
+
+/**
+ * \brief Find out whether an event only moves along a straight line
+ * Override blocks are looked up in the tags cache as parse_tags() does,
+ * and \move and the Banner effect are evaluated the same way as while
+ * rendering, so the resulting position is exact. Karaoke words are
+ * allowed and reported, their sweep doesn't change the layout.
+ * \param motion out: kind of motion and current position of the event
+ * \return false if the event changes over time in any other way
+ */
+bool ass_event_motion(ASS_Renderer *render_priv, ASS_Event *event,
+                      EventMotion *motion)
+{
+    *motion = (EventMotion) { .type = MOTION_NONE };
+
+    char *effect = event->Effect;
+    if (effect && *effect) {
+        if (strncmp(effect, "Banner;", 7) != 0)
+            return false;
+        int v[2];
+        int cnt = 0;
+        for (char *p = effect; cnt < 2 && (p = strchr(p, ';')); )
+            v[cnt++] = atoi(++p);
+        int delay = v[0] ? v[0] : 1;
+        int shift = (render_priv->time - event->Start) / delay;
+        if (cnt >= 2 && v[1] == 0) {
+            motion->type = MOTION_BANNER_RL;
+            motion->pos.x = render_priv->track->PlayResX - shift;
+        } else {
+            motion->type = MOTION_BANNER_LR;
+            motion->pos.x = shift;
+        }
+    }
+
+    // escaped braces can only be told from override blocks while parsing
+    if (strstr(event->Text, "\\{"))
+        return false;
+
+    bool ok = true;
+    char *p = event->Text, *q;
+    while (ok && (p = strchr(p, '{')) && (q = strchr(p, '}'))) {
+        TagsHashKey key = {
+            .text = p,
+            .length = q - p + 1,
+        };
+        TagsHashValue *val =
+            ass_cache_get(render_priv->cache.tags_cache, &key, NULL);
+        if (!val)
+            return false;
+        for (size_t i = 0; ok && val->valid && i < val->n_tags; i++) {
+            const ParsedTag *tag = val->tags + i;
+            struct arg args[MAX_VALID_NARGS + 1];
+            int nargs = load_args(args, p, val, tag);
+            switch (tag->type) {
+            case TAG_K:
+            case TAG_KF:
+            case TAG_KO:
+                motion->karaoke = true;
+                break;
+            case TAG_T:
+            case TAG_FADE:
+            case TAG_ORG:
+            case TAG_CLIP:
+            case TAG_ICLIP:
+                ok = false;
+                break;
+            case TAG_POS:
+                ok = nargs != 2;
+                break;
+            case TAG_MOVE:
+                // only the first valid \move applies
+                if (motion->type == MOTION_MOVE ||
+                        !move_position(render_priv, event, args, nargs,
+                                       &motion->pos.x, &motion->pos.y))
+                    break;
+                // \move over a Banner effect is left to the renderer
+                ok = motion->type == MOTION_NONE;
+                motion->type = MOTION_MOVE;
+                motion->args_start = args[0].start - event->Text;
+                motion->args_end = args[nargs - 1].end - event->Text;
+                break;
+            }
+        }
+        ass_cache_dec_ref(val);
+        p = q + 1;
+    }
+    return ok;
+}
+
+/**
+ * \brief Check whether an event looks the same at any time it's displayed
+ * Override blocks are looked up in the tags cache as parse_tags() does.
+ * \return false if the event has an effect or any tag that depends on time
+ */
+bool ass_event_is_static(ASS_Renderer *render_priv, ASS_Event *event)
+{
+    if (event->Effect && *event->Effect)
+        return false;
+    // escaped braces can only be told from override blocks while parsing
+    if (strstr(event->Text, "\\{"))
+        return false;
+
+    bool animated = false;
+    char *p = event->Text, *q;
+    while (!animated && (p = strchr(p, '{')) && (q = strchr(p, '}'))) {
+        TagsHashKey key = {
+            .text = p,
+            .length = q - p + 1,
+        };
+        TagsHashValue *val =
+            ass_cache_get(render_priv->cache.tags_cache, &key, NULL);
+        if (!val || !val->valid) {
+            ass_cache_dec_ref(val);
+            return false;
+        }
+        for (size_t i = 0; !animated && i < val->n_tags; i++) {
+            switch (val->tags[i].type) {
+            case TAG_T:
+                // without its tags argument, \t is ignored
+                animated = val->tags[i].nargs >= 1 && val->tags[i].nargs <= 4;
+                break;
+            case TAG_K:
+            case TAG_KF:
+            case TAG_KO:
+            case TAG_MOVE:
+            case TAG_FADE:
+                animated = true;
+                break;
+            }
+        }
+        ass_cache_dec_ref(val);
+        p = q + 1;
+    }
+    return !animated;
 }
 
 void apply_transition_effects(ASS_Renderer *render_priv, ASS_Event *event)
@@ -917,8 +1453,9 @@ void apply_transition_effects(ASS_Renderer *render_priv, ASS_Event *event)
  * (the first glyph of the karaoke word)'s effect_type and effect_timing.
  * This function:
  * 1. sets effect_type for all glyphs in the word (_karaoke_ word)
- * 2. sets effect_timing for all glyphs to x coordinate of the border line between the left and right karaoke parts
- * (left part is filled with PrimaryColour, right one - with SecondaryColour).
+ * 2. stores the time span and the extents of the word in all its glyphs,
+ * from which apply_karaoke_timing() finds the split for the current time.
+ * Only the latter depends on the time, so the layout can be reused.
  */
 void process_karaoke_effects(ASS_Renderer *render_priv)
 {
@@ -928,12 +1465,8 @@ void process_karaoke_effects(ASS_Renderer *render_priv)
     int i;
     int timing;                 // current timing
     int tm_start, tm_end;       // timings at start and end of the current word
-    int tm_current;
-    double dt;
-    int x;
     int x_start, x_end;
 
-    tm_current = render_priv->time - render_priv->state.event->Start;
     timing = 0;
     s1 = s2 = 0;
     for (i = 0; i <= render_priv->text_info.length; ++i) {
@@ -954,17 +1487,9 @@ void process_karaoke_effects(ASS_Renderer *render_priv)
                     x_end = FFMAX(x_end, d6_to_int(cur2->pos.x + cur2->advance.x));
                 }
 
-                dt = (tm_current - tm_start);
-                if ((s1->effect_type == EF_KARAOKE)
-                    || (s1->effect_type == EF_KARAOKE_KO)) {
-                    if (dt >= 0)
-                        x = x_end + 1;
-                    else
-                        x = x_start;
-                } else if (s1->effect_type == EF_KARAOKE_KF) {
-                    dt /= (tm_end - tm_start);
-                    x = x_start + (x_end - x_start) * dt;
-                } else {
+                if ((s1->effect_type != EF_KARAOKE)
+                    && (s1->effect_type != EF_KARAOKE_KO)
+                    && (s1->effect_type != EF_KARAOKE_KF)) {
                     ass_msg(render_priv->library, MSGL_ERR,
                             "Unknown effect type");
                     continue;
@@ -972,7 +1497,11 @@ void process_karaoke_effects(ASS_Renderer *render_priv)
 
                 for (cur2 = s1; cur2 <= e1; ++cur2) {
                     cur2->effect_type = s1->effect_type;
-                    cur2->effect_timing = x - d6_to_int(cur2->pos.x);
+                    cur2->karaoke_start = tm_start;
+                    cur2->karaoke_end = tm_end;
+                    cur2->karaoke_x_start = x_start;
+                    cur2->karaoke_x_end = x_end;
+                    cur2->karaoke_pos = d6_to_int(cur2->pos.x);
                 }
                 s1->effect = 1;
             }
@@ -980,6 +1509,33 @@ void process_karaoke_effects(ASS_Renderer *render_priv)
     }
 }
 
+/**
+ * \brief Set the karaoke split of all glyphs for the current time
+ * effect_timing becomes the x coordinate of the border between the left
+ * and right karaoke parts (left part is filled with PrimaryColour, right
+ * one - with SecondaryColour), relative to the glyph before line wrapping.
+ */
+void apply_karaoke_timing(ASS_Renderer *render_priv)
+{
+    int tm_current = render_priv->time - render_priv->state.event->Start;
+    for (int i = 0; i < render_priv->text_info.length; i++) {
+        GlyphInfo *info = render_priv->text_info.glyphs + i;
+        if (info->effect_type == EF_NONE)
+            continue;
+        double dt = (tm_current - info->karaoke_start);
+        int x;
+        if (info->effect_type == EF_KARAOKE_KF) {
+            dt /= (info->karaoke_end - info->karaoke_start);
+            x = info->karaoke_x_start +
+                (info->karaoke_x_end - info->karaoke_x_start) * dt;
+        } else if (dt >= 0)
+            x = info->karaoke_x_end + 1;
+        else
+            x = info->karaoke_x_start;
+        info->effect_timing = x - info->karaoke_pos;
+    }
+}
+
 
 /**
  * \brief Get next ucs4 char from string, parsing UTF-8 and escapes
@@ -30,9 +30,12 @@ void update_font(ASS_Renderer *render_priv);
 double ensure_font_size(ASS_Renderer *priv, double size);
 void apply_transition_effects(ASS_Renderer *render_priv, ASS_Event *event);
 void process_karaoke_effects(ASS_Renderer *render_priv);
+void apply_karaoke_timing(ASS_Renderer *render_priv);
 unsigned get_next_char(ASS_Renderer *render_priv, char **str);
-char *parse_tags(ASS_Renderer *render_priv, char *p, char *end, double pwr,
-                 bool nested);
+void parse_tags(ASS_Renderer *render_priv, char *p, char *end);
+bool ass_event_motion(ASS_Renderer *render_priv, ASS_Event *event,
+                      EventMotion *motion);
+bool ass_event_is_static(ASS_Renderer *render_priv, ASS_Event *event);
 int event_has_hard_overrides(char *str);
 extern void change_alpha(uint32_t *var, int32_t new, double pwr);
 extern uint32_t mult_alpha(uint32_t a, uint32_t b);
@@ -57,7 +57,9 @@ bool rasterizer_init(RasterizerData *rst, int tile_order, int outline_error)
     rst->linebuf[0] = rst->linebuf[1] = NULL;
     rst->size[0] = rst->capacity[0] = 0;
     rst->size[1] = rst->capacity[1] = 0;
-    rst->n_first = 0;
+    rst->n_first[0] = rst->n_first[1] = 0;
+    rst->n_output = 0;
+    rst->n_outputs = 1;
 
     rst->tile = ass_aligned_alloc(32, 1 << (2 * tile_order), false);
     return rst->tile;
@@ -260,14 +262,10 @@ static bool add_cubic(RasterizerData *rst, const ASS_Vector *pt)
 }
 
 
-bool rasterizer_set_outline(RasterizerData *rst,
-                            const ASS_Outline *path, bool extra)
+static bool set_outline(RasterizerData *rst, const ASS_Outline *path,
+                        size_t *n_first, bool extra)
 {
-    if (!extra) {
-        rectangle_reset(&rst->bbox);
-        rst->n_first = 0;
-    }
-    rst->size[0] = rst->n_first;
+    rst->size[0] = *n_first;
 
     for (size_t i = 0; i < path->n_points; i++) {
         if (path->points[i].x < OUTLINE_MIN || path->points[i].x > OUTLINE_MAX)
@@ -316,17 +314,46 @@ bool rasterizer_set_outline(RasterizerData *rst,
     }
     assert(start == cur && cur == path->points + path->n_points);
 
-    for (size_t k = rst->n_first; k < rst->size[0]; k++) {
+    for (size_t k = *n_first; k < rst->size[0]; k++) {
         struct segment *line = &rst->linebuf[0][k];
         rectangle_update(&rst->bbox,
                          line->x_min, line->y_min,
                          line->x_max, line->y_max);
     }
     if (!extra)
-        rst->n_first = rst->size[0];
+        *n_first = rst->size[0];
     return true;
 }
 
+bool rasterizer_set_outline(RasterizerData *rst,
+                            const ASS_Outline *path, bool extra)
+{
+    if (!extra) {
+        rectangle_reset(&rst->bbox);
+        rst->n_first[0] = 0;
+    } else if (rst->n_outputs > 1) {
+        rst->bbox = rst->bbox_first;
+    }
+    rst->n_outputs = 1;
+    return set_outline(rst, path, &rst->n_first[0], extra);
+}
+
+bool rasterizer_set_outline2(RasterizerData *rst,
+                             const ASS_Outline *path, bool extra)
+{
+    if (rst->n_outputs < 2) {
+        assert(!extra);
+        rst->bbox_first = rst->bbox;
+        rst->n_output = rst->size[0];
+        rst->n_outputs = 2;
+    }
+    if (!extra) {
+        rectangle_reset(&rst->bbox);
+        rst->n_first[1] = rst->n_output;
+    }
+    return set_outline(rst, path, &rst->n_first[1], extra);
+}
+
 
 static void segment_move_x(struct segment *line, int32_t x)
 {
@@ -441,98 +468,100 @@ static inline int segment_check_bottom(const struct segment *line, int32_t y)
 /**
  * \brief Split list of segments horizontally
  * \param src in: input array, can coincide with *dst0 or *dst1
- * \param n_src in: numbers of input segments for both groups
- * \param dst0, dst1 out: output arrays of at least n_src[0] + n_src[1] size
- * \param n_dst0, n_dst1 out: numbers of output segments for both groups
+ * \param n_src in: numbers of input segments for all groups
+ * \param dst0, dst1 out: output arrays of at least total n_src size
+ * \param n_dst0, n_dst1 out: numbers of output segments for all groups
  * \param winding out: resulting winding of bottom-split point
  * \param x in: split coordinate
  */
-static void polyline_split_horz(const struct segment *src, const size_t n_src[2],
-                                struct segment *dst0, size_t n_dst0[2],
-                                struct segment *dst1, size_t n_dst1[2],
-                                int winding[2], int32_t x)
-{
-    const struct segment *cmp = src + n_src[0];
-    const struct segment *end = cmp + n_src[1];
-    n_dst0[0] = n_dst0[1] = 0;
-    n_dst1[0] = n_dst1[1] = 0;
-    for (; src != end; src++) {
-        int group = src < cmp ? 0 : 1;
-
-        int delta = 0;
-        if (!src->y_min && (src->flags & SEGFLAG_EXACT_TOP))
-            delta = src->a < 0 ? 1 : -1;
-        if (segment_check_right(src, x)) {
-            winding[group] += delta;
-            if (src->x_min >= x)
+static void polyline_split_horz(const struct segment *src, const size_t n_src[N_GROUPS],
+                                struct segment *dst0, size_t n_dst0[N_GROUPS],
+                                struct segment *dst1, size_t n_dst1[N_GROUPS],
+                                int winding[N_GROUPS], int32_t x)
+{
+    const struct segment *end[N_GROUPS];
+    for (int group = 0; group < N_GROUPS; group++) {
+        end[group] = (group ? end[group - 1] : src) + n_src[group];
+        n_dst0[group] = n_dst1[group] = 0;
+    }
+    for (int group = 0; group < N_GROUPS; group++) {
+        for (; src != end[group]; src++) {
+            int delta = 0;
+            if (!src->y_min && (src->flags & SEGFLAG_EXACT_TOP))
+                delta = src->a < 0 ? 1 : -1;
+            if (segment_check_right(src, x)) {
+                winding[group] += delta;
+                if (src->x_min >= x)
+                    continue;
+                *dst0 = *src;
+                dst0->x_max = FFMIN(dst0->x_max, x);
+                n_dst0[group]++;
+                dst0++;
+                continue;
+            }
+            if (segment_check_left(src, x)) {
+                *dst1 = *src;
+                segment_move_x(dst1, x);
+                n_dst1[group]++;
+                dst1++;
                 continue;
+            }
+            if (src->flags & SEGFLAG_UL_DR)
+                winding[group] += delta;
             *dst0 = *src;
-            dst0->x_max = FFMIN(dst0->x_max, x);
+            segment_split_horz(dst0, dst1, x);
             n_dst0[group]++;
             dst0++;
-            continue;
-        }
-        if (segment_check_left(src, x)) {
-            *dst1 = *src;
-            segment_move_x(dst1, x);
             n_dst1[group]++;
             dst1++;
-            continue;
         }
-        if (src->flags & SEGFLAG_UL_DR)
-            winding[group] += delta;
-        *dst0 = *src;
-        segment_split_horz(dst0, dst1, x);
-        n_dst0[group]++;
-        dst0++;
-        n_dst1[group]++;
-        dst1++;
     }
 }
 
 /**
  * \brief Split list of segments vertically
  */
-static void polyline_split_vert(const struct segment *src, const size_t n_src[2],
-                                struct segment *dst0, size_t n_dst0[2],
-                                struct segment *dst1, size_t n_dst1[2],
-                                int winding[2], int32_t y)
-{
-    const struct segment *cmp = src + n_src[0];
-    const struct segment *end = cmp + n_src[1];
-    n_dst0[0] = n_dst0[1] = 0;
-    n_dst1[0] = n_dst1[1] = 0;
-    for (; src != end; src++) {
-        int group = src < cmp ? 0 : 1;
-
-        int delta = 0;
-        if (!src->x_min && (src->flags & SEGFLAG_EXACT_LEFT))
-            delta = src->b < 0 ? 1 : -1;
-        if (segment_check_bottom(src, y)) {
-            winding[group] += delta;
-            if (src->y_min >= y)
+static void polyline_split_vert(const struct segment *src, const size_t n_src[N_GROUPS],
+                                struct segment *dst0, size_t n_dst0[N_GROUPS],
+                                struct segment *dst1, size_t n_dst1[N_GROUPS],
+                                int winding[N_GROUPS], int32_t y)
+{
+    const struct segment *end[N_GROUPS];
+    for (int group = 0; group < N_GROUPS; group++) {
+        end[group] = (group ? end[group - 1] : src) + n_src[group];
+        n_dst0[group] = n_dst1[group] = 0;
+    }
+    for (int group = 0; group < N_GROUPS; group++) {
+        for (; src != end[group]; src++) {
+            int delta = 0;
+            if (!src->x_min && (src->flags & SEGFLAG_EXACT_LEFT))
+                delta = src->b < 0 ? 1 : -1;
+            if (segment_check_bottom(src, y)) {
+                winding[group] += delta;
+                if (src->y_min >= y)
+                    continue;
+                *dst0 = *src;
+                dst0->y_max = dst0->y_max < y ? dst0->y_max : y;
+                n_dst0[group]++;
+                dst0++;
                 continue;
+            }
+            if (segment_check_top(src, y)) {
+                *dst1 = *src;
+                segment_move_y(dst1, y);
+                n_dst1[group]++;
+                dst1++;
+                continue;
+            }
+            if (src->flags & SEGFLAG_UL_DR)
+                winding[group] += delta;
             *dst0 = *src;
-            dst0->y_max = dst0->y_max < y ? dst0->y_max : y;
+            segment_split_vert(dst0, dst1, y);
             n_dst0[group]++;
             dst0++;
-            continue;
-        }
-        if (segment_check_top(src, y)) {
-            *dst1 = *src;
-            segment_move_y(dst1, y);
             n_dst1[group]++;
             dst1++;
-            continue;
         }
-        if (src->flags & SEGFLAG_UL_DR)
-            winding[group] += delta;
-        *dst0 = *src;
-        segment_split_vert(dst0, dst1, y);
-        n_dst0[group]++;
-        dst0++;
-        n_dst1[group]++;
-        dst1++;
     }
 }
 
@@ -619,31 +648,21 @@ static inline int get_fill_flags(struct segment *line, size_t n_lines, int windi
 }
 
 /**
- * \brief Main quad-tree filling function
- * \param index index (0 or 1) of the input segment buffer (rst->linebuf)
- * \param offs current offset from the beginning of the buffer
- * \param winding bottom-left winding value
- * \return false on error
- * Rasterizes (possibly recursive) one quad-tree level.
- * Truncates used input buffer.
+ * \brief Fill one output of the quad-tree level if possible
+ * \param line, n_lines, winding in: both segment groups of the output
+ * \return true if the output is done, false if further splitting is required
  */
-static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rst,
-                                  uint8_t *buf, int width, int height, ptrdiff_t stride,
-                                  int index, const size_t n_lines[2], const int winding[2])
+static bool rasterizer_fill_output(const BitmapEngine *engine, RasterizerData *rst,
+                                   uint8_t *buf, int width, int height, ptrdiff_t stride,
+                                   struct segment *line, const size_t n_lines[2],
+                                   const int winding[2])
 {
-    assert(width > 0 && height > 0);
-    assert((unsigned) index < 2u && n_lines[0] + n_lines[1] <= rst->size[index]);
-    assert(!(width  & ((1 << engine->tile_order) - 1)));
-    assert(!(height & ((1 << engine->tile_order) - 1)));
-
-    size_t offs = rst->size[index] - n_lines[0] - n_lines[1];
-    struct segment *line = rst->linebuf[index] + offs, *line1 = line + n_lines[0];
+    struct segment *line1 = line + n_lines[0];
     int flags0 = get_fill_flags(line,  n_lines[0], winding[0]);
     int flags1 = get_fill_flags(line1, n_lines[1], winding[1]);
     int flags = (flags0 | flags1) ^ FLAG_COMPLEX;
     if (flags & (FLAG_SOLID | FLAG_COMPLEX)) {
         rasterizer_fill_solid(engine, buf, width, height, stride, flags & FLAG_SOLID);
-        rst->size[index] = offs;
         return true;
     }
     if (!(flags & FLAG_GENERIC) && ((flags0 ^ flags1) & FLAG_COMPLEX)) {
@@ -652,83 +671,208 @@ static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rs
         rasterizer_fill_halfplane(engine, buf, width, height, stride,
                                   line->a, line->b, line->c,
                                   flags & FLAG_REVERSE ? -line->scale : line->scale);
-        rst->size[index] = offs;
         return true;
     }
-    if (width == 1 << engine->tile_order && height == 1 << engine->tile_order) {
-        if (!(flags1 & FLAG_COMPLEX)) {
-            engine->fill_generic(buf, stride, line, n_lines[0], winding[0]);
-            rst->size[index] = offs;
-            return true;
-        }
-        if (!(flags0 & FLAG_COMPLEX)) {
-            engine->fill_generic(buf, stride, line1, n_lines[1], winding[1]);
-            rst->size[index] = offs;
-            return true;
+    if (width != 1 << engine->tile_order || height != 1 << engine->tile_order)
+        return false;
+
+    if (!(flags1 & FLAG_COMPLEX)) {
+        engine->fill_generic(buf, stride, line, n_lines[0], winding[0]);
+        return true;
+    }
+    if (!(flags0 & FLAG_COMPLEX)) {
+        engine->fill_generic(buf, stride, line1, n_lines[1], winding[1]);
+        return true;
+    }
+    if (flags0 & FLAG_GENERIC)
+        engine->fill_generic(buf, stride, line, n_lines[0], winding[0]);
+    else
+        engine->fill_halfplane(buf, stride, line->a, line->b, line->c,
+                               flags0 & FLAG_REVERSE ? -line->scale : line->scale);
+    if (flags1 & FLAG_GENERIC)
+        engine->fill_generic(rst->tile, width, line1, n_lines[1], winding[1]);
+    else
+        engine->fill_halfplane(rst->tile, width, line1->a, line1->b, line1->c,
+                               flags1 & FLAG_REVERSE ? -line1->scale : line1->scale);
+    // XXX: better to use max instead of add
+    engine->add_bitmaps(buf, stride, rst->tile, width, height, width);
+    return true;
+}
+
+/**
+ * \brief Move a quad-tree level out of the input buffer into a new piece
+ * \return false on error
+ */
+static bool save_piece(RasterizerData *rst, RasterizerPieces *pieces,
+                       uint8_t *const buf[2], int width, int height,
+                       int index, const size_t n_lines[N_GROUPS],
+                       const int winding[N_GROUPS])
+{
+    size_t n_total = n_lines[0] + n_lines[1] + n_lines[2] + n_lines[3];
+    size_t offs = rst->size[index] - n_total;
+
+    if (pieces->n_pieces >= pieces->max_pieces) {
+        size_t new_size = FFMAX(2 * pieces->max_pieces, 16);
+        if (!ASS_REALLOC_ARRAY(pieces->pieces, new_size))
+            return false;
+        pieces->max_pieces = new_size;
+    }
+    if (pieces->n_lines + n_total > pieces->max_lines) {
+        size_t new_size = FFMAX(2 * pieces->max_lines, 64);
+        while (new_size < pieces->n_lines + n_total)
+            new_size *= 2;
+        if (!ASS_REALLOC_ARRAY(pieces->lines, new_size))
+            return false;
+        pieces->max_lines = new_size;
+    }
+
+    RasterizerPiece *piece = pieces->pieces + pieces->n_pieces++;
+    piece->buf[0] = buf[0];
+    piece->buf[1] = buf[1];
+    piece->width  = width;
+    piece->height = height;
+    piece->offset = pieces->n_lines;
+    for (int i = 0; i < N_GROUPS; i++) {
+        piece->n_lines[i] = n_lines[i];
+        piece->winding[i] = winding[i];
+    }
+    memcpy(pieces->lines + pieces->n_lines, rst->linebuf[index] + offs,
+           n_total * sizeof(struct segment));
+    pieces->n_lines += n_total;
+    rst->size[index] = offs;
+    return true;
+}
+
+/**
+ * \brief Main quad-tree filling function
+ * \param buf output buffers, NULL for outputs that are already done
+ * \param index index (0 or 1) of the input segment buffer (rst->linebuf)
+ * \param n_lines numbers of segments in every group
+ * \param winding bottom-left winding values
+ * \param pieces receives levels that shouldn't be filled right away, can be NULL
+ * \return false on error
+ * Rasterizes (possibly recursive) one quad-tree level.
+ * Both outputs share the splitting, so every output gets exactly
+ * the same tiles as it would get if rasterized on its own.
+ * Truncates used input buffer.
+ */
+static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rst,
+                                  uint8_t *const buf[2], int width, int height, ptrdiff_t stride,
+                                  int index, const size_t n_lines[N_GROUPS],
+                                  const int winding[N_GROUPS], RasterizerPieces *pieces)
+{
+    size_t n_total = n_lines[0] + n_lines[1] + n_lines[2] + n_lines[3];
+    assert(width > 0 && height > 0);
+    assert((unsigned) index < 2u && n_total <= rst->size[index]);
+    assert(!(width  & ((1 << engine->tile_order) - 1)));
+    assert(!(height & ((1 << engine->tile_order) - 1)));
+
+    if (pieces && (int64_t) width * height <= pieces->max_area)
+        return save_piece(rst, pieces, buf, width, height, index, n_lines, winding);
+
+    size_t offs = rst->size[index] - n_total;
+    struct segment *line = rst->linebuf[index] + offs, *src = NULL;
+    struct segment *group = line;
+    uint8_t *next_buf[2] = { NULL, NULL };
+    size_t n_src[N_GROUPS] = { 0 };
+    for (int k = 0; k < 2; k++) {
+        const size_t *n_cur = n_lines + 2 * k;
+        struct segment *cur = group;
+        group += n_cur[0] + n_cur[1];
+        if (!buf[k]) {
+            assert(!n_cur[0] && !n_cur[1]);
+            continue;
         }
-        if (flags0 & FLAG_GENERIC)
-            engine->fill_generic(buf, stride, line, n_lines[0], winding[0]);
-        else
-            engine->fill_halfplane(buf, stride, line->a, line->b, line->c,
-                                   flags0 & FLAG_REVERSE ? -line->scale : line->scale);
-        if (flags1 & FLAG_GENERIC)
-            engine->fill_generic(rst->tile, width, line1, n_lines[1], winding[1]);
-        else
-            engine->fill_halfplane(rst->tile, width, line1->a, line1->b, line1->c,
-                                   flags1 & FLAG_REVERSE ? -line1->scale : line1->scale);
-        // XXX: better to use max instead of add
-        engine->add_bitmaps(buf, stride, rst->tile, width, height, width);
+        if (rasterizer_fill_output(engine, rst, buf[k], width, height, stride,
+                                   cur, n_cur, winding + 2 * k))
+            continue;
+        if (!src)
+            src = cur;
+        next_buf[k] = buf[k];
+        n_src[2 * k + 0] = n_cur[0];
+        n_src[2 * k + 1] = n_cur[1];
+    }
+    if (!src) {
         rst->size[index] = offs;
         return true;
     }
 
+    size_t n_split = n_src[0] + n_src[1] + n_src[2] + n_src[3];
     size_t offs1 = rst->size[index ^ 1];
-    if (!check_capacity(rst, index ^ 1, n_lines[0] + n_lines[1]))
+    if (!check_capacity(rst, index ^ 1, n_split))
         return false;
     struct segment *dst0 = line;
     struct segment *dst1 = rst->linebuf[index ^ 1] + offs1;
 
-    uint8_t *buf1 = buf;
+    uint8_t *next_buf1[2] = { next_buf[0], next_buf[1] };
     int width1  = width;
     int height1 = height;
-    size_t n_next0[2], n_next1[2];
-    int winding1[2] = { winding[0], winding[1] };
+    size_t n_next0[N_GROUPS], n_next1[N_GROUPS];
+    int winding1[N_GROUPS];
+    for (int i = 0; i < N_GROUPS; i++)
+        winding1[i] = winding[i];
     if (width > height) {
         width = 1 << ilog2(width - 1);
         width1 -= width;
-        buf1 += width;
-        polyline_split_horz(line, n_lines,
+        for (int k = 0; k < 2; k++)
+            if (next_buf1[k])
+                next_buf1[k] += width;
+        polyline_split_horz(src, n_src,
                             dst0, n_next0, dst1, n_next1,
                             winding1, (int32_t) width << 6);
     } else {
         height = 1 << ilog2(height - 1);
         height1 -= height;
-        buf1 += height * stride;
-        polyline_split_vert(line, n_lines,
+        for (int k = 0; k < 2; k++)
+            if (next_buf1[k])
+                next_buf1[k] += height * stride;
+        polyline_split_vert(src, n_src,
                             dst0, n_next0, dst1, n_next1,
                             winding1, (int32_t) height << 6);
     }
-    rst->size[index ^ 0] = offs  + n_next0[0] + n_next0[1];
-    rst->size[index ^ 1] = offs1 + n_next1[0] + n_next1[1];
+    rst->size[index ^ 0] = offs  + n_next0[0] + n_next0[1] + n_next0[2] + n_next0[3];
+    rst->size[index ^ 1] = offs1 + n_next1[0] + n_next1[1] + n_next1[2] + n_next1[3];
 
-    if (!rasterizer_fill_level(engine, rst, buf,  width,  height,  stride, index ^ 0, n_next0,  winding))
+    if (!rasterizer_fill_level(engine, rst, next_buf,  width,  height,  stride,
+                               index ^ 0, n_next0,  winding,  pieces))
         return false;
     assert(rst->size[index ^ 0] == offs);
-    if (!rasterizer_fill_level(engine, rst, buf1, width1, height1, stride, index ^ 1, n_next1, winding1))
+    if (!rasterizer_fill_level(engine, rst, next_buf1, width1, height1, stride,
+                               index ^ 1, n_next1, winding1, pieces))
         return false;
     assert(rst->size[index ^ 1] == offs1);
     return true;
 }
 
-bool rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
-                     uint8_t *buf, int x0, int y0,
-                     int width, int height, ptrdiff_t stride)
+static bool fill_outputs(const BitmapEngine *engine, RasterizerData *rst,
+                         uint8_t *const buf[2], int x0, int y0,
+                         int width, int height, ptrdiff_t stride,
+                         RasterizerPieces *pieces)
 {
     assert(width > 0 && height > 0);
     assert(!(width  & ((1 << engine->tile_order) - 1)));
     assert(!(height & ((1 << engine->tile_order) - 1)));
     x0 *= 1 << 6;  y0 *= 1 << 6;
 
+    size_t n_lines[N_GROUPS] = {
+        rst->n_first[0], rst->size[0] - rst->n_first[0], 0, 0
+    };
+    ASS_Rect bbox = rst->bbox;
+    if (rst->n_outputs > 1) {
+        n_lines[1] = rst->n_output - rst->n_first[0];
+        if (buf[1]) {
+            n_lines[2] = rst->n_first[1] - rst->n_output;
+            n_lines[3] = rst->size[0] - rst->n_first[1];
+            rectangle_update(&bbox,
+                             rst->bbox_first.x_min, rst->bbox_first.y_min,
+                             rst->bbox_first.x_max, rst->bbox_first.y_max);
+        } else {
+            bbox = rst->bbox_first;
+        }
+    }
+    rst->n_outputs = 1;
+    rst->size[0] = n_lines[0] + n_lines[1] + n_lines[2] + n_lines[3];
+
     struct segment *line = rst->linebuf[0];
     struct segment *end = line + rst->size[0];
     for (; line != end; line++) {
@@ -738,49 +882,103 @@ bool rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
         line->y_max -= y0;
         line->c -= line->a * (int64_t) x0 + line->b * (int64_t) y0;
     }
-    rst->bbox.x_min -= x0;
-    rst->bbox.x_max -= x0;
-    rst->bbox.y_min -= y0;
-    rst->bbox.y_max -= y0;
+    bbox.x_min -= x0;
+    bbox.x_max -= x0;
+    bbox.y_min -= y0;
+    bbox.y_max -= y0;
 
     if (!check_capacity(rst, 1, rst->size[0]))
         return false;
 
-    size_t n_unused[2];
-    size_t n_lines[2] = { rst->n_first, rst->size[0] - rst->n_first };
-    int winding[2] = { 0, 0 };
+    size_t n_unused[N_GROUPS];
+    int winding[N_GROUPS] = { 0 };
 
     int32_t size_x = (int32_t) width << 6;
     int32_t size_y = (int32_t) height << 6;
-    if (rst->bbox.x_max >= size_x) {
+    if (bbox.x_max >= size_x) {
         polyline_split_horz(rst->linebuf[0], n_lines,
                             rst->linebuf[0], n_lines,
                             rst->linebuf[1], n_unused,
                             winding, size_x);
-        winding[0] = winding[1] = 0;
+        for (int i = 0; i < N_GROUPS; i++)
+            winding[i] = 0;
     }
-    if (rst->bbox.y_max >= size_y) {
+    if (bbox.y_max >= size_y) {
         polyline_split_vert(rst->linebuf[0], n_lines,
                             rst->linebuf[0], n_lines,
                             rst->linebuf[1], n_unused,
                             winding, size_y);
-        winding[0] = winding[1] = 0;
+        for (int i = 0; i < N_GROUPS; i++)
+            winding[i] = 0;
     }
-    if (rst->bbox.x_min <= 0) {
+    if (bbox.x_min <= 0) {
         polyline_split_horz(rst->linebuf[0], n_lines,
                             rst->linebuf[1], n_unused,
                             rst->linebuf[0], n_lines,
                             winding, 0);
     }
-    if (rst->bbox.y_min <= 0) {
+    if (bbox.y_min <= 0) {
         polyline_split_vert(rst->linebuf[0], n_lines,
                             rst->linebuf[1], n_unused,
                             rst->linebuf[0], n_lines,
                             winding, 0);
     }
-    rst->size[0] = n_lines[0] + n_lines[1];
+    rst->size[0] = n_lines[0] + n_lines[1] + n_lines[2] + n_lines[3];
     rst->size[1] = 0;
     return rasterizer_fill_level(engine, rst,
                                  buf, width, height, stride,
-                                 0, n_lines, winding);
+                                 0, n_lines, winding, pieces);
+}
+
+bool rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
+                     uint8_t *buf, int x0, int y0,
+                     int width, int height, ptrdiff_t stride)
+{
+    uint8_t *const bufs[2] = { buf, NULL };
+    return fill_outputs(engine, rst, bufs, x0, y0, width, height, stride, NULL);
+}
+
+bool rasterizer_fill2(const BitmapEngine *engine, RasterizerData *rst,
+                      uint8_t *buf, uint8_t *buf2, int x0, int y0,
+                      int width, int height, ptrdiff_t stride)
+{
+    assert(rst->n_outputs == 2);
+    uint8_t *const bufs[2] = { buf, buf2 };
+    return fill_outputs(engine, rst, bufs, x0, y0, width, height, stride, NULL);
+}
+
+bool rasterizer_fill_split(const BitmapEngine *engine, RasterizerData *rst,
+                           uint8_t *buf, uint8_t *buf2, int x0, int y0,
+                           int width, int height, ptrdiff_t stride,
+                           RasterizerPieces *pieces)
+{
+    assert(!buf2 || rst->n_outputs == 2);
+    uint8_t *const bufs[2] = { buf, buf2 };
+    return fill_outputs(engine, rst, bufs, x0, y0, width, height, stride, pieces);
+}
+
+bool rasterizer_fill_piece(const BitmapEngine *engine, RasterizerData *rst,
+                           const RasterizerPieces *pieces, size_t index,
+                           ptrdiff_t stride)
+{
+    assert(index < pieces->n_pieces);
+    const RasterizerPiece *piece = pieces->pieces + index;
+    const size_t *n_lines = piece->n_lines;
+    size_t n_total = n_lines[0] + n_lines[1] + n_lines[2] + n_lines[3];
+
+    rst->size[0] = rst->size[1] = 0;
+    if (!check_capacity(rst, 0, n_total))
+        return false;
+    memcpy(rst->linebuf[0], pieces->lines + piece->offset,
+           n_total * sizeof(struct segment));
+    rst->size[0] = n_total;
+    return rasterizer_fill_level(engine, rst,
+                                 piece->buf, piece->width, piece->height, stride,
+                                 0, n_lines, piece->winding, NULL);
+}
+
+void rasterizer_pieces_free(RasterizerPieces *pieces)
+{
+    free(pieces->pieces);
+    free(pieces->lines);
 }
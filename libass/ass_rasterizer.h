@@ -51,11 +51,37 @@ typedef struct {
     // internal buffers
     struct segment *linebuf[2];
     size_t size[2], capacity[2];
-    size_t n_first;
+    size_t n_first[2];  // start of the extra outline of each output
+    size_t n_output;    // start of the second output
+    int n_outputs;
+    ASS_Rect bbox_first;
 
     uint8_t *tile;
 } RasterizerData;
 
+/*
+ * Segment lists consist of up to 4 consecutive groups:
+ * two outputs with two outlines each (see rasterizer_fill2()).
+ */
+#define N_GROUPS 4
+
+// Independent part of the tile grid, see rasterizer_fill_split()
+typedef struct {
+    uint8_t *buf[2];    // NULL for outputs that are already done
+    int width, height;
+    size_t offset;      // position of the segments in RasterizerPieces.lines
+    size_t n_lines[N_GROUPS];
+    int winding[N_GROUPS];
+} RasterizerPiece;
+
+typedef struct {
+    int64_t max_area;   // in: maximal size of a piece in pixels
+    RasterizerPiece *pieces;
+    size_t n_pieces, max_pieces;
+    struct segment *lines;
+    size_t n_lines, max_lines;
+} RasterizerPieces;
+
 bool rasterizer_init(RasterizerData *rst, int tile_order, int outline_error);
 void rasterizer_done(RasterizerData *rst);
 
@@ -67,6 +93,13 @@ void rasterizer_done(RasterizerData *rst);
  */
 bool rasterizer_set_outline(RasterizerData *rst,
                             const ASS_Outline *path, bool extra);
+/**
+ * \brief Same as rasterizer_set_outline() but for the second output
+ * Can only be called after the first output has been set.
+ * Afterwards bbox holds the bounds of the second output.
+ */
+bool rasterizer_set_outline2(RasterizerData *rst,
+                             const ASS_Outline *path, bool extra);
 
 /**
  * \brief Polyline rasterization function
@@ -79,6 +112,37 @@ bool rasterizer_set_outline(RasterizerData *rst,
 bool rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
                      uint8_t *buf, int x0, int y0,
                      int width, int height, ptrdiff_t stride);
+/**
+ * \brief Rasterize both outputs in a single pass over the tile grid
+ * \param buf, buf2 out: output buffers for the first and second output
+ * Same window and stride are used for both outputs, each one gets exactly
+ * the same result as it would get from rasterizer_fill() on its own.
+ */
+bool rasterizer_fill2(const BitmapEngine *engine, RasterizerData *rst,
+                      uint8_t *buf, uint8_t *buf2, int x0, int y0,
+                      int width, int height, ptrdiff_t stride);
+/**
+ * \brief Start rasterization, leaving parts of the window for later
+ * \param buf2 out: buffer for the second output or NULL if not needed
+ * \param pieces in/out: zero-initialized except for max_area,
+ * receives tile-aligned parts of at most max_area pixels that still have
+ * to be filled with rasterizer_fill_piece(), in any order and on any thread
+ * Everything else is filled right away, the result is exactly the same
+ * as from rasterizer_fill() or rasterizer_fill2().
+ */
+bool rasterizer_fill_split(const BitmapEngine *engine, RasterizerData *rst,
+                           uint8_t *buf, uint8_t *buf2, int x0, int y0,
+                           int width, int height, ptrdiff_t stride,
+                           RasterizerPieces *pieces);
+/**
+ * \brief Fill a part left by rasterizer_fill_split()
+ * \param rst scratch buffers, must not be in use by another fill
+ * \param index index of the piece
+ */
+bool rasterizer_fill_piece(const BitmapEngine *engine, RasterizerData *rst,
+                           const RasterizerPieces *pieces, size_t index,
+                           ptrdiff_t stride);
+void rasterizer_pieces_free(RasterizerPieces *pieces);
 
 
 #endif /* LIBASS_RASTERIZER_H */
@@ -45,6 +45,16 @@ void ass_fill_solid_tile32_c(uint8_t *buf, ptrdiff_t stride, int set)
     }
 }
 
+void ass_fill_solid_tile64_c(uint8_t *buf, ptrdiff_t stride, int set)
+{
+    uint8_t value = set ? 255 : 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++)
+            buf[x] = value;
+        buf += stride;
+    }
+}
+
 
 /*
  * Halfplane Filling Functions
@@ -133,6 +143,41 @@ void ass_fill_halfplane_tile32_c(uint8_t *buf, ptrdiff_t stride,
 }
 
 
+// Products of the 16-pixel precision overflow int16_t over 64 pixels,
+// so this one works in int32_t to keep that precision.
+void ass_fill_halfplane_tile64_c(uint8_t *buf, ptrdiff_t stride,
+                                 int32_t a, int32_t b, int64_t c, int32_t scale)
+{
+    int32_t aa = (a * (int64_t) scale + ((int64_t) 1 << 49)) >> 50;
+    int32_t bb = (b * (int64_t) scale + ((int64_t) 1 << 49)) >> 50;
+    int32_t cc = ((int32_t) (c >> 13) * (int64_t) scale + ((int64_t) 1 << 42)) >> 43;
+    cc += (1 << 9) - ((aa + bb) >> 1);
+
+    int32_t abs_a = aa < 0 ? -aa : aa;
+    int32_t abs_b = bb < 0 ? -bb : bb;
+    int32_t delta = (FFMIN(abs_a, abs_b) + 2) >> 2;
+
+    int32_t va1[64], va2[64];
+    for (int x = 0; x < 64; x++) {
+        va1[x] = aa * x - delta;
+        va2[x] = aa * x + delta;
+    }
+
+    static const int32_t full = (1 << 10) - 1;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            int32_t c1 = cc - va1[x];
+            int32_t c2 = cc - va2[x];
+            c1 = FFMINMAX(c1, 0, full);
+            c2 = FFMINMAX(c2, 0, full);
+            buf[x] = (c1 + c2) >> 3;
+        }
+        buf += stride;
+        cc -= bb;
+    }
+}
+
+
 /*
  * Generic Filling Functions
  *
@@ -375,3 +420,121 @@ void ass_fill_generic_tile32_c(uint8_t *buf, ptrdiff_t stride,
         buf += stride;
     }
 }
+
+// Render top/bottom line of the trapeziod with antialiasing
+// Like the halfplane fill, this keeps the 16-pixel precision in int32_t.
+static inline void update_border_line64(int32_t res[64],
+                                        int32_t abs_a, const int32_t va[64],
+                                        int32_t b, int32_t abs_b,
+                                        int32_t c, int up, int dn)
+{
+    int32_t size = dn - up;
+    int32_t w = (1 << 10) + (size << 4) - abs_a;
+    w = FFMIN(w, 1 << 10) << 3;
+
+    int32_t dc_b = abs_b * size >> 6;
+    int32_t dc = (FFMIN(abs_a, dc_b) + 2) >> 2;
+
+    int32_t base = b * (up + dn) >> 7;
+    int32_t offs1 = size - ((base + dc) * w >> 16);
+    int32_t offs2 = size - ((base - dc) * w >> 16);
+
+    size <<= 1;
+    for (int x = 0; x < 64; x++) {
+        int32_t cw = (c - va[x]) * w >> 16;
+        int32_t c1 = cw + offs1;
+        int32_t c2 = cw + offs2;
+        c1 = FFMINMAX(c1, 0, size);
+        c2 = FFMINMAX(c2, 0, size);
+        res[x] += c1 + c2;
+    }
+}
+
+void ass_fill_generic_tile64_c(uint8_t *buf, ptrdiff_t stride,
+                               const struct segment *line, size_t n_lines,
+                               int winding)
+{
+    int32_t res[64][64], delta[66];
+    for (int y = 0; y < 64; y++)
+        for (int x = 0; x < 64; x++)
+            res[y][x] = 0;
+    for (int y = 0; y < 66; y++)
+        delta[y] = 0;
+
+    static const int32_t full = 1 << 10;
+    const struct segment *end = line + n_lines;
+    for (; line != end; ++line) {
+        assert(line->y_min >= 0 && line->y_min < 1 << 12);
+        assert(line->y_max > 0 && line->y_max <= 1 << 12);
+        assert(line->y_min <= line->y_max);
+
+        int32_t up_delta = line->flags & SEGFLAG_DN ? 4 : 0;
+        int32_t dn_delta = up_delta;
+        if (!line->x_min && (line->flags & SEGFLAG_EXACT_LEFT)) dn_delta ^= 4;
+        if (line->flags & SEGFLAG_UL_DR) {
+            int32_t tmp = up_delta;
+            up_delta = dn_delta;
+            dn_delta = tmp;
+        }
+
+        int up = line->y_min >> 6, dn = line->y_max >> 6;
+        int32_t up_pos = line->y_min & 63;
+        int32_t up_delta1 = up_delta * up_pos;
+        int32_t dn_pos = line->y_max & 63;
+        int32_t dn_delta1 = dn_delta * dn_pos;
+        delta[up + 1] -= up_delta1;
+        delta[up] -= (up_delta << 6) - up_delta1;
+        delta[dn + 1] += dn_delta1;
+        delta[dn] += (dn_delta << 6) - dn_delta1;
+        if (line->y_min == line->y_max)
+            continue;
+
+        int32_t a = (line->a * (int64_t) line->scale + ((int64_t) 1 << 49)) >> 50;
+        int32_t b = (line->b * (int64_t) line->scale + ((int64_t) 1 << 49)) >> 50;
+        int32_t c = ((int32_t) (line->c >> 13) * (int64_t) line->scale + ((int64_t) 1 << 42)) >> 43;
+        c -= (a >> 1) + b * up;
+
+        int32_t va[64];
+        for (int x = 0; x < 64; x++)
+            va[x] = a * x;
+        int32_t abs_a = a < 0 ? -a : a;
+        int32_t abs_b = b < 0 ? -b : b;
+        int32_t dc = (FFMIN(abs_a, abs_b) + 2) >> 2;
+        int32_t base = (1 << 9) - (b >> 1);
+        int32_t dc1 = base + dc;
+        int32_t dc2 = base - dc;
+
+        if (up_pos) {
+            if (dn == up) {
+                update_border_line64(res[up], abs_a, va, b, abs_b, c, up_pos, dn_pos);
+                continue;
+            }
+            update_border_line64(res[up], abs_a, va, b, abs_b, c, up_pos, 64);
+            up++;
+            c -= b;
+        }
+        for (int y = up; y < dn; y++) {
+            for (int x = 0; x < 64; x++) {
+                int32_t c1 = c - va[x] + dc1;
+                int32_t c2 = c - va[x] + dc2;
+                c1 = FFMINMAX(c1, 0, full);
+                c2 = FFMINMAX(c2, 0, full);
+                res[y][x] += (c1 + c2) >> 3;
+            }
+            c -= b;
+        }
+        if (dn_pos)
+            update_border_line64(res[dn], abs_a, va, b, abs_b, c, 0, dn_pos);
+    }
+
+    int32_t cur = 256 * winding;
+    for (int y = 0; y < 64; y++) {
+        cur += delta[y];
+        for (int x = 0; x < 64; x++) {
+            int32_t val = res[y][x] + cur, neg_val = -val;
+            val = (val > neg_val ? val : neg_val);
+            buf[x] = FFMIN(val, 255);
+        }
+        buf += stride;
+    }
+}
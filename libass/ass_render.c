@@ -20,9 +20,13 @@
 #include "ass_compat.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#ifdef CONFIG_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "ass_outline.h"
 #include "ass_render.h"
@@ -33,6 +37,7 @@
 #define MAX_LINES_INITIAL 64
 #define MAX_BITMAPS_INITIAL 16
 #define MAX_SUB_BITMAPS_INITIAL 64
+#define IMAGE_SLAB_SIZE 64
 #define SUBPIXEL_MASK 63
 #define STROKER_PRECISION 16     // stroker error in integer units, unrelated to final accuracy
 #define RASTERIZER_PRECISION 16  // rasterizer spline approximation error in 1/64 pixel units
@@ -40,7 +45,181 @@
 #define MAX_PERSP_SCALE 16.0
 #define SUBPIXEL_ORDER 3  // ~ log2(64 / POSITION_PRECISION)
 #define BLUR_PRECISION (1.0 / 256)  // blur error as fraction of full input range
+#define PARALLEL_FILL_AREA (512 * 512)  // minimal rasterization window to split between threads
+#define FILL_PIECE_AREA (256 * 256)     // minimal size of a part filled by one thread
+// reduced quality for the frame budget, see ass_set_frame_budget()
+#define DEGRADE_BUDGET_SHARE 0.75   // part of the budget used before degrading events
+#define DEGRADED_MIN_BE 4           // fewest \be passes to halve
+#define DEGRADED_STROKER_SHIFT 2    // log2 of the stroker error increase
+#define DEGRADED_MIN_BORDER 16      // thinnest border to stroke coarsely, in stroker error units
+
+#ifdef CONFIG_PTHREAD
+typedef struct {
+    RenderThreads *threads;
+    ASS_Renderer *render_priv;  // private copy of the owner renderer
+    pthread_t thread;
+} RenderWorker;
+
+// Rasterization split by ass_rasterize() for idle threads to help with
+typedef struct fill_task {
+    struct fill_task *next;
+    const BitmapEngine *engine;
+    RasterizerPieces pieces;
+    ptrdiff_t stride;
+    size_t next_piece, n_done;
+    bool failed;
+} FillTask;
+
+struct render_threads {
+    // Serializes event layout: fonts, the shaper and FreeType are not
+    // thread-safe. Rasterization and compositing run without it.
+    pthread_mutex_t layout_lock;
+
+    pthread_mutex_t lock;       // protects the job fields below
+    pthread_cond_t job_cond, done_cond;
+    unsigned job_id;            // incremented for every batch of jobs
+    bool quit;
+    ASS_Renderer *owner;
+    const int *events;          // ids of the events to render
+    bool at_start;              // render events at their start time
+    int job_next, job_count, job_done;
+    FillTask *fill_tasks;       // tasks with pieces left to take
+
+    int n_workers;
+    RenderWorker *workers;
+};
+#endif
+
+static inline void lock_layout(ASS_Renderer *render_priv)
+{
+#ifdef CONFIG_PTHREAD
+    if (render_priv->shared_cache)
+        lock_shared_layout(render_priv->shared_cache);
+    else if (render_priv->threads)
+        pthread_mutex_lock(&render_priv->threads->layout_lock);
+#endif
+}
+
+static inline void unlock_layout(ASS_Renderer *render_priv)
+{
+#ifdef CONFIG_PTHREAD
+    if (render_priv->shared_cache)
+        unlock_shared_layout(render_priv->shared_cache);
+    else if (render_priv->threads)
+        pthread_mutex_unlock(&render_priv->threads->layout_lock);
+#endif
+}
+
+static bool text_info_init(TextInfo *text_info)
+{
+    text_info->max_bitmaps = MAX_BITMAPS_INITIAL;
+    text_info->max_glyphs = MAX_GLYPHS_INITIAL;
+    text_info->max_lines = MAX_LINES_INITIAL;
+    text_info->n_bitmaps = 0;
+    text_info->combined_bitmaps = calloc(MAX_BITMAPS_INITIAL, sizeof(CombinedBitmapInfo));
+    text_info->glyphs = calloc(MAX_GLYPHS_INITIAL, sizeof(GlyphInfo));
+    text_info->lines = calloc(MAX_LINES_INITIAL, sizeof(LineInfo));
+    return text_info->combined_bitmaps && text_info->glyphs && text_info->lines;
+}
+
+static void text_info_done(TextInfo *text_info)
+{
+    free(text_info->glyphs);
+    free(text_info->lines);
+    free(text_info->combined_bitmaps);
+}
+
+typedef struct image_slab {
+    struct image_slab *next;
+    ASS_ImagePriv images[IMAGE_SLAB_SIZE];
+} ImageSlab;
+
+/*
+ * Free list of image structs, allocated in slabs and never shrunk.
+ * Released frames are spliced back as a whole, so taking and returning
+ * images costs no malloc calls once the pool has grown to the frame size.
+ */
+struct image_pool {
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_t lock;
+#endif
+    ASS_ImagePriv *free_list;   // linked through result.next
+    ImageSlab *slabs;
+};
+
+static ImagePool *image_pool_create(void)
+{
+    ImagePool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_init(&pool->lock, NULL);
+#endif
+    return pool;
+}
+
+/**
+ * \brief Free the pool
+ * All images taken from it must have been released.
+ */
+static void image_pool_free(ImagePool *pool)
+{
+    if (!pool)
+        return;
+    ImageSlab *slab = pool->slabs;
+    while (slab) {
+        ImageSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    free(pool);
+}
+
+static ASS_ImagePriv *image_pool_get(ImagePool *pool)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&pool->lock);
+#endif
+    if (!pool->free_list) {
+        ImageSlab *slab = malloc(sizeof(ImageSlab));
+        if (slab) {
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            for (int i = 0; i < IMAGE_SLAB_SIZE; i++) {
+                slab->images[i].result.next = i + 1 < IMAGE_SLAB_SIZE ?
+                    &slab->images[i + 1].result : NULL;
+                slab->images[i].pool = pool;
+            }
+            pool->free_list = slab->images;
+        }
+    }
+    ASS_ImagePriv *img = pool->free_list;
+    if (img)
+        pool->free_list = (ASS_ImagePriv *) img->result.next;
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    return img;
+}
 
+/**
+ * \brief Give a chain of images back to their pool
+ * \param last last image of the chain, its next pointer is overwritten
+ */
+static void image_pool_put(ImagePool *pool, ASS_ImagePriv *first, ASS_ImagePriv *last)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&pool->lock);
+#endif
+    last->result.next = (ASS_Image *) pool->free_list;
+    pool->free_list = first;
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
 
 ASS_Renderer *ass_renderer_init(ASS_Library *library)
 {
@@ -69,40 +248,46 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
     priv->ftlibrary = ft;
     // images_root and related stuff is zero-filled in calloc
 
-#if (defined(__i386__) || defined(__x86_64__)) && CONFIG_ASM
-    if (has_avx2())
-        priv->engine = &ass_bitmap_engine_avx2;
-    else if (has_sse2())
-        priv->engine = &ass_bitmap_engine_sse2;
-    else
-        priv->engine = &ass_bitmap_engine_c;
-#else
-    priv->engine = &ass_bitmap_engine_c;
-#endif
+    priv->engine = ass_bitmap_engine_init(NULL);
 
     if (!rasterizer_init(&priv->rasterizer, priv->engine->tile_order,
                          RASTERIZER_PRECISION))
         goto fail;
+    if (!(priv->image_pool = image_pool_create()))
+        goto fail;
 
     priv->cache.font_cache = ass_font_cache_create();
     priv->cache.bitmap_cache = ass_bitmap_cache_create();
     priv->cache.composite_cache = ass_composite_cache_create();
+    priv->cache.shadow_cache = ass_shadow_cache_create();
     priv->cache.outline_cache = ass_outline_cache_create();
-    if (!priv->cache.font_cache || !priv->cache.bitmap_cache || !priv->cache.composite_cache || !priv->cache.outline_cache)
+    priv->cache.event_cache = ass_event_cache_create();
+    priv->cache.tags_cache = ass_tags_cache_create();
+    if (!priv->cache.font_cache || !priv->cache.bitmap_cache || !priv->cache.composite_cache || !priv->cache.outline_cache ||
+            !priv->cache.shadow_cache || !priv->cache.event_cache || !priv->cache.tags_cache)
         goto fail;
 
+    if (!(priv->cache.budget = ass_cache_budget_create()))
+        goto fail;
+    // fonts are only counted: the budget can be trimmed on any thread,
+    // but FreeType faces mustn't be closed while others are in use
+    if (!ass_cache_set_budget(priv->cache.font_cache, priv->cache.budget, false))
+        goto fail;
+    Cache *budget_caches[] = {
+        priv->cache.outline_cache,
+        priv->cache.bitmap_cache, priv->cache.composite_cache,
+        priv->cache.shadow_cache, priv->cache.event_cache,
+        priv->cache.tags_cache,
+    };
+    for (size_t i = 0; i < sizeof(budget_caches) / sizeof(budget_caches[0]); i++)
+        if (!ass_cache_set_budget(budget_caches[i], priv->cache.budget, true))
+            goto fail;
+
     priv->cache.glyph_max = GLYPH_CACHE_MAX;
     priv->cache.bitmap_max_size = BITMAP_CACHE_MAX_SIZE;
     priv->cache.composite_max_size = COMPOSITE_CACHE_MAX_SIZE;
 
-    priv->text_info.max_bitmaps = MAX_BITMAPS_INITIAL;
-    priv->text_info.max_glyphs = MAX_GLYPHS_INITIAL;
-    priv->text_info.max_lines = MAX_LINES_INITIAL;
-    priv->text_info.n_bitmaps = 0;
-    priv->text_info.combined_bitmaps = calloc(MAX_BITMAPS_INITIAL, sizeof(CombinedBitmapInfo));
-    priv->text_info.glyphs = calloc(MAX_GLYPHS_INITIAL, sizeof(GlyphInfo));
-    priv->text_info.lines = calloc(MAX_LINES_INITIAL, sizeof(LineInfo));
-    if (!priv->text_info.combined_bitmaps || !priv->text_info.glyphs || !priv->text_info.lines)
+    if (!text_info_init(&priv->text_info))
         goto fail;
 
     priv->settings.font_size_coeff = 1.;
@@ -118,6 +303,9 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
     priv->settings.shaper = ASS_SHAPING_SIMPLE;
 #endif
 
+    priv->trace_id = ass_trace_new_id(library->trace);
+    ASS_TRACE(library, TRACE_RENDERER_INIT, priv->trace_id);
+
     ass_msg(library, MSGL_V, "Initialized");
 
     return priv;
@@ -134,45 +322,161 @@ void ass_renderer_done(ASS_Renderer *render_priv)
     if (!render_priv)
         return;
 
+    ASS_TRACE(render_priv->library, TRACE_RENDERER_DONE, render_priv->trace_id);
+    ass_render_threads_free(render_priv->threads);
+
     ass_frame_unref(render_priv->images_root);
     ass_frame_unref(render_priv->prev_images_root);
+    ass_atlas_free(render_priv->atlas);
 
+    if (!render_priv->shared_cache)
+        ass_cache_done(render_priv->cache.tags_cache);
+    ass_cache_done(render_priv->cache.event_cache);
+    ass_cache_done(render_priv->cache.shadow_cache);
     ass_cache_done(render_priv->cache.composite_cache);
     ass_cache_done(render_priv->cache.bitmap_cache);
-    ass_cache_done(render_priv->cache.outline_cache);
+    if (!render_priv->shared_cache)
+        ass_cache_done(render_priv->cache.outline_cache);
     ass_shaper_free(render_priv->shaper);
-    ass_cache_done(render_priv->cache.font_cache);
+    if (!render_priv->shared_cache)
+        ass_cache_done(render_priv->cache.font_cache);
+    ass_shared_cache_unref(render_priv->shared_cache);
+    ass_cache_budget_done(render_priv->cache.budget);
 
     rasterizer_done(&render_priv->rasterizer);
+    ass_arena_done(&render_priv->arena);
 
+    ass_font_loader_free(render_priv->font_loader);
     if (render_priv->fontselect)
         ass_fontselect_free(render_priv->fontselect);
     if (render_priv->ftlibrary)
         FT_Done_FreeType(render_priv->ftlibrary);
     free(render_priv->eimg);
-    free(render_priv->text_info.glyphs);
-    free(render_priv->text_info.lines);
-
-    free(render_priv->text_info.combined_bitmaps);
+    free(render_priv->static_frame.ids);
+    free(render_priv->static_frame.events);
+    free(render_priv->static_frame.styles);
+    free(render_priv->static_frame.strings);
+    free(render_priv->image_table);
+    free(render_priv->degraded_ids);
+    free(render_priv->placed);
+    ass_aligned_free(render_priv->rgba_buffer);
+    text_info_done(&render_priv->text_info);
 
     free(render_priv->settings.default_font);
     free(render_priv->settings.default_family);
 
     free(render_priv->user_override_style.FontName);
 
+    // all images are released by now, they are owned by the frames and caches
+    image_pool_free(render_priv->image_pool);
     free(render_priv);
 }
 
+/**
+ * \brief Switch the renderer to another bitmap engine (for benchmarks)
+ * Must be called before ass_set_threads(). Bitmaps made with
+ * the previous engine are dropped from the caches.
+ */
+bool ass_renderer_set_engine(ASS_Renderer *priv, const BitmapEngine *engine)
+{
+    if (priv->threads)
+        return false;
+    if (engine == priv->engine)
+        return true;
+
+    RasterizerData rasterizer;
+    if (!rasterizer_init(&rasterizer, engine->tile_order, RASTERIZER_PRECISION))
+        return false;
+    rasterizer_done(&priv->rasterizer);
+    priv->rasterizer = rasterizer;
+    priv->engine = engine;
+
+    priv->render_id++;
+    priv->static_frame.valid = false;
+    ass_cache_empty(priv->cache.event_cache);
+    ass_cache_empty(priv->cache.shadow_cache);
+    ass_cache_empty(priv->cache.composite_cache);
+    ass_cache_empty(priv->cache.bitmap_cache);
+    return true;
+}
+
+ASS_SharedCache *ass_shared_cache_new(ASS_Library *library, int glyph_max)
+{
+    ASS_SharedCache *cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        goto fail;
+
+    if (FT_Init_FreeType(&cache->ftlibrary)) {
+        ass_msg(library, MSGL_FATAL, "%s failed", "FT_Init_FreeType");
+        free(cache);
+        goto fail;
+    }
+    cache->library = library;
+    cache->glyph_max = glyph_max > 0 ? glyph_max : GLYPH_CACHE_MAX;
+    cache->ref_count = 1;
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_mutex_init(&cache->layout_lock, NULL);
+#endif
+
+    cache->font_cache = ass_font_cache_create();
+    cache->outline_cache = ass_outline_cache_create();
+    cache->tags_cache = ass_tags_cache_create();
+    if (!cache->font_cache || !cache->outline_cache || !cache->tags_cache) {
+        ass_shared_cache_unref(cache);
+        goto fail;
+    }
+    return cache;
+
+fail:
+    ass_msg(library, MSGL_ERR, "Shared cache initialization failed");
+    return NULL;
+}
+
+void ass_shared_cache_unref(ASS_SharedCache *cache)
+{
+    if (!cache)
+        return;
+
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&cache->lock);
+    int ref_count = --cache->ref_count;
+    pthread_mutex_unlock(&cache->lock);
+#else
+    int ref_count = --cache->ref_count;
+#endif
+    if (ref_count)
+        return;
+
+    // outlines hold references to fonts, fonts to the font selector
+    ass_cache_done(cache->tags_cache);
+    ass_cache_done(cache->outline_cache);
+    ass_cache_done(cache->font_cache);
+    if (cache->fontselect)
+        ass_fontselect_free(cache->fontselect);
+    FT_Done_FreeType(cache->ftlibrary);
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_destroy(&cache->lock);
+    pthread_mutex_destroy(&cache->layout_lock);
+#endif
+    free(cache);
+}
+
+void ass_shared_cache_done(ASS_SharedCache *cache)
+{
+    ass_shared_cache_unref(cache);
+}
+
 /**
  * \brief Create a new ASS_Image
  * Parameters are the same as ASS_Image fields.
  */
-static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
-                                 int bitmap_h, int stride, int dst_x,
-                                 int dst_y, uint32_t color,
-                                 CompositeHashValue *source)
+static ASS_Image *my_draw_bitmap(ImagePool *pool, unsigned char *bitmap,
+                                 int bitmap_w, int bitmap_h, int stride,
+                                 int dst_x, int dst_y, uint32_t color,
+                                 void *source)
 {
-    ASS_ImagePriv *img = malloc(sizeof(ASS_ImagePriv));
+    ASS_ImagePriv *img = image_pool_get(pool);
     if (!img) {
         if (!source)
             ass_aligned_free(bitmap);
@@ -290,7 +594,7 @@ static ASS_Image **render_glyph_i(ASS_Renderer *render_priv,
                                   Bitmap *bm, int dst_x, int dst_y,
                                   uint32_t color, uint32_t color2, int brk,
                                   ASS_Image **tail, unsigned type,
-                                  CompositeHashValue *source)
+                                  void *source)
 {
     int i, j, x0, y0, x1, y1, cx0, cy0, cx1, cy1, sx, sy, zx, zy;
     Rect r[4];
@@ -355,7 +659,8 @@ static ASS_Image **render_glyph_i(ASS_Renderer *render_priv,
         // split up into left and right for karaoke, if needed
         if (lbrk > r[j].x0) {
             if (lbrk > r[j].x1) lbrk = r[j].x1;
-            img = my_draw_bitmap(bm->buffer + r[j].y0 * bm->stride + r[j].x0,
+            img = my_draw_bitmap(render_priv->image_pool,
+                                 bm->buffer + r[j].y0 * bm->stride + r[j].x0,
                                  lbrk - r[j].x0, r[j].y1 - r[j].y0, bm->stride,
                                  dst_x + r[j].x0, dst_y + r[j].y0, color, source);
             if (!img) break;
@@ -365,7 +670,8 @@ static ASS_Image **render_glyph_i(ASS_Renderer *render_priv,
         }
         if (lbrk < r[j].x1) {
             if (lbrk < r[j].x0) lbrk = r[j].x0;
-            img = my_draw_bitmap(bm->buffer + r[j].y0 * bm->stride + lbrk,
+            img = my_draw_bitmap(render_priv->image_pool,
+                                 bm->buffer + r[j].y0 * bm->stride + lbrk,
                                  r[j].x1 - lbrk, r[j].y1 - r[j].y0, bm->stride,
                                  dst_x + lbrk, dst_y + r[j].y0, color2, source);
             if (!img) break;
@@ -393,7 +699,7 @@ static ASS_Image **render_glyph_i(ASS_Renderer *render_priv,
 static ASS_Image **
 render_glyph(ASS_Renderer *render_priv, Bitmap *bm, int dst_x, int dst_y,
              uint32_t color, uint32_t color2, int brk, ASS_Image **tail,
-             unsigned type, CompositeHashValue *source)
+             unsigned type, void *source)
 {
     // Inverse clipping in use?
     if (render_priv->state.clip_mode)
@@ -413,10 +719,15 @@ render_glyph(ASS_Renderer *render_priv, Bitmap *bm, int dst_x, int dst_y,
     brk -= dst_x;
 
     // clipping
-    clip_x0 = FFMINMAX(render_priv->state.clip_x0, 0, render_priv->width);
-    clip_y0 = FFMINMAX(render_priv->state.clip_y0, 0, render_priv->height);
-    clip_x1 = FFMINMAX(render_priv->state.clip_x1, 0, render_priv->width);
-    clip_y1 = FFMINMAX(render_priv->state.clip_y1, 0, render_priv->height);
+    if (render_priv->state.unclipped) {
+        clip_x0 = clip_y0 = INT_MIN / 2;
+        clip_x1 = clip_y1 = INT_MAX / 2;
+    } else {
+        clip_x0 = FFMINMAX(render_priv->state.clip_x0, 0, render_priv->width);
+        clip_y0 = FFMINMAX(render_priv->state.clip_y0, 0, render_priv->height);
+        clip_x1 = FFMINMAX(render_priv->state.clip_x1, 0, render_priv->width);
+        clip_y1 = FFMINMAX(render_priv->state.clip_y1, 0, render_priv->height);
+    }
     b_x0 = 0;
     b_y0 = 0;
     b_x1 = bm->w;
@@ -441,7 +752,8 @@ render_glyph(ASS_Renderer *render_priv, Bitmap *bm, int dst_x, int dst_y,
     if (brk > b_x0) {           // draw left part
         if (brk > b_x1)
             brk = b_x1;
-        img = my_draw_bitmap(bm->buffer + bm->stride * b_y0 + b_x0,
+        img = my_draw_bitmap(render_priv->image_pool,
+                             bm->buffer + bm->stride * b_y0 + b_x0,
                              brk - b_x0, b_y1 - b_y0, bm->stride,
                              dst_x + b_x0, dst_y + b_y0, color, source);
         if (!img) return tail;
@@ -452,7 +764,8 @@ render_glyph(ASS_Renderer *render_priv, Bitmap *bm, int dst_x, int dst_y,
     if (brk < b_x1) {           // draw right part
         if (brk < b_x0)
             brk = b_x0;
-        img = my_draw_bitmap(bm->buffer + bm->stride * b_y0 + brk,
+        img = my_draw_bitmap(render_priv->image_pool,
+                             bm->buffer + bm->stride * b_y0 + brk,
                              b_x1 - brk, b_y1 - b_y0, bm->stride,
                              dst_x + brk, dst_y + b_y0, color2, source);
         if (!img) return tail;
@@ -463,6 +776,42 @@ render_glyph(ASS_Renderer *render_priv, Bitmap *bm, int dst_x, int dst_y,
     return tail;
 }
 
+/**
+ * \brief Attach border bitmap to be rendered along with the glyph
+ * \param border in: key of the border bitmap or NULL
+ * Doesn't touch reference counts.
+ */
+static void set_border_key(BitmapHashKey *key, const BitmapHashKey *border)
+{
+    if (!border) {
+        ASS_Vector zero = { 0, 0 };
+        key->border = NULL;
+        key->border_offset = key->border_matrix_x = zero;
+        key->border_matrix_y = key->border_matrix_z = zero;
+        return;
+    }
+    key->border = border->outline;
+    key->border_offset   = border->offset;
+    key->border_matrix_x = border->matrix_x;
+    key->border_matrix_y = border->matrix_y;
+    key->border_matrix_z = border->matrix_z;
+}
+
+/**
+ * \brief Extract key of the attached border bitmap
+ */
+static void extract_border_key(BitmapHashKey *border, const BitmapHashKey *key)
+{
+    border->outline  = key->border;
+    border->offset   = key->border_offset;
+    border->matrix_x = key->border_matrix_x;
+    border->matrix_y = key->border_matrix_y;
+    border->matrix_z = key->border_matrix_z;
+    border->window_min = key->window_min;
+    border->window_max = key->window_max;
+    set_border_key(border, NULL);
+}
+
 static bool quantize_transform(double m[3][3], ASS_Vector *pos,
                                ASS_DVector *offset, bool first,
                                BitmapHashKey *key)
@@ -608,6 +957,9 @@ static bool quantize_transform(double m[3][3], ASS_Vector *pos,
     key->matrix_x.x = qm[0][0];  key->matrix_x.y = qm[0][1];
     key->matrix_y.x = qm[1][0];  key->matrix_y.y = qm[1][1];
     key->matrix_z.x = qm[2][0];  key->matrix_z.y = qm[2][1];
+    key->window_min.x = key->window_min.y = INT32_MIN;
+    key->window_max.x = key->window_max.y = INT32_MAX;
+    set_border_key(key, NULL);
     return true;
 }
 
@@ -649,6 +1001,68 @@ static void restore_transform(double m[3][3], const BitmapHashKey *key)
         m[i][2] -= m[i][0] * x0 + m[i][1] * y0;
 }
 
+/**
+ * \brief Restrict bitmap to the part inside of the clip rectangle
+ * \param pos bitmap position from quantize_transform()
+ * \param clip visible area in screen pixels or NULL
+ * \return false if nothing of the bitmap can be visible
+ * Only bitmaps that are mostly hidden get a window, partially clipped
+ * ones keep their regular keys and stay shared between frames.
+ */
+static bool set_bitmap_window(BitmapHashKey *key, ASS_Vector pos,
+                              const ASS_Rect *clip)
+{
+    if (!clip)
+        return true;
+
+    double m[3][3];
+    restore_transform(m, key);
+
+    // bitmap bounding box estimate from the corners of the control box,
+    // the image stays within their convex hull while z > 0
+    const ASS_Rect *cbox = &key->outline->cbox;
+    double x_min = INFINITY, y_min = INFINITY;
+    double x_max = -INFINITY, y_max = -INFINITY;
+    for (int i = 0; i < 4; i++) {
+        double x = i & 1 ? cbox->x_max : cbox->x_min;
+        double y = i & 2 ? cbox->y_max : cbox->y_min;
+        double z = m[2][0] * x + m[2][1] * y + m[2][2];
+        if (!(z >= 0.1))
+            return true;
+        double w = 1 / (64 * z);
+        double px = (m[0][0] * x + m[0][1] * y + m[0][2]) * w;
+        double py = (m[1][0] * x + m[1][1] * y + m[1][2]) * w;
+        x_min = FFMIN(x_min, px);  x_max = FFMAX(x_max, px);
+        y_min = FFMIN(y_min, py);  y_max = FFMAX(y_max, py);
+    }
+    const double max_val = 1000000;
+    if (!(x_max - x_min < max_val && y_max - y_min < max_val))
+        return true;
+    int32_t bx0 = floor(x_min) - 2, bx1 = ceil(x_max) + 2;
+    int32_t by0 = floor(y_min) - 2, by1 = ceil(y_max) + 2;
+
+    int32_t cx0 = clip->x_min - pos.x, cx1 = clip->x_max - pos.x;
+    int32_t cy0 = clip->y_min - pos.y, cy1 = clip->y_max - pos.y;
+    int32_t w = FFMIN(bx1, cx1) - FFMAX(bx0, cx0);
+    int32_t h = FFMIN(by1, cy1) - FFMAX(by0, cy0);
+    if (w <= 0 || h <= 0)
+        return false;
+    if (2 * (int64_t) w * h > (int64_t) (bx1 - bx0) * (by1 - by0))
+        return true;
+
+    // coarse steps to keep the key stable under small movements
+    const int32_t mask = 31;
+    if (cx0 > bx0)
+        key->window_min.x = cx0 & ~mask;
+    if (cy0 > by0)
+        key->window_min.y = cy0 & ~mask;
+    if (cx1 < bx1)
+        key->window_max.x = (cx1 + mask) & ~mask;
+    if (cy1 < by1)
+        key->window_max.y = (cy1 + mask) & ~mask;
+    return true;
+}
+
 // Calculate bitmap memory footprint
 static inline size_t bitmap_size(const Bitmap *bm)
 {
@@ -660,6 +1074,89 @@ static inline size_t bitmap_size(const Bitmap *bm)
  * applicable. The blended bitmaps are added to a free list which is freed
  * at the start of a new frame.
  */
+/**
+ * \brief Get classes of clip tiles covering the rectangle
+ * \return bit mask of (1 << TILE_*) values
+ */
+static int clip_tile_mask(const BitmapEngine *engine, const Bitmap *clip,
+                          int x, int y, int w, int h)
+{
+    if (!clip->tiles)
+        return 1 << TILE_MIXED;
+
+    int order = engine->tile_order;
+    int n_x = (clip->w + (1 << order) - 1) >> order;
+    int mask = 0;
+    for (int ty = y >> order; ty <= (y + h - 1) >> order; ty++)
+        for (int tx = x >> order; tx <= (x + w - 1) >> order; tx++)
+            mask |= 1 << clip->tiles[ty * n_x + tx];
+    return mask;
+}
+
+/**
+ * \brief Apply clip tile by tile
+ * \param dst, dst_stride output, can coincide with src for inverse clip
+ * \param x, y, w, h rectangle in clip coordinates
+ * Empty and solid tiles are handled without touching the clip pixels.
+ * Mixed tiles of a tile row are blended in one engine call that starts
+ * at a multiple of 16 pixels from dst, as the engine may need dst to be
+ * aligned like a freshly allocated bitmap. Its extra part only covers
+ * empty and solid tiles, where blending gives the same result.
+ */
+static void apply_clip_tiles(const BitmapEngine *engine, const Bitmap *clip, bool inverse,
+                             uint8_t *dst, ptrdiff_t dst_stride,
+                             uint8_t *src, ptrdiff_t src_stride,
+                             int x, int y, int w, int h)
+{
+    int order = engine->tile_order;
+    int n_x = (clip->w + (1 << order) - 1) >> order;
+    int tx_min = x >> order, tx_max = (x + w - 1) >> order;
+    for (int ty = y >> order; ty <= (y + h - 1) >> order; ty++) {
+        int y0 = FFMAX(y, ty << order);
+        int y1 = FFMIN(y + h, (ty + 1) << order);
+        const uint8_t *tiles = clip->tiles ? clip->tiles + ty * n_x : NULL;
+
+        // mixed tiles span [span_x0, span_x1) relative to x
+        int span_x0 = w, span_x1 = 0;
+        for (int tx = tx_min; tx <= tx_max; tx++) {
+            if (tiles && tiles[tx] != TILE_MIXED)
+                continue;
+            span_x0 = FFMIN(span_x0, FFMAX(x, tx << order) - x);
+            span_x1 = FFMIN(x + w, (tx + 1) << order) - x;
+        }
+        span_x0 &= ~15;
+
+        for (int tx = tx_min; tx <= tx_max; tx++) {
+            int x0 = FFMAX(x, tx << order);
+            int x1 = FFMIN(x + w, (tx + 1) << order);
+            if (x0 - x >= span_x0 && x1 - x <= span_x1)
+                continue;
+            uint8_t *d = dst + (y0 - y) * dst_stride + (x0 - x);
+            uint8_t *s = src + (y0 - y) * src_stride + (x0 - x);
+
+            if (tiles[tx] == (inverse ? TILE_SOLID : TILE_EMPTY)) {
+                for (int i = y0; i < y1; i++, d += dst_stride)
+                    memset(d, 0, x1 - x0);
+            } else if (d != s) {
+                for (int i = y0; i < y1; i++, d += dst_stride, s += src_stride)
+                    memcpy(d, s, x1 - x0);
+            }
+        }
+        if (span_x0 >= span_x1)
+            continue;
+
+        uint8_t *d = dst + (y0 - y) * dst_stride + span_x0;
+        uint8_t *s = src + (y0 - y) * src_stride + span_x0;
+        uint8_t *c = clip->buffer + y0 * clip->stride + x + span_x0;
+        if (inverse)
+            engine->sub_bitmaps(d, dst_stride, c, clip->stride,
+                                y1 - y0, span_x1 - span_x0);
+        else
+            engine->mul_bitmaps(d, dst_stride, s, src_stride, c, clip->stride,
+                                span_x1 - span_x0, y1 - y0);
+    }
+}
+
 static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
 {
     if (!render_priv->state.clip_drawing_text)
@@ -693,15 +1190,15 @@ static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
     }
 
     // Iterate through bitmaps and blend/clip them
+    const BitmapEngine *engine = render_priv->engine;
     for (ASS_Image *cur = head; cur; cur = cur->next) {
         int left, top, right, bottom, w, h;
         int ax, ay, aw, ah, as;
-        int bx, by, bw, bh, bs;
+        int bx, by, bw, bh;
         int aleft, atop, bleft, btop;
-        unsigned char *abuffer, *bbuffer, *nbuffer;
+        unsigned char *abuffer, *nbuffer;
 
         abuffer = cur->bitmap;
-        bbuffer = clip_bm->buffer;
         ax = cur->dst_x;
         ay = cur->dst_y;
         aw = cur->w;
@@ -711,7 +1208,6 @@ static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
         by = pos.y + clip_bm->top;
         bw = clip_bm->w;
         bh = clip_bm->h;
-        bs = clip_bm->stride;
 
         // Calculate overlap coordinates
         left = (ax > bx) ? ax : bx;
@@ -731,6 +1227,9 @@ static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
                 ay > by + bh || !h || !w) {
                 continue;
             }
+            int mask = clip_tile_mask(engine, clip_bm, bleft, btop, w, h);
+            if (mask == 1 << TILE_EMPTY)
+                continue;
 
             // Allocate new buffer and add to free list
             nbuffer = ass_aligned_alloc(32, as * ah, false);
@@ -739,9 +1238,9 @@ static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
 
             // Blend together
             memcpy(nbuffer, abuffer, ((ah - 1) * as) + aw);
-            render_priv->engine->sub_bitmaps(nbuffer + atop * as + aleft, as,
-                                             bbuffer + btop * bs + bleft, bs,
-                                             h, w);
+            uint8_t *ptr = nbuffer + atop * as + aleft;
+            apply_clip_tiles(engine, clip_bm, true, ptr, as, ptr, as,
+                             bleft, btop, w, h);
         } else {
             // Regular clip
             if (ax + aw < bx || ay + ah < by || ax > bx + bw ||
@@ -749,6 +1248,20 @@ static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
                 cur->w = cur->h = cur->stride = 0;
                 continue;
             }
+            int mask = clip_tile_mask(engine, clip_bm, bleft, btop, w, h);
+            if (mask == 1 << TILE_EMPTY) {
+                cur->w = cur->h = cur->stride = 0;
+                continue;
+            }
+            if (mask == 1 << TILE_SOLID) {
+                // fully inside of the clip, just crop
+                cur->bitmap += atop * as + aleft;
+                cur->dst_x += aleft;
+                cur->dst_y += atop;
+                cur->w = w;
+                cur->h = h;
+                continue;
+            }
 
             // Allocate new buffer and add to free list
             unsigned align = (w >= 16) ? 16 : ((w >= 8) ? 8 : 1);
@@ -758,10 +1271,9 @@ static void blend_vector_clip(ASS_Renderer *render_priv, ASS_Image *head)
                 break;
 
             // Blend together
-            render_priv->engine->mul_bitmaps(nbuffer, ns,
-                                             abuffer + atop * as + aleft, as,
-                                             bbuffer + btop * bs + bleft, bs,
-                                             w, h);
+            apply_clip_tiles(engine, clip_bm, false, nbuffer, ns,
+                             abuffer + atop * as + aleft, as,
+                             bleft, btop, w, h);
             cur->dst_x += aleft;
             cur->dst_y += atop;
             cur->w = w;
@@ -796,7 +1308,7 @@ static ASS_Image *render_text(ASS_Renderer *render_priv)
 
         tail =
             render_glyph(render_priv, info->bm_s, info->x, info->y, info->c[3], 0,
-                         1000000, tail, IMAGE_TYPE_SHADOW, info->image);
+                         1000000, tail, IMAGE_TYPE_SHADOW, info->bm_s);
     }
 
     for (unsigned i = 0; i < n_bitmaps; i++) {
@@ -842,8 +1354,10 @@ static ASS_Image *render_text(ASS_Renderer *render_priv)
                              0, 1000000, tail, IMAGE_TYPE_CHARACTER, info->image);
     }
 
-    for (unsigned i = 0; i < n_bitmaps; i++)
+    for (unsigned i = 0; i < n_bitmaps; i++) {
         ass_cache_dec_ref(bitmaps[i].image);
+        ass_cache_dec_ref(bitmaps[i].bm_s);
+    }
 
     *tail = 0;
     blend_vector_clip(render_priv, head);
@@ -1065,6 +1579,7 @@ init_render_context(ASS_Renderer *render_priv, ASS_Event *event)
     render_priv->state.clip_x1 = render_priv->track->PlayResX;
     render_priv->state.clip_y1 = render_priv->track->PlayResY;
     render_priv->state.clip_mode = 0;
+    render_priv->state.unclipped = 0;
     render_priv->state.detect_collisions = 1;
     render_priv->state.fade = 0;
     render_priv->state.drawing_scale = 0;
@@ -1139,6 +1654,7 @@ get_outline_glyph(ASS_Renderer *priv, GlyphInfo *info)
         k->bold = info->bold;
         k->italic = info->italic;
         k->flags = info->flags;
+        k->hinting = priv->settings.hinting;
 
         val = ass_cache_get(priv->cache.outline_cache, &key, priv);
         if (!val || !val->valid) {
@@ -1169,6 +1685,63 @@ get_outline_glyph(ASS_Renderer *priv, GlyphInfo *info)
     info->desc = lrint(desc * scale.y);
 }
 
+/**
+ * \brief Build an underlined or struck-through glyph
+ * The plain glyph comes from the outline cache and gets the lines
+ * appended as extra contours, so FreeType doesn't load it again.
+ * \return false on allocation failure
+ */
+static bool decorate_glyph(ASS_Renderer *render_priv, const GlyphHashKey *k,
+                           OutlineHashValue *v, ASS_Outline *outline)
+{
+    OutlineHashKey key;
+    key.type = OUTLINE_GLYPH;
+    key.u.glyph = *k;
+    key.u.glyph.flags &= ~(DECO_UNDERLINE | DECO_STRIKETHROUGH);
+    ass_cache_inc_ref(k->font);
+    OutlineHashValue *plain =
+        ass_cache_get(render_priv->cache.outline_cache, &key, render_priv);
+    if (!plain || !plain->valid) {
+        ass_cache_dec_ref(plain);
+        return false;
+    }
+    if (!plain->glyph_loaded) {
+        ass_cache_dec_ref(plain);
+        return true;
+    }
+
+    ASS_DecorationLine lines[2];
+    ass_face_set_size(k->font->faces[k->face_index], k->size);
+    int n_lines = ass_font_get_decorations(k->font, k->face_index,
+                                           k->flags, lines);
+
+    bool ok = outline_unpack(outline, &plain->outline[0], 4 * n_lines);
+    for (int i = 0; ok && i < n_lines; i++) {
+        // same contour as the glyph would have in FreeType, with y flipped
+        int32_t top = -(lines[i].pos + lines[i].size);
+        int32_t bottom = -(lines[i].pos - lines[i].size);
+        ASS_Vector pt[4] = {
+            { 0, top }, { plain->advance, top },
+            { plain->advance, bottom }, { 0, bottom },
+        };
+        for (int j = 0; j < 4; j++) {
+            ASS_Vector p = pt[plain->truetype_orientation ? j : 3 - j];
+            ok &= outline_add_point(outline, p, OUTLINE_LINE_SEGMENT);
+        }
+        ok = ok && outline_close_contour(outline);
+    }
+
+    v->glyph_loaded = true;
+    v->truetype_orientation = plain->truetype_orientation;
+    v->advance = plain->advance;
+    v->asc = plain->asc;
+    v->desc = plain->desc;
+    ass_cache_dec_ref(plain);
+    if (!ok)
+        outline_free(outline);
+    return ok;
+}
+
 size_t ass_outline_construct(void *key, void *value, void *priv)
 {
     ASS_Renderer *render_priv = priv;
@@ -1176,18 +1749,31 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
     OutlineHashValue *v = value;
     memset(v, 0, sizeof(*v));
 
+    // built at full precision, then packed for the cache
+    ASS_Outline outline[2] = {0};
+
     switch (outline_key->type) {
     case OUTLINE_GLYPH:
         {
             GlyphHashKey *k = &outline_key->u.glyph;
+            if (k->flags & (DECO_UNDERLINE | DECO_STRIKETHROUGH)) {
+                if (!decorate_glyph(render_priv, k, v, &outline[0]))
+                    return 1;
+                break;
+            }
             ass_face_set_size(k->font->faces[k->face_index], k->size);
             FT_Glyph glyph =
                 ass_font_get_glyph(k->font, k->face_index, k->glyph_index,
-                                   render_priv->settings.hinting, k->flags);
+                                   k->hinting, k->flags);
             if (glyph != NULL) {
                 FT_Outline *src = &((FT_OutlineGlyph) glyph)->outline;
-                if (!outline_convert(&v->outline[0], src))
+                if (!outline_convert(&outline[0], src)) {
+                    FT_Done_Glyph(glyph);
                     return 1;
+                }
+                v->glyph_loaded = true;
+                v->truetype_orientation =
+                    FT_Outline_Get_Orientation(src) == FT_ORIENTATION_TRUETYPE;
                 v->advance = d16_to_d6(glyph->advance.x);
                 FT_Done_Glyph(glyph);
                 ass_font_get_asc_desc(k->font, k->face_index,
@@ -1199,7 +1785,7 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
         {
             ASS_Rect bbox;
             const char *text = outline_key->u.drawing.text;
-            if (!ass_drawing_parse(&v->outline[0], &bbox, text, render_priv->library))
+            if (!ass_drawing_parse(&outline[0], &bbox, text, render_priv->library))
                 return 1;
 
             v->advance = bbox.x_max - bbox.x_min;
@@ -1215,26 +1801,27 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
             if (!k->outline->outline[0].n_points)
                 break;
 
+            ArenaMark mark = ass_arena_mark(&render_priv->arena);
             ASS_Outline src;
-            if (!outline_scale_pow2(&src, &k->outline->outline[0],
-                                    k->scale_ord_x, k->scale_ord_y))
-                return 1;
-            if (!outline_stroke(&v->outline[0], &v->outline[1], &src,
-                                k->border.x * STROKER_PRECISION,
-                                k->border.y * STROKER_PRECISION,
-                                STROKER_PRECISION)) {
+            bool ok = outline_scale_pow2(&src, &k->outline->outline[0],
+                                         k->scale_ord_x, k->scale_ord_y,
+                                         &render_priv->arena) &&
+                outline_stroke(&outline[0], &outline[1], &src,
+                               k->border.x * STROKER_PRECISION,
+                               k->border.y * STROKER_PRECISION,
+                               STROKER_PRECISION);
+            ass_arena_release(&render_priv->arena, mark);
+            if (!ok) {
                 ass_msg(render_priv->library, MSGL_WARN, "Cannot stroke outline");
-                outline_free(&v->outline[0]);
-                outline_free(&v->outline[1]);
-                outline_free(&src);
+                outline_free(&outline[0]);
+                outline_free(&outline[1]);
                 return 1;
             }
-            outline_free(&src);
             break;
         }
     case OUTLINE_BOX:
         {
-            ASS_Outline *ol = &v->outline[0];
+            ASS_Outline *ol = &outline[0];
             if (!outline_alloc(ol, 4, 4))
                 return 1;
             ol->points[0].x = ol->points[3].x = 0;
@@ -1253,11 +1840,18 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
     }
 
     rectangle_reset(&v->cbox);
-    outline_update_cbox(&v->outline[0], &v->cbox);
-    outline_update_cbox(&v->outline[1], &v->cbox);
+    outline_update_cbox(&outline[0], &v->cbox);
+    outline_update_cbox(&outline[1], &v->cbox);
     if (v->cbox.x_min > v->cbox.x_max || v->cbox.y_min > v->cbox.y_max)
         v->cbox.x_min = v->cbox.y_min = v->cbox.x_max = v->cbox.y_max = 0;
-    v->valid = true;
+    v->valid = outline_pack(&v->outline[0], &outline[0]) &&
+               outline_pack(&v->outline[1], &outline[1]);
+    outline_free(&outline[0]);
+    outline_free(&outline[1]);
+    if (!v->valid) {
+        outline_free_packed(&v->outline[0]);
+        outline_free_packed(&v->outline[1]);
+    }
     return 1;
 }
 
@@ -1307,51 +1901,71 @@ static void calc_transform_matrix(ASS_Renderer *render_priv,
     }
 }
 
+static inline double snap_angle(double angle, double step)
+{
+    return step * round(angle / step);
+}
+
 /**
- * \brief Get bitmaps for a glyph
- * \param info glyph info
- * Tries to get glyph bitmaps from bitmap cache.
- * If they can't be found, they are generated by rotating and rendering the glyph.
- * After that, bitmaps are added to the cache.
- * They are returned in info->bm (glyph), info->bm_o (outline).
+ * \brief Snap rotation and shear of a glyph to the configured step
+ * \param m in: exact transform from calc_transform_matrix(), out: snapped one
+ * The snapped transform still maps the glyph center to the same point,
+ * so glyphs keep their exact positions and only their orientation
+ * is rounded. Animated rotations then reuse bitmaps between frames.
  */
-static void
-get_bitmap_glyph(ASS_Renderer *render_priv, GlyphInfo *info,
-                 ASS_Vector *pos, ASS_Vector *pos_o,
-                 ASS_DVector *offset, bool first, int flags)
+static void snap_transform_matrix(ASS_Renderer *render_priv,
+                                  GlyphInfo *info, double m[3][3])
 {
-    if (!info->outline || info->symbol == '\n' || info->symbol == 0 || info->skip) {
-        ass_cache_dec_ref(info->outline);
+    double step = render_priv->settings.angle_step;
+    if (!(step > 0))
         return;
-    }
 
-    double m1[3][3], m2[3][3], m[3][3];
+    GlyphInfo snapped = *info;
+    snapped.frx = snap_angle(info->frx, step);
+    snapped.fry = snap_angle(info->fry, step);
+    snapped.frz = snap_angle(info->frz, step);
+    // shear factor is the tangent of the slant angle
+    snapped.fax = snap_angle(info->fax, step);
+    snapped.fay = snap_angle(info->fay, step);
+    if (snapped.frx == info->frx && snapped.fry == info->fry &&
+            snapped.frz == info->frz &&
+            snapped.fax == info->fax && snapped.fay == info->fay)
+        return;
+
+    double mq[3][3];
+    calc_transform_matrix(render_priv, &snapped, mq);
+
+    // glyph center in the input coordinates of m
     const ASS_Transform *tr = &info->transform;
-    calc_transform_matrix(render_priv, info, m1);
+    const ASS_Rect *bbox = &info->outline->cbox;
+    double x0 = tr->offset.x + tr->scale.x * (bbox->x_min + bbox->x_max) / 2.0;
+    double y0 = tr->offset.y + tr->scale.y * (bbox->y_min + bbox->y_max) / 2.0;
     for (int i = 0; i < 3; i++) {
-        m2[i][0] = m1[i][0] * tr->scale.x;
-        m2[i][1] = m1[i][1] * tr->scale.y;
-        m2[i][2] = m1[i][0] * tr->offset.x + m1[i][1] * tr->offset.y + m1[i][2];
-    }
-    memcpy(m, m2, sizeof(m));
-
-    BitmapHashKey key;
-    key.outline = info->outline;
-    if (!quantize_transform(m, pos, offset, first, &key)) {
-        ass_cache_dec_ref(info->outline);
-        return;
-    }
-    info->bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, render_priv);
-    if (!info->bm || !info->bm->buffer) {
-        ass_cache_dec_ref(info->bm);
-        info->bm = NULL;
+        m[i][2] += (m[i][0] - mq[i][0]) * x0 + (m[i][1] - mq[i][1]) * y0;
+        m[i][0] = mq[i][0];
+        m[i][1] = mq[i][1];
     }
-    *pos_o = *pos;
+}
 
+/**
+ * \brief Calculate border bitmap key for a glyph
+ * \param m in: glyph transform after quantize_transform(), gets overwritten
+ * \param m1, m2 in: glyph transforms without and with glyph scale
+ * \param key out: border bitmap key, key->outline is NULL
+ * if the border bitmap is the same as the glyph one
+ * \return false if there's no border bitmap
+ */
+static bool calc_border_key(ASS_Renderer *render_priv, GlyphInfo *info,
+                            double m[3][3], double m1[3][3], double m2[3][3],
+                            ASS_Vector *pos_o, ASS_DVector *offset, int flags,
+                            BitmapHashKey *key)
+{
+    const ASS_Transform *tr = &info->transform;
     OutlineHashKey ol_key;
+    OutlineHashValue *border = NULL;
     if (flags & FILTER_BORDER_STYLE_3) {
         if (!(flags & (FILTER_NONZERO_BORDER | FILTER_NONZERO_SHADOW)))
-            return;
+            return false;
 
         ol_key.type = OUTLINE_BOX;
 
@@ -1387,7 +2001,7 @@ get_bitmap_glyph(ASS_Renderer *render_priv, GlyphInfo *info,
         }
     } else {
         if (!(flags & FILTER_NONZERO_BORDER))
-            return;
+            return false;
 
         ol_key.type = OUTLINE_BORDER;
         BorderHashKey *k = &ol_key.u.border;
@@ -1441,9 +2055,24 @@ get_bitmap_glyph(ASS_Renderer *render_priv, GlyphInfo *info,
         k->border.x = lrint(ldexp(bord_x, k->scale_ord_x) / STROKER_PRECISION);
         k->border.y = lrint(ldexp(bord_y, k->scale_ord_y) / STROKER_PRECISION);
         if (!k->border.x && !k->border.y) {
-            ass_cache_inc_ref(info->bm);
-            info->bm_o = info->bm;
-            return;
+            key->outline = NULL;
+            return true;
+        }
+
+        // stroke on a coarser grid, unless the exact border is at hand
+        if (render_priv->degrade) {
+            BorderHashKey coarse = *k;
+            coarse.scale_ord_x -= DEGRADED_STROKER_SHIFT;
+            coarse.scale_ord_y -= DEGRADED_STROKER_SHIFT;
+            coarse.border.x = lrint(ldexp(bord_x, coarse.scale_ord_x) / STROKER_PRECISION);
+            coarse.border.y = lrint(ldexp(bord_y, coarse.scale_ord_y) / STROKER_PRECISION);
+            if (FFMAX(coarse.border.x, coarse.border.y) >= DEGRADED_MIN_BORDER) {
+                border = ass_cache_find(render_priv->cache.outline_cache, &ol_key);
+                if (!border) {
+                    *k = coarse;
+                    render_priv->degraded = true;
+                }
+            }
         }
 
         for (int i = 0; i < 3; i++) {
@@ -1453,43 +2082,177 @@ get_bitmap_glyph(ASS_Renderer *render_priv, GlyphInfo *info,
         }
     }
 
-    key.outline = ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
-    if (!key.outline || !key.outline->valid ||
-            !quantize_transform(m, pos_o, offset, false, &key)) {
-        ass_cache_dec_ref(key.outline);
-        return;
+    key->outline = border ? border :
+        ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
+    if (!key->outline || !key->outline->valid ||
+            !quantize_transform(m, pos_o, offset, false, key)) {
+        ass_cache_dec_ref(key->outline);
+        return false;
     }
-    info->bm_o = ass_cache_get(render_priv->cache.bitmap_cache, &key, render_priv);
-    if (!info->bm_o || !info->bm_o->buffer) {
-        ass_cache_dec_ref(info->bm_o);
-        info->bm_o = NULL;
-        *pos_o = *pos;
-    } else if (!info->bm)
-        *pos = *pos_o;
+    return true;
 }
 
-size_t ass_bitmap_construct(void *key, void *value, void *priv)
+/**
+ * \brief Get bitmaps for a glyph
+ * \param info glyph info
+ * Tries to get glyph bitmaps from bitmap cache.
+ * If they can't be found, they are generated by rotating and rendering the glyph.
+ * After that, bitmaps are added to the cache.
+ * They are returned in info->bm (glyph), info->bm_o (outline).
+ * \param clip visible area in screen pixels or NULL
+ * \return true if the glyph got placed but dropped as hidden by the clip
+ */
+static bool
+get_bitmap_glyph(ASS_Renderer *render_priv, GlyphInfo *info,
+                 ASS_Vector *pos, ASS_Vector *pos_o,
+                 ASS_DVector *offset, bool first, int flags,
+                 const ASS_Rect *clip)
 {
-    ASS_Renderer *render_priv = priv;
-    BitmapHashKey *k = key;
-    Bitmap *bm = value;
+    if (!info->outline || info->symbol == '\n' || info->symbol == 0 || info->skip) {
+        ass_cache_dec_ref(info->outline);
+        return false;
+    }
 
-    double m[3][3];
-    restore_transform(m, k);
+    double m1[3][3], m2[3][3], m[3][3];
+    const ASS_Transform *tr = &info->transform;
+    calc_transform_matrix(render_priv, info, m1);
+    snap_transform_matrix(render_priv, info, m1);
+    for (int i = 0; i < 3; i++) {
+        m2[i][0] = m1[i][0] * tr->scale.x;
+        m2[i][1] = m1[i][1] * tr->scale.y;
+        m2[i][2] = m1[i][0] * tr->offset.x + m1[i][1] * tr->offset.y + m1[i][2];
+    }
+    memcpy(m, m2, sizeof(m));
+
+    BitmapHashKey key;
+    key.outline = info->outline;
+    if (!quantize_transform(m, pos, offset, first, &key)) {
+        ass_cache_dec_ref(info->outline);
+        return false;
+    }
+    *pos_o = *pos;
+
+    BitmapHashKey key_o;
+    bool border = calc_border_key(render_priv, info, m, m1, m2,
+                                  pos_o, offset, flags, &key_o);
+    bool visible = set_bitmap_window(&key, *pos, clip), visible_o = visible;
+    if (border && key_o.outline)
+        visible_o = set_bitmap_window(&key_o, *pos_o, clip);
+
+    info->bm = NULL;
+    // Over the frame budget, a glyph that isn't cached yet gets rasterized
+    // together with its border if both land on the same pixel grid,
+    // and the border is then prepared by the glyph construction.
+    // The glyph shares the window of the border then, which slightly
+    // changes its pixels, so its key holds the border too.
+    if (render_priv->degrade && visible && visible_o && border && key_o.outline &&
+            pos_o->x == pos->x && pos_o->y == pos->y) {
+        info->bm = ass_cache_find(render_priv->cache.bitmap_cache, &key);
+        if (!info->bm) {
+            key.window_min = key_o.window_min;
+            key.window_max = key_o.window_max;
+            ass_cache_inc_ref(key_o.outline);
+            set_border_key(&key, &key_o);
+            render_priv->degraded = true;
+        }
+    }
+    const ASS_PackedOutline *outline = info->outline->outline;
+    bool hidden = !visible && !visible_o &&
+        (outline[0].n_points || outline[1].n_points);
+
+    if (!visible)
+        ass_cache_dec_ref(key.outline);
+    else if (!info->bm)
+        info->bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, render_priv);
+    if (!info->bm || !info->bm->buffer) {
+        ass_cache_dec_ref(info->bm);
+        info->bm = NULL;
+    }
+    if (!border)
+        return hidden;
+    if (!key_o.outline) {
+        ass_cache_inc_ref(info->bm);
+        info->bm_o = info->bm;
+        return hidden;
+    }
+
+    info->bm_o = NULL;
+    if (visible_o)
+        info->bm_o = ass_cache_get(render_priv->cache.bitmap_cache, &key_o, render_priv);
+    else
+        ass_cache_dec_ref(key_o.outline);
+    if (render_priv->has_prepared_border) {
+        // border has been in the cache already
+        ass_free_bitmap(&render_priv->prepared_border);
+        render_priv->has_prepared_border = false;
+    }
+    if (!info->bm_o || !info->bm_o->buffer) {
+        ass_cache_dec_ref(info->bm_o);
+        info->bm_o = NULL;
+        *pos_o = *pos;
+    } else if (!info->bm)
+        *pos = *pos_o;
+    return hidden;
+}
+
+static void transform_outlines(const BitmapEngine *engine, ASS_Outline outline[2],
+                               const BitmapHashKey *k, Arena *arena)
+{
+    double m[3][3];
+    restore_transform(m, k);
 
-    ASS_Outline outline[2];
     if (k->matrix_z.x || k->matrix_z.y) {
-        outline_transform_3d(&outline[0], &k->outline->outline[0], m);
-        outline_transform_3d(&outline[1], &k->outline->outline[1], m);
+        TransformPerspectiveFunc transform = engine->transform_perspective;
+        outline_transform_3d(&outline[0], &k->outline->outline[0], m, transform, arena);
+        outline_transform_3d(&outline[1], &k->outline->outline[1], m, transform, arena);
     } else {
-        outline_transform_2d(&outline[0], &k->outline->outline[0], m);
-        outline_transform_2d(&outline[1], &k->outline->outline[1], m);
+        TransformAffineFunc transform = engine->transform_affine;
+        outline_transform_2d(&outline[0], &k->outline->outline[0], m, transform, arena);
+        outline_transform_2d(&outline[1], &k->outline->outline[1], m, transform, arena);
+    }
+}
+
+size_t ass_bitmap_construct(void *key, void *value, void *priv)
+{
+    ASS_Renderer *render_priv = priv;
+    BitmapHashKey *k = key;
+    Bitmap *bm = value;
+
+    if (render_priv->has_prepared_border &&
+            !memcmp(k, &render_priv->prepared_key, sizeof(*k))) {
+        *bm = render_priv->prepared_border;
+        render_priv->has_prepared_border = false;
+        return sizeof(BitmapHashKey) + sizeof(Bitmap) + bitmap_size(bm);
     }
 
-    if (!outline_to_bitmap(render_priv, bm, &outline[0], &outline[1]))
+    ArenaMark mark = ass_arena_mark(&render_priv->arena);
+    ASS_Outline outline[2];
+    transform_outlines(render_priv->engine, outline, k, &render_priv->arena);
+    ASS_Rect window = {
+        .x_min = k->window_min.x, .y_min = k->window_min.y,
+        .x_max = k->window_max.x, .y_max = k->window_max.y,
+    };
+
+    if (k->border) {
+        BitmapHashKey border_key;
+        extract_border_key(&border_key, k);
+        ASS_Outline border[2];
+        transform_outlines(render_priv->engine, border, &border_key, &render_priv->arena);
+
+        // Border bitmap is exactly the same as if it were rendered alone,
+        // keep it for the immediately following border lookup.
+        Bitmap *bm_o = &render_priv->prepared_border;
+        if (!outline_to_bitmap2(render_priv, bm, &outline[0], &outline[1],
+                                bm_o, &border[0], &border[1], &window))
+            memset(bm, 0, sizeof(*bm));
+        if (bm_o->buffer) {
+            render_priv->prepared_key = border_key;
+            render_priv->has_prepared_border = true;
+        }
+    } else if (!outline_to_bitmap(render_priv, bm, &outline[0], &outline[1], &window)) {
         memset(bm, 0, sizeof(*bm));
-    outline_free(&outline[0]);
-    outline_free(&outline[1]);
+    }
+    ass_arena_release(&render_priv->arena, mark);
 
     return sizeof(BitmapHashKey) + sizeof(Bitmap) + bitmap_size(bm);
 }
@@ -1898,9 +2661,8 @@ static bool parse_events(ASS_Renderer *render_priv, ASS_Event *event)
         unsigned code = 0;
         while (*p) {
             if ((*p == '{') && (q = strchr(p, '}'))) {
-                p = parse_tags(render_priv, p, q, 1., false);
-                assert(*p == '}');
-                p++;
+                parse_tags(render_priv, p, q);
+                p = q + 1;
             } else if (render_priv->state.drawing_scale) {
                 q = p;
                 if (*p == '{')
@@ -2257,6 +3019,44 @@ static double restore_blur(int qblur)
 }
 
 // Convert glyphs to bitmaps, combine them, apply blur, generate shadows.
+/**
+ * \brief Calculate the area that composite pixels can be visible from
+ * \param clip out: clip rectangle extended by blur and shadow offset
+ * \return false if the whole composite is needed
+ */
+static bool calc_clip_window(ASS_Renderer *render_priv,
+                             const CombinedBitmapInfo *info, ASS_Rect *clip)
+{
+    // moving events are clipped after caching,
+    // karaoke effects need full glyph extents
+    if (render_priv->state.unclipped || render_priv->state.clip_mode ||
+            info->effect_type != EF_NONE)
+        return false;
+
+    int pad = be_padding(info->filter.be) + 1;
+    double r2 = restore_blur(info->filter.blur);
+    if (r2 > 0.001)
+        pad += ass_blur_padding(r2);
+    int shadow_x = info->shadow.x >> 6;
+    int shadow_y = info->shadow.y >> 6;
+
+    const RenderContext *state = &render_priv->state;
+    clip->x_min = FFMINMAX(state->clip_x0, 0, render_priv->width)  - pad - FFMAX(shadow_x, 0);
+    clip->y_min = FFMINMAX(state->clip_y0, 0, render_priv->height) - pad - FFMAX(shadow_y, 0);
+    clip->x_max = FFMINMAX(state->clip_x1, 0, render_priv->width)  + pad + FFMAX(-shadow_x, 0);
+    clip->y_max = FFMINMAX(state->clip_y1, 0, render_priv->height) + pad + FFMAX(-shadow_y, 0);
+    return true;
+}
+
+/**
+ * \brief Check whether the blur of a composite has a cheaper version
+ */
+static bool can_degrade_filter(ASS_Renderer *render_priv, const FilterDesc *filter)
+{
+    return filter->be >= DEGRADED_MIN_BE ||
+        (filter->blur && render_priv->settings.blur_quality == ASS_BLUR_ACCURATE);
+}
+
 static void render_and_combine_glyphs(ASS_Renderer *render_priv,
                                       double device_x, double device_y)
 {
@@ -2269,6 +3069,11 @@ static void render_and_combine_glyphs(ASS_Renderer *render_priv,
     CombinedBitmapInfo *current_info = NULL;
     GlyphInfo *last_info = NULL;
     ASS_DVector offset;
+    ASS_Rect clip;
+    bool use_clip = false, placed = false;
+    // bitmap lists are only needed for the lookups, the cache keeps its own copies
+    Arena *arena = &render_priv->arena;
+    ArenaMark mark = ass_arena_mark(arena);
     for (int i = 0; i < text_info->length; i++) {
         GlyphInfo *info = text_info->glyphs + i;
         if (info->linebreak) linebreak = 1;
@@ -2318,22 +3123,26 @@ static void render_and_combine_glyphs(ASS_Renderer *render_priv,
                 if (flags & FILTER_NONZERO_SHADOW) {
                     int32_t x = double_to_d6(info->shadow_x * render_priv->border_scale);
                     int32_t y = double_to_d6(info->shadow_y * render_priv->border_scale);
-                    filter->shadow.x = (x + (shadow_mask >> 1)) & ~shadow_mask;
-                    filter->shadow.y = (y + (shadow_mask >> 1)) & ~shadow_mask;
+                    current_info->shadow.x = (x + (shadow_mask >> 1)) & ~shadow_mask;
+                    current_info->shadow.y = (y + (shadow_mask >> 1)) & ~shadow_mask;
                 } else
-                    filter->shadow.x = filter->shadow.y = 0;
+                    current_info->shadow.x = current_info->shadow.y = 0;
 
                 current_info->x = current_info->y = INT_MAX;
                 current_info->bm = current_info->bm_o = current_info->bm_s = NULL;
                 current_info->image = NULL;
 
                 current_info->bitmap_count = current_info->max_bitmap_count = 0;
-                current_info->bitmaps = malloc(MAX_SUB_BITMAPS_INITIAL * sizeof(BitmapRef));
+                current_info->bitmaps =
+                    ass_arena_alloc(arena, MAX_SUB_BITMAPS_INITIAL * sizeof(BitmapRef),
+                                    sizeof(void *));
                 if (!current_info->bitmaps) {
                     ass_cache_dec_ref(info->outline);
                     continue;
                 }
                 current_info->max_bitmap_count = MAX_SUB_BITMAPS_INITIAL;
+                use_clip = calc_clip_window(render_priv, current_info, &clip);
+                placed = false;
 
                 nb_bitmaps++;
             }
@@ -2343,8 +3152,12 @@ static void render_and_combine_glyphs(ASS_Renderer *render_priv,
             ASS_Vector pos, pos_o;
             info->pos.x = double_to_d6(device_x + d6_to_double(info->pos.x) * render_priv->font_scale_x);
             info->pos.y = double_to_d6(device_y) + info->pos.y;
-            get_bitmap_glyph(render_priv, info, &pos, &pos_o,
-                             &offset, !current_info->bitmap_count, flags);
+            int64_t start = ass_stat_start(render_priv);
+            // hidden glyphs still fix the subpixel offset of the rest
+            placed |= get_bitmap_glyph(render_priv, info, &pos, &pos_o, &offset,
+                                       !placed, flags, use_clip ? &clip : NULL);
+            ass_stat_stop(render_priv, ASS_STAT_TIME_BITMAP, start);
+            placed |= info->bm || info->bm_o;
 
             if (!info->bm && !info->bm_o) {
                 ass_cache_dec_ref(info->bm);
@@ -2354,11 +3167,16 @@ static void render_and_combine_glyphs(ASS_Renderer *render_priv,
 
             if (current_info->bitmap_count >= current_info->max_bitmap_count) {
                 size_t new_size = 2 * current_info->max_bitmap_count;
-                if (!ASS_REALLOC_ARRAY(current_info->bitmaps, new_size)) {
+                BitmapRef *bitmaps =
+                    ass_arena_realloc(arena, current_info->bitmaps,
+                                      current_info->max_bitmap_count * sizeof(BitmapRef),
+                                      new_size * sizeof(BitmapRef), sizeof(void *));
+                if (!bitmaps) {
                     ass_cache_dec_ref(info->bm);
                     ass_cache_dec_ref(info->bm_o);
                     continue;
                 }
+                current_info->bitmaps = bitmaps;
                 current_info->max_bitmap_count = new_size;
             }
             current_info->bitmaps[current_info->bitmap_count].bm   = info->bm;
@@ -2389,11 +3207,22 @@ static void render_and_combine_glyphs(ASS_Renderer *render_priv,
         info->effect_timing += x_min;
         info->first_pos_x = x_min;
 
+        // shadow offset is left out of the composite,
+        // so that the blurred bitmaps are shared between shadows
         CompositeHashKey key;
         key.filter = info->filter;
         key.bitmap_count = info->bitmap_count;
         key.bitmaps = info->bitmaps;
-        CompositeHashValue *val = ass_cache_get(render_priv->cache.composite_cache, &key, render_priv);
+        CompositeHashValue *val = NULL;
+        if (render_priv->degrade && can_degrade_filter(render_priv, &key.filter)) {
+            val = ass_cache_find(render_priv->cache.composite_cache, &key);
+            if (!val) {
+                key.filter.flags |= FILTER_DEGRADED;
+                render_priv->degraded = true;
+            }
+        }
+        if (!val)
+            val = ass_cache_get(render_priv->cache.composite_cache, &key, render_priv);
         if (!val)
             continue;
 
@@ -2401,12 +3230,25 @@ static void render_and_combine_glyphs(ASS_Renderer *render_priv,
             info->bm = &val->bm;
         if (val->bm_o.buffer)
             info->bm_o = &val->bm_o;
-        if (val->bm_s.buffer)
-            info->bm_s = &val->bm_s;
         info->image = val;
-        continue;
+
+        if (info->filter.flags & FILTER_NONZERO_SHADOW) {
+            // keyed on the composite's id rather than a reference,
+            // so that cached shadows don't keep composites alive
+            ShadowHashKey skey;
+            skey.composite_id = val->id;
+            skey.shadow = info->shadow;
+            render_priv->shadow_source = val;
+            Bitmap *bm_s = ass_cache_get(render_priv->cache.shadow_cache, &skey, render_priv);
+            render_priv->shadow_source = NULL;
+            if (bm_s && bm_s->buffer)
+                info->bm_s = bm_s;
+            else
+                ass_cache_dec_ref(bm_s);
+        }
     }
 
+    ass_arena_release(arena, mark);
     text_info->n_bitmaps = nb_bitmaps;
 }
 
@@ -2417,106 +3259,143 @@ static inline void rectangle_combine(ASS_Rect *rect, const Bitmap *bm, ASS_Vecto
     rectangle_update(rect, pos.x, pos.y, pos.x + bm->w, pos.y + bm->h);
 }
 
-size_t ass_composite_construct(void *key, void *value, void *priv)
+/**
+ * \brief Sum glyph or outline bitmaps of a composite into one bitmap
+ * \param outline whether to use bm_o instead of bm of the references
+ * \param bord padding added on every side
+ * \param align step of positions that the following blur is exact for
+ */
+static void compose_bitmaps(const BitmapEngine *engine, Bitmap *dst,
+                            const CompositeHashKey *k, bool outline,
+                            int bord, int align)
 {
-    ASS_Renderer *render_priv = priv;
-    CompositeHashKey *k = key;
-    CompositeHashValue *v = value;
-    memset(v, 0, sizeof(*v));
-
-    ASS_Rect rect, rect_o;
+    ASS_Rect rect, full;
     rectangle_reset(&rect);
-    rectangle_reset(&rect_o);
+    rectangle_reset(&full);
 
-    size_t n_bm = 0, n_bm_o = 0;
-    BitmapRef *last = NULL, *last_o = NULL;
+    // only the parts that can have nonzero pixels are used,
+    // so that empty tiles of glyphs aren't summed and blurred
+    size_t n_bm = 0;
+    Bitmap last;
+    ASS_Vector last_pos;
     for (int i = 0; i < k->bitmap_count; i++) {
         BitmapRef *ref = &k->bitmaps[i];
-        if (ref->bm) {
-            rectangle_combine(&rect, ref->bm, ref->pos);
-            last = ref;
-            n_bm++;
-        }
-        if (ref->bm_o) {
-            rectangle_combine(&rect_o, ref->bm_o, ref->pos_o);
-            last_o = ref;
-            n_bm_o++;
-        }
-    }
-
-    int bord = be_padding(k->filter.be);
-    if (!bord && n_bm == 1) {
-        copy_bitmap(render_priv->engine, &v->bm, last->bm);
-        v->bm.left += last->pos.x;
-        v->bm.top  += last->pos.y;
-    } else if (n_bm && alloc_bitmap(render_priv->engine, &v->bm,
-                                    rect.x_max - rect.x_min + 2 * bord,
-                                    rect.y_max - rect.y_min + 2 * bord,
-                                    true)) {
-        Bitmap *dst = &v->bm;
-        dst->left = rect.x_min - bord;
-        dst->top  = rect.y_min - bord;
-        for (int i = 0; i < k->bitmap_count; i++) {
-            Bitmap *src = k->bitmaps[i].bm;
-            if (!src)
-                continue;
-            int x = k->bitmaps[i].pos.x + src->left - dst->left;
-            int y = k->bitmaps[i].pos.y + src->top  - dst->top;
-            assert(x >= 0 && x + src->w <= dst->w);
-            assert(y >= 0 && y + src->h <= dst->h);
-            unsigned char *buf = dst->buffer + y * dst->stride + x;
-            render_priv->engine->add_bitmaps(buf, dst->stride,
-                                             src->buffer, src->stride,
-                                             src->h, src->w);
-        }
-    }
-    if (!bord && n_bm_o == 1) {
-        copy_bitmap(render_priv->engine, &v->bm_o, last_o->bm_o);
-        v->bm_o.left += last_o->pos_o.x;
-        v->bm_o.top  += last_o->pos_o.y;
-    } else if (n_bm_o && alloc_bitmap(render_priv->engine, &v->bm_o,
-                                      rect_o.x_max - rect_o.x_min + 2 * bord,
-                                      rect_o.y_max - rect_o.y_min + 2 * bord,
-                                      true)) {
-        Bitmap *dst = &v->bm_o;
-        dst->left = rect_o.x_min - bord;
-        dst->top  = rect_o.y_min - bord;
-        for (int i = 0; i < k->bitmap_count; i++) {
-            Bitmap *src = k->bitmaps[i].bm_o;
-            if (!src)
-                continue;
-            int x = k->bitmaps[i].pos_o.x + src->left - dst->left;
-            int y = k->bitmaps[i].pos_o.y + src->top  - dst->top;
-            assert(x >= 0 && x + src->w <= dst->w);
-            assert(y >= 0 && y + src->h <= dst->h);
-            unsigned char *buf = dst->buffer + y * dst->stride + x;
-            render_priv->engine->add_bitmaps(buf, dst->stride,
-                                             src->buffer, src->stride,
-                                             src->h, src->w);
-        }
+        Bitmap *bm = outline ? ref->bm_o : ref->bm;
+        ASS_Vector pos = outline ? ref->pos_o : ref->pos;
+        if (!bm)
+            continue;
+        Bitmap src;
+        bitmap_content(engine, bm, &src);
+        if (!src.w || !src.h)
+            continue;
+        rectangle_combine(&rect, &src, pos);
+        rectangle_combine(&full, bm, pos);
+        last = *bm;
+        last_pos = pos;
+        n_bm++;
+    }
+    if (!n_bm)
+        return;
+
+    // cut leading empty space only in whole steps of the blur grid,
+    // so that the result is the same as without the cut
+    rect.x_min = full.x_min + ((rect.x_min - full.x_min) & ~(align - 1));
+    rect.y_min = full.y_min + ((rect.y_min - full.y_min) & ~(align - 1));
+
+    // a single bitmap can be copied whole rows at a time
+    int x = rect.x_min - full.x_min, y = rect.y_min - full.y_min;
+    if (!bord && n_bm == 1 && !x) {
+        last.buffer += y * last.stride;
+        last.left += last_pos.x;
+        last.top  += last_pos.y + y;
+        last.w = rect.x_max - rect.x_min;
+        last.h = rect.y_max - rect.y_min;
+        copy_bitmap(engine, dst, &last);
+        return;
+    }
+    if (!alloc_bitmap(engine, dst,
+                      rect.x_max - rect.x_min + 2 * bord,
+                      rect.y_max - rect.y_min + 2 * bord,
+                      true))
+        return;
+
+    dst->left = rect.x_min - bord;
+    dst->top  = rect.y_min - bord;
+    for (int i = 0; i < k->bitmap_count; i++) {
+        BitmapRef *ref = &k->bitmaps[i];
+        Bitmap *bm = outline ? ref->bm_o : ref->bm;
+        ASS_Vector pos = outline ? ref->pos_o : ref->pos;
+        if (!bm)
+            continue;
+        Bitmap src;
+        bitmap_content(engine, bm, &src);
+        if (!src.w || !src.h)
+            continue;
+        int x = pos.x + src.left - dst->left;
+        int y = pos.y + src.top  - dst->top;
+        assert(x >= 0 && x + src.w <= dst->w);
+        assert(y >= 0 && y + src.h <= dst->h);
+        unsigned char *buf = dst->buffer + y * dst->stride + x;
+        engine->add_bitmaps(buf, dst->stride,
+                            src.buffer, src.stride,
+                            src.h, src.w);
     }
+}
+
+// Composites are constructed by every renderer and its workers,
+// ids have to stay unique across all of them.
+static uint64_t next_composite_id(void)
+{
+    static uint64_t last_id;
+#ifdef CONFIG_PTHREAD
+    return __atomic_add_fetch(&last_id, 1, __ATOMIC_RELAXED);
+#else
+    return ++last_id;
+#endif
+}
+
+size_t ass_composite_construct(void *key, void *value, void *priv)
+{
+    ASS_Renderer *render_priv = priv;
+    CompositeHashKey *k = key;
+    CompositeHashValue *v = value;
+    memset(v, 0, sizeof(*v));
+    v->id = next_composite_id();
 
     int flags = k->filter.flags;
+    int be = k->filter.be;
     double r2 = restore_blur(k->filter.blur);
-    bool no_blur = (flags & ~FILTER_NONZERO_SHADOW) == FILTER_NONZERO_BORDER;
+    ASS_BlurQuality quality = render_priv->settings.blur_quality;
+    if (flags & FILTER_DEGRADED) {
+        // every pass also fades the result a bit, so dropping
+        // more of them would visibly brighten it
+        if (be >= DEGRADED_MIN_BE)
+            be = (be + 1) >> 1;
+        quality = ASS_BLUR_FAST;
+    }
+
+    int bord = be_padding(be);
+    int align = r2 > 0.001 ? ass_blur_alignment(r2) : 1;
+    compose_bitmaps(render_priv->engine, &v->bm, k, false, bord, align);
+    compose_bitmaps(render_priv->engine, &v->bm_o, k, true, bord, align);
+
+    bool no_blur = (flags & ~(FILTER_NONZERO_SHADOW | FILTER_DEGRADED)) ==
+        FILTER_NONZERO_BORDER;
     if (!no_blur)
-        ass_synth_blur(render_priv->engine, &v->bm, k->filter.be, r2);
-    ass_synth_blur(render_priv->engine, &v->bm_o, k->filter.be, r2);
+        ass_synth_blur(render_priv->engine, &render_priv->arena, &v->bm,
+                       be, r2, quality);
+    ass_synth_blur(render_priv->engine, &render_priv->arena, &v->bm_o,
+                   be, r2, quality);
 
+    // the shadow is placed later from bm or bm_o,
+    // bm_s only keeps a source that isn't available otherwise
     if (flags & FILTER_NONZERO_SHADOW) {
-        if (flags & FILTER_NONZERO_BORDER)
+        if (no_blur)
             copy_bitmap(render_priv->engine, &v->bm_s, &v->bm_o);
-        else if (flags & FILTER_BORDER_STYLE_3) {
+        else if (!(flags & FILTER_NONZERO_BORDER) && (flags & FILTER_BORDER_STYLE_3)) {
             v->bm_s = v->bm_o;
             memset(&v->bm_o, 0, sizeof(v->bm_o));
-        } else
-            copy_bitmap(render_priv->engine, &v->bm_s, &v->bm);
-
-        // Works right even for negative offsets
-        // '>>' rounds toward negative infinity, '&' returns correct remainder
-        v->bm_s.left += k->filter.shadow.x >> 6;
-        v->bm_s.top  += k->filter.shadow.y >> 6;
-        shift_bitmap(&v->bm_s, k->filter.shadow.x & SUBPIXEL_MASK, k->filter.shadow.y & SUBPIXEL_MASK);
+        }
     }
 
     if (no_blur)
@@ -2526,6 +3405,30 @@ size_t ass_composite_construct(void *key, void *value, void *priv)
         bitmap_size(&v->bm) + bitmap_size(&v->bm_o) + bitmap_size(&v->bm_s);
 }
 
+size_t ass_shadow_construct(void *key, void *value, void *priv)
+{
+    ASS_Renderer *render_priv = priv;
+    ShadowHashKey *k = key;
+    Bitmap *bm = value;
+    const CompositeHashValue *src = render_priv->shadow_source;
+    const CompositeHashKey *src_key = ass_cache_key((void *) src);
+
+    if (src->bm_s.buffer)
+        copy_bitmap(render_priv->engine, bm, &src->bm_s);
+    else if (src_key->filter.flags & FILTER_NONZERO_BORDER)
+        copy_bitmap(render_priv->engine, bm, &src->bm_o);
+    else
+        copy_bitmap(render_priv->engine, bm, &src->bm);
+
+    // Works right even for negative offsets
+    // '>>' rounds toward negative infinity, '&' returns correct remainder
+    bm->left += k->shadow.x >> 6;
+    bm->top  += k->shadow.y >> 6;
+    shift_bitmap(bm, k->shadow.x & SUBPIXEL_MASK, k->shadow.y & SUBPIXEL_MASK);
+
+    return sizeof(ShadowHashKey) + sizeof(Bitmap) + bitmap_size(bm);
+}
+
 static void add_background(ASS_Renderer *render_priv, EventImages *event_images)
 {
     double size_x = render_priv->state.shadow_x > 0 ?
@@ -2536,10 +3439,12 @@ static void add_background(ASS_Renderer *render_priv, EventImages *event_images)
     int top     = event_images->top  - size_y;
     int right   = event_images->left + event_images->width  + size_x;
     int bottom  = event_images->top  + event_images->height + size_y;
-    left        = FFMINMAX(left,   0, render_priv->width);
-    top         = FFMINMAX(top,    0, render_priv->height);
-    right       = FFMINMAX(right,  0, render_priv->width);
-    bottom      = FFMINMAX(bottom, 0, render_priv->height);
+    if (!render_priv->state.unclipped) {
+        left    = FFMINMAX(left,   0, render_priv->width);
+        top     = FFMINMAX(top,    0, render_priv->height);
+        right   = FFMINMAX(right,  0, render_priv->width);
+        bottom  = FFMINMAX(bottom, 0, render_priv->height);
+    }
     int w = right - left;
     int h = bottom - top;
     if (w < 1 || h < 1)
@@ -2548,7 +3453,8 @@ static void add_background(ASS_Renderer *render_priv, EventImages *event_images)
     if (!nbuffer)
         return;
     memset(nbuffer, 0xFF, w * h);
-    ASS_Image *img = my_draw_bitmap(nbuffer, w, h, w, left, top,
+    ASS_Image *img = my_draw_bitmap(render_priv->image_pool, nbuffer,
+                                    w, h, w, left, top,
                                     render_priv->state.c[3], NULL);
     if (img) {
         img->next = event_images->imgs;
@@ -2557,14 +3463,11 @@ static void add_background(ASS_Renderer *render_priv, EventImages *event_images)
 }
 
 /**
- * \brief Main ass rendering function, glues everything together
- * \param event event to render
- * \param event_images struct containing resulting images, will also be initialized
- * Process event, appending resulting ASS_Image's to images_root.
+ * \brief Parse, shape and lay out the text of an event
+ * Leaves the result in render_priv->text_info and render_priv->state,
+ * glyph positions are relative to the text until render_layout().
  */
-static bool
-ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
-                 EventImages *event_images)
+static bool layout_event(ASS_Renderer *render_priv, ASS_Event *event)
 {
     if (event->Style >= render_priv->track->n_styles) {
         ass_msg(render_priv->library, MSGL_WARN, "No style found");
@@ -2575,50 +3478,62 @@ ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
         return false;
     }
 
+    lock_layout(render_priv);
+
     free_render_context(render_priv);
     init_render_context(render_priv, event);
 
-    if (!parse_events(render_priv, event))
+    int64_t start = ass_stat_start(render_priv);
+    bool parsed = parse_events(render_priv, event);
+    ass_stat_stop(render_priv, ASS_STAT_TIME_PARSE, start);
+    if (!parsed) {
+        unlock_layout(render_priv);
         return false;
+    }
 
     TextInfo *text_info = &render_priv->text_info;
     if (text_info->length == 0) {
         // no valid symbols in the event; this can be smth like {comment}
         free_render_context(render_priv);
+        unlock_layout(render_priv);
         return false;
     }
 
     // Find shape runs and shape text
+    start = ass_stat_start(render_priv);
     ass_shaper_set_base_direction(render_priv->shaper,
             resolve_base_direction(render_priv->state.font_encoding));
     ass_shaper_find_runs(render_priv->shaper, render_priv, text_info->glyphs,
             text_info->length);
-    if (ass_shaper_shape(render_priv->shaper, text_info) < 0) {
+    int shaped = ass_shaper_shape(render_priv->shaper, text_info);
+    ass_stat_stop(render_priv, ASS_STAT_TIME_SHAPE, start);
+    if (shaped < 0) {
         ass_msg(render_priv->library, MSGL_ERR, "Failed to shape text");
         free_render_context(render_priv);
+        unlock_layout(render_priv);
         return false;
     }
 
+    start = ass_stat_start(render_priv);
     retrieve_glyphs(render_priv);
+    ass_stat_stop(render_priv, ASS_STAT_TIME_OUTLINE, start);
 
     preliminary_layout(render_priv);
 
     // depends on glyph x coordinates being monotonous, so it should be done before line wrap
     process_karaoke_effects(render_priv);
 
-    int valign = render_priv->state.alignment & 12;
-
-    int MarginL =
+    render_priv->state.margin_l =
         (event->MarginL) ? event->MarginL : render_priv->state.style->MarginL;
-    int MarginR =
+    render_priv->state.margin_r =
         (event->MarginR) ? event->MarginR : render_priv->state.style->MarginR;
-    int MarginV =
+    render_priv->state.margin_v =
         (event->MarginV) ? event->MarginV : render_priv->state.style->MarginV;
 
     // calculate max length of a line
     double max_text_width =
-        x2scr_right(render_priv, render_priv->track->PlayResX - MarginR) -
-        x2scr_left(render_priv, MarginL);
+        x2scr_right(render_priv, render_priv->track->PlayResX - render_priv->state.margin_r) -
+        x2scr_left(render_priv, render_priv->state.margin_l);
 
     // wrap lines
     if (render_priv->state.evt_type != EVENT_HSCROLL) {
@@ -2634,6 +3549,33 @@ ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
 
     reorder_text(render_priv);
 
+    // everything later only uses per-renderer state and the caches
+    unlock_layout(render_priv);
+    return true;
+}
+
+/**
+ * \brief Place laid out text and render it
+ * \param event_images struct containing resulting images, will also be initialized
+ * \param frame_clip if set, images are not cropped to the frame,
+ * the rectangle they have to be cropped to is stored here instead
+ * Consumes render_priv->text_info and render_priv->state.
+ */
+static bool
+render_layout(ASS_Renderer *render_priv, ASS_Event *event,
+              EventImages *event_images, ASS_Rect *frame_clip)
+{
+    TextInfo *text_info = &render_priv->text_info;
+    int valign = render_priv->state.alignment & 12;
+    int MarginL = render_priv->state.margin_l;
+    int MarginR = render_priv->state.margin_r;
+    int MarginV = render_priv->state.margin_v;
+
+    apply_karaoke_timing(render_priv);
+
+    double max_text_width =
+        x2scr_right(render_priv, render_priv->track->PlayResX - MarginR) -
+        x2scr_left(render_priv, MarginL);
     align_lines(render_priv, max_text_width);
 
     // determing text bounding box
@@ -2772,9 +3714,23 @@ ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
         render_priv->state.clip_y1 = render_priv->settings.frame_height;
     }
 
+    if (frame_clip) {
+        frame_clip->x_min = FFMINMAX(render_priv->state.clip_x0, 0, render_priv->width);
+        frame_clip->y_min = FFMINMAX(render_priv->state.clip_y0, 0, render_priv->height);
+        frame_clip->x_max = FFMINMAX(render_priv->state.clip_x1, 0, render_priv->width);
+        frame_clip->y_max = FFMINMAX(render_priv->state.clip_y1, 0, render_priv->height);
+        render_priv->state.unclipped = 1;
+    }
+
     calculate_rotation_params(render_priv, &bbox, device_x, device_y);
 
+    // bitmap time is measured inside, count the rest as compositing
+    int64_t bitmap_time = render_priv->stats[ASS_STAT_TIME_BITMAP];
+    int64_t start = ass_stat_start(render_priv);
     render_and_combine_glyphs(render_priv, device_x, device_y);
+    if (render_priv->measure_time)
+        start += render_priv->stats[ASS_STAT_TIME_BITMAP] - bitmap_time;
+    ass_stat_stop(render_priv, ASS_STAT_TIME_COMPOSITE, start);
 
     memset(event_images, 0, sizeof(*event_images));
     // VSFilter does *not* shift lines with a border > margin to be within the
@@ -2802,74 +3758,507 @@ ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
 }
 
 /**
- * \brief Check cache limits and reset cache if they are exceeded
+ * \brief Main ass rendering function, glues everything together
+ * \param event event to render
+ * \param event_images struct containing resulting images, will also be initialized
+ * \param frame_clip if set, images are not cropped to the frame,
+ * the rectangle they have to be cropped to is stored here instead
+ * Process event, appending resulting ASS_Image's to images_root.
  */
-static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
+static bool
+render_event(ASS_Renderer *render_priv, ASS_Event *event,
+             EventImages *event_images, ASS_Rect *frame_clip)
 {
-    ass_cache_cut(cache->composite_cache, cache->composite_max_size);
-    ass_cache_cut(cache->bitmap_cache, cache->bitmap_max_size);
-    ass_cache_cut(cache->outline_cache, cache->glyph_max);
+    return layout_event(render_priv, event) &&
+        render_layout(render_priv, event, event_images, frame_clip);
 }
 
+typedef struct {
+    ASS_Renderer *render_priv;
+    ASS_Event *event;
+    const EventMotion *motion;  // NULL for static events
+} EventConstructParams;
+
 /**
- * \brief Start a new frame
+ * \brief Move the text left by layout_event() into a new EventLayout
+ * Leaves render_priv->text_info without references that need releasing.
  */
-static bool
-ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
-                long long now)
+static EventLayout *save_layout(ASS_Renderer *render_priv)
 {
-    ASS_Settings *settings_priv = &render_priv->settings;
+    TextInfo *text_info = &render_priv->text_info;
+    size_t n_glyphs = 0;
+    for (int i = 0; i < text_info->length; i++)
+        for (GlyphInfo *info = text_info->glyphs + i; info; info = info->next)
+            n_glyphs++;
 
-    if (!render_priv->settings.frame_width
-        && !render_priv->settings.frame_height)
-        return false;               // library not initialized
+    EventLayout *layout = calloc(1, sizeof(*layout));
+    if (!layout)
+        return NULL;
+    TextInfo *dst = &layout->text_info;
+    dst->glyphs = ass_try_realloc_array(NULL, n_glyphs, sizeof(GlyphInfo));
+    dst->lines = ass_try_realloc_array(NULL, text_info->n_lines, sizeof(LineInfo));
+    if (!dst->glyphs || !dst->lines) {
+        free(dst->glyphs);
+        free(dst->lines);
+        free(layout);
+        return NULL;
+    }
 
-    if (!render_priv->fontselect)
-        return false;
+    GlyphInfo *tail = dst->glyphs + text_info->length;
+    for (int i = 0; i < text_info->length; i++) {
+        GlyphInfo *last = dst->glyphs + i;
+        *last = text_info->glyphs[i];
+        for (GlyphInfo *info = last->next; info; info = info->next) {
+            *tail = *info;
+            last->next = tail;
+            last = tail++;
+        }
+        for (GlyphInfo *info = text_info->glyphs + i; info; info = info->next)
+            info->outline = NULL;
+        text_info->glyphs[i].drawing_text = NULL;
+    }
+    for (size_t i = 0; i < n_glyphs; i++)
+        ass_cache_inc_ref(dst->glyphs[i].font);
+    memcpy(dst->lines, text_info->lines, text_info->n_lines * sizeof(LineInfo));
+    dst->length = text_info->length;
+    dst->n_lines = text_info->n_lines;
+    dst->height = text_info->height;
+    dst->border_top = text_info->border_top;
+    dst->border_bottom = text_info->border_bottom;
+    dst->border_x = text_info->border_x;
+    layout->n_glyphs = n_glyphs;
+
+    layout->state = render_priv->state;
+    layout->state.event = NULL;
+    layout->state.style = NULL;
+    layout->state.font = NULL;
+    layout->state.family = NULL;
+    render_priv->state.clip_drawing_text = NULL;
+    return layout;
+}
 
-    if (render_priv->library != track->library)
-        return false;
+void ass_event_layout_free(EventLayout *layout)
+{
+    if (!layout)
+        return;
+    TextInfo *text_info = &layout->text_info;
+    for (size_t i = 0; i < layout->n_glyphs; i++) {
+        ass_cache_dec_ref(text_info->glyphs[i].outline);
+        ass_cache_dec_ref(text_info->glyphs[i].font);
+    }
+    for (int i = 0; i < text_info->length; i++)
+        free(text_info->glyphs[i].drawing_text);
+    free(text_info->glyphs);
+    free(text_info->lines);
+    free(layout->state.clip_drawing_text);
+    free(layout);
+}
 
-    if (track->n_events == 0)
-        return false;               // nothing to do
+/**
+ * \brief Release the text left by layout_event() without rendering it
+ */
+static void discard_layout(ASS_Renderer *render_priv)
+{
+    TextInfo *text_info = &render_priv->text_info;
+    for (int i = 0; i < text_info->length; i++)
+        for (GlyphInfo *info = text_info->glyphs + i; info; info = info->next)
+            ass_cache_dec_ref(info->outline);
+    ass_shaper_cleanup(render_priv->shaper, text_info);
+    free_render_context(render_priv);
+}
 
-    render_priv->track = track;
-    render_priv->time = now;
+/**
+ * \brief Set up render_priv for render_layout() from a cached layout
+ */
+static bool restore_layout(ASS_Renderer *render_priv, ASS_Event *event,
+                           const EventLayout *layout)
+{
+    free_render_context(render_priv);
 
-    ass_lazy_track_init(render_priv->library, render_priv->track);
+    TextInfo *text_info = &render_priv->text_info;
+    const TextInfo *src = &layout->text_info;
+    if (src->length > text_info->max_glyphs) {
+        if (!ASS_REALLOC_ARRAY(text_info->glyphs, src->length))
+            return false;
+        text_info->max_glyphs = src->length;
+    }
+    if (src->n_lines > text_info->max_lines) {
+        if (!ASS_REALLOC_ARRAY(text_info->lines, src->n_lines))
+            return false;
+        text_info->max_lines = src->n_lines;
+    }
+    char *clip_drawing_text = NULL;
+    if (layout->state.clip_drawing_text) {
+        clip_drawing_text = strdup(layout->state.clip_drawing_text);
+        if (!clip_drawing_text)
+            return false;
+    }
 
-    ass_shaper_set_kerning(render_priv->shaper, track->Kerning);
-    ass_shaper_set_language(render_priv->shaper, track->Language);
-    ass_shaper_set_level(render_priv->shaper, render_priv->settings.shaper);
+    render_priv->state = layout->state;
+    render_priv->state.event = event;
+    render_priv->state.style = render_priv->track->styles + event->Style;
+    render_priv->state.clip_drawing_text = clip_drawing_text;
 
-    // PAR correction
-    double par = render_priv->settings.par;
-    if (par == 0.) {
-        if (render_priv->orig_width && render_priv->orig_height &&
-            settings_priv->storage_width && settings_priv->storage_height) {
-            double dar = ((double) render_priv->orig_width) /
-                         render_priv->orig_height;
-            double sar = ((double) settings_priv->storage_width) /
-                         settings_priv->storage_height;
-            par = dar / sar;
-        } else
-            par = 1.0;
+    for (int i = 0; i < src->length; i++) {
+        GlyphInfo *info = text_info->glyphs + i;
+        *info = src->glyphs[i];
+        if (info->drawing_text)
+            info->drawing_text = strdup(info->drawing_text);
+        ass_cache_inc_ref(info->outline);
+        for (const GlyphInfo *next = src->glyphs[i].next; next; next = next->next) {
+            info->next = malloc(sizeof(GlyphInfo));
+            if (!info->next)
+                break;
+            char *drawing_text = info->drawing_text;
+            info = info->next;
+            *info = *next;
+            info->drawing_text = drawing_text;
+            info->next = NULL;
+            ass_cache_inc_ref(info->outline);
+        }
     }
-    render_priv->font_scale_x = par;
+    memcpy(text_info->lines, src->lines, src->n_lines * sizeof(LineInfo));
+    text_info->length = src->length;
+    text_info->n_lines = src->n_lines;
+    text_info->height = src->height;
+    text_info->border_top = src->border_top;
+    text_info->border_bottom = src->border_bottom;
+    text_info->border_x = src->border_x;
+    return true;
+}
 
-    render_priv->prev_images_root = render_priv->images_root;
-    render_priv->images_root = NULL;
+size_t ass_event_construct(void *key, void *value, void *priv)
+{
+    EventConstructParams *params = priv;
+    EventHashValue *v = value;
+    EventHashKey *k = key;
+
+    size_t size = sizeof(EventHashKey) + sizeof(EventHashValue) +
+        strlen(k->text) + 1;
+    v->layout = NULL;
+    if (k->layout) {
+        v->imgs = NULL;
+        v->movable = false;
+        v->valid = layout_event(params->render_priv, params->event);
+        if (!v->valid)
+            return size;
+        v->layout = save_layout(params->render_priv);
+        discard_layout(params->render_priv);
+        v->valid = v->layout;
+        if (v->layout)
+            size += sizeof(EventLayout) +
+                v->layout->n_glyphs * sizeof(GlyphInfo) +
+                v->layout->text_info.n_lines * sizeof(LineInfo);
+        return size;
+    }
 
-    check_cache_limits(render_priv, &render_priv->cache);
+    EventImages ei;
+    v->movable = params->motion;
+    if (v->movable)
+        v->origin = params->motion->pos;
+    v->valid = render_event(params->render_priv, params->event, &ei,
+                            v->movable ? &v->clip : NULL);
+    if (!v->valid) {
+        v->imgs = NULL;
+        return size;
+    }
+
+    v->imgs = ei.imgs;
+    v->top = ei.top;
+    v->height = ei.height;
+    v->left = ei.left;
+    v->width = ei.width;
+    v->detect_collisions = ei.detect_collisions;
+    v->shift_direction = ei.shift_direction;
+    ass_frame_ref(v->imgs);
+    for (ASS_Image *img = v->imgs; img; img = img->next)
+        size += sizeof(ASS_ImagePriv) + (size_t) img->h * img->stride;
+    return size;
+}
 
+// crop an image to a rectangle, false if nothing is left
+static bool crop_image(ASS_Image *img, const ASS_Rect *clip)
+{
+    int x0 = FFMAX(img->dst_x, clip->x_min);
+    int y0 = FFMAX(img->dst_y, clip->y_min);
+    int x1 = FFMIN(img->dst_x + img->w, clip->x_max);
+    int y1 = FFMIN(img->dst_y + img->h, clip->y_max);
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+    img->bitmap += (ptrdiff_t) (y0 - img->dst_y) * img->stride +
+        (x0 - img->dst_x);
+    img->w = x1 - x0;
+    img->h = y1 - y0;
+    img->dst_x = x0;
+    img->dst_y = y0;
     return true;
 }
 
-static int cmp_event_layer(const void *p1, const void *p2)
+/**
+ * \brief Copy a cached event image list
+ * The copies reference the cache item, which keeps the bitmaps alive.
+ * Images of moving events get shifted and cropped to the frame.
+ */
+static ASS_Image *copy_event_images(ImagePool *pool, EventHashValue *val,
+                                    ASS_Vector shift)
 {
-    ASS_Event *e1 = ((EventImages *) p1)->event;
-    ASS_Event *e2 = ((EventImages *) p2)->event;
-    if (e1->Layer < e2->Layer)
+    ASS_Image *head = NULL;
+    ASS_Image **tail = &head;
+    for (ASS_Image *cur = val->imgs; cur; cur = cur->next) {
+        ASS_Image result = *cur;
+        if (val->movable) {
+            result.dst_x += shift.x;
+            result.dst_y += shift.y;
+            if (!crop_image(&result, &val->clip))
+                continue;
+        }
+        ASS_ImagePriv *img = image_pool_get(pool);
+        if (!img)
+            break;
+        img->result = result;
+        img->source = val;
+        ass_cache_inc_ref(val);
+        img->buffer = NULL;
+        img->ref_count = 0;
+        *tail = &img->result;
+        tail = &img->result.next;
+    }
+    *tail = NULL;
+    return head;
+}
+
+/**
+ * \brief Render an event, reusing the images of static events
+ * With the motion cache enabled, events that only move along a straight
+ * line are rendered once for all events that differ only in position,
+ * and the images are shifted by whole pixels. Otherwise only their text
+ * layout is shared, and gets placed at the exact position every frame.
+ * The same goes for karaoke, whose sweep is set on the shared layout.
+ */
+static bool
+render_event_cached(ASS_Renderer *render_priv, ASS_Event *event,
+                    EventImages *event_images)
+{
+    ASS_RenderPriv *priv = event->render_priv;
+    if (!priv || priv->render_id != render_priv->render_id || !event->Text ||
+            event->Style >= render_priv->track->n_styles)
+        return render_event(render_priv, event, event_images, NULL);
+
+    EventHashKey key = {
+        .style = event->Style,
+        .styles_hash = render_priv->styles_hash,
+        .text = event->Text,
+    };
+    EventMotion motion;
+    EventConstructParams params = { render_priv, event, NULL };
+    if (ass_event_is_static(render_priv, event)) {
+        key.render_priv = priv;
+        key.cache_id = priv->cache_id;
+    } else if (ass_event_motion(render_priv, event, &motion)) {
+        key.motion = motion.type;
+        // karaoke sweeps recolor the images, so they can't be shared
+        key.layout = !render_priv->settings.motion_cache || motion.karaoke;
+        key.margin_l = event->MarginL;
+        key.margin_r = event->MarginR;
+        key.margin_v = event->MarginV;
+        params.motion = &motion;
+        if (motion.args_end > motion.args_start) {
+            // leave out the \move arguments, the copy lives until the frame ends
+            size_t len = strlen(event->Text);
+            char *text = ass_arena_alloc(&render_priv->arena,
+                len - (motion.args_end - motion.args_start) + 1, 1);
+            if (!text)
+                return render_event(render_priv, event, event_images, NULL);
+            memcpy(text, event->Text, motion.args_start);
+            memcpy(text + motion.args_start, event->Text + motion.args_end,
+                   len - motion.args_end + 1);
+            key.text = text;
+        }
+    } else
+        return render_event(render_priv, event, event_images, NULL);
+
+    EventHashValue *val;
+    if (render_priv->degrade && !key.layout) {
+        // images that may be degraded mustn't be kept for later frames
+        val = ass_cache_find(render_priv->cache.event_cache, &key);
+        if (!val)
+            return render_event(render_priv, event, event_images, NULL);
+    } else
+        val = ass_cache_get(render_priv->cache.event_cache, &key, &params);
+    if (!val)
+        return false;
+    if (key.layout) {
+        bool valid = val->valid && restore_layout(render_priv, event, val->layout);
+        ass_cache_dec_ref(val);
+        if (!valid)
+            return false;
+        // the only things that change over time
+        if (motion.type == MOTION_MOVE) {
+            render_priv->state.pos_x = motion.pos.x;
+            render_priv->state.pos_y = motion.pos.y;
+        } else
+            apply_transition_effects(render_priv, event);
+        return render_layout(render_priv, event, event_images, NULL);
+    }
+    bool valid = val->valid;
+    if (valid) {
+        ASS_Vector shift = { 0, 0 };
+        if (val->movable) {
+            shift.x = lrint((x2scr_pos(render_priv, motion.pos.x) -
+                             x2scr_pos(render_priv, val->origin.x)) *
+                            render_priv->font_scale_x);
+            shift.y = lrint(y2scr_pos(render_priv, motion.pos.y) -
+                            y2scr_pos(render_priv, val->origin.y));
+        }
+        event_images->imgs =
+            copy_event_images(render_priv->image_pool, val, shift);
+        event_images->top = val->top + shift.y;
+        event_images->height = val->height;
+        event_images->left = val->left + shift.x;
+        event_images->width = val->width;
+        event_images->detect_collisions = val->detect_collisions;
+        event_images->shift_direction = val->shift_direction;
+        event_images->event = event;
+    }
+    ass_cache_dec_ref(val);
+    return valid;
+}
+
+/**
+ * \brief Render an event, at reduced quality if the frame
+ * is running out of its budget
+ */
+static bool
+ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
+                 EventImages *event_images)
+{
+    render_priv->degrade = render_priv->degrade_after &&
+        ass_time_ns() > render_priv->degrade_after;
+    render_priv->degraded = false;
+    bool ok = render_event_cached(render_priv, event, event_images);
+    event_images->degraded = render_priv->degraded;
+    return ok;
+}
+
+/**
+ * \brief Shrink composites and the shadows placed from them
+ * to composite_max_size together, each in proportion to its size
+ */
+static void cut_composite_caches(CacheStore *cache)
+{
+    ASS_CacheStats composites, shadows;
+    ass_cache_stats(cache->composite_cache, &composites);
+    ass_cache_stats(cache->shadow_cache, &shadows);
+    uint64_t total = composites.size + shadows.size;
+    if (total <= cache->composite_max_size)
+        return;
+
+    double scale = (double) cache->composite_max_size / total;
+    ass_cache_cut(cache->shadow_cache, shadows.size * scale);
+    ass_cache_cut(cache->composite_cache, composites.size * scale);
+}
+
+/**
+ * \brief Check cache limits and reset cache if they are exceeded
+ */
+static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
+{
+    size_t budget = ass_cache_budget_limit(cache->budget);
+    if (budget) {
+        ass_cache_budget_trim(cache->budget, budget);
+        if (priv->shared_cache) {
+            ass_cache_cut(cache->outline_cache, priv->shared_cache->glyph_max);
+            ass_cache_cut(cache->tags_cache, priv->shared_cache->glyph_max);
+        }
+        ass_shaper_cut_cache(priv->shaper, cache->glyph_max);
+        return;
+    }
+
+    ass_cache_cut(cache->event_cache, cache->composite_max_size);
+    cut_composite_caches(cache);
+    ass_cache_cut(cache->bitmap_cache, cache->bitmap_max_size);
+    size_t glyph_max = priv->shared_cache ?
+        priv->shared_cache->glyph_max : cache->glyph_max;
+    ass_cache_cut(cache->outline_cache, glyph_max);
+    ass_cache_cut(cache->tags_cache, glyph_max);
+    ass_shaper_cut_cache(priv->shaper, cache->glyph_max);
+}
+
+/**
+ * \brief Prepare the renderer for rendering events of a track
+ */
+static bool
+ass_setup_render(ASS_Renderer *render_priv, ASS_Track *track,
+                 long long now)
+{
+    ASS_Settings *settings_priv = &render_priv->settings;
+
+    if (!render_priv->settings.frame_width
+        && !render_priv->settings.frame_height)
+        return false;               // library not initialized
+
+    if (render_priv->library != track->library)
+        return false;
+
+    if (track->n_events == 0)
+        return false;               // nothing to do
+
+    // without memory fonts to go on, wait for the fonts being loaded
+    ass_renderer_update_fonts(render_priv, !render_priv->fontselect);
+    if (!ass_renderer_fontselect(render_priv))
+        return false;
+
+    render_priv->track = track;
+    render_priv->time = now;
+
+    ass_lazy_track_init(render_priv->library, render_priv->track);
+
+    ass_shaper_set_kerning(render_priv->shaper, track->Kerning);
+    ass_shaper_set_language(render_priv->shaper, track->Language);
+    ass_shaper_set_level(render_priv->shaper, render_priv->settings.shaper);
+
+    // PAR correction
+    double par = render_priv->settings.par;
+    if (par == 0.) {
+        if (render_priv->orig_width && render_priv->orig_height &&
+            settings_priv->storage_width && settings_priv->storage_height) {
+            double dar = ((double) render_priv->orig_width) /
+                         render_priv->orig_height;
+            double sar = ((double) settings_priv->storage_width) /
+                         settings_priv->storage_height;
+            par = dar / sar;
+        } else
+            par = 1.0;
+    }
+    render_priv->font_scale_x = par;
+
+    check_cache_limits(render_priv, &render_priv->cache);
+
+    return true;
+}
+
+/**
+ * \brief Start a new frame
+ */
+static bool
+ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
+                long long now)
+{
+    if (!ass_setup_render(render_priv, track, now))
+        return false;
+    ass_prune_events(track, now);
+
+    render_priv->prev_images_root = render_priv->images_root;
+    render_priv->images_root = NULL;
+    ass_arena_reset(&render_priv->arena);
+    return true;
+}
+
+static int cmp_event_layer(const void *p1, const void *p2)
+{
+    ASS_Event *e1 = ((EventImages *) p1)->event;
+    ASS_Event *e2 = ((EventImages *) p2)->event;
+    if (e1->Layer < e2->Layer)
         return -1;
     if (e1->Layer > e2->Layer)
         return 1;
@@ -2891,6 +4280,7 @@ static ASS_RenderPriv *get_render_priv(ASS_Renderer *render_priv,
     if (render_priv->render_id != event->render_priv->render_id) {
         memset(event->render_priv, 0, sizeof(ASS_RenderPriv));
         event->render_priv->render_id = render_priv->render_id;
+        event->render_priv->cache_id = ++render_priv->event_cache_id;
     }
 
     return event->render_priv;
@@ -2904,9 +4294,55 @@ static int overlap(Segment *s1, Segment *s2)
     return 1;
 }
 
-static int cmp_segment(const void *p1, const void *p2)
+/*
+ * Placed segments of a layer, sorted by top and in placement order among
+ * equal tops. A segment can only reach down to its top plus the tallest
+ * height, so searches look at a window of the array found by bisection
+ * instead of at every segment.
+ */
+typedef struct {
+    Segment *seg;
+    int n;
+    int max_height;
+} SegmentSet;
+
+// first segment with a top greater than y
+static int segment_upper_bound(const SegmentSet *set, int y)
 {
-    return ((Segment *) p1)->a - ((Segment *) p2)->a;
+    int lo = 0, hi = set->n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (set->seg[mid].a <= y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// first segment with a top greater than or equal to y
+static int segment_lower_bound(const SegmentSet *set, int y)
+{
+    return segment_upper_bound(set, y - 1);
+}
+
+static bool segment_set_overlaps(const SegmentSet *set, Segment *s)
+{
+    int end = segment_lower_bound(set, s->b);
+    for (int i = segment_upper_bound(set, s->a - set->max_height); i < end; i++)
+        if (overlap(s, set->seg + i))
+            return true;
+    return false;
+}
+
+static void segment_set_add(SegmentSet *set, const Segment *s)
+{
+    int pos = segment_upper_bound(set, s->a);
+    memmove(set->seg + pos + 1, set->seg + pos,
+            (set->n - pos) * sizeof(Segment));
+    set->seg[pos] = *s;
+    set->n++;
+    set->max_height = FFMAX(set->max_height, s->b - s->a);
 }
 
 static void
@@ -2937,46 +4373,61 @@ shift_event(ASS_Renderer *render_priv, EventImages *ei, int shift)
 
 // dir: 1 - move down
 //      -1 - move up
-static int fit_segment(Segment *s, Segment *fixed, int *cnt, int dir)
+static int fit_segment(Segment *s, SegmentSet *fixed, int dir)
 {
-    int i;
     int shift = 0;
 
-    if (dir == 1)               // move down
-        for (i = 0; i < *cnt; ++i) {
-            if (s->b + shift <= fixed[i].a || s->a + shift >= fixed[i].b ||
-                s->hb <= fixed[i].ha || s->ha >= fixed[i].hb)
+    // shift only grows while moving down and shrinks while moving up,
+    // segments outside of the window never overlap
+    if (dir == 1) {             // move down
+        for (int i = segment_upper_bound(fixed, s->a - fixed->max_height);
+                i < fixed->n; i++) {
+            Segment *f = fixed->seg + i;
+            if (f->a >= s->b + shift)
+                break;
+            if (s->a + shift >= f->b || s->hb <= f->ha || s->ha >= f->hb)
                 continue;
-            shift = fixed[i].b - s->a;
-    } else                      // dir == -1, move up
-        for (i = *cnt - 1; i >= 0; --i) {
-            if (s->b + shift <= fixed[i].a || s->a + shift >= fixed[i].b ||
-                s->hb <= fixed[i].ha || s->ha >= fixed[i].hb)
+            shift = f->b - s->a;
+        }
+    } else {                    // dir == -1, move up
+        for (int i = segment_lower_bound(fixed, s->b) - 1; i >= 0; i--) {
+            Segment *f = fixed->seg + i;
+            if (f->a + fixed->max_height <= s->a + shift)
+                break;
+            if (s->b + shift <= f->a || s->a + shift >= f->b ||
+                s->hb <= f->ha || s->ha >= f->hb)
                 continue;
-            shift = fixed[i].a - s->b;
+            shift = f->a - s->b;
         }
+    }
 
-    fixed[*cnt].a = s->a + shift;
-    fixed[*cnt].b = s->b + shift;
-    fixed[*cnt].ha = s->ha;
-    fixed[*cnt].hb = s->hb;
-    (*cnt)++;
-    qsort(fixed, *cnt, sizeof(Segment), cmp_segment);
-
+    Segment placed = {
+        .a = s->a + shift, .b = s->b + shift,
+        .ha = s->ha, .hb = s->hb,
+    };
+    segment_set_add(fixed, &placed);
     return shift;
 }
 
-static void
+/**
+ * \brief Place the events of a layer so that they don't overlap
+ * \return true if all of them were fixed already and stayed where they were
+ */
+static bool
 fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
 {
-    Segment *used = ass_realloc_array(NULL, cnt, sizeof(*used));
-    int cnt_used = 0;
-    int i, j;
+    ArenaMark mark = ass_arena_mark(&render_priv->arena);
+    SegmentSet used = {
+        .seg = ass_arena_alloc(&render_priv->arena,
+                               cnt * sizeof(Segment), sizeof(int)),
+    };
+    bool kept = true;
+    int i;
 
-    if (!used)
-        return;
+    if (!used.seg)
+        return false;
 
-    // fill used[] with fixed events
+    // fill used with fixed events
     for (i = 0; i < cnt; ++i) {
         ASS_RenderPriv *priv;
         if (!imgs[i].detect_collisions)
@@ -2988,32 +4439,23 @@ fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
             s.b = priv->top + priv->height;
             s.ha = priv->left;
             s.hb = priv->left + priv->width;
-            if (priv->height != imgs[i].height) {       // no, it's not
-                ass_msg(render_priv->library, MSGL_WARN,
-                        "Event height has changed");
+            if (priv->height != imgs[i].height ||   // no, it's not
+                    segment_set_overlaps(&used, &s)) {
+                if (priv->height != imgs[i].height)
+                    ass_msg(render_priv->library, MSGL_WARN,
+                            "Event height has changed");
                 priv->top = 0;
                 priv->height = 0;
                 priv->left = 0;
                 priv->width = 0;
+                kept = false;
             }
-            for (j = 0; j < cnt_used; ++j)
-                if (overlap(&s, used + j)) {    // no, it's not
-                    priv->top = 0;
-                    priv->height = 0;
-                    priv->left = 0;
-                    priv->width = 0;
-                }
             if (priv->height > 0) {     // still a fixed event
-                used[cnt_used].a = priv->top;
-                used[cnt_used].b = priv->top + priv->height;
-                used[cnt_used].ha = priv->left;
-                used[cnt_used].hb = priv->left + priv->width;
-                cnt_used++;
+                segment_set_add(&used, &s);
                 shift_event(render_priv, imgs + i, priv->top - imgs[i].top);
             }
         }
     }
-    qsort(used, cnt_used, sizeof(Segment), cmp_segment);
 
     // try to fit other events in free spaces
     for (i = 0; i < cnt; ++i) {
@@ -3028,7 +4470,7 @@ fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
             s.b = imgs[i].top + imgs[i].height;
             s.ha = imgs[i].left;
             s.hb = imgs[i].left + imgs[i].width;
-            shift = fit_segment(&s, used, &cnt_used, imgs[i].shift_direction);
+            shift = fit_segment(&s, &used, imgs[i].shift_direction);
             if (shift)
                 shift_event(render_priv, imgs + i, shift);
             // make it fixed
@@ -3036,11 +4478,86 @@ fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
             priv->height = imgs[i].height;
             priv->left = imgs[i].left;
             priv->width = imgs[i].width;
+            kept = false;
         }
 
     }
 
-    free(used);
+    ass_arena_release(&render_priv->arena, mark);
+    return kept;
+}
+
+/**
+ * \brief Reuse the collision layout of the previous frame
+ * If the same events detect collisions as when fix_collisions() last kept
+ * every one of them, in the same order and still fixed at the same places,
+ * it would keep them all again. Only their shifts are applied then.
+ * \return true if the layout was reused
+ */
+static bool reuse_placement(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
+{
+    if (!render_priv->placed_valid)
+        return false;
+
+    int n = 0;
+    for (int i = 0; i < cnt; i++) {
+        if (!imgs[i].detect_collisions)
+            continue;
+        ASS_RenderPriv *priv = get_render_priv(render_priv, imgs[i].event);
+        if (!priv || n == render_priv->n_placed)
+            return false;
+        PlacedEvent *p = render_priv->placed + n++;
+        if (p->cache_id != priv->cache_id ||
+                p->layer != imgs[i].event->Layer ||
+                p->top != priv->top || p->height != priv->height ||
+                p->left != priv->left || p->width != priv->width ||
+                priv->height != imgs[i].height)
+            return false;
+    }
+    if (n != render_priv->n_placed)
+        return false;
+
+    for (int i = 0; i < cnt; i++) {
+        if (!imgs[i].detect_collisions)
+            continue;
+        ASS_RenderPriv *priv = imgs[i].event->render_priv;
+        shift_event(render_priv, imgs + i, priv->top - imgs[i].top);
+    }
+    return true;
+}
+
+/**
+ * \brief Remember the collision layout for reuse_placement()
+ * \param kept whether fix_collisions() kept it for every layer
+ */
+static void save_placement(ASS_Renderer *render_priv, EventImages *imgs,
+                           int cnt, bool kept)
+{
+    render_priv->placed_valid = false;
+    if (!kept)
+        return;
+    if (cnt > render_priv->max_placed) {
+        if (!ASS_REALLOC_ARRAY(render_priv->placed, cnt))
+            return;
+        render_priv->max_placed = cnt;
+    }
+
+    int n = 0;
+    for (int i = 0; i < cnt; i++) {
+        if (!imgs[i].detect_collisions)
+            continue;
+        ASS_RenderPriv *priv = get_render_priv(render_priv, imgs[i].event);
+        if (!priv)
+            return;
+        render_priv->placed[n++] = (PlacedEvent) {
+            .cache_id = priv->cache_id,
+            .layer = imgs[i].event->Layer,
+            .top = priv->top, .height = priv->height,
+            .left = priv->left, .width = priv->width,
+        };
+    }
+    render_priv->n_placed = n;
+    render_priv->placed_valid = true;
 }
 
 /**
@@ -3105,6 +4622,692 @@ static int ass_detect_change(ASS_Renderer *priv)
     return diff;
 }
 
+static inline bool rects_touch(const ASS_DirtyRect *a, const ASS_DirtyRect *b)
+{
+    return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+           a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+static inline void rect_union(ASS_DirtyRect *a, const ASS_DirtyRect *b)
+{
+    int x1 = FFMAX(a->x + a->w, b->x + b->w);
+    int y1 = FFMAX(a->y + a->h, b->y + b->h);
+    a->x = FFMIN(a->x, b->x);
+    a->y = FFMIN(a->y, b->y);
+    a->w = x1 - a->x;
+    a->h = y1 - a->y;
+}
+
+/**
+ * \brief Add a rectangle to the dirty list
+ * Rectangles that touch are merged. Once the list is full, the new one is
+ * merged with the rectangle whose area grows the least.
+ */
+static void add_dirty_rect(ASS_Renderer *priv, ASS_DirtyRect r)
+{
+    r.w = FFMIN(r.x + r.w, priv->width) - FFMAX(r.x, 0);
+    r.h = FFMIN(r.y + r.h, priv->height) - FFMAX(r.y, 0);
+    r.x = FFMAX(r.x, 0);
+    r.y = FFMAX(r.y, 0);
+    if (r.w <= 0 || r.h <= 0)
+        return;
+
+    ASS_DirtyRect *rects = priv->dirty_rects;
+    int i = 0;
+    while (i < priv->n_dirty_rects) {
+        if (!rects_touch(&rects[i], &r)) {
+            i++;
+            continue;
+        }
+        // the grown rectangle can touch ones checked before
+        rect_union(&r, &rects[i]);
+        rects[i] = rects[--priv->n_dirty_rects];
+        i = 0;
+    }
+    while (priv->n_dirty_rects == MAX_DIRTY_RECTS) {
+        int best = 0;
+        int64_t best_growth = INT64_MAX;
+        for (i = 0; i < MAX_DIRTY_RECTS; i++) {
+            ASS_DirtyRect u = rects[i];
+            rect_union(&u, &r);
+            int64_t growth = (int64_t) u.w * u.h - (int64_t) rects[i].w * rects[i].h;
+            if (growth < best_growth) {
+                best_growth = growth;
+                best = i;
+            }
+        }
+        rect_union(&r, &rects[best]);
+        rects[best] = rects[--priv->n_dirty_rects];
+        // merge whatever the result touches now
+        for (i = 0; i < priv->n_dirty_rects; i++) {
+            if (!rects_touch(&rects[i], &r))
+                continue;
+            rect_union(&r, &rects[i]);
+            rects[i] = rects[--priv->n_dirty_rects];
+            i = -1;
+        }
+    }
+    rects[priv->n_dirty_rects++] = r;
+}
+
+static inline void add_image_rect(ASS_Renderer *priv, ASS_Image *img)
+{
+    ASS_DirtyRect r = { img->dst_x, img->dst_y, img->w, img->h };
+    add_dirty_rect(priv, r);
+}
+
+static inline uint32_t image_hash(ASS_Image *img)
+{
+    uint32_t hval = FNV1_32A_INIT;
+    hval = fnv_32a_buf(&img->bitmap, sizeof(img->bitmap), hval);
+    hval = fnv_32a_buf(&img->color, sizeof(img->color), hval);
+    hval = fnv_32a_buf(&img->dst_x, sizeof(img->dst_x), hval);
+    hval = fnv_32a_buf(&img->dst_y, sizeof(img->dst_y), hval);
+    return hval;
+}
+
+/**
+ * \brief Find the changed parts of the frame
+ * Images of both lists are matched through a hash table, the unmatched
+ * ones are dirty. Reordering of overlapping images is not detected.
+ */
+static void find_dirty_rects(ASS_Renderer *priv)
+{
+    priv->n_dirty_rects = 0;
+
+    size_t n = 0;
+    for (ASS_Image *img = priv->images_root; img; img = img->next)
+        n++;
+    size_t size = 16;
+    while (size < 2 * n)
+        size *= 2;
+    if (size > priv->image_table_size) {
+        free(priv->image_table);
+        priv->image_table = malloc(size * sizeof(ImageSlot));
+        if (!priv->image_table) {
+            priv->image_table_size = 0;
+            ASS_DirtyRect all = { 0, 0, priv->width, priv->height };
+            add_dirty_rect(priv, all);
+            return;
+        }
+        priv->image_table_size = size;
+    }
+    ImageSlot *table = priv->image_table;
+    size_t mask = size - 1;
+    memset(table, 0, size * sizeof(ImageSlot));
+
+    for (ASS_Image *img = priv->images_root; img; img = img->next) {
+        size_t pos = image_hash(img) & mask;
+        while (table[pos].img)
+            pos = (pos + 1) & mask;
+        table[pos].img = img;
+    }
+
+    for (ASS_Image *img = priv->prev_images_root; img; img = img->next) {
+        size_t pos = image_hash(img) & mask;
+        for (; table[pos].img; pos = (pos + 1) & mask)
+            if (!table[pos].matched && !ass_image_compare(img, table[pos].img))
+                break;
+        if (table[pos].img)
+            table[pos].matched = true;
+        else
+            add_image_rect(priv, img);
+    }
+
+    for (size_t i = 0; i < size; i++)
+        if (table[i].img && !table[i].matched)
+            add_image_rect(priv, table[i].img);
+}
+
+int ass_get_dirty_rects(ASS_Renderer *priv, const ASS_DirtyRect **rects)
+{
+    *rects = priv->dirty_rects;
+    return priv->n_dirty_rects;
+}
+
+#ifdef CONFIG_PTHREAD
+/**
+ * \brief Render queued events until none are left
+ * Called with threads->lock held.
+ */
+static void run_render_jobs(RenderThreads *threads, ASS_Renderer *render_priv)
+{
+    while (threads->job_next < threads->job_count) {
+        int i = threads->job_next++;
+        pthread_mutex_unlock(&threads->lock);
+
+        ASS_Event *event = render_priv->track->events + threads->events[i];
+        if (threads->at_start)
+            render_priv->time = event->Start;
+        ass_render_event(render_priv, event, threads->owner->eimg + i);
+
+        pthread_mutex_lock(&threads->lock);
+        if (++threads->job_done == threads->job_count)
+            pthread_cond_broadcast(&threads->done_cond);
+    }
+}
+
+/**
+ * \brief Fill one piece of the first pending fill task
+ * Called with threads->lock held.
+ * \return false if there was nothing to do
+ */
+static bool run_fill_piece(RenderThreads *threads, ASS_Renderer *render_priv)
+{
+    FillTask *task = threads->fill_tasks;
+    if (!task)
+        return false;
+    size_t i = task->next_piece++;
+    if (task->next_piece == task->pieces.n_pieces)
+        threads->fill_tasks = task->next;
+    pthread_mutex_unlock(&threads->lock);
+
+    bool ok = rasterizer_fill_piece(task->engine, &render_priv->rasterizer,
+                                    &task->pieces, i, task->stride);
+
+    pthread_mutex_lock(&threads->lock);
+    if (!ok)
+        task->failed = true;
+    if (++task->n_done == task->pieces.n_pieces)
+        pthread_cond_broadcast(&threads->done_cond);
+    return true;
+}
+
+static void *render_worker(void *arg)
+{
+    RenderWorker *worker = arg;
+    RenderThreads *threads = worker->threads;
+    unsigned job_id = 0;
+
+    pthread_mutex_lock(&threads->lock);
+    while (true) {
+        while (!threads->quit && threads->job_id == job_id && !threads->fill_tasks)
+            pthread_cond_wait(&threads->job_cond, &threads->lock);
+        if (threads->quit)
+            break;
+        if (threads->job_id != job_id) {
+            job_id = threads->job_id;
+            run_render_jobs(threads, worker->render_priv);
+        }
+        run_fill_piece(threads, worker->render_priv);
+    }
+    pthread_mutex_unlock(&threads->lock);
+    return NULL;
+}
+
+/**
+ * \brief Update a worker's copy of the renderer for a new frame
+ * Everything but the per-event state is shared with the owner.
+ */
+static void sync_render_worker(ASS_Renderer *worker, ASS_Renderer *owner)
+{
+    RenderContext state = worker->state;
+    TextInfo text_info = worker->text_info;
+    RasterizerData rasterizer = worker->rasterizer;
+    Arena arena = worker->arena;
+
+    *worker = *owner;
+    worker->state = state;
+    worker->text_info = text_info;
+    worker->rasterizer = rasterizer;
+    worker->arena = arena;
+    ass_arena_reset(&worker->arena);
+    memset(worker->stats, 0, sizeof(worker->stats));
+}
+
+/**
+ * \brief Render events in parallel
+ * Output slots of events that failed to render have their event set to NULL.
+ */
+static void render_events_parallel(ASS_Renderer *priv,
+                                   const int *events, int count,
+                                   bool at_start)
+{
+    RenderThreads *threads = priv->threads;
+    for (int i = 0; i < threads->n_workers; i++)
+        sync_render_worker(threads->workers[i].render_priv, priv);
+    for (int i = 0; i < count; i++)
+        priv->eimg[i].event = NULL;
+
+    pthread_mutex_lock(&threads->lock);
+    threads->events = events;
+    threads->at_start = at_start;
+    threads->job_next = threads->job_done = 0;
+    threads->job_count = count;
+    threads->job_id++;
+    pthread_cond_broadcast(&threads->job_cond);
+
+    run_render_jobs(threads, priv);
+    while (threads->job_done < threads->job_count)
+        if (!run_fill_piece(threads, priv))
+            pthread_cond_wait(&threads->done_cond, &threads->lock);
+    pthread_mutex_unlock(&threads->lock);
+
+    for (int i = 0; i < threads->n_workers; i++) {
+        ASS_Renderer *worker = threads->workers[i].render_priv;
+        for (int j = 0; j < RENDER_STAT_COUNT; j++)
+            priv->stats[j] += worker->stats[j];
+    }
+}
+
+/**
+ * \brief Split a fill between this thread and the idle ones
+ * \return false if the window is too small to bother, true otherwise
+ * with the fill result in *result
+ */
+static bool rasterize_parallel(ASS_Renderer *render_priv, bool *result,
+                               uint8_t *buf, uint8_t *buf2, int x0, int y0,
+                               int width, int height, ptrdiff_t stride)
+{
+    RenderThreads *threads = render_priv->threads;
+    int64_t area = (int64_t) width * height;
+    if (!threads || area < PARALLEL_FILL_AREA)
+        return false;
+
+    FillTask task = {0};
+    task.engine = render_priv->engine;
+    task.stride = stride;
+    task.pieces.max_area = FFMAX(area / (4 * (threads->n_workers + 1)), FILL_PIECE_AREA);
+    *result = rasterizer_fill_split(task.engine, &render_priv->rasterizer,
+                                    buf, buf2, x0, y0, width, height, stride,
+                                    &task.pieces);
+    if (*result && task.pieces.n_pieces) {
+        pthread_mutex_lock(&threads->lock);
+        task.next = threads->fill_tasks;
+        threads->fill_tasks = &task;
+        pthread_cond_broadcast(&threads->job_cond);
+        pthread_cond_broadcast(&threads->done_cond);
+        while (task.n_done < task.pieces.n_pieces)
+            if (!run_fill_piece(threads, render_priv))
+                pthread_cond_wait(&threads->done_cond, &threads->lock);
+        *result = !task.failed;
+        pthread_mutex_unlock(&threads->lock);
+    }
+    rasterizer_pieces_free(&task.pieces);
+    return true;
+}
+
+static void free_worker_renderer(ASS_Renderer *render_priv)
+{
+    if (!render_priv)
+        return;
+    rasterizer_done(&render_priv->rasterizer);
+    ass_arena_done(&render_priv->arena);
+    text_info_done(&render_priv->text_info);
+    free(render_priv);
+}
+
+RenderThreads *ass_render_threads_create(ASS_Renderer *priv, int n_workers)
+{
+    RenderThreads *threads = calloc(1, sizeof(*threads));
+    if (!threads)
+        return NULL;
+    threads->owner = priv;
+    threads->workers = calloc(n_workers, sizeof(RenderWorker));
+    if (!threads->workers) {
+        free(threads);
+        return NULL;
+    }
+    pthread_mutex_init(&threads->layout_lock, NULL);
+    pthread_mutex_init(&threads->lock, NULL);
+    pthread_cond_init(&threads->job_cond, NULL);
+    pthread_cond_init(&threads->done_cond, NULL);
+
+    for (int i = 0; i < n_workers; i++) {
+        RenderWorker *worker = threads->workers + i;
+        worker->threads = threads;
+        worker->render_priv = calloc(1, sizeof(ASS_Renderer));
+        if (!worker->render_priv ||
+                !text_info_init(&worker->render_priv->text_info) ||
+                !rasterizer_init(&worker->render_priv->rasterizer,
+                                 priv->engine->tile_order,
+                                 RASTERIZER_PRECISION) ||
+                pthread_create(&worker->thread, NULL, render_worker, worker)) {
+            free_worker_renderer(worker->render_priv);
+            break;
+        }
+        threads->n_workers++;
+    }
+    if (!threads->n_workers) {
+        ass_render_threads_free(threads);
+        return NULL;
+    }
+    if (threads->n_workers < n_workers)
+        ass_msg(priv->library, MSGL_WARN,
+                "Started only %d of %d render threads",
+                threads->n_workers, n_workers);
+    return threads;
+}
+
+void ass_render_threads_free(RenderThreads *threads)
+{
+    if (!threads)
+        return;
+
+    pthread_mutex_lock(&threads->lock);
+    threads->quit = true;
+    pthread_cond_broadcast(&threads->job_cond);
+    pthread_mutex_unlock(&threads->lock);
+
+    for (int i = 0; i < threads->n_workers; i++) {
+        pthread_join(threads->workers[i].thread, NULL);
+        free_worker_renderer(threads->workers[i].render_priv);
+    }
+
+    pthread_cond_destroy(&threads->done_cond);
+    pthread_cond_destroy(&threads->job_cond);
+    pthread_mutex_destroy(&threads->lock);
+    pthread_mutex_destroy(&threads->layout_lock);
+    free(threads->workers);
+    free(threads);
+}
+#else
+RenderThreads *ass_render_threads_create(ASS_Renderer *priv, int n_workers)
+{
+    ass_msg(priv->library, MSGL_WARN,
+            "libass was built without thread support");
+    return NULL;
+}
+
+void ass_render_threads_free(RenderThreads *threads)
+{
+}
+
+static bool rasterize_parallel(ASS_Renderer *render_priv, bool *result,
+                               uint8_t *buf, uint8_t *buf2, int x0, int y0,
+                               int width, int height, ptrdiff_t stride)
+{
+    return false;
+}
+#endif
+
+bool ass_rasterize(ASS_Renderer *render_priv, uint8_t *buf, uint8_t *buf2,
+                   int x0, int y0, int width, int height, ptrdiff_t stride)
+{
+    bool result;
+    if (rasterize_parallel(render_priv, &result, buf, buf2,
+                           x0, y0, width, height, stride))
+        return result;
+    if (buf2)
+        return rasterizer_fill2(render_priv->engine, &render_priv->rasterizer,
+                                buf, buf2, x0, y0, width, height, stride);
+    return rasterizer_fill(render_priv->engine, &render_priv->rasterizer,
+                           buf, x0, y0, width, height, stride);
+}
+
+static bool same_string(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+static bool same_settings(const ASS_Settings *a, const ASS_Settings *b)
+{
+    return a->frame_width == b->frame_width &&
+           a->frame_height == b->frame_height &&
+           a->storage_width == b->storage_width &&
+           a->storage_height == b->storage_height &&
+           a->font_size_coeff == b->font_size_coeff &&
+           a->line_spacing == b->line_spacing &&
+           a->line_position == b->line_position &&
+           a->top_margin == b->top_margin && a->bottom_margin == b->bottom_margin &&
+           a->left_margin == b->left_margin && a->right_margin == b->right_margin &&
+           a->use_margins == b->use_margins && a->par == b->par &&
+           a->hinting == b->hinting && a->shaper == b->shaper &&
+           a->blur_quality == b->blur_quality &&
+           a->angle_step == b->angle_step &&
+           a->motion_cache == b->motion_cache &&
+           a->selective_style_overrides == b->selective_style_overrides &&
+           same_string(a->default_font, b->default_font) &&
+           same_string(a->default_family, b->default_family);
+}
+
+static bool same_header(const ASS_Track *a, const ASS_Track *b)
+{
+    return a->track_type == b->track_type &&
+           a->PlayResX == b->PlayResX && a->PlayResY == b->PlayResY &&
+           a->Timer == b->Timer && a->WrapStyle == b->WrapStyle &&
+           a->ScaledBorderAndShadow == b->ScaledBorderAndShadow &&
+           a->Kerning == b->Kerning && a->YCbCrMatrix == b->YCbCrMatrix &&
+           same_string(a->Language, b->Language) &&
+           a->default_style == b->default_style;
+}
+
+static bool same_event(const ASS_Event *a, const ASS_Event *b)
+{
+    return a->Start == b->Start && a->Duration == b->Duration &&
+           a->ReadOrder == b->ReadOrder && a->Layer == b->Layer &&
+           a->Style == b->Style && a->MarginL == b->MarginL &&
+           a->MarginR == b->MarginR && a->MarginV == b->MarginV &&
+           same_string(a->Name, b->Name) && same_string(a->Effect, b->Effect) &&
+           same_string(a->Text, b->Text);
+}
+
+static bool same_style(const ASS_Style *a, const ASS_Style *b)
+{
+    return a->FontSize == b->FontSize &&
+           a->PrimaryColour == b->PrimaryColour &&
+           a->SecondaryColour == b->SecondaryColour &&
+           a->OutlineColour == b->OutlineColour &&
+           a->BackColour == b->BackColour &&
+           a->Bold == b->Bold && a->Italic == b->Italic &&
+           a->Underline == b->Underline && a->StrikeOut == b->StrikeOut &&
+           a->ScaleX == b->ScaleX && a->ScaleY == b->ScaleY &&
+           a->Spacing == b->Spacing && a->Angle == b->Angle &&
+           a->BorderStyle == b->BorderStyle &&
+           a->Outline == b->Outline && a->Shadow == b->Shadow &&
+           a->Alignment == b->Alignment && a->MarginL == b->MarginL &&
+           a->MarginR == b->MarginR && a->MarginV == b->MarginV &&
+           a->Encoding == b->Encoding &&
+           a->treat_fontname_as_pattern == b->treat_fontname_as_pattern &&
+           a->Blur == b->Blur && a->Justify == b->Justify &&
+           same_string(a->Name, b->Name) &&
+           same_string(a->FontName, b->FontName);
+}
+
+#define HASH_FIELD(field) \
+    hval = fnv_32a_buf(&style->field, sizeof(style->field), hval)
+
+/**
+ * \brief Hash the fields of the track's styles, strings by content
+ */
+static uint32_t hash_styles(const ASS_Track *track)
+{
+    uint32_t hval = FNV1_32A_INIT;
+    for (int i = 0; i < track->n_styles; i++) {
+        ASS_Style *style = track->styles + i;
+        // keep empty and missing strings apart from the next field
+        hval = fnv_32a_str(style->Name ? style->Name : "", hval);
+        hval = fnv_32a_buf("", 1, hval);
+        hval = fnv_32a_str(style->FontName ? style->FontName : "", hval);
+        hval = fnv_32a_buf("", 1, hval);
+        HASH_FIELD(FontSize);
+        HASH_FIELD(PrimaryColour);
+        HASH_FIELD(SecondaryColour);
+        HASH_FIELD(OutlineColour);
+        HASH_FIELD(BackColour);
+        HASH_FIELD(Bold);
+        HASH_FIELD(Italic);
+        HASH_FIELD(Underline);
+        HASH_FIELD(StrikeOut);
+        HASH_FIELD(ScaleX);
+        HASH_FIELD(ScaleY);
+        HASH_FIELD(Spacing);
+        HASH_FIELD(Angle);
+        HASH_FIELD(BorderStyle);
+        HASH_FIELD(Outline);
+        HASH_FIELD(Shadow);
+        HASH_FIELD(Alignment);
+        HASH_FIELD(MarginL);
+        HASH_FIELD(MarginR);
+        HASH_FIELD(MarginV);
+        HASH_FIELD(Encoding);
+        HASH_FIELD(treat_fontname_as_pattern);
+        HASH_FIELD(Blur);
+        HASH_FIELD(Justify);
+    }
+    return hval;
+}
+
+#undef HASH_FIELD
+
+/**
+ * \brief Check whether the previous frame can be returned as is
+ * That's the case if it showed the same static events with the same
+ * styles, renderer settings and script header.
+ */
+static bool check_static_frame(ASS_Renderer *priv, ASS_Track *track,
+                               const int *active, int n_active)
+{
+    StaticFrame *frame = &priv->static_frame;
+    if (!frame->valid || frame->track != track ||
+            frame->render_id != priv->render_id ||
+            frame->n_events != n_active || frame->n_styles != track->n_styles)
+        return false;
+    if (!same_settings(&frame->settings, &priv->settings) ||
+            !same_header(&frame->header, track))
+        return false;
+    for (int i = 0; i < n_active; i++)
+        if (frame->ids[i] != active[i] ||
+                !same_event(&frame->events[i], track->events + active[i]))
+            return false;
+    for (int i = 0; i < track->n_styles; i++)
+        if (!same_style(&frame->styles[i], track->styles + i))
+            return false;
+    return true;
+}
+
+static size_t string_size(const char *str)
+{
+    return str ? strlen(str) + 1 : 0;
+}
+
+// copy str to *pos and advance it
+static char *save_string(char **pos, const char *str)
+{
+    if (!str)
+        return NULL;
+    size_t size = strlen(str) + 1;
+    char *copy = memcpy(*pos, str, size);
+    *pos += size;
+    return copy;
+}
+
+/**
+ * \brief Remember the input of a frame for check_static_frame()
+ * Strings are copied, the track and settings may free theirs meanwhile.
+ */
+static void save_static_frame(ASS_Renderer *priv, ASS_Track *track,
+                              const int *active, int n_active)
+{
+    StaticFrame *frame = &priv->static_frame;
+    frame->valid = false;
+    for (int i = 0; i < n_active; i++)
+        if (!ass_event_is_static(priv, track->events + active[i]))
+            return;
+
+    if (n_active > frame->max_events) {
+        if (!ASS_REALLOC_ARRAY(frame->ids, n_active) ||
+                !ASS_REALLOC_ARRAY(frame->events, n_active))
+            return;
+        frame->max_events = n_active;
+    }
+    if (track->n_styles > frame->max_styles) {
+        if (!ASS_REALLOC_ARRAY(frame->styles, track->n_styles))
+            return;
+        frame->max_styles = track->n_styles;
+    }
+    size_t size = string_size(priv->settings.default_font) +
+                  string_size(priv->settings.default_family) +
+                  string_size(track->Language);
+    for (int i = 0; i < n_active; i++) {
+        const ASS_Event *event = track->events + active[i];
+        size += string_size(event->Name) + string_size(event->Effect) +
+                string_size(event->Text);
+    }
+    for (int i = 0; i < track->n_styles; i++)
+        size += string_size(track->styles[i].Name) +
+                string_size(track->styles[i].FontName);
+    if (size > frame->max_strings) {
+        if (!ASS_REALLOC_ARRAY(frame->strings, size))
+            return;
+        frame->max_strings = size;
+    }
+
+    char *pos = frame->strings;
+    frame->track = track;
+    frame->render_id = priv->render_id;
+    frame->settings = priv->settings;
+    frame->settings.default_font = save_string(&pos, priv->settings.default_font);
+    frame->settings.default_family = save_string(&pos, priv->settings.default_family);
+    frame->header = *track;
+    frame->header.Language = save_string(&pos, track->Language);
+    frame->n_events = n_active;
+    for (int i = 0; i < n_active; i++) {
+        const ASS_Event *event = track->events + active[i];
+        ASS_Event *copy = &frame->events[i];
+        frame->ids[i] = active[i];
+        *copy = *event;
+        copy->Name = save_string(&pos, event->Name);
+        copy->Effect = save_string(&pos, event->Effect);
+        copy->Text = save_string(&pos, event->Text);
+    }
+    frame->n_styles = track->n_styles;
+    for (int i = 0; i < track->n_styles; i++) {
+        ASS_Style *copy = &frame->styles[i];
+        *copy = track->styles[i];
+        copy->Name = save_string(&pos, track->styles[i].Name);
+        copy->FontName = save_string(&pos, track->styles[i].FontName);
+    }
+    frame->valid = true;
+}
+
+uint64_t ass_render_constructed_bytes(ASS_Renderer *priv)
+{
+    return ass_cache_constructed(priv->cache.bitmap_cache) +
+           ass_cache_constructed(priv->cache.composite_cache) +
+           ass_cache_constructed(priv->cache.shadow_cache) +
+           ass_cache_constructed(priv->cache.event_cache);
+}
+
+/**
+ * \brief Remember which of the rendered events are degraded
+ */
+static void collect_degraded_events(ASS_Renderer *priv, ASS_Track *track,
+                                    int cnt)
+{
+    for (int i = 0; i < cnt; i++) {
+        if (!priv->eimg[i].degraded)
+            continue;
+        if (priv->n_degraded >= priv->max_degraded) {
+            int max = FFMAX(16, 2 * priv->max_degraded);
+            if (!ASS_REALLOC_ARRAY(priv->degraded_ids, max))
+                return;
+            priv->max_degraded = max;
+        }
+        priv->degraded_ids[priv->n_degraded++] = priv->eimg[i].event - track->events;
+    }
+}
+
+/**
+ * \brief Move the counters of the current frame to the last frame stats
+ */
+static void finish_frame_stats(ASS_Renderer *priv, int64_t start, int n_events)
+{
+    uint64_t constructed = ass_render_constructed_bytes(priv);
+    priv->stats[ASS_STAT_FRAMES] = 1;
+    priv->stats[ASS_STAT_EVENTS] = n_events;
+    priv->stats[ASS_STAT_ALLOC_BYTES] = constructed - priv->alloc_mark;
+    priv->stats[ASS_STAT_DEGRADED] = priv->n_degraded;
+    priv->alloc_mark = constructed;
+    ass_stat_stop(priv, ASS_STAT_TIME_FRAME, start);
+
+    for (int i = 0; i < RENDER_STAT_COUNT; i++) {
+        priv->last_stats[i] = priv->stats[i];
+        priv->total_stats[i] += priv->stats[i];
+    }
+    memset(priv->stats, 0, sizeof(priv->stats));
+}
+
 /**
  * \brief render a frame
  * \param priv library handle
@@ -3117,43 +5320,96 @@ static int ass_detect_change(ASS_Renderer *priv)
 ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
                             long long now, int *detect_change)
 {
+    ASS_TRACE(priv->library, TRACE_RENDER_FRAME, priv->trace_id,
+              ass_track_trace_id(track), now);
+    int64_t start = ass_stat_start(priv);
+    priv->n_degraded = 0;
+    if (priv->frame_budget)
+        priv->degrade_after = ass_time_ns() +
+            (int64_t) (priv->frame_budget * DEGRADE_BUDGET_SHARE);
+
     // init frame
     if (!ass_start_frame(priv, track, now)) {
+        priv->degrade_after = 0;
+        priv->static_frame.valid = false;
+        ASS_DirtyRect all = { 0, 0, priv->width, priv->height };
+        priv->n_dirty_rects = 0;
+        add_dirty_rect(priv, all);
         if (detect_change)
             *detect_change = 2;
         return NULL;
     }
 
     // render events separately
-    int cnt = 0;
-    for (int i = 0; i < track->n_events; i++) {
-        ASS_Event *event = track->events + i;
-        if ((event->Start <= now)
-            && (now < (event->Start + event->Duration))) {
-            if (cnt >= priv->eimg_size) {
-                priv->eimg_size += 100;
-                priv->eimg =
-                    realloc(priv->eimg,
-                            priv->eimg_size * sizeof(EventImages));
-            }
-            if (ass_render_event(priv, event, priv->eimg + cnt))
-                cnt++;
-        }
+    int cnt = 0, n_active;
+    const int *active = ass_active_events(track, now, &n_active);
+    if (!active)
+        ass_msg(priv->library, MSGL_ERR, "Failed to find active events");
+
+    // nothing can have changed since the previous frame
+    if (active && check_static_frame(priv, track, active, n_active)) {
+        priv->images_root = priv->prev_images_root;
+        priv->prev_images_root = NULL;
+        priv->n_dirty_rects = 0;
+        if (detect_change)
+            *detect_change = 0;
+        priv->degrade_after = 0;
+        finish_frame_stats(priv, start, n_active);
+        return priv->images_root;
+    }
+    if (n_active > priv->eimg_size) {
+        if (!ASS_REALLOC_ARRAY(priv->eimg, n_active + 100))
+            n_active = priv->eimg_size;
+        else
+            priv->eimg_size = n_active + 100;
+    }
+
+    // set up the event cache keys
+    priv->styles_hash = hash_styles(track);
+    for (int i = 0; i < n_active; i++)
+        get_render_priv(priv, track->events + active[i]);
+#ifdef CONFIG_PTHREAD
+    if (priv->threads && n_active > 1) {
+        render_events_parallel(priv, active, n_active, false);
+        for (int i = 0; i < n_active; i++)
+            if (priv->eimg[i].event)
+                priv->eimg[cnt++] = priv->eimg[i];
+    } else
+#endif
+    for (int i = 0; i < n_active; i++) {
+        ASS_Event *event = track->events + active[i];
+        if (ass_render_event(priv, event, priv->eimg + cnt))
+            cnt++;
     }
+    priv->degrade_after = 0;
+    collect_degraded_events(priv, track, cnt);
 
     // sort by layer
     if (cnt > 0)
         qsort(priv->eimg, cnt, sizeof(EventImages), cmp_event_layer);
 
-    // call fix_collisions for each group of events with the same layer
-    EventImages *last = priv->eimg;
-    for (int i = 1; i < cnt; i++)
-        if (last->event->Layer != priv->eimg[i].event->Layer) {
-            fix_collisions(priv, last, priv->eimg + i - last);
-            last = priv->eimg + i;
-        }
-    if (cnt > 0)
-        fix_collisions(priv, last, priv->eimg + cnt - last);
+    // reuse the last layout, or call fix_collisions for each group of
+    // events with the same layer
+    int64_t collisions_start = ass_stat_start(priv);
+    if (!reuse_placement(priv, priv->eimg, cnt)) {
+        bool kept = true;
+        EventImages *last = priv->eimg;
+        for (int i = 1; i < cnt; i++)
+            if (last->event->Layer != priv->eimg[i].event->Layer) {
+                kept &= fix_collisions(priv, last, priv->eimg + i - last);
+                last = priv->eimg + i;
+            }
+        if (cnt > 0)
+            kept &= fix_collisions(priv, last, priv->eimg + cnt - last);
+        save_placement(priv, priv->eimg, cnt, kept);
+    }
+    ass_stat_stop(priv, ASS_STAT_TIME_COLLISIONS, collisions_start);
+
+    // events that failed to render may succeed next time,
+    // and degraded ones are due to be rendered at full quality
+    priv->static_frame.valid = false;
+    if (active && cnt == n_active && !priv->n_degraded)
+        save_static_frame(priv, track, active, n_active);
 
     // concat lists
     ASS_Image **tail = &priv->images_root;
@@ -3167,16 +5423,318 @@ ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
     }
     ass_frame_ref(priv->images_root);
 
-    if (detect_change)
+    priv->n_dirty_rects = 0;
+    if (detect_change) {
         *detect_change = ass_detect_change(priv);
+        if (*detect_change)
+            find_dirty_rects(priv);
+    }
 
     // free the previous image list
     ass_frame_unref(priv->prev_images_root);
     priv->prev_images_root = NULL;
 
+    finish_frame_stats(priv, start, cnt);
     return priv->images_root;
 }
 
+void ass_prefetch(ASS_Renderer *priv, ASS_Track *track,
+                  long long start, long long end)
+{
+    ASS_TRACE(priv->library, TRACE_PREFETCH, priv->trace_id,
+              ass_track_trace_id(track), start, end);
+    if (start >= end || !ass_setup_render(priv, track, start))
+        return;
+
+    int n_events;
+    const int *events = ass_starting_events(track, start, end, &n_events);
+    if (!events) {
+        ass_msg(priv->library, MSGL_ERR, "Failed to find events to prefetch");
+        return;
+    }
+    if (n_events > priv->eimg_size) {
+        if (!ASS_REALLOC_ARRAY(priv->eimg, n_events))
+            return;
+        priv->eimg_size = n_events;
+    }
+    for (int i = 0; i < n_events; i++)
+        get_render_priv(priv, track->events + events[i]);
+
+    // render each event as it looks when it appears, keeping
+    // only what the caches retained
+    int cnt = 0;
+#ifdef CONFIG_PTHREAD
+    if (priv->threads && n_events > 1) {
+        render_events_parallel(priv, events, n_events, true);
+        for (int i = 0; i < n_events; i++)
+            if (priv->eimg[i].event)
+                priv->eimg[cnt++] = priv->eimg[i];
+    } else
+#endif
+    for (int i = 0; i < n_events; i++) {
+        ASS_Event *event = track->events + events[i];
+        priv->time = event->Start;
+        if (ass_render_event(priv, event, priv->eimg + cnt))
+            cnt++;
+    }
+
+    for (int i = 0; i < cnt; i++) {
+        ass_frame_ref(priv->eimg[i].imgs);
+        ass_frame_unref(priv->eimg[i].imgs);
+    }
+}
+
+void ass_blend_images(ASS_Renderer *priv, const ASS_Image *img,
+                      unsigned char *buffer, int stride,
+                      int x, int y, int w, int h)
+{
+    for (; img; img = img->next) {
+        int x0 = FFMAX(img->dst_x, x);
+        int y0 = FFMAX(img->dst_y, y);
+        int x1 = FFMIN(img->dst_x + img->w, x + w);
+        int y1 = FFMIN(img->dst_y + img->h, y + h);
+        if (x0 >= x1 || y0 >= y1)
+            continue;
+        priv->engine->blend_rgba(
+            buffer + (ptrdiff_t) (y0 - y) * stride + 4 * (x0 - x), stride,
+            img->bitmap + (ptrdiff_t) (y0 - img->dst_y) * img->stride +
+                (x0 - img->dst_x), img->stride,
+            x1 - x0, y1 - y0, img->color);
+    }
+}
+
+/**
+ * \brief Get the buffer for the bitmaps of ass_render_frame_rgba*()
+ * \return buffer of at least size bytes, or NULL on allocation failure
+ */
+static unsigned char *get_rgba_buffer(ASS_Renderer *priv, size_t size)
+{
+    if (size <= priv->rgba_size)
+        return priv->rgba_buffer;
+    ass_aligned_free(priv->rgba_buffer);
+    priv->rgba_buffer = ass_aligned_alloc(1 << priv->engine->align_order,
+                                          size, false);
+    priv->rgba_size = priv->rgba_buffer ? size : 0;
+    return priv->rgba_buffer;
+}
+
+const ASS_ImageRGBA *ass_render_frame_rgba(ASS_Renderer *priv,
+                                           ASS_Track *track, long long now,
+                                           int *detect_change)
+{
+    ASS_Image *img = ass_render_frame(priv, track, now, detect_change);
+
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for (ASS_Image *cur = img; cur; cur = cur->next) {
+        if (!cur->w || !cur->h)
+            continue;
+        x0 = FFMIN(x0, cur->dst_x);
+        y0 = FFMIN(y0, cur->dst_y);
+        x1 = FFMAX(x1, cur->dst_x + cur->w);
+        y1 = FFMAX(y1, cur->dst_y + cur->h);
+    }
+    if (x0 >= x1 || y0 >= y1)
+        return NULL;
+
+    ASS_ImageRGBA *rgba = &priv->rgba[0];
+    rgba->w = x1 - x0;
+    rgba->h = y1 - y0;
+    rgba->stride = ass_align(1 << priv->engine->align_order, 4 * rgba->w);
+    rgba->dst_x = x0;
+    rgba->dst_y = y0;
+    size_t size = (size_t) rgba->stride * rgba->h;
+    if (!(rgba->buffer = get_rgba_buffer(priv, size)))
+        return NULL;
+    memset(rgba->buffer, 0, size);
+    ass_blend_images(priv, img, rgba->buffer, rgba->stride,
+                     x0, y0, rgba->w, rgba->h);
+    return rgba;
+}
+
+int ass_render_frame_rgba_rects(ASS_Renderer *priv, ASS_Track *track,
+                                long long now, const ASS_ImageRGBA **rects)
+{
+    int changed;
+    ASS_Image *img = ass_render_frame(priv, track, now, &changed);
+    *rects = priv->rgba;
+    if (!changed)
+        return 0;
+
+    int n = priv->n_dirty_rects;
+    size_t size = 0;
+    for (int i = 0; i < n; i++) {
+        const ASS_DirtyRect *r = &priv->dirty_rects[i];
+        ASS_ImageRGBA *rgba = &priv->rgba[i];
+        rgba->w = r->w;
+        rgba->h = r->h;
+        rgba->stride = ass_align(1 << priv->engine->align_order, 4 * r->w);
+        rgba->dst_x = r->x;
+        rgba->dst_y = r->y;
+        size += (size_t) rgba->stride * rgba->h;
+    }
+    if (!n)
+        return 0;
+
+    // the strides are aligned, so every bitmap starts aligned
+    unsigned char *buffer = get_rgba_buffer(priv, size);
+    if (!buffer)
+        return -1;
+    memset(buffer, 0, size);
+    for (int i = 0; i < n; i++) {
+        ASS_ImageRGBA *rgba = &priv->rgba[i];
+        rgba->buffer = buffer;
+        ass_blend_images(priv, img, rgba->buffer, rgba->stride,
+                         rgba->dst_x, rgba->dst_y, rgba->w, rgba->h);
+        buffer += (size_t) rgba->stride * rgba->h;
+    }
+    return n;
+}
+
+int ass_render_frame_array(ASS_Renderer *priv, ASS_Track *track,
+                           long long now, int *detect_change,
+                           ASS_Image *images, int max_images)
+{
+    ASS_Image *img = ass_render_frame(priv, track, now, detect_change);
+
+    int count = 0;
+    for (; img; img = img->next, count++) {
+        if (count >= max_images)
+            continue;
+        images[count] = *img;
+        images[count].next = NULL;
+        if (count)
+            images[count - 1].next = &images[count];
+    }
+    return count;
+}
+
+const ASS_AtlasFrame *ass_render_frame_atlas(ASS_Renderer *priv,
+                                             ASS_Track *track, long long now,
+                                             int *detect_change)
+{
+    if (!priv->atlas)
+        return NULL;
+    ASS_Image *img = ass_render_frame(priv, track, now, detect_change);
+    return ass_atlas_update(priv->atlas, img);
+}
+
+#define BATCH_CHUNK 16  // frames rendered by each renderer in one go
+
+// frames [begin, end) of ass_render_frames(), stored frame by frame
+typedef struct {
+    ASS_Renderer **renderers;
+    int n_renderers;
+    ASS_Track *track;
+    const long long *times;
+    int begin, end;
+    ASS_Image **images;         // [frame - begin][renderer], referenced
+    int *changes;               // detect_change of the images
+} FrameChunk;
+
+static void *render_chunk(void *arg)
+{
+    FrameChunk *chunk = arg;
+    int n = chunk->n_renderers;
+    // renderer by renderer, since the per-event state kept in the track
+    // is reset whenever another renderer renders the event
+    for (int r = 0; r < n; r++) {
+        for (int i = chunk->begin; i < chunk->end; i++) {
+            size_t k = (size_t) (i - chunk->begin) * n + r;
+            chunk->images[k] = ass_render_frame(chunk->renderers[r],
+                                                chunk->track, chunk->times[i],
+                                                &chunk->changes[k]);
+            ass_frame_ref(chunk->images[k]);
+        }
+    }
+    return NULL;
+}
+
+static void release_chunk(FrameChunk *chunk)
+{
+    size_t n = (size_t) (chunk->end - chunk->begin) * chunk->n_renderers;
+    for (size_t k = 0; k < n; k++)
+        ass_frame_unref(chunk->images[k]);
+}
+
+int ass_render_frames(ASS_Renderer **renderers, int n_renderers,
+                      ASS_Track *track, const long long *times, int n_times,
+                      ASS_FrameCallback callback, void *data)
+{
+    if (n_renderers <= 0 || n_times <= 0)
+        return 0;
+
+    size_t chunk_size = (size_t) BATCH_CHUNK * n_renderers;
+    ASS_Image **images = ass_realloc_array(NULL, 2 * chunk_size,
+                                           sizeof(ASS_Image *));
+    int *changes = ass_realloc_array(NULL, 2 * chunk_size, sizeof(int));
+    if (!images || !changes) {
+        ass_msg(renderers[0]->library, MSGL_ERR,
+                "Failed to allocate batch of frames");
+        free(images);
+        free(changes);
+        return -1;
+    }
+
+    // the callbacks for one chunk run while the next one is rendered
+    FrameChunk chunk[2];
+    for (int j = 0; j < 2; j++)
+        chunk[j] = (FrameChunk) {
+            .renderers = renderers,
+            .n_renderers = n_renderers,
+            .track = track,
+            .times = times,
+            .images = images + j * chunk_size,
+            .changes = changes + j * chunk_size,
+        };
+    chunk[0].end = FFMIN(n_times, BATCH_CHUNK);
+    render_chunk(&chunk[0]);
+
+    int delivered = 0;
+    bool stop = false;
+    for (int c = 0; ; c ^= 1) {
+        FrameChunk *cur = &chunk[c], *next = &chunk[c ^ 1];
+        next->begin = cur->end;
+        next->end = FFMIN(n_times, cur->end + BATCH_CHUNK);
+        bool has_next = next->begin < next->end;
+
+#ifdef CONFIG_PTHREAD
+        pthread_t thread;
+        bool background = has_next &&
+            !pthread_create(&thread, NULL, render_chunk, next);
+#endif
+        for (int i = cur->begin; i < cur->end && !stop; i++) {
+            for (int r = 0; r < n_renderers && !stop; r++) {
+                size_t k = (size_t) (i - cur->begin) * n_renderers + r;
+                stop = callback(data, i, r, cur->images[k], cur->changes[k]);
+            }
+            if (!stop)
+                delivered++;
+        }
+#ifdef CONFIG_PTHREAD
+        if (background)
+            pthread_join(thread, NULL);
+        else
+#endif
+        if (has_next && !stop)
+            render_chunk(next);
+        release_chunk(cur);
+
+        if (!has_next)
+            break;
+        if (stop) {
+#ifdef CONFIG_PTHREAD
+            if (background)
+                release_chunk(next);
+#endif
+            break;
+        }
+    }
+
+    free(images);
+    free(changes);
+    return delivered;
+}
+
 /**
  * \brief Add reference to a frame image list.
  * \param image_list image list returned by ass_render_frame()
@@ -3185,7 +5743,7 @@ void ass_frame_ref(ASS_Image *img)
 {
     if (!img)
         return;
-    ((ASS_ImagePriv *) img)->ref_count++;
+    ref_inc(&((ASS_ImagePriv *) img)->ref_count);
 }
 
 /**
@@ -3194,13 +5752,19 @@ void ass_frame_ref(ASS_Image *img)
  */
 void ass_frame_unref(ASS_Image *img)
 {
-    if (!img || --((ASS_ImagePriv *) img)->ref_count)
+    if (!img || ref_dec(&((ASS_ImagePriv *) img)->ref_count))
         return;
-    do {
+    ASS_ImagePriv *first = (ASS_ImagePriv *) img;
+    while (true) {
         ASS_ImagePriv *priv = (ASS_ImagePriv *) img;
-        img = img->next;
         ass_cache_dec_ref(priv->source);
         ass_aligned_free(priv->buffer);
-        free(priv);
-    } while (img);
+        img = img->next;
+        if (!img || ((ASS_ImagePriv *) img)->pool != first->pool) {
+            image_pool_put(first->pool, first, priv);
+            if (!img)
+                break;
+            first = (ASS_ImagePriv *) img;
+        }
+    }
 }
@@ -21,6 +21,9 @@
 #define LIBASS_RENDER_H
 
 #include <inttypes.h>
+#ifdef CONFIG_PTHREAD
+#include <pthread.h>
+#endif
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
@@ -39,6 +42,8 @@
 #include "ass_drawing.h"
 #include "ass_bitmap.h"
 #include "ass_rasterizer.h"
+#include "ass_atlas.h"
+#include "ass_trace.h"
 
 #define GLYPH_CACHE_MAX 10000
 #define MEGABYTE (1024 * 1024)
@@ -46,14 +51,19 @@
 #define COMPOSITE_CACHE_RATIO 2
 #define COMPOSITE_CACHE_MAX_SIZE (BITMAP_CACHE_MAX_SIZE / COMPOSITE_CACHE_RATIO)
 
+#define MAX_DIRTY_RECTS 16
+
 #define PARSED_FADE (1<<0)
 #define PARSED_A    (1<<1)
 
+typedef struct image_pool ImagePool;
+
 typedef struct {
     ASS_Image result;
-    CompositeHashValue *source;
+    void *source;               // cache value the bitmap belongs to
     unsigned char *buffer;
     size_t ref_count;
+    ImagePool *pool;            // where the image goes back when released
 } ASS_ImagePriv;
 
 typedef struct {
@@ -73,6 +83,9 @@ typedef struct {
     double par;                 // user defined pixel aspect ratio (0 = unset)
     ASS_Hinting hinting;
     ASS_ShapingLevel shaper;
+    ASS_BlurQuality blur_quality;
+    double angle_step;          // rotation and shear rounding step in radians, 0 = exact
+    int motion_cache;           // shift cached images of moving events, see ass_set_motion_cache()
     int selective_style_overrides; // ASS_OVERRIDE_* flags
 
     char *default_font;
@@ -86,8 +99,46 @@ typedef struct {
     int detect_collisions;
     int shift_direction;
     ASS_Event *event;
+    bool degraded;              // rendered at reduced quality for the frame budget
 } EventImages;
 
+// collision placement of an event, see reuse_placement()
+typedef struct {
+    int cache_id;               // ASS_RenderPriv.cache_id of the event
+    int layer;
+    int top, height, left, width;
+} PlacedEvent;
+
+// straight-line motion of an event, see ass_event_motion()
+typedef struct {
+    enum {
+        MOTION_NONE,
+        MOTION_MOVE,            // \move
+        MOTION_BANNER_RL,       // "Banner" effect, right to left
+        MOTION_BANNER_LR,       // "Banner" effect, left to right
+    } type;
+    ASS_DVector pos;            // current position in script coordinates
+    size_t args_start, args_end;    // \move arguments in the event text
+    bool karaoke;               // has karaoke words, which sweep over time
+} EventMotion;
+
+// snapshot of the input of a frame without time-dependent events,
+// used to return the same images while nothing changes
+typedef struct {
+    bool valid;
+    ASS_Track *track;
+    int render_id;
+    ASS_Settings settings;
+    ASS_Track header;           // copy of the track's script header fields
+    int *ids;                   // active events and their copies
+    ASS_Event *events;
+    int n_events, max_events;
+    ASS_Style *styles;
+    int n_styles, max_styles;
+    char *strings;              // copies of the strings of the above
+    size_t max_strings;
+} StaticFrame;
+
 typedef enum {
     EF_NONE = 0,
     EF_KARAOKE,
@@ -98,6 +149,7 @@ typedef enum {
 // describes a combined bitmap
 typedef struct {
     FilterDesc filter;
+    ASS_Vector shadow;          // shadow offset, 26.6
     uint32_t c[4];              // colors
     Effect effect_type;
     int effect_timing;          // time duration of current karaoke word
@@ -111,7 +163,8 @@ typedef struct {
 
     int x, y;
     Bitmap *bm, *bm_o, *bm_s;   // glyphs, outline, shadow bitmaps
-    CompositeHashValue *image;
+    CompositeHashValue *image;  // cache value holding bm and bm_o,
+                                // bm_s is a shadow cache value itself
 } CombinedBitmapInfo;
 
 typedef struct {
@@ -150,6 +203,10 @@ typedef struct glyph_info {
     // after process_karaoke_effects: distance in pixels from the glyph origin.
     // part of the glyph to the left of it is displayed in a different color.
     int effect_skip_timing;     // delay after the end of last karaoke word
+    // karaoke word of the glyph, see process_karaoke_effects()
+    int karaoke_start, karaoke_end;     // time span relative to the event start
+    int karaoke_x_start, karaoke_x_end; // horizontal extents before wrapping
+    int karaoke_pos;                    // glyph origin before wrapping
     int asc, desc;              // font max ascender and descender
     int be;                     // blur edges
     double blur;                // gaussian blur
@@ -231,6 +288,7 @@ typedef struct {
     int clip_x0, clip_y0, clip_x1, clip_y1;
     char have_origin;           // origin is explicitly defined; if 0, get_base_point() is used
     char clip_mode;             // 1 = iclip
+    char unclipped;             // don't crop images to the frame, see render_event()
     char detect_collisions;
     char be;                    // blur edges
     int fade;                   // alpha from \fad
@@ -258,6 +316,7 @@ typedef struct {
         SCROLL_BT
     } scroll_direction;         // for EVENT_HSCROLL, EVENT_VSCROLL
     int scroll_shift;
+    int margin_l, margin_r, margin_v;   // event margins, style values if unset
 
     // face properties
     char *family;
@@ -275,11 +334,25 @@ typedef struct {
     int explicit;
 } RenderContext;
 
+// text of an event as left by layout_event(), see ass_render_event();
+// glyphs of clusters follow the first text_info.length ones
+typedef struct event_layout {
+    TextInfo text_info;
+    size_t n_glyphs;
+    RenderContext state;
+} EventLayout;
+
+void ass_event_layout_free(EventLayout *layout);
+
 typedef struct {
     Cache *font_cache;
     Cache *outline_cache;
     Cache *bitmap_cache;
     Cache *composite_cache;
+    Cache *shadow_cache;
+    Cache *event_cache;
+    Cache *tags_cache;
+    CacheBudget *budget;    // for all of the above unless shared
     size_t glyph_max;
     size_t bitmap_max_size;
     size_t composite_max_size;
@@ -287,10 +360,38 @@ typedef struct {
 
 #include "ass_shaper.h"
 
+typedef struct render_threads RenderThreads;
+
+#define RENDER_STAT_COUNT (ASS_STAT_DEGRADED + 1)
+
+typedef struct {
+    ASS_Image *img;
+    bool matched;
+} ImageSlot;
+
+// font, outline and override tag caches that can be used by several renderers
+struct ass_shared_cache {
+    ASS_Library *library;
+    FT_Library ftlibrary;
+    ASS_FontSelector *fontselect;   // set up by the first ass_set_fonts()
+    Cache *font_cache;
+    Cache *outline_cache;
+    Cache *tags_cache;
+    size_t glyph_max;
+    int ref_count;                  // owner and attached renderers
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_t lock;           // protects ref_count and fontselect
+    // serializes event layout across all attached renderers
+    pthread_mutex_t layout_lock;
+#endif
+};
+
 struct ass_renderer {
     ASS_Library *library;
     FT_Library ftlibrary;
-    ASS_FontSelector *fontselect;
+    ASS_FontSelector *fontselect;   // memory fonts only while font_loader runs
+    ASS_FontLoader *font_loader;    // fonts being loaded in the background
+    int font_init_mode;             // ASS_FontInitMode of ass_set_fonts()
     ASS_Settings settings;
     int render_id;
     ASS_Shaper *shaper;
@@ -320,13 +421,104 @@ struct ass_renderer {
 
     const BitmapEngine *engine;
     RasterizerData rasterizer;
+    Arena arena;                // scratch memory, reset every frame
+    // border bitmap rendered along with its glyph, see ass_bitmap_construct()
+    BitmapHashKey prepared_key;
+    Bitmap prepared_border;
+    bool has_prepared_border;
+    // composite the shadow being constructed is placed from,
+    // see ass_shadow_construct()
+    const CompositeHashValue *shadow_source;
 
     ASS_Style user_override_style;
+
+    RenderThreads *threads;     // worker pool, NULL if events are rendered on the caller's thread
+    ImagePool *image_pool;      // recycled ASS_ImagePriv, shared with the render workers
+    ASS_SharedCache *shared_cache;  // provides font and outline caches if set
+    StaticFrame static_frame;
+    ASS_DirtyRect dirty_rects[MAX_DIRTY_RECTS];
+    int n_dirty_rects;
+    ImageSlot *image_table;     // temporary hash table for change detection
+    size_t image_table_size;
+    ASS_ImageRGBA rgba[MAX_DIRTY_RECTS];    // output of ass_render_frame_rgba*()
+    unsigned char *rgba_buffer; // bitmaps of rgba, one after the other
+    size_t rgba_size;           // allocated size of rgba_buffer
+    Atlas *atlas;               // set up by ass_set_atlas()
+    int event_cache_id;         // last assigned RenderPriv.cache_id
+    uint32_t styles_hash;       // hash of the track's styles for this frame
+
+    // statistics, see ass_get_render_stat()
+    bool measure_time;          // set by ass_set_render_stats()
+    int64_t stats[RENDER_STAT_COUNT];       // current frame, per worker
+    int64_t last_stats[RENDER_STAT_COUNT];
+    int64_t total_stats[RENDER_STAT_COUNT];
+    uint64_t alloc_mark;        // cache bytes constructed until the last frame
+
+    // frame budget, see ass_set_frame_budget()
+    int64_t frame_budget;       // ns, 0 if unlimited
+    int64_t degrade_after;      // time to degrade events from, 0 outside frames
+    bool degrade;               // current event may be degraded
+    bool degraded;              // current event got degraded images
+    int *degraded_ids;          // degraded events of the last frame
+    int n_degraded, max_degraded;
+
+    PlacedEvent *placed;        // collision layout of the last frame
+    int n_placed, max_placed;
+    bool placed_valid;          // placed can be reused
+
+    int trace_id;               // see ass_set_trace_file()
 };
 
+// font lookup used by the renderer, which may come from a shared cache
+static inline ASS_FontSelector *ass_renderer_fontselect(ASS_Renderer *priv)
+{
+    return priv->shared_cache ? priv->shared_cache->fontselect : priv->fontselect;
+}
+
+/**
+ * \brief Start using the fonts of a finished background load.
+ * \param wait wait for the load if it isn't finished yet
+ */
+void ass_renderer_update_fonts(ASS_Renderer *priv, bool wait);
+
+// stage timing helpers, no-ops unless enabled with ass_set_render_stats()
+static inline int64_t ass_stat_start(ASS_Renderer *priv)
+{
+    return priv->measure_time ? ass_time_ns() : 0;
+}
+
+static inline void ass_stat_stop(ASS_Renderer *priv, ASS_RenderStat stat,
+                                 int64_t start)
+{
+    if (priv->measure_time)
+        priv->stats[stat] += ass_time_ns() - start;
+}
+
+uint64_t ass_render_constructed_bytes(ASS_Renderer *priv);
+
+static inline FT_Library ass_renderer_ftlibrary(ASS_Renderer *priv)
+{
+    return priv->shared_cache ? priv->shared_cache->ftlibrary : priv->ftlibrary;
+}
+
+static inline void lock_shared_layout(ASS_SharedCache *cache)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&cache->layout_lock);
+#endif
+}
+
+static inline void unlock_shared_layout(ASS_SharedCache *cache)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_unlock(&cache->layout_lock);
+#endif
+}
+
 typedef struct render_priv {
     int top, height, left, width;
     int render_id;
+    int cache_id;               // key of the rendered event in the event cache
 } RenderPriv;
 
 typedef struct {
@@ -344,8 +536,23 @@ typedef struct {
 void reset_render_context(ASS_Renderer *render_priv, ASS_Style *style);
 void ass_frame_ref(ASS_Image *img);
 void ass_frame_unref(ASS_Image *img);
+bool ass_renderer_set_engine(ASS_Renderer *priv, const BitmapEngine *engine);
+RenderThreads *ass_render_threads_create(ASS_Renderer *priv, int n_workers);
+void ass_render_threads_free(RenderThreads *threads);
+/**
+ * \brief Rasterize the outlines set up in render_priv->rasterizer
+ * Same as rasterizer_fill2() or rasterizer_fill() if buf2 is NULL,
+ * but idle render threads help with huge windows.
+ */
+bool ass_rasterize(ASS_Renderer *render_priv, uint8_t *buf, uint8_t *buf2,
+                   int x0, int y0, int width, int height, ptrdiff_t stride);
+void ass_shared_cache_unref(ASS_SharedCache *cache);
 
 // XXX: this is actually in ass.c, includes should be fixed later on
 void ass_lazy_track_init(ASS_Library *lib, ASS_Track *track);
+const int *ass_active_events(ASS_Track *track, long long now, int *count);
+void ass_prune_events(ASS_Track *track, long long now);
+const int *ass_starting_events(ASS_Track *track, long long start,
+                               long long end, int *count);
 
 #endif /* LIBASS_RENDER_H */
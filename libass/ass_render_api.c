@@ -27,9 +27,13 @@ static void ass_reconfigure(ASS_Renderer *priv)
     ASS_Settings *settings = &priv->settings;
 
     priv->render_id++;
+    ass_cache_empty(priv->cache.event_cache);
+    ass_cache_empty(priv->cache.shadow_cache);
     ass_cache_empty(priv->cache.composite_cache);
     ass_cache_empty(priv->cache.bitmap_cache);
-    ass_cache_empty(priv->cache.outline_cache);
+    // shared outlines don't depend on renderer settings
+    if (!priv->shared_cache)
+        ass_cache_empty(priv->cache.outline_cache);
 
     priv->width = settings->frame_width;
     priv->height = settings->frame_height;
@@ -51,6 +55,7 @@ static void ass_reconfigure(ASS_Renderer *priv)
 
 void ass_set_frame_size(ASS_Renderer *priv, int w, int h)
 {
+    ASS_TRACE(priv->library, TRACE_SET_FRAME_SIZE, priv->trace_id, w, h);
     if (priv->settings.frame_width != w || priv->settings.frame_height != h) {
         priv->settings.frame_width = w;
         priv->settings.frame_height = h;
@@ -60,6 +65,7 @@ void ass_set_frame_size(ASS_Renderer *priv, int w, int h)
 
 void ass_set_storage_size(ASS_Renderer *priv, int w, int h)
 {
+    ASS_TRACE(priv->library, TRACE_SET_STORAGE_SIZE, priv->trace_id, w, h);
     if (priv->settings.storage_width != w ||
         priv->settings.storage_height != h) {
         priv->settings.storage_width = w;
@@ -70,17 +76,21 @@ void ass_set_storage_size(ASS_Renderer *priv, int w, int h)
 
 void ass_set_shaper(ASS_Renderer *priv, ASS_ShapingLevel level)
 {
+    ASS_TRACE(priv->library, TRACE_SET_SHAPER, priv->trace_id, (int) level);
 #ifdef CONFIG_HARFBUZZ
     // select the complex shaper for illegal values
-    if (level == ASS_SHAPING_SIMPLE || level == ASS_SHAPING_COMPLEX)
+    if (level != ASS_SHAPING_SIMPLE && level != ASS_SHAPING_COMPLEX)
+        level = ASS_SHAPING_COMPLEX;
+    if (priv->settings.shaper != level) {
         priv->settings.shaper = level;
-    else
-        priv->settings.shaper = ASS_SHAPING_COMPLEX;
+        ass_cache_empty(priv->cache.event_cache);
+    }
 #endif
 }
 
 void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
 {
+    ASS_TRACE(priv->library, TRACE_SET_MARGINS, priv->trace_id, t, b, l, r);
     if (priv->settings.left_margin != l || priv->settings.right_margin != r ||
         priv->settings.top_margin != t || priv->settings.bottom_margin != b) {
         priv->settings.left_margin = l;
@@ -93,7 +103,11 @@ void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
 
 void ass_set_use_margins(ASS_Renderer *priv, int use)
 {
-    priv->settings.use_margins = use;
+    ASS_TRACE(priv->library, TRACE_SET_USE_MARGINS, priv->trace_id, use);
+    if (priv->settings.use_margins != use) {
+        priv->settings.use_margins = use;
+        ass_cache_empty(priv->cache.event_cache);
+    }
 }
 
 void ass_set_aspect_ratio(ASS_Renderer *priv, double dar, double sar)
@@ -103,6 +117,7 @@ void ass_set_aspect_ratio(ASS_Renderer *priv, double dar, double sar)
 
 void ass_set_pixel_aspect(ASS_Renderer *priv, double par)
 {
+    ASS_TRACE(priv->library, TRACE_SET_PIXEL_ASPECT, priv->trace_id, par);
     if (priv->settings.par != par) {
         priv->settings.par = par;
         ass_reconfigure(priv);
@@ -111,6 +126,7 @@ void ass_set_pixel_aspect(ASS_Renderer *priv, double par)
 
 void ass_set_font_scale(ASS_Renderer *priv, double font_scale)
 {
+    ASS_TRACE(priv->library, TRACE_SET_FONT_SCALE, priv->trace_id, font_scale);
     if (priv->settings.font_size_coeff != font_scale) {
         priv->settings.font_size_coeff = font_scale;
         ass_reconfigure(priv);
@@ -119,19 +135,50 @@ void ass_set_font_scale(ASS_Renderer *priv, double font_scale)
 
 void ass_set_hinting(ASS_Renderer *priv, ASS_Hinting ht)
 {
+    ASS_TRACE(priv->library, TRACE_SET_HINTING, priv->trace_id, (int) ht);
     if (priv->settings.hinting != ht) {
         priv->settings.hinting = ht;
         ass_reconfigure(priv);
     }
 }
 
+void ass_set_blur_quality(ASS_Renderer *priv, ASS_BlurQuality quality)
+{
+    ASS_TRACE(priv->library, TRACE_SET_BLUR_QUALITY, priv->trace_id, (int) quality);
+    if (priv->settings.blur_quality != quality) {
+        priv->settings.blur_quality = quality;
+        ass_reconfigure(priv);
+    }
+}
+
+void ass_set_rotation_step(ASS_Renderer *priv, double step)
+{
+    ASS_TRACE(priv->library, TRACE_SET_ROTATION_STEP, priv->trace_id, step);
+    double angle_step = step > 0 ? step * (M_PI / 180) : 0;
+    if (priv->settings.angle_step != angle_step) {
+        priv->settings.angle_step = angle_step;
+        ass_reconfigure(priv);
+    }
+}
+
+void ass_set_motion_cache(ASS_Renderer *priv, int enable)
+{
+    ASS_TRACE(priv->library, TRACE_SET_MOTION_CACHE, priv->trace_id, enable);
+    priv->settings.motion_cache = !!enable;
+}
+
 void ass_set_line_spacing(ASS_Renderer *priv, double line_spacing)
 {
-    priv->settings.line_spacing = line_spacing;
+    ASS_TRACE(priv->library, TRACE_SET_LINE_SPACING, priv->trace_id, line_spacing);
+    if (priv->settings.line_spacing != line_spacing) {
+        priv->settings.line_spacing = line_spacing;
+        ass_cache_empty(priv->cache.event_cache);
+    }
 }
 
 void ass_set_line_position(ASS_Renderer *priv, double line_position)
 {
+    ASS_TRACE(priv->library, TRACE_SET_LINE_POSITION, priv->trace_id, line_position);
     if (priv->settings.line_position != line_position) {
         priv->settings.line_position = line_position;
         ass_reconfigure(priv);
@@ -142,6 +189,8 @@ void ass_set_fonts(ASS_Renderer *priv, const char *default_font,
                    const char *default_family, int dfp,
                    const char *config, int update)
 {
+    ASS_TRACE(priv->library, TRACE_SET_FONTS, priv->trace_id, default_font,
+              default_family, dfp, config, update);
     free(priv->settings.default_font);
     free(priv->settings.default_family);
     priv->settings.default_font = default_font ? strdup(default_font) : 0;
@@ -150,18 +199,78 @@ void ass_set_fonts(ASS_Renderer *priv, const char *default_font,
 
     ass_reconfigure(priv);
 
-    ass_cache_empty(priv->cache.font_cache);
     if (priv->shaper)
         ass_shaper_empty_cache(priv->shaper);
 
+    ASS_SharedCache *shared = priv->shared_cache;
+    if (shared) {
+        // the first renderer to set up fonts configures them for all
+        lock_shared_layout(shared);
+        if (!shared->fontselect)
+            shared->fontselect =
+                ass_fontselect_init(shared->library, shared->ftlibrary,
+                                    default_family, default_font, config, dfp);
+        unlock_shared_layout(shared);
+        return;
+    }
+
+    ass_cache_empty(priv->cache.font_cache);
+
+    ass_font_loader_free(priv->font_loader);
+    priv->font_loader = NULL;
     if (priv->fontselect)
         ass_fontselect_free(priv->fontselect);
-    priv->fontselect = ass_fontselect_init(priv->library, priv->ftlibrary,
-            default_family, default_font, config, dfp);
+    priv->fontselect = NULL;
+
+    if (priv->font_init_mode != ASS_FONT_INIT_SYNC)
+        priv->font_loader = ass_font_loader_start(priv->library,
+                default_family, default_font, config, dfp);
+    if (!priv->font_loader)
+        priv->fontselect = ass_fontselect_init(priv->library, priv->ftlibrary,
+                default_family, default_font, config, dfp);
+    else if (priv->font_init_mode == ASS_FONT_INIT_ASYNC_EMBEDDED)
+        priv->fontselect = ass_fontselect_init_embedded(priv->library,
+                priv->ftlibrary, default_family, default_font);
+}
+
+void ass_set_font_init_mode(ASS_Renderer *priv, int mode)
+{
+    ASS_TRACE(priv->library, TRACE_SET_FONT_INIT_MODE, priv->trace_id, mode);
+    priv->font_init_mode = mode;
+}
+
+int ass_fonts_ready(ASS_Renderer *priv)
+{
+    return !priv->font_loader || ass_font_loader_ready(priv->font_loader);
+}
+
+void ass_renderer_update_fonts(ASS_Renderer *priv, bool wait)
+{
+    if (!priv->font_loader ||
+            (!wait && !ass_font_loader_ready(priv->font_loader)))
+        return;
+
+    ASS_FontSelector *fontselect = ass_font_loader_finish(priv->font_loader);
+    priv->font_loader = NULL;
+    if (fontselect)
+        ass_fontselect_add_memory_fonts(fontselect, priv->library,
+                                        priv->ftlibrary);
+
+    if (priv->fontselect) {
+        // drop everything made with the memory fonts alone
+        ass_reconfigure(priv);
+        if (priv->shaper)
+            ass_shaper_empty_cache(priv->shaper);
+        ass_cache_empty(priv->cache.font_cache);
+        ass_fontselect_free(priv->fontselect);
+    }
+    priv->fontselect = fontselect;
 }
 
 void ass_set_selective_style_override_enabled(ASS_Renderer *priv, int bits)
 {
+    ASS_TRACE(priv->library, TRACE_SET_SELECTIVE_STYLE_OVERRIDE_ENABLED,
+              priv->trace_id, bits);
     if (priv->settings.selective_style_overrides != bits) {
         priv->settings.selective_style_overrides = bits;
         ass_reconfigure(priv);
@@ -171,6 +280,8 @@ void ass_set_selective_style_override_enabled(ASS_Renderer *priv, int bits)
 void ass_set_selective_style_override(ASS_Renderer *priv, ASS_Style *style)
 {
     ASS_Style *user_style = &priv->user_override_style;
+    priv->static_frame.valid = false;
+    ass_cache_empty(priv->cache.event_cache);
     free(user_style->FontName);
     *user_style = *style;
     user_style->FontName = strdup(user_style->FontName);
@@ -185,6 +296,8 @@ int ass_fonts_update(ASS_Renderer *render_priv)
 void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
                           int bitmap_max)
 {
+    ASS_TRACE(render_priv->library, TRACE_SET_CACHE_LIMITS,
+              render_priv->trace_id, glyph_max, bitmap_max);
     render_priv->cache.glyph_max = glyph_max ? glyph_max : GLYPH_CACHE_MAX;
 
     size_t bitmap_cache, composite_cache;
@@ -200,9 +313,170 @@ void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
     render_priv->cache.composite_max_size = composite_cache;
 }
 
+void ass_set_cache_budget(ASS_Renderer *priv, size_t max_bytes)
+{
+    ASS_TRACE(priv->library, TRACE_SET_CACHE_BUDGET, priv->trace_id,
+              (long long) max_bytes);
+    ass_cache_budget_set_limit(priv->cache.budget, max_bytes);
+    if (max_bytes)
+        ass_cache_budget_trim(priv->cache.budget, max_bytes);
+}
+
+void ass_set_threads(ASS_Renderer *priv, int threads)
+{
+    ASS_TRACE(priv->library, TRACE_SET_THREADS, priv->trace_id, threads);
+    ass_render_threads_free(priv->threads);
+    priv->threads = NULL;
+    if (threads > 1)
+        priv->threads = ass_render_threads_create(priv, threads - 1);
+}
+
+int ass_set_shared_cache(ASS_Renderer *priv, ASS_SharedCache *cache)
+{
+    if (cache == priv->shared_cache)
+        return 0;
+    if (cache && cache->library != priv->library) {
+        ass_msg(priv->library, MSGL_ERR,
+                "Shared cache belongs to a different library");
+        return -1;
+    }
+
+    Cache *font_cache, *outline_cache, *tags_cache;
+    if (cache) {
+        font_cache = cache->font_cache;
+        outline_cache = cache->outline_cache;
+        tags_cache = cache->tags_cache;
+    } else {
+        font_cache = ass_font_cache_create();
+        outline_cache = ass_outline_cache_create();
+        tags_cache = ass_tags_cache_create();
+        if (!font_cache || !outline_cache || !tags_cache ||
+                !ass_cache_set_budget(font_cache, priv->cache.budget, false) ||
+                !ass_cache_set_budget(outline_cache, priv->cache.budget, true) ||
+                !ass_cache_set_budget(tags_cache, priv->cache.budget, true)) {
+            ass_cache_done(font_cache);
+            ass_cache_done(outline_cache);
+            ass_cache_done(tags_cache);
+            return -1;
+        }
+    }
+
+    // drop everything that references the old fonts and outlines
+    ass_cache_empty(priv->cache.event_cache);
+    ass_cache_empty(priv->cache.shadow_cache);
+    ass_cache_empty(priv->cache.composite_cache);
+    ass_cache_empty(priv->cache.bitmap_cache);
+    if (priv->shaper)
+        ass_shaper_empty_cache(priv->shaper);
+    priv->render_id++;
+
+    if (priv->shared_cache) {
+        ass_shared_cache_unref(priv->shared_cache);
+    } else {
+        ass_cache_done(priv->cache.tags_cache);
+        ass_cache_done(priv->cache.outline_cache);
+        ass_cache_done(priv->cache.font_cache);
+    }
+
+    if (cache) {
+#ifdef CONFIG_PTHREAD
+        pthread_mutex_lock(&cache->lock);
+        cache->ref_count++;
+        pthread_mutex_unlock(&cache->lock);
+#else
+        cache->ref_count++;
+#endif
+    }
+    priv->shared_cache = cache;
+    priv->cache.font_cache = font_cache;
+    priv->cache.outline_cache = outline_cache;
+    priv->cache.tags_cache = tags_cache;
+    return 0;
+}
+
 ASS_FontProvider *
 ass_create_font_provider(ASS_Renderer *priv, ASS_FontProviderFuncs *funcs,
                          void *data)
 {
-    return ass_font_provider_new(priv->fontselect, funcs, data);
+    // the provider has to be attached to the fonts that will stay
+    ass_renderer_update_fonts(priv, true);
+    return ass_font_provider_new(ass_renderer_fontselect(priv), funcs, data);
+}
+
+int ass_set_atlas(ASS_Renderer *priv, int page_size, int max_pages)
+{
+    ass_atlas_free(priv->atlas);
+    priv->atlas = NULL;
+    if (page_size <= 0)
+        return 0;
+    if (max_pages <= 0)
+        return -1;
+    priv->atlas = ass_atlas_create(priv->library, page_size, max_pages);
+    return priv->atlas ? 0 : -1;
+}
+
+void ass_set_frame_budget(ASS_Renderer *priv, int budget_us)
+{
+    ASS_TRACE(priv->library, TRACE_SET_FRAME_BUDGET, priv->trace_id, budget_us);
+    priv->frame_budget = budget_us > 0 ? budget_us * INT64_C(1000) : 0;
+}
+
+int ass_get_degraded_events(ASS_Renderer *priv, int *events, int max_events)
+{
+    if (events)
+        for (int i = 0; i < FFMIN(priv->n_degraded, max_events); i++)
+            events[i] = priv->degraded_ids[i];
+    return priv->n_degraded;
+}
+
+void ass_set_render_stats(ASS_Renderer *priv, int enable)
+{
+    priv->measure_time = enable;
+}
+
+int64_t ass_get_render_stat(ASS_Renderer *priv, ASS_RenderStat stat,
+                            int last_frame)
+{
+    if ((unsigned) stat >= RENDER_STAT_COUNT)
+        return -1;
+    return last_frame ? priv->last_stats[stat] : priv->total_stats[stat];
+}
+
+static Cache *get_cache(ASS_Renderer *priv, ASS_CacheType type)
+{
+    switch (type) {
+    case ASS_CACHE_FONT:        return priv->cache.font_cache;
+    case ASS_CACHE_OUTLINE:     return priv->cache.outline_cache;
+    case ASS_CACHE_BITMAP:      return priv->cache.bitmap_cache;
+    case ASS_CACHE_COMPOSITE:   return priv->cache.composite_cache;
+    case ASS_CACHE_SHADOW:      return priv->cache.shadow_cache;
+    case ASS_CACHE_EVENT:       return priv->cache.event_cache;
+    case ASS_CACHE_TAGS:        return priv->cache.tags_cache;
+    case ASS_CACHE_SHAPED_RUN:  return ass_shaper_run_cache(priv->shaper);
+    }
+    return NULL;
+}
+
+void ass_reset_render_stats(ASS_Renderer *priv)
+{
+    memset(priv->last_stats, 0, sizeof(priv->last_stats));
+    memset(priv->total_stats, 0, sizeof(priv->total_stats));
+    priv->alloc_mark = ass_render_constructed_bytes(priv);
+    for (int i = ASS_CACHE_FONT; i <= ASS_CACHE_SHAPED_RUN; i++) {
+        Cache *cache = get_cache(priv, i);
+        if (cache)
+            ass_cache_reset_stats(cache);
+    }
+}
+
+int ass_get_cache_stats(ASS_Renderer *priv, ASS_CacheType type,
+                        ASS_CacheStats *stats)
+{
+    Cache *cache = get_cache(priv, type);
+    if (!cache) {
+        memset(stats, 0, sizeof(*stats));
+        return 0;
+    }
+    ass_cache_stats(cache, stats);
+    return 1;
 }
@@ -37,6 +37,12 @@ enum {
     CLIG
 };
 #define NUM_FEATURES 5
+
+// optional features of a run, part of the shaped run key
+enum {
+    FEATURE_KERNING   = 1 << 0,
+    FEATURE_LIGATURES = 1 << 1,
+};
 #endif
 
 #if FRIBIDI_MAJOR_VERSION >= 1
@@ -62,9 +68,13 @@ struct ass_shaper {
     int n_features;
     hb_feature_t *features;
     hb_language_t language;
+    bool kerning;
 
     // Glyph metrics cache, to speed up shaping
     Cache *metrics_cache;
+    // Shaped run cache, to skip shaping of repeated text
+    Cache *run_cache;
+    hb_buffer_t *buf;
 #endif
 };
 
@@ -121,7 +131,9 @@ static bool check_allocations(ASS_Shaper *shaper, size_t new_size)
 void ass_shaper_free(ASS_Shaper *shaper)
 {
 #ifdef CONFIG_HARFBUZZ
+    ass_cache_done(shaper->run_cache);
     ass_cache_done(shaper->metrics_cache);
+    hb_buffer_destroy(shaper->buf);
     free(shaper->features);
 #endif
     free(shaper->event_text);
@@ -137,10 +149,30 @@ void ass_shaper_free(ASS_Shaper *shaper)
 void ass_shaper_empty_cache(ASS_Shaper *shaper)
 {
 #ifdef CONFIG_HARFBUZZ
+    ass_cache_empty(shaper->run_cache);
     ass_cache_empty(shaper->metrics_cache);
 #endif
 }
 
+void ass_shaper_cut_cache(ASS_Shaper *shaper, size_t max_size)
+{
+#ifdef CONFIG_HARFBUZZ
+    ass_cache_cut(shaper->run_cache, max_size);
+#endif
+}
+
+/**
+ * \brief Get the shaped run cache, NULL without HarfBuzz
+ */
+Cache *ass_shaper_run_cache(ASS_Shaper *shaper)
+{
+#ifdef CONFIG_HARFBUZZ
+    return shaper->run_cache;
+#else
+    return NULL;
+#endif
+}
+
 void ass_shaper_font_data_free(ASS_ShaperFontData *priv)
 {
 #ifdef CONFIG_HARFBUZZ
@@ -184,19 +216,17 @@ static bool init_features(ASS_Shaper *shaper)
 /**
  * \brief Set features depending on properties of the run
  */
-static void set_run_features(ASS_Shaper *shaper, GlyphInfo *info)
+static void set_run_features(ASS_Shaper *shaper, ShapeProps *props)
 {
     // enable vertical substitutions for @font runs
-    if (info->font->desc.vertical)
+    if (props->font->desc.vertical)
         shaper->features[VERT].value = shaper->features[VKNA].value = 1;
     else
         shaper->features[VERT].value = shaper->features[VKNA].value = 0;
 
-    // disable ligatures if horizontal spacing is non-standard
-    if (info->hspacing)
-        shaper->features[LIGA].value = shaper->features[CLIG].value = 0;
-    else
-        shaper->features[LIGA].value = shaper->features[CLIG].value = 1;
+    shaper->features[KERN].value = !!(props->features & FEATURE_KERNING);
+    shaper->features[LIGA].value = shaper->features[CLIG].value =
+        !!(props->features & FEATURE_LIGATURES);
 }
 
 /**
@@ -410,12 +440,12 @@ get_contour_point(hb_font_t *font, void *font_data, hb_codepoint_t glyph,
 /**
  * \brief Retrieve HarfBuzz font from cache.
  * Create it from FreeType font, if needed.
- * \param info glyph cluster
+ * \param props run properties
  * \return HarfBuzz font
  */
-static hb_font_t *get_hb_font(ASS_Shaper *shaper, GlyphInfo *info)
+static hb_font_t *get_hb_font(ASS_Shaper *shaper, ShapeProps *props)
 {
-    ASS_Font *font = info->font;
+    ASS_Font *font = props->font;
     hb_font_t **hb_fonts;
 
     if (!font->shaper_priv)
@@ -423,20 +453,19 @@ static hb_font_t *get_hb_font(ASS_Shaper *shaper, GlyphInfo *info)
 
 
     hb_fonts = font->shaper_priv->fonts;
-    if (!hb_fonts[info->face_index]) {
-        hb_fonts[info->face_index] =
-            hb_ft_font_create(font->faces[info->face_index], NULL);
+    if (!hb_fonts[props->face_index]) {
+        hb_fonts[props->face_index] =
+            hb_ft_font_create(font->faces[props->face_index], NULL);
 
         // set up cached metrics access
-        font->shaper_priv->metrics_data[info->face_index] =
+        font->shaper_priv->metrics_data[props->face_index] =
             calloc(sizeof(struct ass_shaper_metrics_data), 1);
         struct ass_shaper_metrics_data *metrics =
-            font->shaper_priv->metrics_data[info->face_index];
-        metrics->metrics_cache = shaper->metrics_cache;
-        metrics->vertical = info->font->desc.vertical;
+            font->shaper_priv->metrics_data[props->face_index];
+        metrics->vertical = props->font->desc.vertical;
 
         hb_font_funcs_t *funcs = hb_font_funcs_create();
-        font->shaper_priv->font_funcs[info->face_index] = funcs;
+        font->shaper_priv->font_funcs[props->face_index] = funcs;
         hb_font_funcs_set_nominal_glyph_func(funcs, get_glyph_nominal,
                 metrics, NULL);
         hb_font_funcs_set_variation_glyph_func(funcs, get_glyph_variation,
@@ -457,21 +486,23 @@ static hb_font_t *get_hb_font(ASS_Shaper *shaper, GlyphInfo *info)
                 metrics, NULL);
         hb_font_funcs_set_glyph_contour_point_func(funcs, get_contour_point,
                 metrics, NULL);
-        hb_font_set_funcs(hb_fonts[info->face_index], funcs,
-                font->faces[info->face_index], NULL);
+        hb_font_set_funcs(hb_fonts[props->face_index], funcs,
+                font->faces[props->face_index], NULL);
     }
 
-    ass_face_set_size(font->faces[info->face_index], info->font_size);
-    update_hb_size(hb_fonts[info->face_index], font->faces[info->face_index]);
+    ass_face_set_size(font->faces[props->face_index], props->size);
+    update_hb_size(hb_fonts[props->face_index], font->faces[props->face_index]);
 
-    // update hash key for cached metrics
+    // update hash key for cached metrics; the font can be used by
+    // several shapers, so the metrics cache must be refreshed as well
     struct ass_shaper_metrics_data *metrics =
-        font->shaper_priv->metrics_data[info->face_index];
-    metrics->hash_key.font = info->font;
-    metrics->hash_key.face_index = info->face_index;
-    metrics->hash_key.size = info->font_size;
+        font->shaper_priv->metrics_data[props->face_index];
+    metrics->metrics_cache = shaper->metrics_cache;
+    metrics->hash_key.font = props->font;
+    metrics->hash_key.face_index = props->face_index;
+    metrics->hash_key.size = props->size;
 
-    return hb_fonts[info->face_index];
+    return hb_fonts[props->face_index];
 }
 
 /**
@@ -575,23 +606,68 @@ hb_shaper_get_run_language(ASS_Shaper *shaper, hb_script_t script)
     return lang;
 }
 
+/**
+ * \brief Shape a run of text, store the glyphs in a cache value
+ */
+size_t ass_shaped_run_construct(void *key, void *value, void *priv)
+{
+    ASS_Shaper *shaper = priv;
+    ShapedRunHashKey *k = key;
+    ShapedRunHashValue *v = value;
+    hb_buffer_t *buf = shaper->buf;
+    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
+
+    hb_font_t *font = get_hb_font(shaper, &k->props);
+
+    hb_buffer_pre_allocate(buf, k->length);
+    hb_buffer_add_utf32(buf, k->text, k->length, 0, k->length);
+
+    props.direction = k->props.rtl ? HB_DIRECTION_RTL : HB_DIRECTION_LTR;
+    props.script = k->props.script;
+    props.language = k->props.language;
+    hb_buffer_set_segment_properties(buf, &props);
+
+    set_run_features(shaper, &k->props);
+    hb_shape(font, buf, shaper->features, shaper->n_features);
+
+    unsigned num_glyphs = hb_buffer_get_length(buf);
+    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, NULL);
+    hb_glyph_position_t *pos    = hb_buffer_get_glyph_positions(buf, NULL);
+
+    v->valid = false;
+    v->n_glyphs = num_glyphs;
+    v->glyphs = ass_realloc_array(NULL, num_glyphs, sizeof(ShapedGlyph));
+    if (v->glyphs || !num_glyphs) {
+        for (unsigned j = 0; j < num_glyphs; j++) {
+            ShapedGlyph *glyph = v->glyphs + j;
+            glyph->glyph_index = glyph_info[j].codepoint;
+            glyph->cluster   = glyph_info[j].cluster;
+            glyph->x_advance = pos[j].x_advance;
+            glyph->y_advance = pos[j].y_advance;
+            glyph->x_offset  = pos[j].x_offset;
+            glyph->y_offset  = pos[j].y_offset;
+        }
+        v->valid = true;
+    }
+
+    hb_buffer_reset(buf);
+    return 1;
+}
+
 /**
  * \brief Feed a run of shaped characters into the GlyphInfo array.
  *
  * \param glyphs GlyphInfo array
- * \param buf buffer of shaped run
+ * \param run shaped run
  * \param offset offset into GlyphInfo array
  */
 static void
-shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
+shape_harfbuzz_process_run(GlyphInfo *glyphs, ShapedRunHashValue *run,
+                           int offset)
 {
-    int j;
-    int num_glyphs = hb_buffer_get_length(buf);
-    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, NULL);
-    hb_glyph_position_t *pos    = hb_buffer_get_glyph_positions(buf, NULL);
-
-    for (j = 0; j < num_glyphs; j++) {
-        unsigned idx = glyph_info[j].cluster + offset;
+    for (size_t j = 0; j < run->n_glyphs; j++) {
+        ShapedGlyph *glyph = run->glyphs + j;
+        unsigned idx = glyph->cluster + offset;
         GlyphInfo *info = glyphs + idx;
         GlyphInfo *root = info;
 
@@ -611,11 +687,11 @@ shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
 
         // set position and advance
         info->skip = 0;
-        info->glyph_index = glyph_info[j].codepoint;
-        info->offset.x    = pos[j].x_offset * info->scale_x;
-        info->offset.y    = -pos[j].y_offset * info->scale_y;
-        info->advance.x   = pos[j].x_advance * info->scale_x;
-        info->advance.y   = -pos[j].y_advance * info->scale_y;
+        info->glyph_index = glyph->glyph_index;
+        info->offset.x    = glyph->x_offset * info->scale_x;
+        info->offset.y    = -glyph->y_offset * info->scale_y;
+        info->advance.x   = glyph->x_advance * info->scale_x;
+        info->advance.y   = -glyph->y_advance * info->scale_y;
 
         // accumulate advance in the root glyph
         root->cluster_advance.x += info->advance.x;
@@ -625,14 +701,13 @@ shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
 
 /**
  * \brief Shape event text with HarfBuzz. Full OpenType shaping.
+ * Runs are looked up in the shaped run cache and only shaped on a miss.
  * \param glyphs glyph clusters
  * \param len number of clusters
  */
 static void shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
 {
     int i;
-    hb_buffer_t *buf = hb_buffer_create();
-    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
 
     // Initialize: skip all glyphs, this is undone later as needed
     for (i = 0; i < len; i++)
@@ -640,31 +715,33 @@ static void shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
 
     for (i = 0; i < len; i++) {
         int offset = i;
-        hb_font_t *font = get_hb_font(shaper, glyphs + offset);
-        int level = glyphs[offset].shape_run_id;
-        int direction = shaper->emblevels[offset] % 2;
+        GlyphInfo *info = glyphs + offset;
+        int level = info->shape_run_id;
 
         // advance in text until end of run
         while (i < (len - 1) && level == glyphs[i+1].shape_run_id)
             i++;
 
-        hb_buffer_pre_allocate(buf, i - offset + 1);
-        hb_buffer_add_utf32(buf, shaper->event_text + offset, i - offset + 1,
-                0, i - offset + 1);
-
-        props.direction = direction ? HB_DIRECTION_RTL : HB_DIRECTION_LTR;
-        props.script = glyphs[offset].script;
-        props.language  = hb_shaper_get_run_language(shaper, props.script);
-        hb_buffer_set_segment_properties(buf, &props);
-
-        set_run_features(shaper, glyphs + offset);
-        hb_shape(font, buf, shaper->features, shaper->n_features);
-
-        shape_harfbuzz_process_run(glyphs, buf, offset);
-        hb_buffer_reset(buf);
+        ShapedRunHashKey key;
+        key.props.font = info->font;
+        key.props.size = info->font_size;
+        key.props.face_index = info->face_index;
+        key.props.script = info->script;
+        key.props.language = hb_shaper_get_run_language(shaper, info->script);
+        key.props.rtl = shaper->emblevels[offset] % 2;
+        // disable ligatures if horizontal spacing is non-standard
+        key.props.features = (shaper->kerning ? FEATURE_KERNING : 0) |
+            (info->hspacing ? 0 : FEATURE_LIGATURES);
+        key.length = i - offset + 1;
+        key.text = shaper->event_text + offset;
+
+        ShapedRunHashValue *run = ass_cache_get(shaper->run_cache, &key, shaper);
+        if (!run)
+            continue;
+        if (run->valid)
+            shape_harfbuzz_process_run(glyphs, run, offset);
+        ass_cache_dec_ref(run);
     }
-
-    hb_buffer_destroy(buf);
 }
 
 /**
@@ -724,6 +801,11 @@ size_t ass_glyph_metrics_construct(void *key, void *value, void *priv)
     return 0;  // that function should be never used
 }
 
+size_t ass_shaped_run_construct(void *key, void *value, void *priv)
+{
+    return 0;  // that function should be never used
+}
+
 #endif
 
 /**
@@ -761,7 +843,7 @@ static void shape_fribidi(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
 void ass_shaper_set_kerning(ASS_Shaper *shaper, int kern)
 {
 #ifdef CONFIG_HARFBUZZ
-    shaper->features[KERN].value = !!kern;
+    shaper->kerning = kern;
 #endif
 }
 
@@ -786,7 +868,7 @@ void ass_shaper_find_runs(ASS_Shaper *shaper, ASS_Renderer *render_priv,
         if (info->symbol == 0xfffc)
             continue;
         // set size and get glyph index
-        ass_font_get_index(render_priv->fontselect, info->font,
+        ass_font_get_index(ass_renderer_fontselect(render_priv), info->font,
                 info->symbol, &info->face_index, &info->glyph_index);
         // shape runs break on: xbord, ybord, xshad, yshad,
         // all four colors, all four alphas, be, blur, fn, fs,
@@ -966,6 +1048,12 @@ ASS_Shaper *ass_shaper_new(size_t prealloc)
     shaper->metrics_cache = ass_glyph_metrics_cache_create();
     if (!shaper->metrics_cache)
         goto error;
+    shaper->run_cache = ass_shaped_run_cache_create();
+    if (!shaper->run_cache)
+        goto error;
+    shaper->buf = hb_buffer_create();
+    if (!hb_buffer_allocation_successful(shaper->buf))
+        goto error;
 #endif
 
     return shaper;
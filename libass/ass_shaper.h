@@ -28,6 +28,8 @@ void ass_shaper_info(ASS_Library *lib);
 ASS_Shaper *ass_shaper_new(size_t prealloc);
 void ass_shaper_free(ASS_Shaper *shaper);
 void ass_shaper_empty_cache(ASS_Shaper *shaper);
+void ass_shaper_cut_cache(ASS_Shaper *shaper, size_t max_size);
+Cache *ass_shaper_run_cache(ASS_Shaper *shaper);
 void ass_shaper_set_kerning(ASS_Shaper *shaper, int kern);
 void ass_shaper_find_runs(ASS_Shaper *shaper, ASS_Renderer *render_priv,
                           GlyphInfo *glyphs, size_t len);
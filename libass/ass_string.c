@@ -20,6 +20,7 @@
 #include "ass_compat.h"
 
 #include "ass_string.h"
+#include "ass_utils.h"
 
 static const unsigned char lowertab[] = {
     0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
@@ -60,6 +61,20 @@ int ass_strcasecmp(const char *s1, const char *s2)
     return a - b;
 }
 
+/**
+ * \brief Hash a string so that strings equal under ass_strcasecmp()
+ * hash to the same value
+ */
+uint32_t ass_strcasehash(const char *str)
+{
+    uint32_t hval = FNV1_32A_INIT;
+    for (const unsigned char *s = (const unsigned char *) str; *s; s++) {
+        hval ^= lowertab[*s];
+        hval *= FNV1_32A_PRIME;
+    }
+    return hval;
+}
+
 int ass_strncasecmp(const char *s1, const char *s2, size_t n)
 {
     unsigned char a, b;
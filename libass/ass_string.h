@@ -17,12 +17,14 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifndef ASS_STRING_H
 #define ASS_STRING_H
 
 int ass_strcasecmp(const char *s1, const char *s2);
 int ass_strncasecmp(const char *s1, const char *s2, size_t n);
+uint32_t ass_strcasehash(const char *str);
 
 static inline int ass_isspace(int c)
 {
@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef CONFIG_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "ass_trace.h"
+
+/*
+ * File layout:
+ *   magic, uint version, then records until the end of file:
+ *     uint call, uint nanoseconds since the previous record, arguments
+ * A uint is a LEB128 variable-length integer, an int is a zigzag-encoded
+ * uint and a double is 8 bytes little-endian. Strings and string lists
+ * are stored as a uint with their length or count plus one, 0 for NULL,
+ * and blobs as a uint length, followed by the bytes or strings.
+ */
+#define TRACE_MAGIC "libass trace\n"
+#define TRACE_VERSION 1
+
+static const char *const trace_formats[TRACE_CALL_COUNT] = {
+    [TRACE_SET_FONTS_DIR]               = "s",
+    [TRACE_SET_FONTS_DIR_CACHE]         = "s",
+    [TRACE_SET_EXTRACT_FONTS]           = "i",
+    [TRACE_SET_STYLE_OVERRIDES]         = "v",
+    [TRACE_SET_ZERO_COPY]               = "i",
+    [TRACE_SET_PARSE_THREADS]           = "i",
+    [TRACE_ADD_FONT]                    = "sb",
+    [TRACE_CLEAR_FONTS]                 = "",
+
+    [TRACE_RENDERER_INIT]               = "o",
+    [TRACE_RENDERER_DONE]               = "o",
+    [TRACE_SET_FRAME_SIZE]              = "oii",
+    [TRACE_SET_STORAGE_SIZE]            = "oii",
+    [TRACE_SET_SHAPER]                  = "oi",
+    [TRACE_SET_MARGINS]                 = "oiiii",
+    [TRACE_SET_USE_MARGINS]             = "oi",
+    [TRACE_SET_PIXEL_ASPECT]            = "od",
+    [TRACE_SET_FONT_SCALE]              = "od",
+    [TRACE_SET_HINTING]                 = "oi",
+    [TRACE_SET_BLUR_QUALITY]            = "oi",
+    [TRACE_SET_ROTATION_STEP]           = "od",
+    [TRACE_SET_MOTION_CACHE]            = "oi",
+    [TRACE_SET_LINE_SPACING]            = "od",
+    [TRACE_SET_LINE_POSITION]           = "od",
+    [TRACE_SET_FONTS]                   = "ossisi",
+    [TRACE_SET_FONT_INIT_MODE]          = "oi",
+    [TRACE_SET_SELECTIVE_STYLE_OVERRIDE_ENABLED] = "oi",
+    [TRACE_SET_CACHE_LIMITS]            = "oii",
+    [TRACE_SET_CACHE_BUDGET]            = "ol",
+    [TRACE_SET_THREADS]                 = "oi",
+    [TRACE_SET_FRAME_BUDGET]            = "oi",
+    [TRACE_RENDER_FRAME]                = "ool",
+    [TRACE_PREFETCH]                    = "ooll",
+
+    [TRACE_NEW_TRACK]                   = "o",
+    [TRACE_FREE_TRACK]                  = "o",
+    [TRACE_READ_MEMORY]                 = "ob",
+    [TRACE_PROCESS_DATA]                = "ob",
+    [TRACE_PROCESS_CODEC_PRIVATE]       = "ob",
+    [TRACE_PROCESS_CHUNK]               = "obll",
+    [TRACE_PROCESS_STREAM]              = "ob",
+    [TRACE_PROCESS_STREAM_END]          = "o",
+    [TRACE_FLUSH_EVENTS]                = "o",
+    [TRACE_SET_CHECK_READORDER]         = "oi",
+    [TRACE_SET_EVENT_RETENTION]         = "ol",
+    [TRACE_TRACK_SET_FEATURE]           = "oii",
+};
+
+struct ass_trace {
+    ASS_Library *library;
+    FILE *file;
+    int64_t last_time;              // of the previous record
+    int next_id;
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_t lock;           // protects everything above
+#endif
+};
+
+static void write_uint(FILE *file, uint64_t val)
+{
+    uint8_t buf[10];
+    int n = 0;
+    do {
+        buf[n] = val & 0x7F;
+        val >>= 7;
+        if (val)
+            buf[n] |= 0x80;
+        n++;
+    } while (val);
+    fwrite(buf, 1, n, file);
+}
+
+static void write_int(FILE *file, int64_t val)
+{
+    write_uint(file, (uint64_t) val << 1 ^ (uint64_t) (val >> 63));
+}
+
+static void write_double(FILE *file, double val)
+{
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    uint8_t buf[8];
+    for (int i = 0; i < 8; i++, bits >>= 8)
+        buf[i] = bits;
+    fwrite(buf, 1, 8, file);
+}
+
+static void write_string(FILE *file, const char *str)
+{
+    if (!str) {
+        write_uint(file, 0);
+        return;
+    }
+    size_t len = strlen(str);
+    write_uint(file, len + 1);
+    fwrite(str, 1, len, file);
+}
+
+ASS_Trace *ass_trace_open(ASS_Library *library, const char *path)
+{
+    ASS_Trace *trace = calloc(1, sizeof(*trace));
+    if (!trace)
+        return NULL;
+#ifdef CONFIG_PTHREAD
+    if (pthread_mutex_init(&trace->lock, NULL)) {
+        free(trace);
+        return NULL;
+    }
+#endif
+    trace->library = library;
+    trace->next_id = 1;
+    trace->last_time = ass_time_ns();
+    trace->file = fopen(path, "wb");
+    if (!trace->file) {
+        ass_msg(library, MSGL_ERR, "Cannot open trace file '%s'", path);
+        ass_trace_close(trace);
+        return NULL;
+    }
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace->file);
+    write_uint(trace->file, TRACE_VERSION);
+    ass_msg(library, MSGL_INFO, "Recording trace to '%s'", path);
+    return trace;
+}
+
+void ass_trace_close(ASS_Trace *trace)
+{
+    if (!trace)
+        return;
+    if (trace->file) {
+        bool failed = ferror(trace->file);
+        if (fclose(trace->file) || failed)
+            ass_msg(trace->library, MSGL_ERR, "Failed to write trace file");
+    }
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_destroy(&trace->lock);
+#endif
+    free(trace);
+}
+
+static void lock_trace(ASS_Trace *trace)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_lock(&trace->lock);
+#endif
+}
+
+static void unlock_trace(ASS_Trace *trace)
+{
+#ifdef CONFIG_PTHREAD
+    pthread_mutex_unlock(&trace->lock);
+#endif
+}
+
+int ass_trace_new_id(ASS_Trace *trace)
+{
+    if (!trace)
+        return 0;
+    lock_trace(trace);
+    int id = trace->next_id++;
+    unlock_trace(trace);
+    return id;
+}
+
+typedef struct {
+    int64_t i;
+    double d;
+    const void *ptr;
+    size_t size;
+} TraceValue;
+
+void ass_trace_call(ASS_Trace *trace, TraceCall call, ...)
+{
+    const char *format = trace_formats[call];
+    TraceValue values[TRACE_MAX_ARGS];
+    int n = strlen(format);
+
+    va_list va;
+    va_start(va, call);
+    for (int i = 0; i < n; i++) {
+        TraceValue *val = &values[i];
+        switch (format[i]) {
+        case 'o':
+        case 'i':
+            val->i = va_arg(va, int);
+            break;
+        case 'l':
+            val->i = va_arg(va, long long);
+            break;
+        case 'd':
+            val->d = va_arg(va, double);
+            break;
+        case 's':
+            val->ptr = va_arg(va, const char *);
+            break;
+        case 'b':
+            val->ptr = va_arg(va, const void *);
+            val->size = va_arg(va, size_t);
+            break;
+        case 'v':
+            val->ptr = va_arg(va, char **);
+            break;
+        }
+        // calls on objects made before the trace was started
+        if (format[i] == 'o' && !val->i) {
+            va_end(va);
+            return;
+        }
+    }
+    va_end(va);
+
+    lock_trace(trace);
+    FILE *file = trace->file;
+    int64_t now = ass_time_ns();
+    write_uint(file, call);
+    write_uint(file, FFMAX(now - trace->last_time, 0));
+    trace->last_time = now;
+    for (int i = 0; i < n; i++) {
+        const TraceValue *val = &values[i];
+        switch (format[i]) {
+        case 'o':
+        case 'i':
+        case 'l':
+            write_int(file, val->i);
+            break;
+        case 'd':
+            write_double(file, val->d);
+            break;
+        case 's':
+            write_string(file, val->ptr);
+            break;
+        case 'b':
+            write_uint(file, val->size);
+            fwrite(val->ptr, 1, val->size, file);
+            break;
+        case 'v': {
+            char *const *list = val->ptr;
+            size_t count = 0;
+            while (list && list[count])
+                count++;
+            write_uint(file, list ? count + 1 : 0);
+            for (size_t j = 0; j < count; j++)
+                write_string(file, list[j]);
+            break;
+        }
+        }
+    }
+    unlock_trace(trace);
+}
+
+
+static uint64_t read_uint(TraceReader *reader)
+{
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(reader->file);
+        if (c == EOF)
+            break;
+        val |= (uint64_t) (c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return val;
+    }
+    reader->error = true;
+    return 0;
+}
+
+static int64_t read_int(TraceReader *reader)
+{
+    uint64_t val = read_uint(reader);
+    return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+}
+
+static double read_double(TraceReader *reader)
+{
+    uint8_t buf[8];
+    if (fread(buf, 1, 8, reader->file) != 8) {
+        reader->error = true;
+        return 0;
+    }
+    uint64_t bits = 0;
+    for (int i = 7; i >= 0; i--)
+        bits = bits << 8 | buf[i];
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+// Read size bytes into a zero-terminated arena buffer
+static char *read_bytes(TraceReader *reader, uint64_t size)
+{
+    if (reader->error || size >= SIZE_MAX) {
+        reader->error = true;
+        return NULL;
+    }
+    char *buf = ass_arena_alloc(&reader->arena, size + 1, 1);
+    if (!buf || fread(buf, 1, size, reader->file) != size) {
+        reader->error = true;
+        return NULL;
+    }
+    buf[size] = '\0';
+    return buf;
+}
+
+static char *read_string(TraceReader *reader)
+{
+    uint64_t len = read_uint(reader);
+    if (!len)
+        return NULL;
+    return read_bytes(reader, len - 1);
+}
+
+static char **read_list(TraceReader *reader)
+{
+    uint64_t count = read_uint(reader);
+    if (!count)
+        return NULL;
+    if (count > SIZE_MAX / sizeof(char *)) {
+        reader->error = true;
+        return NULL;
+    }
+    char **list = ass_arena_alloc(&reader->arena, count * sizeof(char *),
+                                  sizeof(char *));
+    if (!list) {
+        reader->error = true;
+        return NULL;
+    }
+    for (size_t i = 0; i < count - 1 && !reader->error; i++)
+        if (!(list[i] = read_string(reader)))
+            reader->error = true;
+    list[count - 1] = NULL;
+    return list;
+}
+
+bool ass_trace_reader_open(TraceReader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+        return false;
+
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), reader->file) != sizeof(magic) ||
+            memcmp(magic, TRACE_MAGIC, sizeof(magic)) ||
+            read_uint(reader) != TRACE_VERSION || reader->error) {
+        ass_trace_reader_close(reader);
+        return false;
+    }
+    return true;
+}
+
+void ass_trace_reader_close(TraceReader *reader)
+{
+    if (reader->file)
+        fclose(reader->file);
+    ass_arena_done(&reader->arena);
+    memset(reader, 0, sizeof(*reader));
+}
+
+const TraceRecord *ass_trace_read(TraceReader *reader)
+{
+    if (reader->error)
+        return NULL;
+    ass_arena_reset(&reader->arena);
+
+    int c = getc(reader->file);
+    if (c == EOF)
+        return NULL;
+    ungetc(c, reader->file);
+
+    TraceRecord *rec = &reader->record;
+    memset(rec, 0, sizeof(*rec));
+    uint64_t call = read_uint(reader);
+    if (!call || call >= TRACE_CALL_COUNT || !trace_formats[call]) {
+        reader->error = true;
+        return NULL;
+    }
+    rec->call = call;
+    reader->time += read_uint(reader);
+    rec->time = reader->time;
+
+    const char *format = trace_formats[call];
+    for (int i = 0; format[i] && !reader->error; i++) {
+        TraceArg *arg = &rec->args[i];
+        switch (format[i]) {
+        case 'o':
+        case 'i':
+        case 'l':
+            arg->i = read_int(reader);
+            break;
+        case 'd':
+            arg->d = read_double(reader);
+            break;
+        case 's':
+            arg->str = read_string(reader);
+            break;
+        case 'b':
+            arg->size = read_uint(reader);
+            arg->str = read_bytes(reader, arg->size);
+            break;
+        case 'v':
+            arg->list = read_list(reader);
+            break;
+        }
+    }
+    return reader->error ? NULL : rec;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_TRACE_H
+#define LIBASS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ass.h"
+#include "ass_utils.h"
+
+/*
+ * Trace of the API calls made on a library, see ass_set_trace_file().
+ * Renderers and tracks created while the trace is active get ids, calls
+ * on other objects are not recorded. Every record holds the call, the time
+ * since the previous record and the arguments as listed in trace_formats
+ * of ass_trace.c. Values are numbered in the order of the enum and must
+ * not change, new calls are added at the end.
+ */
+
+typedef enum {
+    TRACE_SET_FONTS_DIR = 1,
+    TRACE_SET_FONTS_DIR_CACHE,
+    TRACE_SET_EXTRACT_FONTS,
+    TRACE_SET_STYLE_OVERRIDES,
+    TRACE_SET_ZERO_COPY,
+    TRACE_SET_PARSE_THREADS,
+    TRACE_ADD_FONT,
+    TRACE_CLEAR_FONTS,
+
+    TRACE_RENDERER_INIT,
+    TRACE_RENDERER_DONE,
+    TRACE_SET_FRAME_SIZE,
+    TRACE_SET_STORAGE_SIZE,
+    TRACE_SET_SHAPER,
+    TRACE_SET_MARGINS,
+    TRACE_SET_USE_MARGINS,
+    TRACE_SET_PIXEL_ASPECT,
+    TRACE_SET_FONT_SCALE,
+    TRACE_SET_HINTING,
+    TRACE_SET_BLUR_QUALITY,
+    TRACE_SET_ROTATION_STEP,
+    TRACE_SET_MOTION_CACHE,
+    TRACE_SET_LINE_SPACING,
+    TRACE_SET_LINE_POSITION,
+    TRACE_SET_FONTS,
+    TRACE_SET_FONT_INIT_MODE,
+    TRACE_SET_SELECTIVE_STYLE_OVERRIDE_ENABLED,
+    TRACE_SET_CACHE_LIMITS,
+    TRACE_SET_CACHE_BUDGET,
+    TRACE_SET_THREADS,
+    TRACE_SET_FRAME_BUDGET,
+    TRACE_RENDER_FRAME,
+    TRACE_PREFETCH,
+
+    TRACE_NEW_TRACK,
+    TRACE_FREE_TRACK,
+    TRACE_READ_MEMORY,
+    TRACE_PROCESS_DATA,
+    TRACE_PROCESS_CODEC_PRIVATE,
+    TRACE_PROCESS_CHUNK,
+    TRACE_PROCESS_STREAM,
+    TRACE_PROCESS_STREAM_END,
+    TRACE_FLUSH_EVENTS,
+    TRACE_SET_CHECK_READORDER,
+    TRACE_SET_EVENT_RETENTION,
+    TRACE_TRACK_SET_FEATURE,
+
+    TRACE_CALL_COUNT
+} TraceCall;
+
+typedef struct ass_trace ASS_Trace;
+
+ASS_Trace *ass_trace_open(ASS_Library *library, const char *path);
+void ass_trace_close(ASS_Trace *trace);
+
+/**
+ * \brief Get an id for a new renderer or track
+ * \return 0 without a trace
+ */
+int ass_trace_new_id(ASS_Trace *trace);
+
+/**
+ * \brief Record a call with its arguments
+ * The arguments follow the format of the call, where
+ *   'o' is an int object id, the call is dropped if it is 0,
+ *   'i' is an int, 'l' a long long, 'd' a double,
+ *   's' a string that may be NULL,
+ *   'b' a data pointer followed by its size_t size,
+ *   'v' a NULL-terminated string list that may be NULL.
+ */
+void ass_trace_call(ASS_Trace *trace, TraceCall call, ...);
+
+#define ASS_TRACE(library, ...) do { \
+        if ((library)->trace) \
+            ass_trace_call((library)->trace, __VA_ARGS__); \
+    } while (0)
+
+// implemented in ass.c, since the id is kept in the private track data
+int ass_track_trace_id(ASS_Track *track);
+
+
+#define TRACE_MAX_ARGS 6
+
+typedef struct {
+    int64_t i;                      // 'o', 'i' and 'l'
+    double d;
+    char *str;                      // 's' and 'b', zero-terminated
+    size_t size;                    // 'b'
+    char **list;                    // 'v'
+} TraceArg;
+
+typedef struct {
+    TraceCall call;
+    int64_t time;                   // in nanoseconds since the trace start
+    TraceArg args[TRACE_MAX_ARGS];
+} TraceRecord;
+
+typedef struct {
+    FILE *file;
+    int64_t time;
+    Arena arena;                    // strings of the current record
+    TraceRecord record;
+    bool error;                     // the trace ended with a broken record
+} TraceReader;
+
+bool ass_trace_reader_open(TraceReader *reader, const char *path);
+void ass_trace_reader_close(TraceReader *reader);
+
+/**
+ * \brief Read the next record of a trace
+ * \return the record, valid until the next call, or NULL at the end
+ * of the trace or at a truncated or corrupt record, which sets error
+ */
+const TraceRecord *ass_trace_read(TraceReader *reader);
+
+#endif                          /* LIBASS_TRACE_H */
@@ -49,6 +49,7 @@ typedef struct ass_renderer ASS_Renderer;
 typedef struct render_priv ASS_RenderPriv;
 typedef struct parser_priv ASS_ParserPriv;
 typedef struct ass_library ASS_Library;
+typedef struct ass_shared_cache ASS_SharedCache;
 
 /* ASS Style: line */
 typedef struct ass_style {
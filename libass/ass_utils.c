@@ -25,6 +25,10 @@
 #include <stdint.h>
 #include <limits.h>
 #include <inttypes.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include "ass_library.h"
 #include "ass.h"
@@ -64,6 +68,21 @@ int has_avx2(void)
     return (ebx >> 5) & has_avx();
 }
 
+#if CONFIG_AVX512
+int has_avx512bw(void)
+{
+    if (!has_avx())
+        return 0;
+    uint32_t eax, ebx, ecx, edx;
+    ass_get_xgetbv(0, &eax, &edx);
+    if ((eax & 0xE6) != 0xE6) // check opmask and ZMM state is enabled by OS
+        return 0;
+    eax = 7;
+    ass_get_cpuid(&eax, &ebx, &ecx, &edx);
+    return (ebx >> 16) & (ebx >> 30) & 0x1; // AVX512F and AVX512BW
+}
+#endif
+
 #endif // ASM
 
 #ifndef HAVE_STRNDUP
@@ -138,6 +157,161 @@ void *ass_try_realloc_array(void *ptr, size_t nmemb, size_t size)
     }
 }
 
+#define ARENA_BLOCK_SIZE (64 << 10)
+#define ARENA_MAX_KEEP (16 << 20)  // larger arenas are freed on reset
+
+struct arena_block {
+    ArenaBlock *next;
+    size_t size;
+};
+
+static inline char *arena_block_data(ArenaBlock *block)
+{
+    return (char *) (block + 1);
+}
+
+static inline char *align_ptr(char *ptr, size_t alignment)
+{
+    return (char *) (((uintptr_t) ptr + alignment - 1) & ~(uintptr_t) (alignment - 1));
+}
+
+/**
+ * \brief Allocate uninitialized memory from the arena
+ * \param alignment power of 2
+ * \return NULL on failure
+ */
+void *ass_arena_alloc(Arena *arena, size_t size, size_t alignment)
+{
+    assert(alignment && !(alignment & (alignment - 1)));
+    char *ptr = align_ptr(arena->pos, alignment);
+    if (arena->cur && ptr <= arena->end && size <= arena->end - ptr) {
+        arena->pos = ptr + size;
+        return ptr;
+    }
+
+    // look for a spare block left by ass_arena_release()
+    ArenaBlock *last = arena->cur;
+    ArenaBlock *block = last ? last->next : arena->first;
+    for (; block; last = block, block = block->next) {
+        char *data = arena_block_data(block);
+        ptr = align_ptr(data, alignment);
+        if (ptr - data <= block->size && size <= block->size - (ptr - data))
+            break;
+    }
+
+    if (!block) {
+        if (size > SIZE_MAX - sizeof(ArenaBlock) - alignment)
+            return NULL;
+        size_t block_size = FFMAX(ARENA_BLOCK_SIZE, size + alignment - 1);
+        if (last && last->size < SIZE_MAX / 4)
+            block_size = FFMAX(block_size, 2 * last->size);
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (!block)
+            return NULL;
+        block->next = NULL;
+        block->size = block_size;
+        if (last)
+            last->next = block;
+        else
+            arena->first = block;
+        ptr = align_ptr(arena_block_data(block), alignment);
+    }
+
+    arena->cur = block;
+    arena->end = arena_block_data(block) + block->size;
+    arena->pos = ptr + size;
+    return ptr;
+}
+
+/**
+ * \brief Grow an allocation, in place if it's the last one
+ * Contents up to old_size are preserved, the old memory stays valid.
+ */
+void *ass_arena_realloc(Arena *arena, void *ptr, size_t old_size,
+                        size_t size, size_t alignment)
+{
+    char *p = ptr;
+    if (p && p + old_size == arena->pos && size <= arena->end - p) {
+        arena->pos = p + size;
+        return p;
+    }
+    void *res = ass_arena_alloc(arena, size, alignment);
+    if (res && p)
+        memcpy(res, p, FFMIN(old_size, size));
+    return res;
+}
+
+/**
+ * \brief Drop all allocations done since ass_arena_mark()
+ */
+void ass_arena_release(Arena *arena, ArenaMark mark)
+{
+    arena->cur = mark.block;
+    arena->pos = mark.pos;
+    arena->end = mark.block ? arena_block_data(mark.block) + mark.block->size : NULL;
+}
+
+static void free_arena_blocks(ArenaBlock *block)
+{
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+/**
+ * \brief Drop all allocations
+ * Merges the blocks into one, so that the next frame fits without growing.
+ */
+void ass_arena_reset(Arena *arena)
+{
+    ArenaBlock *first = arena->first;
+    if (first && (first->next || first->size > ARENA_MAX_KEEP)) {
+        size_t total = 0;
+        for (ArenaBlock *block = first; block; block = block->next)
+            total += block->size;
+        free_arena_blocks(first);
+        first = NULL;
+        if (total <= ARENA_MAX_KEEP) {
+            first = malloc(sizeof(ArenaBlock) + total);
+            if (first) {
+                first->next = NULL;
+                first->size = total;
+            }
+        }
+    }
+    arena->first = first;
+    arena->cur = NULL;
+    arena->pos = arena->end = NULL;
+}
+
+void ass_arena_done(Arena *arena)
+{
+    free_arena_blocks(arena->first);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * \brief Monotonic clock for performance measurements
+ * \return current time in nanoseconds from an arbitrary origin
+ */
+int64_t ass_time_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (int64_t) ((double) now.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 void skip_spaces(char **str)
 {
     char *p = *str;
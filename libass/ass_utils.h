@@ -50,6 +50,9 @@
 int has_sse2(void);
 int has_avx(void);
 int has_avx2(void);
+#if CONFIG_AVX512
+int has_avx512bw(void);
+#endif
 #endif
 
 #ifndef HAVE_STRNDUP
@@ -76,6 +79,40 @@ void *ass_try_realloc_array(void *ptr, size_t nmemb, size_t size);
 #define ASS_REALLOC_ARRAY(ptr, count) \
     (errno = 0, (ptr) = ass_try_realloc_array(ptr, count, sizeof(*ptr)), !errno)
 
+typedef struct arena_block ArenaBlock;
+
+/**
+ * Bump allocator for scratch memory that doesn't outlive a frame.
+ * Allocations are never freed individually: ass_arena_release() drops
+ * everything allocated after a mark, ass_arena_reset() drops everything.
+ * Memory is kept for reuse, so a zero-initialized arena warms up after
+ * a few frames and then stops calling malloc altogether.
+ * Not thread-safe, every render thread has its own.
+ */
+typedef struct {
+    ArenaBlock *first, *cur;
+    char *pos, *end;
+} Arena;
+
+typedef struct {
+    ArenaBlock *block;
+    char *pos;
+} ArenaMark;
+
+static inline ArenaMark ass_arena_mark(const Arena *arena)
+{
+    return (ArenaMark) { arena->cur, arena->pos };
+}
+
+void *ass_arena_alloc(Arena *arena, size_t size, size_t alignment);
+void *ass_arena_realloc(Arena *arena, void *ptr, size_t old_size,
+                        size_t size, size_t alignment);
+void ass_arena_release(Arena *arena, ArenaMark mark);
+void ass_arena_reset(Arena *arena);
+void ass_arena_done(Arena *arena);
+
+int64_t ass_time_ns(void);
+
 void skip_spaces(char **str);
 void rskip_spaces(char **str, char *limit);
 int mystrtoi(char **p, int *res);
@@ -164,6 +201,54 @@ static inline int double_to_d22(double x)
     return (int) (x * 0x400000);
 }
 
+// Reference counts that may be changed from several threads at once
+static inline size_t ref_get(size_t *count)
+{
+#ifdef CONFIG_PTHREAD
+    return __atomic_load_n(count, __ATOMIC_RELAXED);
+#else
+    return *count;
+#endif
+}
+
+static inline void ref_inc(size_t *count)
+{
+#ifdef CONFIG_PTHREAD
+    __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+#else
+    ++*count;
+#endif
+}
+
+static inline size_t ref_dec(size_t *count)
+{
+#ifdef CONFIG_PTHREAD
+    return __atomic_sub_fetch(count, 1, __ATOMIC_ACQ_REL);
+#else
+    return --*count;
+#endif
+}
+
+// Fails once the count has dropped to zero: an object whose last
+// reference is being released must not be revived.
+static inline bool ref_inc_not_zero(size_t *count)
+{
+#ifdef CONFIG_PTHREAD
+    size_t old = __atomic_load_n(count, __ATOMIC_RELAXED);
+    do {
+        if (!old)
+            return false;
+    } while (!__atomic_compare_exchange_n(count, &old, old + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+#else
+    if (!*count)
+        return false;
+    ++*count;
+    return true;
+#endif
+}
+
 // Calculate cache key for a rotational angle in radians
 static inline int rot_key(double a)
 {
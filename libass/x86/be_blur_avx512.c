@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2013 rcombs <rcombs@rcombs.me>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <immintrin.h>
+
+#include "ass_utils.h"
+
+
+static inline __mmask64 tail_mask(intptr_t n)
+{
+    return n >= 32 ? 0xFFFFFFFF : ((__mmask64) 1 << n) - 1;
+}
+
+// 32 pixels at position x widened to words, pixels past w read as zero
+static inline __m512i load_pixels(const uint8_t *src, intptr_t x, intptr_t w)
+{
+    if (x >= w)
+        return _mm512_setzero_si512();
+    __m512i pix = _mm512_maskz_loadu_epi8(tail_mask(w - x), src + x);
+    return _mm512_cvtepu8_epi16(_mm512_castsi512_si256(pix));
+}
+
+static inline void store_pixels(uint8_t *dst, intptr_t x, intptr_t w, __m512i val)
+{
+    __m256i pix = _mm512_cvtepi16_epi8(val);
+    _mm512_mask_storeu_epi8(dst + x, tail_mask(w - x), _mm512_castsi256_si512(pix));
+}
+
+/**
+ * \brief Blur with [[1,2,1], [2,4,2], [1,2,1]] kernel
+ * AVX-512BW version of ass_be_blur_c(), 32 pixels per iteration.
+ * Uses the same column sums in tmp (needs 2 * stride words).
+ */
+void ass_be_blur_avx512(uint8_t *buf, intptr_t w, intptr_t h,
+                        intptr_t stride, uint16_t *tmp)
+{
+    static const int16_t index[32] = {
+         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+    };
+    const __m512i idx = _mm512_loadu_si512(index);
+    const __m512i idx_prev = _mm512_add_epi16(idx, _mm512_set1_epi16(31));
+    const __m512i idx_next = _mm512_add_epi16(idx, _mm512_set1_epi16(1));
+
+    uint16_t *col_pix_buf = tmp;
+    uint16_t *col_sum_buf = tmp + stride;
+
+    for (intptr_t y = 0; y < h; y++) {
+        const uint8_t *src = buf + y * stride;
+        uint8_t *dst = buf + (y - 1) * stride;
+
+        __m512i prev = _mm512_setzero_si512();
+        __m512i cur = load_pixels(src, 0, w);
+        for (intptr_t x = 0; x < w; x += 32) {
+            __m512i next = load_pixels(src, x + 32, w);
+            __m512i sum = _mm512_add_epi16(_mm512_permutex2var_epi16(prev, idx_prev, cur),
+                                           _mm512_permutex2var_epi16(cur, idx_next, next));
+            sum = _mm512_add_epi16(sum, _mm512_slli_epi16(cur, 1));
+
+            if (y) {
+                __m512i col_pix = _mm512_loadu_si512(col_pix_buf + x);
+                __m512i col_sum = _mm512_loadu_si512(col_sum_buf + x);
+                __m512i res = _mm512_add_epi16(_mm512_add_epi16(col_sum, col_pix), sum);
+                store_pixels(dst, x, w, _mm512_srli_epi16(res, 4));
+                _mm512_storeu_si512(col_sum_buf + x, _mm512_add_epi16(col_pix, sum));
+            } else {
+                _mm512_storeu_si512(col_sum_buf + x, sum);
+            }
+            _mm512_storeu_si512(col_pix_buf + x, sum);
+
+            prev = cur;
+            cur = next;
+        }
+    }
+
+    uint8_t *dst = buf + (h - 1) * stride;
+    for (intptr_t x = 0; x < w; x += 32) {
+        __m512i res = _mm512_add_epi16(_mm512_loadu_si512(col_sum_buf + x),
+                                       _mm512_loadu_si512(col_pix_buf + x));
+        store_pixels(dst, x, w, _mm512_srli_epi16(res, 4));
+    }
+}
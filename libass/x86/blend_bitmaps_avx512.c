@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2013 rcombs <rcombs@rcombs.me>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * AVX-512BW bitmap blending, 64 bytes per iteration.
+ * The row tail goes through masked loads and stores,
+ * so nothing past width is ever touched.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <immintrin.h>
+
+#include "ass_utils.h"
+
+
+static inline __mmask64 tail_mask(intptr_t n)
+{
+    return n >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << n) - 1;
+}
+
+void ass_add_bitmaps_avx512(uint8_t *dst, intptr_t dst_stride,
+                            uint8_t *src, intptr_t src_stride,
+                            intptr_t height, intptr_t width)
+{
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (intptr_t x = 0; x < width; x += 64) {
+            __mmask64 mask = tail_mask(width - x);
+            __m512i a = _mm512_maskz_loadu_epi8(mask, dst + x);
+            __m512i b = _mm512_maskz_loadu_epi8(mask, src + x);
+            _mm512_mask_storeu_epi8(dst + x, mask, _mm512_adds_epu8(a, b));
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+void ass_sub_bitmaps_avx512(uint8_t *dst, intptr_t dst_stride,
+                            uint8_t *src, intptr_t src_stride,
+                            intptr_t height, intptr_t width)
+{
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (intptr_t x = 0; x < width; x += 64) {
+            __mmask64 mask = tail_mask(width - x);
+            __m512i a = _mm512_maskz_loadu_epi8(mask, dst + x);
+            __m512i b = _mm512_maskz_loadu_epi8(mask, src + x);
+            _mm512_mask_storeu_epi8(dst + x, mask, _mm512_subs_epu8(a, b));
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+// (a * b + 255) >> 8 for 32 pixels
+static inline __m256i mul_half(__m256i a, __m256i b)
+{
+    __m512i r = _mm512_mullo_epi16(_mm512_cvtepu8_epi16(a), _mm512_cvtepu8_epi16(b));
+    r = _mm512_add_epi16(r, _mm512_set1_epi16(255));
+    return _mm512_cvtepi16_epi8(_mm512_srli_epi16(r, 8));
+}
+
+void ass_mul_bitmaps_avx512(uint8_t *dst, intptr_t dst_stride,
+                            uint8_t *src1, intptr_t src1_stride,
+                            uint8_t *src2, intptr_t src2_stride,
+                            intptr_t w, intptr_t h)
+{
+    uint8_t *end = src1 + src1_stride * h;
+    while (src1 < end) {
+        for (intptr_t x = 0; x < w; x += 64) {
+            __mmask64 mask = tail_mask(w - x);
+            __m512i a = _mm512_maskz_loadu_epi8(mask, src1 + x);
+            __m512i b = _mm512_maskz_loadu_epi8(mask, src2 + x);
+            __m256i lo = mul_half(_mm512_castsi512_si256(a), _mm512_castsi512_si256(b));
+            __m256i hi = mul_half(_mm512_extracti64x4_epi64(a, 1),
+                                  _mm512_extracti64x4_epi64(b, 1));
+            __m512i res = _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+            _mm512_mask_storeu_epi8(dst + x, mask, res);
+        }
+        dst  += dst_stride;
+        src1 += src1_stride;
+        src2 += src2_stride;
+    }
+}
+
+// x / 255 rounded to nearest, exact for x <= 255 * 255
+static inline __m512i div255(__m512i x)
+{
+    x = _mm512_add_epi16(x, _mm512_set1_epi16(128));
+    return _mm512_srli_epi16(_mm512_add_epi16(x, _mm512_srli_epi16(x, 8)), 8);
+}
+
+// c * k + p * (255 - k), divided by 255, for 8 pixels
+static inline __m256i blend_half(__m256i p, __m512i c, __m512i k)
+{
+    __m512i ik = _mm512_sub_epi16(_mm512_set1_epi16(255), k);
+    __m512i r = _mm512_add_epi16(_mm512_mullo_epi16(c, k),
+                                 _mm512_mullo_epi16(_mm512_cvtepu8_epi16(p), ik));
+    return _mm512_cvtepi16_epi8(div255(r));
+}
+
+/*
+ * 16 pixels per iteration. Alpha is blended like the colors with
+ * a color value of 255, as k + (a * (255 - k)) / 255 is the same as
+ * (255 * k + a * (255 - k)) / 255 with exact rounding.
+ */
+void ass_blend_rgba_avx512(uint8_t *dst, ptrdiff_t dst_stride,
+                           const uint8_t *src, ptrdiff_t src_stride,
+                           uintptr_t width, uintptr_t height, uint32_t color)
+{
+    uint64_t r = color >> 24;
+    uint64_t g = (color >> 16) & 0xFF;
+    uint64_t b = (color >> 8) & 0xFF;
+    __m512i c = _mm512_set1_epi64(r | g << 16 | b << 32 | (uint64_t) 255 << 48);
+    __m256i opacity = _mm256_set1_epi16(255 - (color & 0xFF));
+    __m256i round = _mm256_set1_epi16(128);
+    // each pixel's coverage repeated for its 4 components
+    __m512i idx_lo = _mm512_set_epi16(
+        7, 7, 7, 7, 6, 6, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4,
+        3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    __m512i idx_hi = _mm512_add_epi16(idx_lo, _mm512_set1_epi16(8));
+
+    for (uintptr_t y = 0; y < height; y++) {
+        for (uintptr_t x = 0; x < width; x += 16) {
+            intptr_t n = FFMIN(width - x, 16);
+            __mmask64 mask = tail_mask(4 * n);
+            __m128i s = _mm512_castsi512_si128(
+                _mm512_maskz_loadu_epi8(tail_mask(n), src + x));
+            __m256i k = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(s), opacity);
+            k = _mm256_add_epi16(k, round);
+            k = _mm256_srli_epi16(_mm256_add_epi16(k, _mm256_srli_epi16(k, 8)), 8);
+            __m512i k16 = _mm512_castsi256_si512(k);
+
+            __m512i p = _mm512_maskz_loadu_epi8(mask, dst + 4 * x);
+            __m256i lo = blend_half(_mm512_castsi512_si256(p), c,
+                                    _mm512_permutexvar_epi16(idx_lo, k16));
+            __m256i hi = blend_half(_mm512_extracti64x4_epi64(p, 1), c,
+                                    _mm512_permutexvar_epi16(idx_hi, k16));
+            __m512i res = _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+            _mm512_mask_storeu_epi8(dst + 4 * x, mask, res);
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
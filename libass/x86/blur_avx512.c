@@ -0,0 +1,643 @@
+/*
+ * Copyright (C) 2015 Vabishchevich Nikolay <vabnick@gmail.com>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * AVX-512BW cascade blur filters, see ass_blur.c for the algorithms.
+ * The engine uses align order 6, so every stripe is exactly
+ * one vector of 32 words wide. Results are bit-exact with C.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <immintrin.h>
+
+#include "ass_utils.h"
+#include "ass_bitmap.h"
+
+
+#define STRIPE_WIDTH  32
+#define STRIPE_MASK   (STRIPE_WIDTH - 1)
+static const int16_t dither_line[2 * STRIPE_WIDTH] = {
+     8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,
+     8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,
+    56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24,
+    56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24,
+};
+static const int16_t word_index[STRIPE_WIDTH] = {
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+};
+
+inline static __m512i load_line(const int16_t *ptr, uintptr_t offs, uintptr_t size)
+{
+    return offs < size ? _mm512_loadu_si512(ptr + offs) : _mm512_setzero_si512();
+}
+
+// ptr[k - n] for the stripe row cur with preceding row prev
+inline static __m512i shift_line(__m512i prev, __m512i cur, int n)
+{
+    __m512i index = _mm512_add_epi16(_mm512_loadu_si512(word_index),
+                                     _mm512_set1_epi16(STRIPE_WIDTH - n));
+    return _mm512_permutex2var_epi16(prev, index, cur);
+}
+
+// (a + b) >> 1 without overflow
+inline static __m512i half_add(__m512i a, __m512i b)
+{
+    __m512i odd = _mm512_and_si512(_mm512_xor_si512(a, b), _mm512_set1_epi16(1));
+    return _mm512_sub_epi16(_mm512_avg_epu16(a, b), odd);
+}
+
+// (a + 1) >> 1 with 16-bit wraparound like in C
+inline static __m512i round_half(__m512i a)
+{
+    return _mm512_srli_epi16(_mm512_add_epi16(a, _mm512_set1_epi16(1)), 1);
+}
+
+
+/*
+ * Unpack/Pack Functions
+ */
+
+void ass_stripe_unpack_avx512(int16_t *dst, const uint8_t *src, ptrdiff_t src_stride,
+                              uintptr_t width, uintptr_t height)
+{
+    for (uintptr_t y = 0; y < height; ++y) {
+        int16_t *ptr = dst;
+        for (uintptr_t x = 0; x < width; x += STRIPE_WIDTH) {
+            __m512i val = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *) (src + x)));
+            val = _mm512_or_si512(_mm512_slli_epi16(val, 7), _mm512_srli_epi16(val, 1));
+            _mm512_storeu_si512(ptr, round_half(val));
+            ptr += STRIPE_WIDTH * height;
+        }
+        dst += STRIPE_WIDTH;
+        src += src_stride;
+    }
+}
+
+void ass_stripe_pack_avx512(uint8_t *dst, ptrdiff_t dst_stride, const int16_t *src,
+                            uintptr_t width, uintptr_t height)
+{
+    const __m512i dither[2] = {
+        _mm512_loadu_si512(dither_line), _mm512_loadu_si512(dither_line + STRIPE_WIDTH)
+    };
+    for (uintptr_t x = 0; x < width; x += STRIPE_WIDTH) {
+        uint8_t *ptr = dst;
+        for (uintptr_t y = 0; y < height; ++y) {
+            __m512i val = _mm512_loadu_si512(src);
+            val = _mm512_sub_epi16(val, _mm512_srai_epi16(val, 8));
+            val = _mm512_srli_epi16(_mm512_add_epi16(val, dither[y & 1]), 6);
+            _mm256_storeu_si256((__m256i *) ptr, _mm512_cvtepi16_epi8(val));
+            ptr += dst_stride;
+            src += STRIPE_WIDTH;
+        }
+        dst += STRIPE_WIDTH;
+    }
+    uintptr_t left = dst_stride - ((width + STRIPE_MASK) & ~STRIPE_MASK);
+    for (uintptr_t y = 0; y < height; ++y) {
+        for (uintptr_t x = 0; x < left; ++x)
+            dst[x] = 0;
+        dst += dst_stride;
+    }
+}
+
+
+/*
+ * Contract Filters
+ *
+ * Inputs are always in [0, 0x4000] here, so halving adds
+ * give the same result as the 32-bit arithmetic of C.
+ */
+
+static inline __m512i shrink_func(__m512i p1p, __m512i p1n,
+                                  __m512i z0p, __m512i z0n,
+                                  __m512i n1p, __m512i n1n)
+{
+    __m512i r = half_add(_mm512_add_epi16(p1p, p1n), _mm512_add_epi16(n1p, n1n));
+    __m512i z = _mm512_add_epi16(z0p, z0n);
+    r = half_add(r, z);
+    r = half_add(r, _mm512_add_epi16(p1n, n1p));
+    return round_half(half_add(r, z));
+}
+
+// Even and odd words of the 64-word concatenation a:b
+static inline void deinterleave(__m512i *even, __m512i *odd, __m512i a, __m512i b)
+{
+    __m512i index = _mm512_slli_epi16(_mm512_loadu_si512(word_index), 1);
+    *even = _mm512_permutex2var_epi16(a, index, b);
+    index = _mm512_add_epi16(index, _mm512_set1_epi16(1));
+    *odd = _mm512_permutex2var_epi16(a, index, b);
+}
+
+void ass_shrink_horz_avx512(int16_t *dst, const int16_t *src,
+                            uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_width = (src_width + 5) >> 1;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs + 0 * step, size);
+            __m512i next = load_line(src, offs + 1 * step, size);
+            __m512i p1p, p1n, z0p, z0n, n1p, n1n;
+            deinterleave(&p1p, &p1n, shift_line(prev, cur, 4), shift_line(cur, next, 4));
+            deinterleave(&z0p, &z0n, shift_line(prev, cur, 2), shift_line(cur, next, 2));
+            deinterleave(&n1p, &n1n, cur, next);
+            _mm512_storeu_si512(dst, shrink_func(p1p, p1n, z0p, z0n, n1p, n1n));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        offs += step;
+    }
+}
+
+void ass_shrink_vert_avx512(int16_t *dst, const int16_t *src,
+                            uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_height = (src_height + 5) >> 1;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p1p = load_line(src, offs - 4 * STRIPE_WIDTH, step);
+            __m512i p1n = load_line(src, offs - 3 * STRIPE_WIDTH, step);
+            __m512i z0p = load_line(src, offs - 2 * STRIPE_WIDTH, step);
+            __m512i z0n = load_line(src, offs - 1 * STRIPE_WIDTH, step);
+            __m512i n1p = load_line(src, offs - 0 * STRIPE_WIDTH, step);
+            __m512i n1n = load_line(src, offs + 1 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, shrink_func(p1p, p1n, z0p, z0n, n1p, n1n));
+            dst += STRIPE_WIDTH;
+            offs += 2 * STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+
+/*
+ * Expand Filters
+ */
+
+static inline void expand_func(__m512i *rp, __m512i *rn,
+                               __m512i p1, __m512i z0, __m512i n1)
+{
+    __m512i r = _mm512_srli_epi16(_mm512_add_epi16(_mm512_srli_epi16(_mm512_add_epi16(p1, n1), 1), z0), 1);
+    __m512i r1 = _mm512_add_epi16(_mm512_srli_epi16(_mm512_add_epi16(r, p1), 1), z0);
+    __m512i r2 = _mm512_add_epi16(_mm512_srli_epi16(_mm512_add_epi16(r, n1), 1), z0);
+    *rp = round_half(r1);
+    *rn = round_half(r2);
+}
+
+// Interleave words of a and b, half is 0 for the low and 1 for the high halves
+static inline __m512i interleave(__m512i a, __m512i b, int half)
+{
+    __m512i index = _mm512_loadu_si512(word_index);
+    __m512i pos = _mm512_srli_epi16(index, 1);
+    __m512i sel = _mm512_slli_epi16(_mm512_and_si512(index, _mm512_set1_epi16(1)), 5);
+    index = _mm512_add_epi16(_mm512_add_epi16(pos, sel), _mm512_set1_epi16(half * STRIPE_WIDTH / 2));
+    return _mm512_permutex2var_epi16(a, index, b);
+}
+
+void ass_expand_horz_avx512(int16_t *dst, const int16_t *src,
+                            uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_width = 2 * src_width + 4;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = STRIPE_WIDTH; x < dst_width; x += 2 * STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i rp, rn;
+            expand_func(&rp, &rn, shift_line(prev, cur, 2), shift_line(prev, cur, 1), cur);
+            _mm512_storeu_si512(dst, interleave(rp, rn, 0));
+            _mm512_storeu_si512(dst + step, interleave(rp, rn, 1));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        dst += step;
+    }
+    if ((dst_width - 1) & STRIPE_WIDTH)
+        return;
+
+    for (uintptr_t y = 0; y < src_height; ++y) {
+        __m512i prev = load_line(src, offs - 1 * step, size);
+        __m512i cur  = load_line(src, offs - 0 * step, size);
+        __m512i rp, rn;
+        expand_func(&rp, &rn, shift_line(prev, cur, 2), shift_line(prev, cur, 1), cur);
+        _mm512_storeu_si512(dst, interleave(rp, rn, 0));
+        dst += STRIPE_WIDTH;
+        offs += STRIPE_WIDTH;
+    }
+}
+
+void ass_expand_vert_avx512(int16_t *dst, const int16_t *src,
+                            uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_height = 2 * src_height + 4;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; y += 2) {
+            __m512i p1 = load_line(src, offs - 2 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs - 1 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs - 0 * STRIPE_WIDTH, step);
+            __m512i rp, rn;
+            expand_func(&rp, &rn, p1, z0, n1);
+            _mm512_storeu_si512(dst, rp);
+            _mm512_storeu_si512(dst + STRIPE_WIDTH, rn);
+            dst += 2 * STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+
+/*
+ * Supplementary Filters
+ */
+
+static inline __m512i pre_blur1_func(__m512i p1, __m512i z0, __m512i n1)
+{
+    __m512i r = _mm512_srli_epi16(_mm512_add_epi16(p1, n1), 1);
+    return round_half(_mm512_add_epi16(r, z0));
+}
+
+static inline __m512i pre_blur2_func(__m512i p2, __m512i p1, __m512i z0,
+                                     __m512i n1, __m512i n2)
+{
+    __m512i r1 = _mm512_srli_epi16(_mm512_add_epi16(p2, n2), 1);
+    r1 = _mm512_add_epi16(_mm512_srli_epi16(_mm512_add_epi16(r1, z0), 1), z0);
+    __m512i r2 = _mm512_add_epi16(p1, n1);
+    __m512i r = _mm512_srli_epi16(_mm512_add_epi16(r1, r2), 1);
+    r = _mm512_or_si512(r, _mm512_and_si512(_mm512_and_si512(r1, r2), _mm512_set1_epi16(0x8000)));
+    return round_half(r);
+}
+
+// 32-bit part of pre_blur3_func() for 16 words
+static inline __m256i pre_blur3_half(__m256i z0, __m256i s1, __m256i s2, __m256i s3)
+{
+    __m512i r = _mm512_mullo_epi32(_mm512_cvtepu16_epi32(z0), _mm512_set1_epi32(20));
+    r = _mm512_add_epi32(r, _mm512_mullo_epi32(_mm512_cvtepu16_epi32(s1), _mm512_set1_epi32(15)));
+    r = _mm512_add_epi32(r, _mm512_mullo_epi32(_mm512_cvtepu16_epi32(s2), _mm512_set1_epi32(6)));
+    r = _mm512_add_epi32(r, _mm512_cvtepu16_epi32(s3));
+    r = _mm512_srli_epi32(_mm512_add_epi32(r, _mm512_set1_epi32(32)), 6);
+    return _mm512_cvtepi32_epi16(r);
+}
+
+static inline __m512i pre_blur3_func(__m512i p3, __m512i p2, __m512i p1,
+                                     __m512i z0,
+                                     __m512i n1, __m512i n2, __m512i n3)
+{
+    __m512i s1 = _mm512_add_epi16(p1, n1);
+    __m512i s2 = _mm512_add_epi16(p2, n2);
+    __m512i s3 = _mm512_add_epi16(p3, n3);
+    __m256i lo = pre_blur3_half(_mm512_castsi512_si256(z0), _mm512_castsi512_si256(s1),
+                                _mm512_castsi512_si256(s2), _mm512_castsi512_si256(s3));
+    __m256i hi = pre_blur3_half(_mm512_extracti64x4_epi64(z0, 1), _mm512_extracti64x4_epi64(s1, 1),
+                                _mm512_extracti64x4_epi64(s2, 1), _mm512_extracti64x4_epi64(s3, 1));
+    return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+}
+
+void ass_pre_blur1_horz_avx512(int16_t *dst, const int16_t *src,
+                               uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_width = src_width + 2;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i res = pre_blur1_func(shift_line(prev, cur, 2),
+                                         shift_line(prev, cur, 1), cur);
+            _mm512_storeu_si512(dst, res);
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+    }
+}
+
+void ass_pre_blur1_vert_avx512(int16_t *dst, const int16_t *src,
+                               uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_height = src_height + 2;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p1 = load_line(src, offs - 2 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs - 1 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs - 0 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, pre_blur1_func(p1, z0, n1));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+void ass_pre_blur2_horz_avx512(int16_t *dst, const int16_t *src,
+                               uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_width = src_width + 4;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i res = pre_blur2_func(shift_line(prev, cur, 4), shift_line(prev, cur, 3),
+                                         shift_line(prev, cur, 2), shift_line(prev, cur, 1),
+                                         cur);
+            _mm512_storeu_si512(dst, res);
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+    }
+}
+
+void ass_pre_blur2_vert_avx512(int16_t *dst, const int16_t *src,
+                               uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_height = src_height + 4;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p2 = load_line(src, offs - 4 * STRIPE_WIDTH, step);
+            __m512i p1 = load_line(src, offs - 3 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs - 2 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs - 1 * STRIPE_WIDTH, step);
+            __m512i n2 = load_line(src, offs - 0 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, pre_blur2_func(p2, p1, z0, n1, n2));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+void ass_pre_blur3_horz_avx512(int16_t *dst, const int16_t *src,
+                               uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_width = src_width + 6;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i res = pre_blur3_func(shift_line(prev, cur, 6), shift_line(prev, cur, 5),
+                                         shift_line(prev, cur, 4), shift_line(prev, cur, 3),
+                                         shift_line(prev, cur, 2), shift_line(prev, cur, 1),
+                                         cur);
+            _mm512_storeu_si512(dst, res);
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+    }
+}
+
+void ass_pre_blur3_vert_avx512(int16_t *dst, const int16_t *src,
+                               uintptr_t src_width, uintptr_t src_height)
+{
+    uintptr_t dst_height = src_height + 6;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p3 = load_line(src, offs - 6 * STRIPE_WIDTH, step);
+            __m512i p2 = load_line(src, offs - 5 * STRIPE_WIDTH, step);
+            __m512i p1 = load_line(src, offs - 4 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs - 3 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs - 2 * STRIPE_WIDTH, step);
+            __m512i n2 = load_line(src, offs - 1 * STRIPE_WIDTH, step);
+            __m512i n3 = load_line(src, offs - 0 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, pre_blur3_func(p3, p2, p1, z0, n1, n2, n3));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+
+/*
+ * Main 9-tap Parametric Filters
+ */
+
+// Two symmetric taps with the same coefficient for 32-bit halves lo and hi
+static inline void blur_tap(__m512i *lo, __m512i *hi,
+                            __m512i p, __m512i n, __m512i z0, int16_t c)
+{
+    p = _mm512_sub_epi16(p, z0);
+    n = _mm512_sub_epi16(n, z0);
+    __m512i coeff = _mm512_set1_epi16(c);
+    *lo = _mm512_add_epi32(*lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(p, n), coeff));
+    *hi = _mm512_add_epi32(*hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(p, n), coeff));
+}
+
+static inline __m512i blur_func(__m512i p4, __m512i p3, __m512i p2, __m512i p1,
+                                __m512i z0,
+                                __m512i n1, __m512i n2, __m512i n3, __m512i n4,
+                                const int16_t c[])
+{
+    __m512i lo = _mm512_set1_epi32(0x8000), hi = lo;
+    blur_tap(&lo, &hi, p1, n1, z0, c[0]);
+    blur_tap(&lo, &hi, p2, n2, z0, c[1]);
+    blur_tap(&lo, &hi, p3, n3, z0, c[2]);
+    blur_tap(&lo, &hi, p4, n4, z0, c[3]);
+    // unpack and pack both work within 128-bit lanes, so the order is restored
+    __m512i res = _mm512_packs_epi32(_mm512_srai_epi32(lo, 16), _mm512_srai_epi32(hi, 16));
+    return _mm512_add_epi16(res, z0);
+}
+
+void ass_blur1234_horz_avx512(int16_t *dst, const int16_t *src,
+                              uintptr_t src_width, uintptr_t src_height,
+                              const int16_t *param)
+{
+    uintptr_t dst_width = src_width + 8;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i res = blur_func(shift_line(prev, cur, 8), shift_line(prev, cur, 7),
+                                    shift_line(prev, cur, 6), shift_line(prev, cur, 5),
+                                    shift_line(prev, cur, 4), shift_line(prev, cur, 3),
+                                    shift_line(prev, cur, 2), shift_line(prev, cur, 1),
+                                    cur, param);
+            _mm512_storeu_si512(dst, res);
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+    }
+}
+
+void ass_blur1234_vert_avx512(int16_t *dst, const int16_t *src,
+                              uintptr_t src_width, uintptr_t src_height,
+                              const int16_t *param)
+{
+    uintptr_t dst_height = src_height + 8;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p4 = load_line(src, offs -  8 * STRIPE_WIDTH, step);
+            __m512i p3 = load_line(src, offs -  7 * STRIPE_WIDTH, step);
+            __m512i p2 = load_line(src, offs -  6 * STRIPE_WIDTH, step);
+            __m512i p1 = load_line(src, offs -  5 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs -  4 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs -  3 * STRIPE_WIDTH, step);
+            __m512i n2 = load_line(src, offs -  2 * STRIPE_WIDTH, step);
+            __m512i n3 = load_line(src, offs -  1 * STRIPE_WIDTH, step);
+            __m512i n4 = load_line(src, offs -  0 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, blur_func(p4, p3, p2, p1, z0, n1, n2, n3, n4, param));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+void ass_blur1235_horz_avx512(int16_t *dst, const int16_t *src,
+                              uintptr_t src_width, uintptr_t src_height,
+                              const int16_t *param)
+{
+    uintptr_t dst_width = src_width + 10;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i res = blur_func(shift_line(prev, cur, 10), shift_line(prev, cur, 8),
+                                    shift_line(prev, cur, 7), shift_line(prev, cur, 6),
+                                    shift_line(prev, cur, 5), shift_line(prev, cur, 4),
+                                    shift_line(prev, cur, 3), shift_line(prev, cur, 2),
+                                    cur, param);
+            _mm512_storeu_si512(dst, res);
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+    }
+}
+
+void ass_blur1235_vert_avx512(int16_t *dst, const int16_t *src,
+                              uintptr_t src_width, uintptr_t src_height,
+                              const int16_t *param)
+{
+    uintptr_t dst_height = src_height + 10;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p4 = load_line(src, offs - 10 * STRIPE_WIDTH, step);
+            __m512i p3 = load_line(src, offs -  8 * STRIPE_WIDTH, step);
+            __m512i p2 = load_line(src, offs -  7 * STRIPE_WIDTH, step);
+            __m512i p1 = load_line(src, offs -  6 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs -  5 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs -  4 * STRIPE_WIDTH, step);
+            __m512i n2 = load_line(src, offs -  3 * STRIPE_WIDTH, step);
+            __m512i n3 = load_line(src, offs -  2 * STRIPE_WIDTH, step);
+            __m512i n4 = load_line(src, offs -  0 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, blur_func(p4, p3, p2, p1, z0, n1, n2, n3, n4, param));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
+
+void ass_blur1246_horz_avx512(int16_t *dst, const int16_t *src,
+                              uintptr_t src_width, uintptr_t src_height,
+                              const int16_t *param)
+{
+    uintptr_t dst_width = src_width + 12;
+    uintptr_t size = ((src_width + STRIPE_MASK) & ~STRIPE_MASK) * src_height;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    uintptr_t offs = 0;
+    for (uintptr_t x = 0; x < dst_width; x += STRIPE_WIDTH) {
+        for (uintptr_t y = 0; y < src_height; ++y) {
+            __m512i prev = load_line(src, offs - 1 * step, size);
+            __m512i cur  = load_line(src, offs - 0 * step, size);
+            __m512i res = blur_func(shift_line(prev, cur, 12), shift_line(prev, cur, 10),
+                                    shift_line(prev, cur, 8), shift_line(prev, cur, 7),
+                                    shift_line(prev, cur, 6), shift_line(prev, cur, 5),
+                                    shift_line(prev, cur, 4), shift_line(prev, cur, 2),
+                                    cur, param);
+            _mm512_storeu_si512(dst, res);
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+    }
+}
+
+void ass_blur1246_vert_avx512(int16_t *dst, const int16_t *src,
+                              uintptr_t src_width, uintptr_t src_height,
+                              const int16_t *param)
+{
+    uintptr_t dst_height = src_height + 12;
+    uintptr_t step = STRIPE_WIDTH * src_height;
+
+    for (uintptr_t x = 0; x < src_width; x += STRIPE_WIDTH) {
+        uintptr_t offs = 0;
+        for (uintptr_t y = 0; y < dst_height; ++y) {
+            __m512i p4 = load_line(src, offs - 12 * STRIPE_WIDTH, step);
+            __m512i p3 = load_line(src, offs - 10 * STRIPE_WIDTH, step);
+            __m512i p2 = load_line(src, offs -  8 * STRIPE_WIDTH, step);
+            __m512i p1 = load_line(src, offs -  7 * STRIPE_WIDTH, step);
+            __m512i z0 = load_line(src, offs -  6 * STRIPE_WIDTH, step);
+            __m512i n1 = load_line(src, offs -  5 * STRIPE_WIDTH, step);
+            __m512i n2 = load_line(src, offs -  4 * STRIPE_WIDTH, step);
+            __m512i n3 = load_line(src, offs -  2 * STRIPE_WIDTH, step);
+            __m512i n4 = load_line(src, offs -  0 * STRIPE_WIDTH, step);
+            _mm512_storeu_si512(dst, blur_func(p4, p3, p2, p1, z0, n1, n2, n3, n4, param));
+            dst += STRIPE_WIDTH;
+            offs += STRIPE_WIDTH;
+        }
+        src += step;
+    }
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2014 Vabishchevich Nikolay <vabnick@gmail.com>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * AVX-512BW rasterization of 64x64 tiles, bit-exact with the
+ * ass_fill_*_tile64_c() functions. Those keep the precision of 16x16
+ * tiles, which needs 32-bit intermediates: a tile row is four vectors
+ * of 16 dwords.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <immintrin.h>
+#include <assert.h>
+
+#include "ass_utils.h"
+#include "ass_rasterizer.h"
+
+
+void ass_fill_solid_tile64_avx512(uint8_t *buf, ptrdiff_t stride, int set)
+{
+    __m512i value = _mm512_set1_epi8(set ? 255 : 0);
+    for (int y = 0; y < 64; y++) {
+        _mm512_storeu_si512(buf, value);
+        buf += stride;
+    }
+}
+
+
+// { 0, 1, ..., 15 } * a, { 16, ..., 31 } * a and so on
+static inline void calc_va(__m512i va[4], int32_t a)
+{
+    __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                      8, 9, 10, 11, 12, 13, 14, 15);
+    va[0] = _mm512_mullo_epi32(index, _mm512_set1_epi32(a));
+    for (int i = 1; i < 4; i++)
+        va[i] = _mm512_add_epi32(va[i - 1], _mm512_set1_epi32(16 * a));
+}
+
+// Store a tile row, values have to be in [0, 255] already
+static inline void store_tile_row(uint8_t *buf, const __m512i res[4])
+{
+    for (int i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i *) (buf + 16 * i), _mm512_cvtepi32_epi8(res[i]));
+}
+
+static inline __m512i clamp(__m512i val, __m512i max)
+{
+    return _mm512_min_epi32(_mm512_max_epi32(val, _mm512_setzero_si512()), max);
+}
+
+void ass_fill_halfplane_tile64_avx512(uint8_t *buf, ptrdiff_t stride,
+                                      int32_t a, int32_t b, int64_t c, int32_t scale)
+{
+    int32_t aa = (a * (int64_t) scale + ((int64_t) 1 << 49)) >> 50;
+    int32_t bb = (b * (int64_t) scale + ((int64_t) 1 << 49)) >> 50;
+    int32_t cc = ((int32_t) (c >> 13) * (int64_t) scale + ((int64_t) 1 << 42)) >> 43;
+    cc += (1 << 9) - ((aa + bb) >> 1);
+
+    int32_t abs_a = aa < 0 ? -aa : aa;
+    int32_t abs_b = bb < 0 ? -bb : bb;
+    int32_t delta = (FFMIN(abs_a, abs_b) + 2) >> 2;
+
+    __m512i va[4], va1[4], va2[4];
+    calc_va(va, aa);
+    for (int i = 0; i < 4; i++) {
+        va1[i] = _mm512_sub_epi32(va[i], _mm512_set1_epi32(delta));
+        va2[i] = _mm512_add_epi32(va[i], _mm512_set1_epi32(delta));
+    }
+
+    const __m512i full = _mm512_set1_epi32((1 << 10) - 1);
+    for (int y = 0; y < 64; y++) {
+        __m512i vc = _mm512_set1_epi32(cc), res[4];
+        for (int i = 0; i < 4; i++) {
+            __m512i c1 = clamp(_mm512_sub_epi32(vc, va1[i]), full);
+            __m512i c2 = clamp(_mm512_sub_epi32(vc, va2[i]), full);
+            res[i] = _mm512_srli_epi32(_mm512_add_epi32(c1, c2), 3);
+        }
+        store_tile_row(buf, res);
+        buf += stride;
+        cc -= bb;
+    }
+}
+
+
+// Render top/bottom line of the trapeziod with antialiasing
+static inline void update_border_line(__m512i res[4], int32_t abs_a, const __m512i va[4],
+                                      int32_t b, int32_t abs_b, int32_t c, int up, int dn)
+{
+    int32_t size = dn - up;
+    int32_t w = (1 << 10) + (size << 4) - abs_a;
+    w = FFMIN(w, 1 << 10) << 3;
+
+    int32_t dc_b = abs_b * size >> 6;
+    int32_t dc = (FFMIN(abs_a, dc_b) + 2) >> 2;
+
+    int32_t base = b * (up + dn) >> 7;
+    int32_t offs1 = size - ((base + dc) * w >> 16);
+    int32_t offs2 = size - ((base - dc) * w >> 16);
+
+    const __m512i max = _mm512_set1_epi32(size << 1);
+    for (int i = 0; i < 4; i++) {
+        __m512i cw = _mm512_sub_epi32(_mm512_set1_epi32(c), va[i]);
+        cw = _mm512_srai_epi32(_mm512_mullo_epi32(cw, _mm512_set1_epi32(w)), 16);
+        __m512i c1 = clamp(_mm512_add_epi32(cw, _mm512_set1_epi32(offs1)), max);
+        __m512i c2 = clamp(_mm512_add_epi32(cw, _mm512_set1_epi32(offs2)), max);
+        res[i] = _mm512_add_epi32(res[i], _mm512_add_epi32(c1, c2));
+    }
+}
+
+void ass_fill_generic_tile64_avx512(uint8_t *buf, ptrdiff_t stride,
+                                    const struct segment *line, size_t n_lines,
+                                    int winding)
+{
+    __m512i res[64][4];
+    int32_t delta[66];
+    for (int y = 0; y < 64; y++)
+        for (int i = 0; i < 4; i++)
+            res[y][i] = _mm512_setzero_si512();
+    for (int y = 0; y < 66; y++)
+        delta[y] = 0;
+
+    const __m512i full = _mm512_set1_epi32(1 << 10);
+    const struct segment *end = line + n_lines;
+    for (; line != end; ++line) {
+        assert(line->y_min >= 0 && line->y_min < 1 << 12);
+        assert(line->y_max > 0 && line->y_max <= 1 << 12);
+        assert(line->y_min <= line->y_max);
+
+        int32_t up_delta = line->flags & SEGFLAG_DN ? 4 : 0;
+        int32_t dn_delta = up_delta;
+        if (!line->x_min && (line->flags & SEGFLAG_EXACT_LEFT)) dn_delta ^= 4;
+        if (line->flags & SEGFLAG_UL_DR) {
+            int32_t tmp = up_delta;
+            up_delta = dn_delta;
+            dn_delta = tmp;
+        }
+
+        int up = line->y_min >> 6, dn = line->y_max >> 6;
+        int32_t up_pos = line->y_min & 63;
+        int32_t up_delta1 = up_delta * up_pos;
+        int32_t dn_pos = line->y_max & 63;
+        int32_t dn_delta1 = dn_delta * dn_pos;
+        delta[up + 1] -= up_delta1;
+        delta[up] -= (up_delta << 6) - up_delta1;
+        delta[dn + 1] += dn_delta1;
+        delta[dn] += (dn_delta << 6) - dn_delta1;
+        if (line->y_min == line->y_max)
+            continue;
+
+        int32_t a = (line->a * (int64_t) line->scale + ((int64_t) 1 << 49)) >> 50;
+        int32_t b = (line->b * (int64_t) line->scale + ((int64_t) 1 << 49)) >> 50;
+        int32_t c = ((int32_t) (line->c >> 13) * (int64_t) line->scale + ((int64_t) 1 << 42)) >> 43;
+        c -= (a >> 1) + b * up;
+
+        __m512i va[4];
+        calc_va(va, a);
+        int32_t abs_a = a < 0 ? -a : a;
+        int32_t abs_b = b < 0 ? -b : b;
+        int32_t dc = (FFMIN(abs_a, abs_b) + 2) >> 2;
+        int32_t base = (1 << 9) - (b >> 1);
+        __m512i dc1 = _mm512_set1_epi32(base + dc);
+        __m512i dc2 = _mm512_set1_epi32(base - dc);
+
+        if (up_pos) {
+            if (dn == up) {
+                update_border_line(res[up], abs_a, va, b, abs_b, c, up_pos, dn_pos);
+                continue;
+            }
+            update_border_line(res[up], abs_a, va, b, abs_b, c, up_pos, 64);
+            up++;
+            c -= b;
+        }
+        for (int y = up; y < dn; y++) {
+            __m512i vc = _mm512_set1_epi32(c);
+            for (int i = 0; i < 4; i++) {
+                __m512i cv = _mm512_sub_epi32(vc, va[i]);
+                __m512i c1 = clamp(_mm512_add_epi32(cv, dc1), full);
+                __m512i c2 = clamp(_mm512_add_epi32(cv, dc2), full);
+                c1 = _mm512_srli_epi32(_mm512_add_epi32(c1, c2), 3);
+                res[y][i] = _mm512_add_epi32(res[y][i], c1);
+            }
+            c -= b;
+        }
+        if (dn_pos)
+            update_border_line(res[dn], abs_a, va, b, abs_b, c, 0, dn_pos);
+    }
+
+    int32_t cur = 256 * winding;
+    const __m512i max = _mm512_set1_epi32(255);
+    for (int y = 0; y < 64; y++) {
+        cur += delta[y];
+        __m512i vcur = _mm512_set1_epi32(cur), row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = _mm512_min_epi32(_mm512_abs_epi32(_mm512_add_epi32(res[y][i], vcur)), max);
+        store_tile_row(buf, row);
+        buf += stride;
+    }
+}
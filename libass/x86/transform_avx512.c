@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2015 Vabishchevich Nikolay <vabnick@gmail.com>
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * AVX-512 outline point transforms, 16 points per iteration.
+ * Every operation is done in the same order and precision as in C
+ * (this file must be built without FMA contraction), conversion
+ * rounds to nearest like lrint(), so results are bit-exact with C.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <immintrin.h>
+
+#include "ass_utils.h"
+#include "ass_outline.h"
+
+
+typedef struct {
+    __m512d lo, hi;
+} Coords;
+
+// up to 16 offsets widened to doubles, base added in integers like C does
+static inline Coords load_coords(const uint16_t *src, int32_t base, __mmask32 mask)
+{
+    __m512i val = _mm512_maskz_loadu_epi16(mask, src);
+    val = _mm512_cvtepu16_epi32(_mm512_castsi512_si256(val));
+    val = _mm512_add_epi32(val, _mm512_set1_epi32(base));
+    Coords res = {
+        _mm512_cvtepi32_pd(_mm512_castsi512_si256(val)),
+        _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(val, 1)),
+    };
+    return res;
+}
+
+static inline __m512d apply_row(const double row[3], __m512d x, __m512d y)
+{
+    __m512d v = _mm512_add_pd(_mm512_mul_pd(_mm512_set1_pd(row[0]), x),
+                              _mm512_mul_pd(_mm512_set1_pd(row[1]), y));
+    return _mm512_add_pd(v, _mm512_set1_pd(row[2]));
+}
+
+static inline __m512i round_pair(__m512d lo, __m512d hi)
+{
+    __m256i res_lo = _mm512_cvtpd_epi32(lo);
+    __m256i res_hi = _mm512_cvtpd_epi32(hi);
+    return _mm512_inserti64x4(_mm512_castsi256_si512(res_lo), res_hi, 1);
+}
+
+// interleave 16 x and 16 y values into ASS_Vector order
+static inline void store_points(ASS_Vector *dst, __m512i x, __m512i y, size_t n)
+{
+    static const int32_t index[32] = {
+        0, 16,  1, 17,  2, 18,  3, 19,  4, 20,  5, 21,  6, 22,  7, 23,
+        8, 24,  9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31,
+    };
+    __m512i res_lo = _mm512_permutex2var_epi32(x, _mm512_loadu_si512(index), y);
+    __m512i res_hi = _mm512_permutex2var_epi32(x, _mm512_loadu_si512(index + 16), y);
+    if (n >= 16) {
+        _mm512_storeu_si512(dst, res_lo);
+        _mm512_storeu_si512(dst + 8, res_hi);
+        return;
+    }
+    __mmask16 mask_lo = n >= 8 ? 0xFFFF : (1 << 2 * n) - 1;
+    __mmask16 mask_hi = n <= 8 ? 0 : (1 << 2 * (n - 8)) - 1;
+    _mm512_mask_storeu_epi32(dst, mask_lo, res_lo);
+    _mm512_mask_storeu_epi32(dst + 8, mask_hi, res_hi);
+}
+
+static inline __mmask32 load_mask(size_t n)
+{
+    return n >= 16 ? 0xFFFF : ((__mmask32) 1 << n) - 1;
+}
+
+void ass_transform_affine_avx512(ASS_Vector *dst,
+                                 const uint16_t *x, const uint16_t *y,
+                                 size_t n, ASS_Vector base, const double m[2][3])
+{
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask32 mask = load_mask(n - i);
+        Coords px = load_coords(x + i, base.x, mask);
+        Coords py = load_coords(y + i, base.y, mask);
+
+        __m512i res_x = round_pair(apply_row(m[0], px.lo, py.lo),
+                                   apply_row(m[0], px.hi, py.hi));
+        __m512i res_y = round_pair(apply_row(m[1], px.lo, py.lo),
+                                   apply_row(m[1], px.hi, py.hi));
+        store_points(dst + i, res_x, res_y, n - i);
+    }
+}
+
+void ass_transform_perspective_avx512(ASS_Vector *dst,
+                                      const uint16_t *x, const uint16_t *y,
+                                      size_t n, ASS_Vector base, const double m[3][3])
+{
+    const __m512d one = _mm512_set1_pd(1), min_z = _mm512_set1_pd(0.1);
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask32 mask = load_mask(n - i);
+        Coords px = load_coords(x + i, base.x, mask);
+        Coords py = load_coords(y + i, base.y, mask);
+
+        // max_pd() returns the second argument for NaN, same as FFMAX(v, 0.1)
+        __m512d w_lo = _mm512_div_pd(one, _mm512_max_pd(apply_row(m[2], px.lo, py.lo), min_z));
+        __m512d w_hi = _mm512_div_pd(one, _mm512_max_pd(apply_row(m[2], px.hi, py.hi), min_z));
+
+        __m512i res_x = round_pair(_mm512_mul_pd(apply_row(m[0], px.lo, py.lo), w_lo),
+                                   _mm512_mul_pd(apply_row(m[0], px.hi, py.hi), w_hi));
+        __m512i res_y = round_pair(_mm512_mul_pd(apply_row(m[1], px.lo, py.lo), w_lo),
+                                   _mm512_mul_pd(apply_row(m[1], px.hi, py.hi), w_hi));
+        store_points(dst + i, res_x, res_y, n - i);
+    }
+}
@@ -18,82 +18,1026 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "config.h"
+#include "ass_compat.h"
+
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
-#include "../libass/ass.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "ass_render.h"
+
+// The profiler is linked statically and uses internal functions
+// to force bitmap engines and to call their kernels directly.
+
+static const char *engine_names[] = { "c", "sse2", "avx2", "avx512" };
 
-typedef struct image_s {
-    int width, height, stride;
-    unsigned char *buffer;      // RGB24
-} image_t;
+#define N_ENGINES (sizeof(engine_names) / sizeof(engine_names[0]))
 
-ASS_Library *ass_library;
-ASS_Renderer *ass_renderer;
+static const char *stage_names[] = {
+    "parse", "shape", "outline", "bitmap", "composite", "collisions"
+};
+
+static const char *cache_names[] = {
+    "font", "outline", "bitmap", "composite", "shadow", "event", "tags", "shaped_run"
+};
+
+static int json;
 
 void msg_callback(int level, const char *fmt, va_list va, void *data)
 {
-    if (level > 6)
+    if (level > 3 || json)
         return;
     printf("libass: ");
     vprintf(fmt, va);
     printf("\n");
 }
 
-static void init(int frame_w, int frame_h)
+static const char *engine_name(const BitmapEngine *engine)
+{
+    for (int i = 0; i < N_ENGINES; i++)
+        if (ass_bitmap_engine_init(engine_names[i]) == engine)
+            return engine_names[i];
+    return "unknown";
+}
+
+static int cmp_time(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static double ns_to_ms(int64_t ns)
+{
+    return ns / 1e6;
+}
+
+static void print_json_string(const char *str)
+{
+    putchar('"');
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+
+typedef struct {
+    ASS_Renderer *renderer;
+    ASS_Track *track;
+    double start, fps, end;
+    int64_t *times;
+    int max_frames;
+} RenderBench;
+
+/**
+ * \brief Render all frames of the time range and report their latency
+ * \param name pass name, "cold" for the first pass over empty caches
+ */
+static void render_pass(RenderBench *bench, const char *name, bool first)
+{
+    ASS_Renderer *renderer = bench->renderer;
+    ass_reset_render_stats(renderer);
+
+    int n_frames = 0;
+    int64_t total = 0;
+    for (double tm = bench->start; tm < bench->end; tm += 1 / bench->fps) {
+        int64_t start = ass_time_ns();
+        ass_render_frame(renderer, bench->track, (long long) (tm * 1000), NULL);
+        int64_t time = ass_time_ns() - start;
+        total += time;
+        if (n_frames < bench->max_frames)
+            bench->times[n_frames++] = time;
+    }
+    if (!n_frames)
+        return;
+    qsort(bench->times, n_frames, sizeof(int64_t), cmp_time);
+
+    double fps = total ? n_frames * 1e9 / total : 0;
+    int64_t p50 = bench->times[(n_frames - 1) / 2];
+    int64_t p99 = bench->times[(int) ((n_frames - 1) * 0.99)];
+    int64_t max = bench->times[n_frames - 1];
+    int64_t events = ass_get_render_stat(renderer, ASS_STAT_EVENTS, 0);
+    int64_t alloc = ass_get_render_stat(renderer, ASS_STAT_ALLOC_BYTES, 0);
+
+    if (json) {
+        printf("%s    {\"name\": \"%s\", \"frames\": %d, \"events\": %lld, "
+               "\"fps\": %.2f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+               "\"max_ms\": %.3f, \"alloc_bytes\": %lld, \"stages_ms\": {",
+               first ? "" : ",\n", name, n_frames, (long long) events, fps,
+               ns_to_ms(p50), ns_to_ms(p99), ns_to_ms(max), (long long) alloc);
+        for (int i = 0; i < sizeof(stage_names) / sizeof(stage_names[0]); i++)
+            printf("%s\"%s\": %.3f", i ? ", " : "", stage_names[i],
+                   ns_to_ms(ass_get_render_stat(renderer, ASS_STAT_TIME_PARSE + i, 0)));
+        printf("}}");
+        return;
+    }
+
+    printf("%s: %d frames, %lld events, %.2f fps\n",
+           name, n_frames, (long long) events, fps);
+    printf("  latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           ns_to_ms(p50), ns_to_ms(p99), ns_to_ms(max));
+    printf("  stages:");
+    for (int i = 0; i < sizeof(stage_names) / sizeof(stage_names[0]); i++)
+        printf(" %s %.1f ms", stage_names[i],
+               ns_to_ms(ass_get_render_stat(renderer, ASS_STAT_TIME_PARSE + i, 0)));
+    printf("\n  cache allocations: %lld bytes\n", (long long) alloc);
+}
+
+static void print_cache_stats(ASS_Renderer *renderer)
+{
+    if (json)
+        printf(",\n  \"caches\": {");
+    else
+        printf("caches after the warm pass:\n");
+    bool first = true;
+    for (int i = 0; i < sizeof(cache_names) / sizeof(cache_names[0]); i++) {
+        ASS_CacheStats stats;
+        if (!ass_get_cache_stats(renderer, ASS_CACHE_FONT + i, &stats))
+            continue;
+        if (json)
+            printf("%s\n    \"%s\": {\"hits\": %llu, \"misses\": %llu, "
+                   "\"evictions\": %llu, \"items\": %llu, \"size\": %llu}",
+                   first ? "" : ",", cache_names[i],
+                   (unsigned long long) stats.hits,
+                   (unsigned long long) stats.misses,
+                   (unsigned long long) stats.evictions,
+                   (unsigned long long) stats.items,
+                   (unsigned long long) stats.size);
+        else
+            printf("  %-10s hits %llu, misses %llu, evictions %llu, "
+                   "items %llu, size %llu\n", cache_names[i],
+                   (unsigned long long) stats.hits,
+                   (unsigned long long) stats.misses,
+                   (unsigned long long) stats.evictions,
+                   (unsigned long long) stats.items,
+                   (unsigned long long) stats.size);
+        first = false;
+    }
+    if (json)
+        printf("\n  }");
+}
+
+
+/*
+ * Kernel microbenchmarks on synthetic inputs
+ */
+
+#define KERNEL_W 512
+#define KERNEL_H 128
+#define KERNEL_TIME 50000000  // minimal measurement time in ns
+
+typedef struct {
+    const BitmapEngine *engine;
+    int tile;
+    struct segment lines[16];
+    int n_lines;
+    uint8_t *buf[3];        // KERNEL_W x KERNEL_H bitmaps
+    uint16_t *tmp;          // be_blur scratch
+    int16_t *stripe[2];     // stripe buffers for the gaussian blur filters
+    bool first;
+} KernelBench;
+
+typedef void (*KernelFunc)(KernelBench *bench, int index);
+
+static int ilog2(uint32_t n)
+{
+    int res = 0;
+    while (n >>= 1)
+        res++;
+    return res;
+}
+
+// same setup as add_line() of the rasterizer
+static void add_segment(KernelBench *bench,
+                        int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    struct segment *line = &bench->lines[bench->n_lines++];
+    int32_t x = x1 - x0, y = y1 - y0;
+
+    line->flags = SEGFLAG_EXACT_LEFT | SEGFLAG_EXACT_RIGHT |
+                  SEGFLAG_EXACT_TOP | SEGFLAG_EXACT_BOTTOM;
+    if (x < 0)
+        line->flags ^= SEGFLAG_UL_DR;
+    if (y >= 0)
+        line->flags ^= SEGFLAG_DN | SEGFLAG_UL_DR;
+
+    line->x_min = FFMIN(x0, x1);
+    line->x_max = FFMAX(x0, x1);
+    line->y_min = FFMIN(y0, y1);
+    line->y_max = FFMAX(y0, y1);
+
+    line->a = y;
+    line->b = -x;
+    line->c = y * (int64_t) x0 - x * (int64_t) y0;
+
+    int32_t abs_x = x < 0 ? -x : x;
+    int32_t abs_y = y < 0 ? -y : y;
+    uint32_t max_ab = (abs_x > abs_y ? abs_x : abs_y);
+    int shift = 30 - ilog2(max_ab);
+    max_ab <<= shift + 1;
+    line->a *= 1 << shift;
+    line->b *= 1 << shift;
+    line->c *= 1 << shift;
+    line->scale = (uint64_t) 0x53333333 * (uint32_t) (max_ab * (uint64_t) max_ab >> 32) >> 32;
+    line->scale += 0x8810624D - (0xBBC6A7EF * (uint64_t) max_ab >> 32);
+}
+
+static void run_fill_solid(KernelBench *bench, int index)
+{
+    bench->engine->fill_solid(bench->buf[0], KERNEL_W, 1);
+}
+
+static void run_fill_halfplane(KernelBench *bench, int index)
+{
+    const struct segment *line = &bench->lines[0];
+    bench->engine->fill_halfplane(bench->buf[0], KERNEL_W,
+                                  line->a, line->b, line->c, line->scale);
+}
+
+static void run_fill_generic(KernelBench *bench, int index)
+{
+    bench->engine->fill_generic(bench->buf[0], KERNEL_W,
+                                bench->lines, bench->n_lines, 0);
+}
+
+static void run_add_bitmaps(KernelBench *bench, int index)
+{
+    bench->engine->add_bitmaps(bench->buf[0], KERNEL_W, bench->buf[1], KERNEL_W,
+                               KERNEL_H, KERNEL_W);
+}
+
+static void run_sub_bitmaps(KernelBench *bench, int index)
+{
+    bench->engine->sub_bitmaps(bench->buf[0], KERNEL_W, bench->buf[1], KERNEL_W,
+                               KERNEL_H, KERNEL_W);
+}
+
+static void run_mul_bitmaps(KernelBench *bench, int index)
+{
+    bench->engine->mul_bitmaps(bench->buf[0], KERNEL_W, bench->buf[1], KERNEL_W,
+                               bench->buf[2], KERNEL_W, KERNEL_W, KERNEL_H);
+}
+
+static void run_be_blur(KernelBench *bench, int index)
+{
+    // the bitmap needs some padding on the right like real ones
+    memset(bench->tmp, 0, 2 * KERNEL_W * sizeof(uint16_t));
+    bench->engine->be_blur(bench->buf[0], KERNEL_W - 32, KERNEL_H, KERNEL_W, bench->tmp);
+}
+
+static void run_blend_rgba(KernelBench *bench, int index)
+{
+    // buf[2] holds KERNEL_W / 4 RGBA pixels per row
+    bench->engine->blend_rgba(bench->buf[2], KERNEL_W, bench->buf[1], KERNEL_W,
+                              KERNEL_W / 4, KERNEL_H, 0x20406080);
+}
+
+static void run_stripe_unpack(KernelBench *bench, int index)
+{
+    bench->engine->stripe_unpack(bench->stripe[0], bench->buf[1], KERNEL_W,
+                                 KERNEL_W, KERNEL_H);
+}
+
+static void run_stripe_pack(KernelBench *bench, int index)
+{
+    bench->engine->stripe_pack(bench->buf[0], KERNEL_W, bench->stripe[0],
+                               KERNEL_W, KERNEL_H);
+}
+
+static void run_shrink_horz(KernelBench *bench, int index)
+{
+    bench->engine->shrink_horz(bench->stripe[1], bench->stripe[0], KERNEL_W, KERNEL_H);
+}
+
+static void run_shrink_vert(KernelBench *bench, int index)
+{
+    bench->engine->shrink_vert(bench->stripe[1], bench->stripe[0], KERNEL_W, KERNEL_H);
+}
+
+static void run_expand_horz(KernelBench *bench, int index)
+{
+    bench->engine->expand_horz(bench->stripe[1], bench->stripe[0], KERNEL_W, KERNEL_H);
+}
+
+static void run_expand_vert(KernelBench *bench, int index)
+{
+    bench->engine->expand_vert(bench->stripe[1], bench->stripe[0], KERNEL_W, KERNEL_H);
+}
+
+static void run_pre_blur_horz(KernelBench *bench, int index)
+{
+    bench->engine->pre_blur_horz[index](bench->stripe[1], bench->stripe[0],
+                                        KERNEL_W, KERNEL_H);
+}
+
+static void run_pre_blur_vert(KernelBench *bench, int index)
 {
-    ass_library = ass_library_init();
-    if (!ass_library) {
+    bench->engine->pre_blur_vert[index](bench->stripe[1], bench->stripe[0],
+                                        KERNEL_W, KERNEL_H);
+}
+
+static const int16_t blur_param[8] = { 2400, 1600, 800, 300, 100, 30, 0, 0 };
+
+static void run_main_blur_horz(KernelBench *bench, int index)
+{
+    bench->engine->main_blur_horz[index](bench->stripe[1], bench->stripe[0],
+                                         KERNEL_W, KERNEL_H, blur_param);
+}
+
+static void run_main_blur_vert(KernelBench *bench, int index)
+{
+    bench->engine->main_blur_vert[index](bench->stripe[1], bench->stripe[0],
+                                         KERNEL_W, KERNEL_H, blur_param);
+}
+
+static void run_kernel(KernelBench *bench, const char *name, int index,
+                       KernelFunc func, int64_t pixels)
+{
+    // double the iteration count until the measurement is long enough
+    int64_t time = 0, iters = 1;
+    while (true) {
+        int64_t start = ass_time_ns();
+        for (int64_t i = 0; i < iters; i++)
+            func(bench, index);
+        time = ass_time_ns() - start;
+        if (time >= KERNEL_TIME || iters >= (int64_t) 1 << 40)
+            break;
+        iters *= 2;
+    }
+
+    char full_name[64];
+    if (index >= 0)
+        snprintf(full_name, sizeof(full_name), "%s%d", name, index + 1);
+    else
+        snprintf(full_name, sizeof(full_name), "%s", name);
+    double ns = (double) time / iters;
+    if (json)
+        printf("%s\n    {\"name\": \"%s\", \"ns\": %.2f, \"pixels\": %lld}",
+               bench->first ? "" : ",", full_name, ns, (long long) pixels);
+    else
+        printf("  %-16s %12.2f ns %10.3f ns/pixel\n", full_name, ns, ns / pixels);
+    bench->first = false;
+}
+
+static int bench_kernels(const BitmapEngine *engine)
+{
+    KernelBench bench = {0};
+    bench.engine = engine;
+    bench.tile = 1 << engine->tile_order;
+    bench.first = true;
+
+    size_t align = (size_t) 1 << engine->align_order;
+    size_t stripe_size = (size_t) (2 * KERNEL_W + 64) * (2 * KERNEL_H + 64);
+    bool ok = true;
+    for (int i = 0; i < 3; i++)
+        ok &= !!(bench.buf[i] = ass_aligned_alloc(align, KERNEL_W * KERNEL_H, false));
+    ok &= !!(bench.tmp = ass_aligned_alloc(align, 2 * KERNEL_W * sizeof(uint16_t), true));
+    for (int i = 0; i < 2; i++)
+        ok &= !!(bench.stripe[i] = ass_aligned_alloc(align, stripe_size * sizeof(int16_t), true));
+    if (!ok) {
+        printf("Out of memory!\n");
+        return 1;
+    }
+
+    // pseudo-random coverage with some saturated areas
+    uint32_t seed = 1;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < KERNEL_W * KERNEL_H; j++) {
+            seed = seed * 1664525 + 1013904223;
+            uint8_t val = seed >> 24;
+            bench.buf[i][j] = val < 64 ? 0 : val >= 192 ? 255 : val;
+        }
+    engine->stripe_unpack(bench.stripe[0], bench.buf[1], KERNEL_W, KERNEL_W, KERNEL_H);
+
+    // star polygon inside a tile, in 1/64 pixel units
+    int32_t size = bench.tile << 6, prev_x = 0, prev_y = 0;
+    for (int i = 0; i <= 10; i++) {
+        double r = (i & 1 ? 0.2 : 0.45) * size, phi = 2 * M_PI * i / 10;
+        int32_t x = size / 2 + lrint(r * sin(phi));
+        int32_t y = size / 2 - lrint(r * cos(phi));
+        if (i)
+            add_segment(&bench, prev_x, prev_y, x, y);
+        prev_x = x;
+        prev_y = y;
+    }
+
+    if (json)
+        printf("{\n  \"engine\": \"%s\",\n  \"tile_size\": %d,\n  \"kernels\": [",
+               engine_name(engine), bench.tile);
+    else
+        printf("engine %s, tile size %d, %dx%d bitmaps\n",
+               engine_name(engine), bench.tile, KERNEL_W, KERNEL_H);
+
+    int64_t tile = bench.tile * bench.tile, area = KERNEL_W * KERNEL_H;
+    run_kernel(&bench, "fill_solid", -1, run_fill_solid, tile);
+    run_kernel(&bench, "fill_halfplane", -1, run_fill_halfplane, tile);
+    run_kernel(&bench, "fill_generic", -1, run_fill_generic, tile);
+    run_kernel(&bench, "add_bitmaps", -1, run_add_bitmaps, area);
+    run_kernel(&bench, "sub_bitmaps", -1, run_sub_bitmaps, area);
+    run_kernel(&bench, "mul_bitmaps", -1, run_mul_bitmaps, area);
+    run_kernel(&bench, "be_blur", -1, run_be_blur, area);
+    run_kernel(&bench, "blend_rgba", -1, run_blend_rgba, area / 4);
+    run_kernel(&bench, "stripe_unpack", -1, run_stripe_unpack, area);
+    run_kernel(&bench, "stripe_pack", -1, run_stripe_pack, area);
+    run_kernel(&bench, "shrink_horz", -1, run_shrink_horz, area);
+    run_kernel(&bench, "shrink_vert", -1, run_shrink_vert, area);
+    run_kernel(&bench, "expand_horz", -1, run_expand_horz, area);
+    run_kernel(&bench, "expand_vert", -1, run_expand_vert, area);
+    for (int i = 0; i < 3; i++)
+        run_kernel(&bench, "pre_blur_horz", i, run_pre_blur_horz, area);
+    for (int i = 0; i < 3; i++)
+        run_kernel(&bench, "pre_blur_vert", i, run_pre_blur_vert, area);
+    for (int i = 0; i < 3; i++)
+        run_kernel(&bench, "main_blur_horz", i, run_main_blur_horz, area);
+    for (int i = 0; i < 3; i++)
+        run_kernel(&bench, "main_blur_vert", i, run_main_blur_vert, area);
+    if (json)
+        printf("\n  ]\n}\n");
+
+    for (int i = 0; i < 3; i++)
+        ass_aligned_free(bench.buf[i]);
+    ass_aligned_free(bench.tmp);
+    for (int i = 0; i < 2; i++)
+        ass_aligned_free(bench.stripe[i]);
+    return 0;
+}
+
+
+/*
+ * Replay of traces recorded with ass_set_trace_file()
+ */
+
+typedef struct {
+    ASS_Renderer *renderer;
+    ASS_Track *track;
+} TraceObject;
+
+enum {
+    REPLAY_RENDER, REPLAY_PARSE, REPLAY_OTHER, REPLAY_KINDS
+};
+
+typedef struct {
+    ASS_Library *library;
+    const BitmapEngine *engine;
+    TraceObject *objects;       // indexed by trace id
+    int n_objects;
+    int64_t *times;             // ass_render_frame() latencies
+    int n_frames, max_frames;
+    int calls[REPLAY_KINDS];
+    int64_t time[REPLAY_KINDS];
+    int64_t stages[sizeof(stage_names) / sizeof(stage_names[0])];
+} Replay;
+
+static TraceObject *get_object(Replay *replay, int64_t id)
+{
+    if (id <= 0 || id >= INT_MAX)
+        return NULL;
+    if (id >= replay->n_objects) {
+        int n = FFMAX(id + 1, 2 * replay->n_objects);
+        TraceObject *objects =
+            ass_realloc_array(replay->objects, n, sizeof(TraceObject));
+        if (!objects)
+            return NULL;
+        memset(objects + replay->n_objects, 0,
+               (n - replay->n_objects) * sizeof(TraceObject));
+        replay->objects = objects;
+        replay->n_objects = n;
+    }
+    return &replay->objects[id];
+}
+
+static ASS_Renderer *get_renderer(Replay *replay, int64_t id)
+{
+    TraceObject *obj = get_object(replay, id);
+    return obj ? obj->renderer : NULL;
+}
+
+static ASS_Track *get_track(Replay *replay, int64_t id)
+{
+    TraceObject *obj = get_object(replay, id);
+    return obj ? obj->track : NULL;
+}
+
+static void free_renderer(Replay *replay, TraceObject *obj)
+{
+    for (int i = 0; i < sizeof(stage_names) / sizeof(stage_names[0]); i++)
+        replay->stages[i] +=
+            ass_get_render_stat(obj->renderer, ASS_STAT_TIME_PARSE + i, 0);
+    ass_renderer_done(obj->renderer);
+    obj->renderer = NULL;
+}
+
+static void add_frame_time(Replay *replay, int64_t time)
+{
+    if (replay->n_frames >= replay->max_frames) {
+        int n = FFMAX(1024, 2 * replay->max_frames);
+        int64_t *times = ass_realloc_array(replay->times, n, sizeof(int64_t));
+        if (!times)
+            return;
+        replay->times = times;
+        replay->max_frames = n;
+    }
+    replay->times[replay->n_frames++] = time;
+}
+
+static int call_kind(TraceCall call)
+{
+    switch (call) {
+    case TRACE_RENDER_FRAME:
+    case TRACE_PREFETCH:
+        return REPLAY_RENDER;
+    case TRACE_READ_MEMORY:
+    case TRACE_PROCESS_DATA:
+    case TRACE_PROCESS_CODEC_PRIVATE:
+    case TRACE_PROCESS_CHUNK:
+    case TRACE_PROCESS_STREAM:
+    case TRACE_PROCESS_STREAM_END:
+        return REPLAY_PARSE;
+    default:
+        return REPLAY_OTHER;
+    }
+}
+
+/**
+ * \brief Repeat a recorded call on the objects of the replay
+ * Calls on objects that failed to be created are skipped.
+ */
+static void replay_call(Replay *replay, const TraceRecord *rec)
+{
+    ASS_Library *library = replay->library;
+    const TraceArg *arg = rec->args;
+    TraceCall call = rec->call;
+
+    // renderer calls have the renderer, track calls the track first
+    ASS_Renderer *renderer = NULL;
+    ASS_Track *track = NULL;
+    if (call > TRACE_RENDERER_INIT && call < TRACE_NEW_TRACK) {
+        if (!(renderer = get_renderer(replay, arg[0].i)))
+            return;
+        if ((call == TRACE_RENDER_FRAME || call == TRACE_PREFETCH) &&
+                !(track = get_track(replay, arg[1].i)))
+            return;
+    } else if (call > TRACE_READ_MEMORY || call == TRACE_FREE_TRACK) {
+        if (!(track = get_track(replay, arg[0].i)))
+            return;
+    }
+
+    switch (call) {
+    case TRACE_SET_FONTS_DIR:
+        ass_set_fonts_dir(library, arg[0].str);
+        break;
+    case TRACE_SET_FONTS_DIR_CACHE:
+        ass_set_fonts_dir_cache(library, arg[0].str);
+        break;
+    case TRACE_SET_EXTRACT_FONTS:
+        ass_set_extract_fonts(library, arg[0].i);
+        break;
+    case TRACE_SET_STYLE_OVERRIDES:
+        ass_set_style_overrides(library, arg[0].list);
+        break;
+    case TRACE_SET_ZERO_COPY:
+        ass_set_zero_copy(library, arg[0].i);
+        break;
+    case TRACE_SET_PARSE_THREADS:
+        ass_set_parse_threads(library, arg[0].i);
+        break;
+    case TRACE_ADD_FONT:
+        ass_add_font(library, arg[0].str, arg[1].str, arg[1].size);
+        break;
+    case TRACE_CLEAR_FONTS:
+        ass_clear_fonts(library);
+        break;
+
+    case TRACE_RENDERER_INIT: {
+        TraceObject *obj = get_object(replay, arg[0].i);
+        if (!obj || obj->renderer)
+            break;
+        obj->renderer = ass_renderer_init(library);
+        if (!obj->renderer)
+            break;
+        ass_renderer_set_engine(obj->renderer, replay->engine);
+        ass_set_render_stats(obj->renderer, 1);
+        break;
+    }
+    case TRACE_RENDERER_DONE:
+        free_renderer(replay, get_object(replay, arg[0].i));
+        break;
+    case TRACE_SET_FRAME_SIZE:
+        ass_set_frame_size(renderer, arg[1].i, arg[2].i);
+        break;
+    case TRACE_SET_STORAGE_SIZE:
+        ass_set_storage_size(renderer, arg[1].i, arg[2].i);
+        break;
+    case TRACE_SET_SHAPER:
+        ass_set_shaper(renderer, arg[1].i);
+        break;
+    case TRACE_SET_MARGINS:
+        ass_set_margins(renderer, arg[1].i, arg[2].i, arg[3].i, arg[4].i);
+        break;
+    case TRACE_SET_USE_MARGINS:
+        ass_set_use_margins(renderer, arg[1].i);
+        break;
+    case TRACE_SET_PIXEL_ASPECT:
+        ass_set_pixel_aspect(renderer, arg[1].d);
+        break;
+    case TRACE_SET_FONT_SCALE:
+        ass_set_font_scale(renderer, arg[1].d);
+        break;
+    case TRACE_SET_HINTING:
+        ass_set_hinting(renderer, arg[1].i);
+        break;
+    case TRACE_SET_BLUR_QUALITY:
+        ass_set_blur_quality(renderer, arg[1].i);
+        break;
+    case TRACE_SET_ROTATION_STEP:
+        ass_set_rotation_step(renderer, arg[1].d);
+        break;
+    case TRACE_SET_MOTION_CACHE:
+        ass_set_motion_cache(renderer, arg[1].i);
+        break;
+    case TRACE_SET_LINE_SPACING:
+        ass_set_line_spacing(renderer, arg[1].d);
+        break;
+    case TRACE_SET_LINE_POSITION:
+        ass_set_line_position(renderer, arg[1].d);
+        break;
+    case TRACE_SET_FONTS:
+        ass_set_fonts(renderer, arg[1].str, arg[2].str, arg[3].i,
+                      arg[4].str, arg[5].i);
+        break;
+    case TRACE_SET_FONT_INIT_MODE:
+        ass_set_font_init_mode(renderer, arg[1].i);
+        break;
+    case TRACE_SET_SELECTIVE_STYLE_OVERRIDE_ENABLED:
+        ass_set_selective_style_override_enabled(renderer, arg[1].i);
+        break;
+    case TRACE_SET_CACHE_LIMITS:
+        ass_set_cache_limits(renderer, arg[1].i, arg[2].i);
+        break;
+    case TRACE_SET_CACHE_BUDGET:
+        ass_set_cache_budget(renderer, arg[1].i);
+        break;
+    case TRACE_SET_THREADS:
+        ass_set_threads(renderer, arg[1].i);
+        break;
+    case TRACE_SET_FRAME_BUDGET:
+        ass_set_frame_budget(renderer, arg[1].i);
+        break;
+    case TRACE_RENDER_FRAME: {
+        int change;
+        ass_render_frame(renderer, track, arg[2].i, &change);
+        break;
+    }
+    case TRACE_PREFETCH:
+        ass_prefetch(renderer, track, arg[2].i, arg[3].i);
+        break;
+
+    case TRACE_NEW_TRACK:
+    case TRACE_READ_MEMORY: {
+        TraceObject *obj = get_object(replay, arg[0].i);
+        if (!obj || obj->track)
+            break;
+        obj->track = call == TRACE_NEW_TRACK ? ass_new_track(library) :
+            ass_read_memory(library, arg[1].str, arg[1].size, NULL);
+        break;
+    }
+    case TRACE_FREE_TRACK:
+        ass_free_track(track);
+        get_object(replay, arg[0].i)->track = NULL;
+        break;
+    case TRACE_PROCESS_DATA:
+        ass_process_data(track, arg[1].str, arg[1].size);
+        break;
+    case TRACE_PROCESS_CODEC_PRIVATE:
+        ass_process_codec_private(track, arg[1].str, arg[1].size);
+        break;
+    case TRACE_PROCESS_CHUNK:
+        ass_process_chunk(track, arg[1].str, arg[1].size, arg[2].i, arg[3].i);
+        break;
+    case TRACE_PROCESS_STREAM:
+        ass_process_stream(track, arg[1].str, arg[1].size);
+        break;
+    case TRACE_PROCESS_STREAM_END:
+        ass_process_stream_end(track);
+        break;
+    case TRACE_FLUSH_EVENTS:
+        ass_flush_events(track);
+        break;
+    case TRACE_SET_CHECK_READORDER:
+        ass_set_check_readorder(track, arg[1].i);
+        break;
+    case TRACE_SET_EVENT_RETENTION:
+        ass_set_event_retention(track, arg[1].i);
+        break;
+    case TRACE_TRACK_SET_FEATURE:
+        ass_track_set_feature(track, arg[1].i, arg[2].i);
+        break;
+    case TRACE_CALL_COUNT:
+        break;
+    }
+}
+
+static void sleep_until(int64_t time)
+{
+    int64_t delay = time - ass_time_ns();
+    if (delay <= 0)
+        return;
+#ifdef _WIN32
+    Sleep(delay / 1000000);
+#else
+    struct timespec ts = { delay / 1000000000, delay % 1000000000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/**
+ * \brief Run the calls of a trace and report the time spent in them
+ * \param paced wait between the calls as long as when they were recorded
+ */
+static int replay_trace(const char *path, const BitmapEngine *engine,
+                        bool paced)
+{
+    TraceReader reader;
+    if (!ass_trace_reader_open(&reader, path)) {
+        printf("Cannot read trace file '%s'!\n", path);
+        return 1;
+    }
+
+    Replay replay = {0};
+    replay.engine = engine;
+    replay.library = ass_library_init();
+    if (!replay.library) {
         printf("ass_library_init failed!\n");
-        exit(1);
+        ass_trace_reader_close(&reader);
+        return 1;
     }
+    ass_set_message_cb(replay.library, msg_callback, NULL);
 
-    ass_set_message_cb(ass_library, msg_callback, NULL);
+    int n_calls = 0;
+    int64_t trace_time = 0, start = ass_time_ns();
+    const TraceRecord *rec;
+    while ((rec = ass_trace_read(&reader))) {
+        if (paced)
+            sleep_until(start + rec->time);
+        int64_t call_start = ass_time_ns();
+        replay_call(&replay, rec);
+        int64_t time = ass_time_ns() - call_start;
+        int kind = call_kind(rec->call);
+        if (rec->call == TRACE_RENDER_FRAME)
+            add_frame_time(&replay, time);
+        replay.calls[kind]++;
+        replay.time[kind] += time;
+        trace_time = rec->time;
+        n_calls++;
+    }
+    int64_t total = ass_time_ns() - start;
+    bool broken = reader.error;
+    ass_trace_reader_close(&reader);
 
-    ass_renderer = ass_renderer_init(ass_library);
-    if (!ass_renderer) {
-        printf("ass_renderer_init failed!\n");
-        exit(1);
+    for (int i = 0; i < replay.n_objects; i++) {
+        TraceObject *obj = &replay.objects[i];
+        if (obj->renderer)
+            free_renderer(&replay, obj);
+        if (obj->track)
+            ass_free_track(obj->track);
+    }
+    free(replay.objects);
+    ass_library_done(replay.library);
+
+    int n_frames = replay.n_frames;
+    int64_t p50 = 0, p99 = 0, max = 0;
+    if (n_frames) {
+        qsort(replay.times, n_frames, sizeof(int64_t), cmp_time);
+        p50 = replay.times[(n_frames - 1) / 2];
+        p99 = replay.times[(int) ((n_frames - 1) * 0.99)];
+        max = replay.times[n_frames - 1];
+    }
+    free(replay.times);
+
+    static const char *kind_names[] = { "render", "parse", "other" };
+    if (json) {
+        printf("{\n  \"trace\": ");
+        print_json_string(path);
+        printf(",\n  \"engine\": \"%s\",\n  \"calls\": %d,\n"
+               "  \"complete\": %s,\n  \"paced\": %s,\n"
+               "  \"recorded_ms\": %.3f,\n  \"replay_ms\": %.3f,\n"
+               "  \"frames\": %d,\n  \"p50_ms\": %.3f,\n  \"p99_ms\": %.3f,\n"
+               "  \"max_ms\": %.3f,\n  \"kinds\": {",
+               engine_name(engine), n_calls, broken ? "false" : "true",
+               paced ? "true" : "false", ns_to_ms(trace_time), ns_to_ms(total),
+               n_frames, ns_to_ms(p50), ns_to_ms(p99), ns_to_ms(max));
+        for (int i = 0; i < REPLAY_KINDS; i++)
+            printf("%s\n    \"%s\": {\"calls\": %d, \"ms\": %.3f}",
+                   i ? "," : "", kind_names[i], replay.calls[i],
+                   ns_to_ms(replay.time[i]));
+        printf("\n  },\n  \"stages_ms\": {");
+        for (int i = 0; i < sizeof(stage_names) / sizeof(stage_names[0]); i++)
+            printf("%s\"%s\": %.3f", i ? ", " : "", stage_names[i],
+                   ns_to_ms(replay.stages[i]));
+        printf("}\n}\n");
+        return broken;
     }
 
-    ass_set_frame_size(ass_renderer, frame_w, frame_h);
-    ass_set_fonts(ass_renderer, NULL, "Sans", 1, NULL, 1);
+    printf("%s: engine %s, %d calls over %.3f s, replayed in %.3f s%s\n",
+           path, engine_name(engine), n_calls, trace_time / 1e9, total / 1e9,
+           paced ? " with the recorded timing" : "");
+    if (broken)
+        printf("  the trace ends with a truncated or invalid call\n");
+    for (int i = 0; i < REPLAY_KINDS; i++)
+        printf("  %-7s %d calls, %.1f ms\n", kind_names[i], replay.calls[i],
+               ns_to_ms(replay.time[i]));
+    printf("frames: %d, latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           n_frames, ns_to_ms(p50), ns_to_ms(p99), ns_to_ms(max));
+    printf("  stages:");
+    for (int i = 0; i < sizeof(stage_names) / sizeof(stage_names[0]); i++)
+        printf(" %s %.1f ms", stage_names[i], ns_to_ms(replay.stages[i]));
+    printf("\n");
+    return broken;
+}
+
+
+static int print_usage(const char *program)
+{
+    const char *fmt =
+        "Usage: %s [options] <subtitle file> <start time> <fps> <end time>\n"
+        "       %s [options] -k\n"
+        "       %s [options] -r <trace file>\n"
+        "Options:\n"
+        "  -s <width>x<height>  frame size, 1280x720 by default\n"
+        "  -t <threads>         number of render threads\n"
+        "  -c <glyphs>:<MB>     glyph and bitmap cache limits\n"
+        "  -e <engine>          bitmap engine: c, sse2, avx2 or avx512\n"
+        "  -k                   benchmark the bitmap engine kernels\n"
+        "  -r                   replay a trace of ass_set_trace_file() with\n"
+        "                       the settings recorded in it\n"
+        "  -w                   wait between the replayed calls as long as\n"
+        "                       when they were recorded\n"
+        "  -j                   print the results as JSON\n";
+    printf(fmt, program, program, program);
+    return 1;
 }
 
 int main(int argc, char *argv[])
 {
-    const int frame_w = 1280;
-    const int frame_h = 720;
+    enum {
+        SIZE, THREADS, CACHE, ENGINE
+    };
+    int pos[4] = {0};
+    int n_args = 0, args[4];
+    bool kernels = false, replay = false, paced = false;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || !argv[i][1] ||
+                (argv[i][1] >= '0' && argv[i][1] <= '9')) {
+            if (n_args >= 4)
+                return print_usage(argv[0]);
+            args[n_args++] = i;
+            continue;
+        }
+        int index;
+        switch (argv[i][1]) {
+        case 's':  index = SIZE;     break;
+        case 't':  index = THREADS;  break;
+        case 'c':  index = CACHE;    break;
+        case 'e':  index = ENGINE;   break;
+        case 'k':
+        case 'j':
+        case 'r':
+        case 'w':
+            if (argv[i][2])
+                return print_usage(argv[0]);
+            if (argv[i][1] == 'k')
+                kernels = true;
+            else if (argv[i][1] == 'r')
+                replay = true;
+            else if (argv[i][1] == 'w')
+                paced = true;
+            else
+                json = 1;
+            continue;
+        default:  return print_usage(argv[0]);
+        }
+        if (argv[i][2] || ++i >= argc || pos[index])
+            return print_usage(argv[0]);
+        pos[index] = i;
+    }
+    if (kernels + replay > 1 || (paced && !replay))
+        return print_usage(argv[0]);
+    if (kernels ? n_args != 0 : replay ? n_args != 1 : n_args != 4)
+        return print_usage(argv[0]);
+    if (replay && (pos[SIZE] || pos[THREADS] || pos[CACHE]))
+        return print_usage(argv[0]);
 
-    if (argc < 5) {
-        printf("usage: %s <subtitle file> <start time> <fps> <end time>\n", argv[0]);
-        exit(1);
+    const BitmapEngine *engine = ass_bitmap_engine_init(NULL);
+    if (pos[ENGINE]) {
+        engine = ass_bitmap_engine_init(argv[pos[ENGINE]]);
+        if (!engine) {
+            printf("Bitmap engine '%s' is not available!\n", argv[pos[ENGINE]]);
+            return 1;
+        }
     }
-    char *subfile = argv[1];
-    double tm = strtod(argv[2], 0);
-    double fps = strtod(argv[3], 0);
-    double end_time = strtod(argv[4], 0);
+    if (kernels)
+        return bench_kernels(engine);
+    if (replay)
+        return replay_trace(argv[args[0]], engine, paced);
 
-    if (fps == 0) {
-        printf("fps cannot equal 0\n");
-        exit(1);
+    int frame_w = 1280, frame_h = 720;
+    if (pos[SIZE] && (sscanf(argv[pos[SIZE]], "%dx%d", &frame_w, &frame_h) != 2 ||
+                      frame_w <= 0 || frame_h <= 0)) {
+        printf("Invalid frame size!\n");
+        return 1;
     }
+    int threads = pos[THREADS] ? atoi(argv[pos[THREADS]]) : 0;
+    int glyph_max = 0, bitmap_max = 0;
+    if (pos[CACHE] && sscanf(argv[pos[CACHE]], "%d:%d", &glyph_max, &bitmap_max) != 2) {
+        printf("Invalid cache limits!\n");
+        return 1;
+    }
+
+    RenderBench bench;
+    const char *subfile = argv[args[0]];
+    bench.start = strtod(argv[args[1]], 0);
+    bench.fps = strtod(argv[args[2]], 0);
+    bench.end = strtod(argv[args[3]], 0);
+    if (bench.fps <= 0) {
+        printf("fps must be positive\n");
+        return 1;
+    }
+    bench.max_frames = (bench.end - bench.start) * bench.fps + 2;
+    if (bench.max_frames < 1)
+        bench.max_frames = 1;
+    bench.times = malloc(bench.max_frames * sizeof(int64_t));
+    if (!bench.times) {
+        printf("Out of memory!\n");
+        return 1;
+    }
+
+    ASS_Library *library = ass_library_init();
+    if (!library) {
+        printf("ass_library_init failed!\n");
+        return 1;
+    }
+    ass_set_message_cb(library, msg_callback, NULL);
+
+    ASS_Renderer *renderer = ass_renderer_init(library);
+    if (!renderer) {
+        printf("ass_renderer_init failed!\n");
+        return 1;
+    }
+    if (!ass_renderer_set_engine(renderer, engine)) {
+        printf("Cannot switch to bitmap engine '%s'!\n", engine_name(engine));
+        return 1;
+    }
+    ass_set_frame_size(renderer, frame_w, frame_h);
+    ass_set_fonts(renderer, NULL, "Sans", 1, NULL, 1);
+    if (threads > 1)
+        ass_set_threads(renderer, threads);
+    if (pos[CACHE])
+        ass_set_cache_limits(renderer, glyph_max, bitmap_max);
+    ass_set_render_stats(renderer, 1);
 
-    init(frame_w, frame_h);
-    ASS_Track *track = ass_read_file(ass_library, subfile, NULL);
+    ASS_Track *track = ass_read_file(library, (char *) subfile, NULL);
     if (!track) {
         printf("track init failed!\n");
-        exit(1);
+        return 1;
     }
+    bench.renderer = renderer;
+    bench.track = track;
 
-    while (tm < end_time) {
-        ass_render_frame(ass_renderer, track, (int) (tm * 1000), NULL);
-        tm += 1 / fps;
-    }
+    if (json) {
+        printf("{\n  \"file\": ");
+        print_json_string(subfile);
+        printf(",\n  \"engine\": \"%s\",\n"
+               "  \"frame_size\": [%d, %d],\n  \"threads\": %d,\n  \"runs\": [\n",
+               engine_name(engine), frame_w, frame_h, threads);
+    } else
+        printf("%s: engine %s, %dx%d, %d threads\n",
+               subfile, engine_name(engine), frame_w, frame_h, threads);
+    render_pass(&bench, "cold", true);
+    render_pass(&bench, "warm", false);
+    if (json)
+        printf("\n  ]");
+    print_cache_stats(renderer);
+    if (json)
+        printf("\n}\n");
 
     ass_free_track(track);
-    ass_renderer_done(ass_renderer);
-    ass_library_done(ass_library);
+    ass_renderer_done(renderer);
+    ass_library_done(library);
+    free(bench.times);
 
     return 0;
 }